@@ -1 +1,6 @@
-gcc -o bin/compiler source/main.c
+mkdir -p bin
+gcc -pthread -o bin/compiler source/main.c
+gcc -pthread -c -fPIC -fvisibility=hidden -o bin/libbee.o source/libbee.c
+objcopy --localize-hidden bin/libbee.o
+ar rcs bin/libbee.a bin/libbee.o
+gcc -pthread -shared -o bin/libbee.so bin/libbee.o
@@ -0,0 +1,336 @@
+#include "abi.h"
+#include "layout.h"
+#include "inline.h"
+#include "loop.h"
+
+unsigned int ClassifyValue(IRModule *module, IRType type, unsigned int *registerCount)
+{
+    if(!type.isAggregate)
+    {
+        *registerCount = 1;
+        return VALUE_CLASS_SCALAR;
+    }
+
+    unsigned int size = GetTypeLayout(module, type).size;
+
+    if(size > module->options->abi.maxRegisterBytes)
+    {
+        *registerCount = 0;
+        return VALUE_CLASS_MEMORY;
+    }
+
+    *registerCount = (size + 7) / 8;
+    return VALUE_CLASS_REGISTERS;
+}
+
+// the memcopy lowering puts right after a call returning an aggregate
+Index FindResultCopy(IRFunction *function, Index call)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(!inst->isDead && inst->opcode == IR_MEMCOPY && inst->operands[1] == call) return n;
+    }
+
+    return IR_NONE;
+}
+
+// every caller copies the result out right away, so each can hand over the copy's destination instead
+bool CanReturnThroughSlot(IRModule *module, IRFunction *callee)
+{
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *function = &module->functions[f];
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead || inst->opcode != IR_CALL || strcmp(inst->name, callee->name)) continue;
+
+            unsigned int uses = CountUses(function, n);
+            if(uses > 1 || (uses == 1 && FindResultCopy(function, n) == IR_NONE)) return false;
+        }
+    }
+
+    return true;
+}
+
+void PrependOperand(IRFunction *function, Index inst, Index operand)
+{
+    AddOperand(function, inst, operand);
+
+    IRInst *i = &function->insts[inst];
+    for(unsigned int o = i->operandCount - 1; o > 0; o--) i->operands[o] = i->operands[o - 1];
+    i->operands[0] = operand;
+}
+
+bool IsMemoryInst(unsigned int opcode)
+{
+    return opcode == IR_LOAD || opcode == IR_STORE || opcode == IR_ZERO || opcode == IR_MEMCOPY || opcode == IR_CALL;
+}
+
+// 'v = f()' copies out of a temporary the call could have written into v directly
+bool ForwardResultSlot(IRFunction *function, Index call)
+{
+    Index slot = function->insts[call].operands[0];
+    if(function->insts[slot].opcode != IR_ALLOCA || CountUses(function, slot) != 2) return false;
+
+    IRBlock *b = &function->blocks[function->insts[call].block];
+    unsigned int position = GetInstPosition(function, call) + 1;
+
+    while(position < b->instCount && !IsMemoryInst(function->insts[b->insts[position]].opcode)) position++;
+    if(position == b->instCount) return false;
+
+    Index copy = b->insts[position];
+    IRInst *copyInst = &function->insts[copy];
+    if(copyInst->opcode != IR_MEMCOPY || copyInst->operands[1] != slot) return false;
+
+    // the callee must not write the result over an argument it still reads
+    Index target = copyInst->operands[0];
+    IRInst *callInst = &function->insts[call];
+
+    for(unsigned int o = 1; o < callInst->operandCount; o++)
+    {
+        if(GetAddressRoot(function, callInst->operands[o]) == GetAddressRoot(function, target)) return false;
+    }
+
+    callInst->operands[0] = target;
+    RemoveInst(function, copy);
+    RemoveInst(function, slot);
+
+    return true;
+}
+
+// 'v = f()' for results in registers, the registers can be stored into v instead of a temporary
+unsigned int ElideResultCopies(IRFunction *caller)
+{
+    unsigned int elided = 0;
+
+    for(unsigned int n = 0; n < caller->instCount; n++)
+    {
+        IRInst *inst = &caller->insts[n];
+        if(inst->isDead || inst->opcode != IR_CALL || !inst->type.isAggregate) continue;
+
+        Index copy = FindResultCopy(caller, n);
+        if(copy == IR_NONE) continue;
+
+        Index slot = caller->insts[copy].operands[0];
+        if(caller->insts[slot].opcode != IR_ALLOCA || CountUses(caller, slot) != 2) continue;
+
+        IRBlock *b = &caller->blocks[caller->insts[copy].block];
+        unsigned int position = GetInstPosition(caller, copy) + 1;
+
+        while(position < b->instCount && !IsMemoryInst(caller->insts[b->insts[position]].opcode)) position++;
+        if(position == b->instCount) continue;
+
+        Index next = b->insts[position];
+        if(caller->insts[next].opcode != IR_MEMCOPY || caller->insts[next].operands[1] != slot) continue;
+
+        caller->insts[copy].operands[0] = caller->insts[next].operands[0];
+        RemoveInst(caller, next);
+        RemoveInst(caller, slot);
+        elided++;
+    }
+
+    return elided;
+}
+
+// large results are written straight into memory the caller passes as a hidden first parameter
+void ConvertToStructReturn(IRModule *module, IRFunction *callee, unsigned int *elidedCounts)
+{
+    for(unsigned int n = 0; n < callee->instCount; n++)
+    {
+        if(!callee->insts[n].isDead && callee->insts[n].opcode == IR_PARAM) callee->insts[n].value++;
+    }
+
+    Index slot = NewInst(callee, IR_PARAM);
+    callee->insts[slot].name = "sret";
+    callee->insts[slot].type = callee->returnType;
+    InsertAtEntry(callee, slot);
+
+    callee->parameterCount++;
+    callee->hasReturnValue = false;
+    callee->hasStructReturn = true;
+
+    // a single named variable returned everywhere can live in the caller's memory from the start
+    Index named = IR_NONE;
+    bool isNamedReturn = true;
+
+    for(unsigned int n = 0; n < callee->instCount; n++)
+    {
+        IRInst *inst = &callee->insts[n];
+        if(inst->isDead || inst->opcode != IR_RET || inst->operandCount == 0) continue;
+
+        Index value = inst->operands[0];
+        if(callee->insts[value].opcode != IR_ALLOCA || (named != IR_NONE && named != value)) isNamedReturn = false;
+        named = value;
+    }
+
+    if(isNamedReturn && named != IR_NONE)
+    {
+        ReplaceAllUses(callee, named, slot);
+        RemoveInst(callee, named);
+    }
+
+    for(unsigned int n = 0; n < callee->instCount; n++)
+    {
+        if(callee->insts[n].isDead || callee->insts[n].opcode != IR_RET || callee->insts[n].operandCount == 0) continue;
+
+        if(callee->insts[n].operands[0] != slot)
+        {
+            Index copy = NewInst(callee, IR_MEMCOPY);
+            AddOperand(callee, copy, slot);
+            AddOperand(callee, copy, callee->insts[n].operands[0]);
+            callee->insts[copy].type = callee->returnType;
+            InsertInst(callee, callee->insts[n].block, GetInstPosition(callee, n), copy);
+        }
+
+        callee->insts[n].operandCount = 0;
+    }
+
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *function = &module->functions[f];
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead || inst->opcode != IR_CALL || strcmp(inst->name, callee->name)) continue;
+
+            Index copy = FindResultCopy(function, n);
+            Index dest;
+
+            if(copy != IR_NONE)
+            {
+                dest = function->insts[copy].operands[0];
+                RemoveInst(function, copy);
+            }
+            else
+            {
+                dest = NewInst(function, IR_ALLOCA);
+                function->insts[dest].name = "ret";
+                function->insts[dest].type = callee->returnType;
+                InsertAtEntry(function, dest);
+            }
+
+            PrependOperand(function, n, dest);
+            function->insts[n].type = (IRType){0};
+
+            if(copy != IR_NONE) elidedCounts[f]++;
+            if(!module->options->abi.noCopyElision && ForwardResultSlot(function, n)) elidedCounts[f]++;
+        }
+    }
+}
+
+// an aggregate argument the callee only reads needs no private copy
+unsigned int ElideArgumentCopies(IRModule *module, NameTable *functions, IRFunction *caller)
+{
+    unsigned int elided = 0;
+
+    for(unsigned int n = 0; n < caller->instCount; n++)
+    {
+        IRInst *inst = &caller->insts[n];
+        if(inst->isDead || inst->opcode != IR_CALL) continue;
+
+        int calleeIndex = LookupName(functions, inst->name, -1);
+        if(calleeIndex == -1) continue;
+
+        IRFunction *callee = &module->functions[calleeIndex];
+        if(inst->operandCount != callee->parameterCount) continue;
+
+        for(unsigned int o = callee->hasStructReturn ? 1 : 0; o < inst->operandCount; o++)
+        {
+            Index argument = caller->insts[n].operands[o];
+            if(!caller->insts[argument].type.isAggregate) continue;
+
+            Index copy = FindForwardableArgumentCopy(caller, n, argument);
+            if(copy == IR_NONE) continue;
+
+            Index param = FindParam(callee, o);
+            if(param == IR_NONE || IsAddressWritten(callee, param)) continue;
+
+            Index source = caller->insts[copy].operands[1];
+            if(callee->hasStructReturn && GetAddressRoot(caller, source) == GetAddressRoot(caller, caller->insts[n].operands[0])) continue;
+
+            caller->insts[n].operands[o] = source;
+            RemoveInst(caller, copy);
+            RemoveInst(caller, argument);
+            elided++;
+        }
+    }
+
+    return elided;
+}
+
+void PrintValueClass(IRModule *module, IRType type)
+{
+    unsigned int registerCount;
+    unsigned int valueClass = ClassifyValue(module, type, &registerCount);
+
+    if(valueClass == VALUE_CLASS_MEMORY) printf("memory");
+    else printf("%u register%s", registerCount, registerCount == 1 ? "" : "s");
+}
+
+void PrintCallingConvention(IRModule *module, IRFunction *function, unsigned int elided)
+{
+    printf("abi: '%s':", function->name);
+
+    for(unsigned int position = 0; position < function->parameterCount; position++)
+    {
+        Index param = FindParam(function, position);
+        if(param == IR_NONE) continue;
+
+        printf("%s %s in ", position == 0 ? "" : ",", function->insts[param].name);
+        if(function->hasStructReturn && position == 0) printf("1 register");
+        else PrintValueClass(module, function->insts[param].type);
+    }
+
+    if(function->hasReturnValue)
+    {
+        printf("%s returns in ", function->parameterCount ? "," : "");
+        PrintValueClass(module, function->returnType);
+    }
+
+    if(function->parameterCount == 0 && !function->hasReturnValue) printf(" nothing passed");
+    if(elided > 0) printf(", %u copies elided", elided);
+    printf("\n");
+}
+
+bool LowerCallingConvention(IRModule *module)
+{
+    NameTable functions = {0};
+    for(unsigned int n = 0; n < module->functionCount; n++) InsertName(&functions, module->functions[n].name, n);
+
+    unsigned int *elidedCounts = (unsigned int*)calloc(module->functionCount ? module->functionCount : 1, sizeof(unsigned int));
+    bool changed = false;
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        IRFunction *function = &module->functions[n];
+        if(!function->hasReturnValue || !function->returnType.isAggregate) continue;
+
+        unsigned int registerCount;
+        if(ClassifyValue(module, function->returnType, &registerCount) != VALUE_CLASS_MEMORY) continue;
+        if(!CanReturnThroughSlot(module, function)) continue;
+
+        ConvertToStructReturn(module, function, elidedCounts);
+        changed = true;
+    }
+
+    for(unsigned int n = 0; n < module->functionCount && !module->options->abi.noCopyElision; n++)
+    {
+        unsigned int elided = ElideArgumentCopies(module, &functions, &module->functions[n]) + ElideResultCopies(&module->functions[n]);
+        elidedCounts[n] += elided;
+        if(elided > 0) changed = true;
+    }
+
+    for(unsigned int n = 0; n < module->functionCount && module->options->printReport; n++)
+    {
+        PrintCallingConvention(module, &module->functions[n], elidedCounts[n]);
+    }
+
+    free(elidedCounts);
+    FreeNameTable(&functions);
+
+    return changed;
+}
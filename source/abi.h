@@ -0,0 +1,17 @@
+#ifndef ABI_H
+#define ABI_H
+
+#include "ir.h"
+
+// how a value crosses a call, after the SysV rules for aggregates
+enum ValueClass
+{
+    VALUE_CLASS_SCALAR = 1,
+    VALUE_CLASS_REGISTERS,      // aggregates up to maxRegisterBytes, one register per eight bytes
+    VALUE_CLASS_MEMORY,         // larger aggregates, by hidden reference or through a return slot
+};
+
+unsigned int ClassifyValue(IRModule *module, IRType type, unsigned int *registerCount);
+bool LowerCallingConvention(IRModule *module);
+
+#endif //ABI_H
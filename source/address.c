@@ -0,0 +1,154 @@
+#include "address.h"
+#include "layout.h"
+
+// base + offset + index * scale, what an address chain like 'a.b[n].c' folds into
+typedef struct {
+    Index base;
+    int offset;
+    Index index;
+    unsigned int scale;
+    unsigned int steps;     // address instructions the form stands for
+} AddressForm;
+
+bool IsAddressStep(unsigned int opcode)
+{
+    return opcode == IR_FIELD_ADDR || opcode == IR_INDEX_ADDR || opcode == IR_ADVANCE_ADDR;
+}
+
+AddressForm DecomposeAddress(IRModule *module, IRFunction *function, Index address)
+{
+    IRInst *inst = &function->insts[address];
+    AddressForm self = {address, 0, IR_NONE, 0, 0};
+
+    if(!IsAddressStep(inst->opcode)) return self;
+
+    AddressForm form = DecomposeAddress(module, function, inst->operands[0]);
+
+    if(inst->opcode == IR_FIELD_ADDR)
+    {
+        IRStruct *s = FindStruct(module, function->insts[inst->operands[0]].type.id);
+        if(!s) return self;
+
+        unsigned int f = 0;
+        while(f < s->fieldCount && strcmp(s->fields[f].name, inst->name)) f++;
+        if(f == s->fieldCount) return self;
+
+        form.offset += s->fields[f].offset;
+        form.steps++;
+        return form;
+    }
+
+    // element steps, the operand counts elements of the instruction's type
+    unsigned int size = GetTypeLayout(module, inst->type).size;
+    Index index = inst->operands[1];
+    IRInst *indexInst = &function->insts[index];
+
+    if(indexInst->opcode == IR_CONST)
+    {
+        form.offset += indexInst->value * (int)size;
+        form.steps++;
+        return form;
+    }
+
+    // a[i + 1] keeps i as the index and moves the constant part into the offset
+    if(indexInst->opcode == IR_ADD || indexInst->opcode == IR_SUB)
+    {
+        IRInst *right = &function->insts[indexInst->operands[1]];
+
+        if(right->opcode == IR_CONST)
+        {
+            int constant = (indexInst->opcode == IR_ADD) ? right->value : -right->value;
+
+            if(form.index == IR_NONE)
+            {
+                form.offset += constant * (int)size;
+                index = indexInst->operands[0];
+            }
+        }
+    }
+
+    // only one scaled index fits in the folded form
+    if(form.index != IR_NONE) return self;
+
+    form.index = index;
+    form.scale = size;
+    form.steps++;
+    return form;
+}
+
+unsigned int FoldFunctionAddresses(IRModule *module, IRFunction *function, unsigned int *stepCount)
+{
+    AddressForm *forms = (AddressForm*)calloc(function->instCount, sizeof(AddressForm));
+
+    // every chain is decomposed before any of its steps is rewritten
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(!inst->isDead && IsAddressStep(inst->opcode)) forms[n] = DecomposeAddress(module, function, n);
+    }
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead || forms[n].steps == 0) continue;
+
+        inst->opcode = IR_OFFSET_ADDR;
+        inst->name = 0;
+        inst->value = forms[n].offset;
+        inst->scale = forms[n].scale;
+        inst->operandCount = 0;
+
+        AddOperand(function, n, forms[n].base);
+        if(forms[n].index != IR_NONE) AddOperand(function, n, forms[n].index);
+    }
+
+    // steps only the folded chains used are gone now
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            if(function->insts[n].isDead || forms[n].steps == 0 || CountUses(function, n) > 0) continue;
+
+            RemoveInst(function, n);
+            changed = true;
+        }
+    }
+
+    unsigned int folded = 0;
+    *stepCount = 0;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        if(forms[n].steps == 0) continue;
+
+        (*stepCount)++;
+        if(!function->insts[n].isDead) folded++;
+    }
+
+    free(forms);
+    return folded;
+}
+
+bool FoldAddresses(IRModule *module)
+{
+    bool changed = false;
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        IRFunction *function = &module->functions[n];
+
+        unsigned int stepCount;
+        unsigned int folded = FoldFunctionAddresses(module, function, &stepCount);
+        if(folded > 0) changed = true;
+
+        if(module->options->printReport && folded > 0)
+        {
+            printf("address: '%s': %u steps folded into %u address computations\n", function->name, stepCount, folded);
+        }
+    }
+
+    return changed;
+}
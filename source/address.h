@@ -0,0 +1,8 @@
+#ifndef ADDRESS_H
+#define ADDRESS_H
+
+#include "ir.h"
+
+bool FoldAddresses(IRModule *module);
+
+#endif //ADDRESS_H
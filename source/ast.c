@@ -1,28 +1,27 @@
 #include "ast.h"
 
-#define MAX_NODE_COUNT 1000
+#define INITIAL_NODE_CAPACITY 1024
 
 void InitAST(AST *ast)
 {
-    ast->nodeList = (Node*)malloc(sizeof(Node) * MAX_NODE_COUNT);
+    ast->nodeList = (Node*)malloc(sizeof(Node) * INITIAL_NODE_CAPACITY);
     ast->nodeCount = 0;
+    ast->nodeCapacity = INITIAL_NODE_CAPACITY;
 }
 
+// the list moves when it grows, so a node pointer does not survive a push
 Index PushNode(AST *ast, Node node)
 {
-    if(ast->nodeCount < MAX_NODE_COUNT)
+    if(ast->nodeCount == ast->nodeCapacity)
     {
-        Index index = ast->nodeCount;
-        ast->nodeList[index] = node;
-        ast->nodeCount++;
-        return index;
-    }
-    else
-    {
-        // TODO: resize list of nodes stored in AST struct
-        printf("ast error: AST node list full! (capacity: %d nodes)\n", MAX_NODE_COUNT);
-        exit(1);
+        ast->nodeCapacity = ast->nodeCapacity ? ast->nodeCapacity * 2 : INITIAL_NODE_CAPACITY;
+        ast->nodeList = (Node*)realloc(ast->nodeList, sizeof(Node) * ast->nodeCapacity);
     }
+
+    Index index = ast->nodeCount;
+    ast->nodeList[index] = node;
+    ast->nodeCount++;
+    return index;
 }
 
 void PushIndex(Index **indexList, unsigned int *indexCount, Index index)
@@ -41,6 +40,350 @@ void PushIndex(Index **indexList, unsigned int *indexCount, Index index)
     (*indexList)[(*indexCount) - 1] = index;
 }
 
+// the one index list a node owns, if any
+Index **GetNodeList(Node *node, unsigned int **count)
+{
+    switch(node->type)
+    {
+        case NODE_PROGRAM:          *count = &node->program.defCount; return &node->program.definitions;
+        case NODE_STRUCT_DEF:       *count = &node->structDef.fieldCount; return &node->structDef.fields;
+        case NODE_FUNC_DEF:         *count = &node->functionDef.parameterCount; return &node->functionDef.parameters;
+        case NODE_FUNC_CALL:        *count = &node->functionCall.argumentCount; return &node->functionCall.arguments;
+        case NODE_STATEMENT_LIST:   *count = &node->statementList.statementCount; return &node->statementList.statements;
+        case NODE_L_VALUE:          *count = &node->lValue.simpleLValueCount; return &node->lValue.simpleLValues;
+    }
+
+    return 0;
+}
+
+// nodes share nothing with the original, so either can be changed or freed on its own
+void CopyAST(AST *to, AST *from)
+{
+    to->nodeCapacity = from->nodeCount > INITIAL_NODE_CAPACITY ? from->nodeCount : INITIAL_NODE_CAPACITY;
+    to->nodeList = (Node*)malloc(sizeof(Node) * to->nodeCapacity);
+    memcpy(to->nodeList, from->nodeList, sizeof(Node) * from->nodeCount);
+    to->nodeCount = from->nodeCount;
+
+    for(unsigned int n = 0; n < to->nodeCount; n++)
+    {
+        unsigned int *count;
+        Index **list = GetNodeList(&to->nodeList[n], &count);
+        if(!list || *count == 0) continue;
+
+        Index *copy = (Index*)malloc(sizeof(Index) * (*count));
+        memcpy(copy, *list, sizeof(Index) * (*count));
+        *list = copy;
+    }
+}
+
+// only for an AST whose lists nothing else points to, like a copy
+void FreeAST(AST *ast)
+{
+    for(unsigned int n = 0; n < ast->nodeCount; n++)
+    {
+        unsigned int *count;
+        Index **list = GetNodeList(&ast->nodeList[n], &count);
+        if(list && *count > 0) free(*list);
+    }
+
+    free(ast->nodeList);
+    ast->nodeList = 0;
+    ast->nodeCount = 0;
+    ast->nodeCapacity = 0;
+}
+
+// calls visit on index and every node below it, parents before children
+void VisitNodes(AST *ast, Index index, NodeVisitor visit, void *data)
+{
+    visit(ast, index, data);
+
+    Node *node = &ast->nodeList[index];
+
+    switch(node->type)
+    {
+        case NODE_PROGRAM:
+        {
+            for(unsigned int n = 0; n < node->program.defCount; n++) VisitNodes(ast, node->program.definitions[n], visit, data);
+        }
+        break;
+
+        case NODE_STRUCT_DEF:
+        {
+            for(unsigned int n = 0; n < node->structDef.fieldCount; n++) VisitNodes(ast, node->structDef.fields[n], visit, data);
+        }
+        break;
+
+        case NODE_FUNC_DEF:
+        {
+            for(unsigned int n = 0; n < node->functionDef.parameterCount; n++) VisitNodes(ast, node->functionDef.parameters[n], visit, data);
+            if(node->functionDef.isReturnTypeDeclared) VisitNodes(ast, node->functionDef.returnType, visit, data);
+            VisitNodes(ast, node->functionDef.body, visit, data);
+        }
+        break;
+
+        case NODE_FUNC_CALL:
+        {
+            for(unsigned int n = 0; n < node->functionCall.argumentCount; n++) VisitNodes(ast, node->functionCall.arguments[n], visit, data);
+        }
+        break;
+
+        case NODE_STATEMENT_LIST:
+        {
+            for(unsigned int n = 0; n < node->statementList.statementCount; n++) VisitNodes(ast, node->statementList.statements[n], visit, data);
+        }
+        break;
+
+        case NODE_VAR_DECL:
+        case NODE_FIELD:
+        case NODE_PARAM:
+        {
+            VisitNodes(ast, node->varDecl.id, visit, data);
+            VisitNodes(ast, node->varDecl.type, visit, data);
+        }
+        break;
+
+        case NODE_L_VALUE:
+        {
+            for(unsigned int n = 0; n < node->lValue.simpleLValueCount; n++) VisitNodes(ast, node->lValue.simpleLValues[n], visit, data);
+        }
+        break;
+
+        case NODE_ARRAY_ACCESS:
+        {
+            VisitNodes(ast, node->arrayAccess.id, visit, data);
+            VisitNodes(ast, node->arrayAccess.expr, visit, data);
+        }
+        break;
+
+        case NODE_OPERATOR:
+        {
+            VisitNodes(ast, node->operator.left, visit, data);
+            if(node->operator.opType != BOOL_OP_NOT) VisitNodes(ast, node->operator.right, visit, data);
+        }
+        break;
+
+        case NODE_ASSIGN_STATEMENT:
+        {
+            VisitNodes(ast, node->assignStmt.lValue, visit, data);
+            VisitNodes(ast, node->assignStmt.expression, visit, data);
+        }
+        break;
+
+        case NODE_IF_STATEMENT:
+        {
+            VisitNodes(ast, node->ifStmt.conditionExpr, visit, data);
+            VisitNodes(ast, node->ifStmt.trueBlock, visit, data);
+            if(node->ifStmt.falseBlockExist) VisitNodes(ast, node->ifStmt.falseBlock, visit, data);
+        }
+        break;
+
+        case NODE_WHILE_STATEMENT:
+        {
+            VisitNodes(ast, node->whileStmt.conditionExpr, visit, data);
+            VisitNodes(ast, node->whileStmt.block, visit, data);
+        }
+        break;
+
+        case NODE_RETURN_STATEMENT:
+        {
+            if(node->returnStmt.exprExist) VisitNodes(ast, node->returnStmt.expression, visit, data);
+        }
+        break;
+    }
+}
+
+bool IsIntegerConstant(AST *ast, Index index, int value)
+{
+    Node *node = &ast->nodeList[index];
+    return (node->type == NODE_INTEGER_CONSTANT) && (node->integer.value == value);
+}
+
+// an expression is pure when dropping it cannot remove a call or a division trap
+bool IsPureExpression(AST *ast, Index index)
+{
+    Node *node = &ast->nodeList[index];
+
+    switch(node->type)
+    {
+        case NODE_INTEGER_CONSTANT:
+        case NODE_STRING_CONSTANT:
+        case NODE_IDENTIFIER:
+        {
+            return true;
+        }
+
+        case NODE_L_VALUE:
+        {
+            for(unsigned int n = 0; n < node->lValue.simpleLValueCount; n++)
+            {
+                if(!IsPureExpression(ast, node->lValue.simpleLValues[n])) return false;
+            }
+            return true;
+        }
+
+        case NODE_ARRAY_ACCESS:
+        {
+            return IsPureExpression(ast, node->arrayAccess.expr);
+        }
+
+        case NODE_OPERATOR:
+        {
+            if(node->operator.opType == BOOL_OP_NOT) return IsPureExpression(ast, node->operator.left);
+
+            if(node->operator.opType == ARITHMETIC_OP_DIV || node->operator.opType == ARITHMETIC_OP_MOD)
+            {
+                Node *divisor = &ast->nodeList[node->operator.right];
+                if(divisor->type != NODE_INTEGER_CONSTANT || divisor->integer.value == 0) return false;
+            }
+
+            return IsPureExpression(ast, node->operator.left) && IsPureExpression(ast, node->operator.right);
+        }
+
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+// bee integers are 32 bit two's complement and wrap around on overflow
+bool EvaluateOperator(unsigned int opType, int left, int right, int *result)
+{
+    unsigned int a = (unsigned int)left;
+    unsigned int b = (unsigned int)right;
+
+    switch(opType)
+    {
+        case ARITHMETIC_OP_ADD:     *result = (int)(a + b); return true;
+        case ARITHMETIC_OP_SUB:     *result = (int)(a - b); return true;
+        case ARITHMETIC_OP_MUL:     *result = (int)(a * b); return true;
+
+        case ARITHMETIC_OP_DIV:
+        case ARITHMETIC_OP_MOD:
+        {
+            // division by zero and INT_MIN / -1 trap at run time, leave them alone
+            if(right == 0 || (left == (-2147483647 - 1) && right == -1)) return false;
+            *result = (opType == ARITHMETIC_OP_DIV) ? (left / right) : (left % right);
+            return true;
+        }
+
+        case COMPARE_OP_LT:         *result = left < right; return true;
+        case COMPARE_OP_GT:         *result = left > right; return true;
+        case COMPARE_OP_EQ_EQ:      *result = left == right; return true;
+        case COMPARE_OP_NOT_EQ:     *result = left != right; return true;
+        case COMPARE_OP_LT_EQ:      *result = left <= right; return true;
+        case COMPARE_OP_GT_EQ:      *result = left >= right; return true;
+
+        case BOOL_OP_AND:           *result = left && right; return true;
+        case BOOL_OP_OR:            *result = left || right; return true;
+        case BOOL_OP_NOT:           *result = !left; return true;
+
+        default:                    return false;
+    }
+}
+
+// replaces the whole subtree starting at subtreeStart with a single constant
+Index PushFoldedConstant(AST *ast, unsigned int subtreeStart, int value)
+{
+    ast->nodeCount = subtreeStart;
+
+    Node node = {0};
+    node.type = NODE_INTEGER_CONSTANT;
+    node.integer.value = value;
+    return PushNode(ast, node);
+}
+
+// drops a constant operand if it was the last node pushed
+Index KeepOperand(AST *ast, Index keep, Index drop)
+{
+    if(drop == ast->nodeCount - 1) ast->nodeCount--;
+    return keep;
+}
+
+// builds an operator node, folding constant operands and simple algebraic identities.
+// every node from subtreeStart onwards must belong to the operands of this operator.
+Index PushOperatorNode(AST *ast, Node node, unsigned int subtreeStart)
+{
+    unsigned int opType = node.operator.opType;
+    Index left = node.operator.left;
+    Index right = node.operator.right;
+
+    Node *l = &ast->nodeList[left];
+    bool leftConst = (l->type == NODE_INTEGER_CONSTANT);
+
+    if(opType == BOOL_OP_NOT)
+    {
+        if(leftConst) return PushFoldedConstant(ast, subtreeStart, !l->integer.value);
+        return PushNode(ast, node);
+    }
+
+    Node *r = &ast->nodeList[right];
+    bool rightConst = (r->type == NODE_INTEGER_CONSTANT);
+
+    int value;
+    if(leftConst && rightConst && EvaluateOperator(opType, l->integer.value, r->integer.value, &value))
+    {
+        return PushFoldedConstant(ast, subtreeStart, value);
+    }
+
+    switch(opType)
+    {
+        case ARITHMETIC_OP_ADD:
+        {
+            if(IsIntegerConstant(ast, right, 0)) return KeepOperand(ast, left, right);
+            if(IsIntegerConstant(ast, left, 0)) return right;
+        }
+        break;
+
+        case ARITHMETIC_OP_SUB:
+        {
+            if(IsIntegerConstant(ast, right, 0)) return KeepOperand(ast, left, right);
+        }
+        break;
+
+        case ARITHMETIC_OP_MUL:
+        {
+            if(IsIntegerConstant(ast, right, 1)) return KeepOperand(ast, left, right);
+            if(IsIntegerConstant(ast, left, 1)) return right;
+            if(IsIntegerConstant(ast, right, 0) && IsPureExpression(ast, left)) return PushFoldedConstant(ast, subtreeStart, 0);
+            if(IsIntegerConstant(ast, left, 0) && IsPureExpression(ast, right)) return PushFoldedConstant(ast, subtreeStart, 0);
+        }
+        break;
+
+        case ARITHMETIC_OP_DIV:
+        {
+            if(IsIntegerConstant(ast, right, 1)) return KeepOperand(ast, left, right);
+        }
+        break;
+
+        case ARITHMETIC_OP_MOD:
+        {
+            if((IsIntegerConstant(ast, right, 1) || IsIntegerConstant(ast, right, -1)) && IsPureExpression(ast, left))
+            {
+                return PushFoldedConstant(ast, subtreeStart, 0);
+            }
+        }
+        break;
+
+        case BOOL_OP_AND:
+        {
+            // the right operand is never evaluated
+            if(IsIntegerConstant(ast, left, 0)) return PushFoldedConstant(ast, subtreeStart, 0);
+            if(IsIntegerConstant(ast, right, 0) && IsPureExpression(ast, left)) return PushFoldedConstant(ast, subtreeStart, 0);
+        }
+        break;
+
+        case BOOL_OP_OR:
+        {
+            if(leftConst && l->integer.value != 0) return PushFoldedConstant(ast, subtreeStart, 1);
+            if(rightConst && r->integer.value != 0 && IsPureExpression(ast, left)) return PushFoldedConstant(ast, subtreeStart, 1);
+        }
+        break;
+    }
+
+    return PushNode(ast, node);
+}
+
 void PrintNode(AST ast, Index index, int indent)
 {
     for(int n = 0; n < indent; n++) printf("   ");
@@ -64,7 +407,7 @@ void PrintNode(AST ast, Index index, int indent)
         
         case NODE_STRUCT_DEF:
         {
-            printf("struct def: '%s'\n", node.structDef.name);
+            printf("struct def: '%s'%s\n", node.structDef.name, node.structDef.isFixedLayout ? " (fixed layout)" : "");
             
             for(int n = 0; n < node.structDef.fieldCount; n++)
             {
@@ -67,6 +67,7 @@ typedef struct {
             const char *name;
             Index *fields;
             unsigned int fieldCount;
+            bool isFixedLayout;     // fields stay in declaration order
         } structDef;
         
         struct
@@ -142,6 +143,7 @@ typedef struct {
         {
             Index *simpleLValues;
             unsigned int simpleLValueCount;            
+            bool isReported;        // an undeclared read that has been warned about, every backend sees it
         } lValue;
 
         struct 
@@ -165,10 +167,17 @@ typedef struct {
 typedef struct {
     Node *nodeList;
     unsigned int nodeCount;
+    unsigned int nodeCapacity;
 } AST;
 
+typedef void (*NodeVisitor)(AST *ast, Index index, void *data);
+
 void InitAST(AST *ast);
 Index PushNode(AST *ast, Node node);
 void PushIndex(Index **indexList, unsigned int *indexCount, Index index);
+Index PushOperatorNode(AST *ast, Node node, unsigned int subtreeStart);
+void VisitNodes(AST *ast, Index index, NodeVisitor visit, void *data);
+void CopyAST(AST *to, AST *from);
+void FreeAST(AST *ast);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,429 @@
+#include <limits.h>
+
+#include "bounds.h"
+#include "loop.h"
+
+// how far range queries follow operands before giving up
+#define MAX_RANGE_DEPTH 8
+
+typedef struct {
+    IRFunction *function;
+    LoopInfo loops;
+} RangeAnalysis;
+
+ValueRange GetValueRange(RangeAnalysis *analysis, Index value, Index block, unsigned int depth);
+
+ValueRange FullRange()
+{
+    return (ValueRange){INT_MIN, INT_MAX};
+}
+
+// results outside int wrap around, nothing is known about them then
+ValueRange ClampRange(long long min, long long max)
+{
+    if(min < INT_MIN || max > INT_MAX) return FullRange();
+    return (ValueRange){min, max};
+}
+
+ValueRange MultiplyRanges(ValueRange a, ValueRange b)
+{
+    long long products[4] = {a.min * b.min, a.min * b.max, a.max * b.min, a.max * b.max};
+    long long min = products[0], max = products[0];
+
+    for(unsigned int n = 1; n < 4; n++)
+    {
+        if(products[n] < min) min = products[n];
+        if(products[n] > max) max = products[n];
+    }
+
+    return ClampRange(min, max);
+}
+
+IRLoop *FindLoopWithHeader(RangeAnalysis *analysis, Index header)
+{
+    for(unsigned int n = 0; n < analysis->loops.loopCount; n++)
+    {
+        if(analysis->loops.loops[n].header == header) return &analysis->loops.loops[n];
+    }
+
+    return 0;
+}
+
+unsigned int MirrorComparison(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case IR_LT:     return IR_GT;
+        case IR_GT:     return IR_LT;
+        case IR_LT_EQ:  return IR_GT_EQ;
+        case IR_GT_EQ:  return IR_LT_EQ;
+        default:        return opcode;
+    }
+}
+
+unsigned int NegateComparison(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case IR_LT:     return IR_GT_EQ;
+        case IR_GT:     return IR_LT_EQ;
+        case IR_LT_EQ:  return IR_GT;
+        case IR_GT_EQ:  return IR_LT;
+        case IR_EQ_EQ:  return IR_NOT_EQ;
+        case IR_NOT_EQ: return IR_EQ_EQ;
+        default:        return opcode;
+    }
+}
+
+// narrows range knowing that 'range opcode other' holds
+ValueRange ApplyComparison(ValueRange range, unsigned int opcode, ValueRange other)
+{
+    switch(opcode)
+    {
+        case IR_LT:     if(other.max - 1 < range.max) range.max = other.max - 1; break;
+        case IR_LT_EQ:  if(other.max < range.max) range.max = other.max; break;
+        case IR_GT:     if(other.min + 1 > range.min) range.min = other.min + 1; break;
+        case IR_GT_EQ:  if(other.min > range.min) range.min = other.min; break;
+
+        case IR_EQ_EQ:
+        {
+            if(other.min > range.min) range.min = other.min;
+            if(other.max < range.max) range.max = other.max;
+        }
+        break;
+    }
+
+    return range;
+}
+
+bool IsComparison(unsigned int opcode)
+{
+    return opcode >= IR_LT && opcode <= IR_GT_EQ;
+}
+
+// every branch on the way down the dominator tree to block tells something about the values it compared
+ValueRange RefineRange(RangeAnalysis *analysis, Index value, Index block, ValueRange range, unsigned int depth)
+{
+    IRFunction *function = analysis->function;
+
+    for(Index current = block; current != 0 && function->blocks[current].idom != IR_NONE; current = function->blocks[current].idom)
+    {
+        IRBlock *b = &function->blocks[current];
+        if(b->predCount != 1) continue;
+
+        Index pred = b->preds[0];
+        Index terminator = GetTerminator(function, pred);
+        IRInst *branch = &function->insts[terminator];
+
+        if(branch->opcode != IR_BRANCH || branch->trueTarget == branch->falseTarget) continue;
+
+        IRInst *condition = &function->insts[branch->operands[0]];
+        if(!IsComparison(condition->opcode)) continue;
+
+        unsigned int opcode = condition->opcode;
+        Index other;
+
+        if(condition->operands[0] == value) other = condition->operands[1];
+        else if(condition->operands[1] == value)
+        {
+            other = condition->operands[0];
+            opcode = MirrorComparison(opcode);
+        }
+        else continue;
+
+        if(branch->falseTarget == current) opcode = NegateComparison(opcode);
+
+        range = ApplyComparison(range, opcode, GetValueRange(analysis, other, pred, depth + 1));
+    }
+
+    return range;
+}
+
+// an induction variable moves away from its start, as long as the step cannot wrap it around
+ValueRange GetPhiRange(RangeAnalysis *analysis, Index phi, unsigned int depth)
+{
+    IRFunction *function = analysis->function;
+    IRLoop *loop = FindLoopWithHeader(analysis, function->insts[phi].block);
+    InductionVariable iv;
+
+    if(!loop || loop->preheader == IR_NONE || loop->latch == IR_NONE || !FindInductionVariable(function, loop, phi, &iv))
+    {
+        return FullRange();
+    }
+
+    ValueRange init = GetValueRange(analysis, iv.init, loop->preheader, depth + 1);
+    if(init.min == INT_MIN && init.max == INT_MAX) return FullRange();
+
+    ValueRange tentative = (iv.step >= 0) ? (ValueRange){init.min, INT_MAX} : (ValueRange){INT_MIN, init.max};
+    ValueRange atLatch = RefineRange(analysis, phi, loop->latch, tentative, depth + 1);
+
+    if(iv.step >= 0)
+    {
+        long long last = atLatch.max + iv.step;
+        if(last > INT_MAX) return FullRange();
+
+        return (ValueRange){init.min, last > init.max ? last : init.max};
+    }
+    else
+    {
+        long long last = atLatch.min + iv.step;
+        if(last < INT_MIN) return FullRange();
+
+        return (ValueRange){last < init.min ? last : init.min, init.max};
+    }
+}
+
+ValueRange GetBaseRange(RangeAnalysis *analysis, Index value, unsigned int depth)
+{
+    IRInst *inst = &analysis->function->insts[value];
+    if(depth > MAX_RANGE_DEPTH) return FullRange();
+
+    switch(inst->opcode)
+    {
+        case IR_CONST:
+        return (ValueRange){inst->value, inst->value};
+
+        case IR_LT:
+        case IR_GT:
+        case IR_EQ_EQ:
+        case IR_NOT_EQ:
+        case IR_LT_EQ:
+        case IR_GT_EQ:
+        case IR_NOT:
+        return (ValueRange){0, 1};
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        {
+            ValueRange a = GetValueRange(analysis, inst->operands[0], inst->block, depth + 1);
+            ValueRange b = GetValueRange(analysis, inst->operands[1], inst->block, depth + 1);
+
+            if(inst->opcode == IR_ADD) return ClampRange(a.min + b.min, a.max + b.max);
+            if(inst->opcode == IR_SUB) return ClampRange(a.min - b.max, a.max - b.min);
+            return MultiplyRanges(a, b);
+        }
+
+        case IR_MOD:
+        {
+            // the remainder takes the sign of the dividend
+            IRInst *divisor = &analysis->function->insts[inst->operands[1]];
+            if(divisor->opcode != IR_CONST || divisor->value <= 0) return FullRange();
+
+            ValueRange a = GetValueRange(analysis, inst->operands[0], inst->block, depth + 1);
+            long long limit = divisor->value - 1;
+
+            if(a.min >= 0) return (ValueRange){0, a.max < limit ? a.max : limit};
+            return (ValueRange){-limit, limit};
+        }
+
+        case IR_PHI:
+        return GetPhiRange(analysis, value, depth);
+
+        default:
+        return FullRange();
+    }
+}
+
+// range of value where it is used in block
+ValueRange GetValueRange(RangeAnalysis *analysis, Index value, Index block, unsigned int depth)
+{
+    ValueRange range = GetBaseRange(analysis, value, depth);
+    if(depth > MAX_RANGE_DEPTH) return range;
+
+    return RefineRange(analysis, value, block, range, depth);
+}
+
+IRLoop *FindInnermostLoop(RangeAnalysis *analysis, Index block)
+{
+    // inner loops come first
+    for(unsigned int n = 0; n < analysis->loops.loopCount; n++)
+    {
+        if(IsInLoop(&analysis->loops.loops[n], block)) return &analysis->loops.loops[n];
+    }
+
+    return 0;
+}
+
+bool ProvesComparison(unsigned int opcode, ValueRange a, ValueRange b)
+{
+    switch(opcode)
+    {
+        case IR_LT:     return a.max < b.min;
+        case IR_GT:     return a.min > b.max;
+        case IR_LT_EQ:  return a.max <= b.min;
+        case IR_GT_EQ:  return a.min >= b.max;
+        default:        return false;
+    }
+}
+
+// true if the header test passes on the way in, so the body runs at least once
+bool IsLoopEntered(RangeAnalysis *analysis, IRLoop *loop)
+{
+    IRFunction *function = analysis->function;
+    IRInst *branch = &function->insts[GetTerminator(function, loop->header)];
+    if(branch->opcode != IR_BRANCH || !IsInLoop(loop, branch->trueTarget)) return false;
+
+    IRInst *condition = &function->insts[branch->operands[0]];
+    if(!IsComparison(condition->opcode)) return false;
+
+    ValueRange operands[2];
+    unsigned int entryIndex = GetPredIndex(function, loop->header, loop->preheader);
+
+    for(unsigned int o = 0; o < 2; o++)
+    {
+        Index operand = condition->operands[o];
+        IRInst *inst = &function->insts[operand];
+
+        // phis hold their starting value on entry
+        if(inst->opcode == IR_PHI && inst->block == loop->header) operand = inst->operands[entryIndex];
+        else if(IsInLoop(loop, inst->block)) return false;
+
+        operands[o] = GetValueRange(analysis, operand, loop->preheader, 0);
+    }
+
+    return ProvesComparison(condition->opcode, operands[0], operands[1]);
+}
+
+// a check on a value fixed for the whole loop fails on the first iteration or never,
+// it can move in front of the loop when nothing observable happens before it would have run
+bool CanHoistCheck(RangeAnalysis *analysis, IRLoop *loop, Index check)
+{
+    IRFunction *function = analysis->function;
+    IRInst *inst = &function->insts[check];
+
+    if(!loop || loop->preheader == IR_NONE || loop->latch == IR_NONE) return false;
+    if(IsInLoop(loop, function->insts[inst->operands[0]].block)) return false;
+    if(!Dominates(function, inst->block, loop->latch)) return false;
+
+    for(unsigned int n = 0; n < loop->blockCount; n++)
+    {
+        Index block = loop->blocks[n];
+        IRBlock *b = &function->blocks[block];
+
+        for(unsigned int i = 0; i < b->instCount; i++)
+        {
+            if(function->insts[b->insts[i]].opcode == IR_CALL) return false;
+        }
+
+        // leaving the loop anywhere but the header could skip the check
+        Index successors[IR_MAX_SUCCESSORS];
+        unsigned int successorCount = GetSuccessors(function, block, successors);
+
+        for(unsigned int s = 0; s < successorCount; s++)
+        {
+            if(block != loop->header && !IsInLoop(loop, successors[s])) return false;
+        }
+
+        if(function->insts[GetTerminator(function, block)].opcode == IR_RET) return false;
+    }
+
+    return IsLoopEntered(analysis, loop);
+}
+
+bool IsCheckDominatedBy(IRFunction *function, Index check, Index other)
+{
+    IRInst *a = &function->insts[check];
+    IRInst *b = &function->insts[other];
+
+    if(b->isDead || b->opcode != IR_BOUNDS_CHECK || other == check) return false;
+    if(a->operands[0] != b->operands[0] || b->value > a->value) return false;
+
+    if(a->block == b->block) return GetInstPosition(function, other) < GetInstPosition(function, check);
+    return Dominates(function, b->block, a->block);
+}
+
+// a check on the same index against an equal or smaller dimension already ran
+unsigned int RemoveRedundantChecks(IRFunction *function)
+{
+    unsigned int removedCount = 0;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead || inst->opcode != IR_BOUNDS_CHECK) continue;
+
+        for(unsigned int other = 0; other < function->instCount; other++)
+        {
+            if(!IsCheckDominatedBy(function, n, other)) continue;
+
+            RemoveInst(function, n);
+            removedCount++;
+            break;
+        }
+    }
+
+    return removedCount;
+}
+
+bool EliminateBoundsChecks(IRFunction *function, const Options *options)
+{
+    RangeAnalysis analysis = {0};
+    analysis.function = function;
+    analysis.loops = FindLoops(function);
+
+    unsigned int checkCount = 0;
+    unsigned int hoistedCount = 0;
+    bool changed = false;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead || inst->opcode != IR_BOUNDS_CHECK) continue;
+
+        checkCount++;
+
+        ValueRange range = GetValueRange(&analysis, inst->operands[0], inst->block, 0);
+
+        if(range.min >= 0 && range.max < inst->value)
+        {
+            RemoveInst(function, n);
+            changed = true;
+            continue;
+        }
+
+        // hoisting out of an inner loop can let it move out of the next one as well
+        bool hoisted = false;
+        IRLoop *loop = FindInnermostLoop(&analysis, inst->block);
+
+        while(CanHoistCheck(&analysis, loop, n))
+        {
+            MoveInst(function, n, loop->preheader, function->blocks[loop->preheader].instCount - 1);
+            hoisted = true;
+            loop = FindInnermostLoop(&analysis, loop->preheader);
+        }
+
+        if(hoisted)
+        {
+            hoistedCount++;
+            changed = true;
+        }
+
+        if(options->printReport)
+        {
+            inst = &function->insts[n];
+            bool alwaysFails = (range.max < 0 || range.min >= inst->value);
+
+            printf("bounds: '%s': check of '%s' index %%%d against %d %s block%d, index range [%lld, %lld]%s\n",
+                   function->name, inst->name, inst->operands[0], inst->value, hoisted ? "hoisted to" : "remains in",
+                   inst->block, range.min, range.max, alwaysFails ? ", always fails" : "");
+        }
+    }
+
+    if(RemoveRedundantChecks(function) > 0) changed = true;
+
+    unsigned int remainingCount = 0;
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        if(!function->insts[n].isDead && function->insts[n].opcode == IR_BOUNDS_CHECK) remainingCount++;
+    }
+
+    if(options->printReport && checkCount > 0)
+    {
+        printf("bounds: '%s': %u checks, %u removed, %u hoisted out of loops, %u left\n", function->name,
+               checkCount, checkCount - remainingCount, hoistedCount, remainingCount);
+    }
+
+    FreeLoopInfo(&analysis.loops);
+    return changed;
+}
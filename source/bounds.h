@@ -0,0 +1,14 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "ir.h"
+
+// values an int may take, wider than int so arithmetic on the limits cannot overflow
+typedef struct {
+    long long min;
+    long long max;
+} ValueRange;
+
+bool EliminateBoundsChecks(IRFunction *function, const Options *options);
+
+#endif //BOUNDS_H
@@ -0,0 +1,139 @@
+#include "bulk.h"
+#include "layout.h"
+
+typedef struct {
+    IRFunction *function;
+    Index block;
+    unsigned int position;      // where the next instruction goes
+} BulkBuilder;
+
+Index EmitBulkInst(BulkBuilder *builder, unsigned int opcode, Index left, Index right, IRType type)
+{
+    Index inst = NewInst(builder->function, opcode);
+    if(left != IR_NONE) AddOperand(builder->function, inst, left);
+    if(right != IR_NONE) AddOperand(builder->function, inst, right);
+    builder->function->insts[inst].type = type;
+
+    InsertInst(builder->function, builder->block, builder->position++, inst);
+    return inst;
+}
+
+Index EmitBulkConst(BulkBuilder *builder, int value)
+{
+    Index inst = EmitBulkInst(builder, IR_CONST, IR_NONE, IR_NONE, (IRType){0});
+    builder->function->insts[inst].value = value;
+    return inst;
+}
+
+Index EmitChunkAddress(BulkBuilder *builder, Index base, unsigned int offset, IRType type)
+{
+    Index address = EmitBulkInst(builder, IR_OFFSET_ADDR, base, IR_NONE, type);
+    builder->function->insts[address].value = offset;
+    return address;
+}
+
+// widest piece that still fits, int and then char
+IRType GetChunkType(unsigned int remaining)
+{
+    IRType type = {0};
+    type.id = (remaining >= 4) ? "int" : "char";
+    return type;
+}
+
+unsigned int GetChunkSize(IRType type)
+{
+    return !strcmp(type.id, "int") ? 4 : 1;
+}
+
+// small objects are set or copied by a handful of register wide stores in place
+unsigned int ExpandBulkInst(BulkBuilder *builder, Index index, unsigned int size)
+{
+    IRFunction *function = builder->function;
+    bool isZero = function->insts[index].opcode == IR_ZERO;
+    Index dest = function->insts[index].operands[0];
+    Index source = isZero ? IR_NONE : function->insts[index].operands[1];
+
+    Index zero = IR_NONE;   // made once
+    unsigned int storeCount = 0;
+
+    for(unsigned int offset = 0; offset < size; storeCount++)
+    {
+        IRType type = GetChunkType(size - offset);
+        Index value;
+
+        if(isZero)
+        {
+            if(zero == IR_NONE) zero = EmitBulkConst(builder, 0);
+            value = zero;
+        }
+        else
+        {
+            value = EmitBulkInst(builder, IR_LOAD, EmitChunkAddress(builder, source, offset, type), IR_NONE, type);
+        }
+
+        EmitBulkInst(builder, IR_STORE, EmitChunkAddress(builder, dest, offset, type), value, type);
+        offset += GetChunkSize(type);
+    }
+
+    return storeCount;
+}
+
+// memset and memmove semantics, a copy may have the same source and destination after stack coloring
+void EmitRuntimeCall(BulkBuilder *builder, Index index, unsigned int size)
+{
+    IRFunction *function = builder->function;
+    bool isZero = function->insts[index].opcode == IR_ZERO;
+
+    Index dest = function->insts[index].operands[0];
+    Index value = isZero ? EmitBulkConst(builder, 0) : function->insts[index].operands[1];
+    Index length = EmitBulkConst(builder, size);
+
+    Index call = EmitBulkInst(builder, IR_CALL, dest, value, (IRType){0});
+    AddOperand(function, call, length);
+    function->insts[call].name = isZero ? "memset" : "memmove";
+}
+
+bool LowerBulkMemory(IRModule *module)
+{
+    bool changed = false;
+
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *function = &module->functions[f];
+        unsigned int inlinedCount = 0, storeCount = 0, callCount = 0;
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead || (inst->opcode != IR_ZERO && inst->opcode != IR_MEMCOPY)) continue;
+
+            unsigned int size = GetTypeLayout(module, inst->type).size;
+
+            BulkBuilder builder = {0};
+            builder.function = function;
+            builder.block = inst->block;
+            builder.position = GetInstPosition(function, n);
+
+            if(size <= module->options->bulk.inlineLimit)
+            {
+                storeCount += ExpandBulkInst(&builder, n, size);
+                inlinedCount++;
+            }
+            else
+            {
+                EmitRuntimeCall(&builder, n, size);
+                callCount++;
+            }
+
+            RemoveInst(function, n);
+            changed = true;
+        }
+
+        if(module->options->printReport && inlinedCount + callCount > 0)
+        {
+            printf("bulk: '%s': %u inlined as %u stores, %u runtime calls\n", function->name, inlinedCount, storeCount, callCount);
+        }
+    }
+
+    return changed;
+}
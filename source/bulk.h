@@ -0,0 +1,8 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include "ir.h"
+
+bool LowerBulkMemory(IRModule *module);
+
+#endif //BULK_H
@@ -0,0 +1,1188 @@
+#include "bytecode.h"
+#include "abi.h"
+#include "layout.h"
+#include "symbol.h"
+
+// an edge whose phi moves cannot go in front of the branch taking it, emitted after the function body
+typedef struct {
+    Index label;
+    Index from;
+    Index to;
+} EdgeStub;
+
+typedef struct {
+    IRModule *module;
+    IRFunction *function;
+    BytecodeModule *bytecode;
+    BytecodeFunction *out;
+    NameTable *functions;
+
+    int *registerOf;        // per ir value, -1 for values recomputed at every use
+
+    Index *labels;          // pc of each label, the blocks first, then edge stubs
+    unsigned int labelCount;
+
+    EdgeStub *stubs;
+    unsigned int stubCount;
+} BytecodeBuilder;
+
+void BytecodeError(BytecodeBuilder *builder, const char *message, const char *name)
+{
+    CompileError("error: function '%s': %s '%s'", builder->function->name, message, name);
+}
+
+Index EmitBytecode(BytecodeBuilder *builder, unsigned int opcode, int dest, int left, int right)
+{
+    BytecodeInst inst = {0};
+    inst.opcode = opcode;
+    inst.dest = dest;
+    inst.left = left;
+    inst.right = right;
+    inst.pool = -1;
+    inst.target = -1;
+
+    BytecodeFunction *out = builder->out;
+    out->codeCount++;
+    out->code = (BytecodeInst*)realloc(out->code, sizeof(BytecodeInst) * out->codeCount);
+    out->code[out->codeCount - 1] = inst;
+
+    return out->codeCount - 1;
+}
+
+Index EmitJumpTo(BytecodeBuilder *builder, unsigned int opcode, int left, Index label)
+{
+    Index jump = EmitBytecode(builder, opcode, -1, left, -1);
+    builder->out->code[jump].target = label;
+    return jump;
+}
+
+int NewRegister(BytecodeBuilder *builder)
+{
+    return builder->out->registerCount++;
+}
+
+Index NewLabel(BytecodeBuilder *builder)
+{
+    PushIndex(&builder->labels, &builder->labelCount, -1);
+    return builder->labelCount - 1;
+}
+
+bool IsRematerialized(unsigned int opcode)
+{
+    return opcode == IR_CONST || opcode == IR_UNDEF || opcode == IR_ALLOCA || opcode == IR_STRING;
+}
+
+bool IsStringValue(IRFunction *function, Index value, unsigned int depth)
+{
+    IRInst *inst = &function->insts[value];
+    if(depth > 8) return false;
+
+    switch(inst->opcode)
+    {
+        case IR_STRING:
+        return true;
+
+        case IR_ADD:
+        case IR_PHI:
+        case IR_COPY:
+        {
+            for(unsigned int o = 0; o < inst->operandCount; o++)
+            {
+                if(IsStringValue(function, inst->operands[o], depth + 1)) return true;
+            }
+        }
+        return false;
+
+        default:
+        return inst->type.id && !strcmp(inst->type.id, "str");
+    }
+}
+
+void SetAccessSize(BytecodeInst *inst, IRType type)
+{
+    const char *id = type.id ? type.id : "str";
+
+    inst->size = GetScalarLayout(id).size;
+    inst->isSigned = id[0] != 'u' && strcmp(id, "bool") && strcmp(id, "str");
+}
+
+Index AddString(BytecodeModule *module, const char *string)
+{
+    module->stringCount++;
+    module->strings = (const char**)realloc(module->strings, sizeof(const char*) * module->stringCount);
+    module->strings[module->stringCount - 1] = string;
+
+    return module->stringCount - 1;
+}
+
+// structs the calling convention keeps in registers cross calls as their eight byte words, 0 for values passed as they are
+unsigned int GetValueWords(IRModule *module, IRType type)
+{
+    unsigned int registerCount;
+    if(!type.isAggregate || ClassifyValue(module, type, &registerCount) != VALUE_CLASS_REGISTERS) return 0;
+
+    return registerCount;
+}
+
+unsigned int GetParameterWords(IRModule *module, IRFunction *function, unsigned int position)
+{
+    Index param = FindParam(function, position);
+    if(param == IR_NONE || (function->hasStructReturn && position == 0)) return 0;
+
+    return GetValueWords(module, function->insts[param].type);
+}
+
+// the register each parameter starts in, a parameter takes up as many registers as it is passed in
+unsigned int GetParameterRegisters(IRModule *module, IRFunction *function, int *firstRegisters)
+{
+    unsigned int count = 0;
+
+    for(unsigned int position = 0; position < function->parameterCount; position++)
+    {
+        unsigned int words = GetParameterWords(module, function, position);
+
+        firstRegisters[position] = count;
+        count += words ? words : 1;
+    }
+
+    return count;
+}
+
+// memory of its own for a struct that arrived in registers
+unsigned int AddFrameSlot(BytecodeFunction *out, unsigned int words)
+{
+    unsigned int offset = (out->frameSize + 7) & ~7u;
+    out->frameSize = offset + words * 8;
+
+    return offset;
+}
+
+// loads or stores one word of the aggregate at address, the last word only as wide as what is left of it
+void EmitWordAccess(BytecodeBuilder *builder, unsigned int opcode, int address, int value, IRType type, unsigned int word)
+{
+    BytecodeFunction *out = builder->out;
+    unsigned int size = GetTypeLayout(builder->module, type).size - word * 8;
+    int wordAddress = address;
+
+    if(word > 0)
+    {
+        wordAddress = NewRegister(builder);
+        Index step = EmitBytecode(builder, BC_ADDR, wordAddress, address, -1);
+        out->code[step].imm = word * 8;
+    }
+
+    Index access = (opcode == BC_LOAD) ? EmitBytecode(builder, BC_LOAD, value, wordAddress, -1) : EmitBytecode(builder, BC_STORE, -1, wordAddress, value);
+    out->code[access].size = size < 8 ? size : 8;
+    out->code[access].isSigned = false;
+}
+
+// constants, strings and frame addresses are made again at each use, right where the peephole pass can fold them in
+void EmitValueInto(BytecodeBuilder *builder, int reg, Index value)
+{
+    IRInst *inst = &builder->function->insts[value];
+    Index emitted;
+
+    switch(inst->opcode)
+    {
+        case IR_CONST:
+        case IR_UNDEF:
+        {
+            emitted = EmitBytecode(builder, BC_CONST, reg, -1, -1);
+            builder->out->code[emitted].imm = (inst->opcode == IR_CONST) ? inst->value : 0;
+        }
+        break;
+
+        case IR_ALLOCA:
+        {
+            emitted = EmitBytecode(builder, BC_FRAME_ADDR, reg, -1, -1);
+            builder->out->code[emitted].imm = inst->value;
+        }
+        break;
+
+        case IR_STRING:
+        {
+            emitted = EmitBytecode(builder, BC_STRING, reg, -1, -1);
+            builder->out->code[emitted].imm = AddString(builder->bytecode, inst->name);
+        }
+        break;
+
+        default:
+        {
+            EmitBytecode(builder, BC_MOVE, reg, builder->registerOf[value], -1);
+        }
+        break;
+    }
+}
+
+int EmitOperand(BytecodeBuilder *builder, Index value)
+{
+    if(!IsRematerialized(builder->function->insts[value].opcode)) return builder->registerOf[value];
+
+    int reg = NewRegister(builder);
+    EmitValueInto(builder, reg, value);
+    return reg;
+}
+
+bool HasPhis(IRFunction *function, Index block)
+{
+    IRBlock *b = &function->blocks[block];
+    return b->instCount > 0 && function->insts[b->insts[0]].opcode == IR_PHI;
+}
+
+// the phis of 'to' take their values for the edge from 'from', all at once
+void EmitPhiMoves(BytecodeBuilder *builder, Index from, Index to)
+{
+    IRFunction *function = builder->function;
+    IRBlock *b = &function->blocks[to];
+
+    unsigned int p = 0;
+    while(p < b->predCount && b->preds[p] != from) p++;
+
+    unsigned int phiCount = 0;
+    while(phiCount < b->instCount && function->insts[b->insts[phiCount]].opcode == IR_PHI) phiCount++;
+
+    // a phi reading the register of another phi on this edge needs the old value kept aside
+    bool needsTemporaries = false;
+
+    for(unsigned int n = 0; n < phiCount; n++)
+    {
+        for(unsigned int m = 0; m < phiCount; m++)
+        {
+            Index value = function->insts[b->insts[m]].operands[p];
+            if(m == n || IsRematerialized(function->insts[value].opcode)) continue;
+
+            if(builder->registerOf[value] == builder->registerOf[b->insts[n]]) needsTemporaries = true;
+        }
+    }
+
+    int *temporaries = (int*)malloc(sizeof(int) * (phiCount ? phiCount : 1));
+
+    for(unsigned int n = 0; n < phiCount; n++)
+    {
+        Index value = function->insts[b->insts[n]].operands[p];
+        temporaries[n] = -1;
+
+        if(needsTemporaries && !IsRematerialized(function->insts[value].opcode))
+        {
+            temporaries[n] = NewRegister(builder);
+            EmitBytecode(builder, BC_MOVE, temporaries[n], builder->registerOf[value], -1);
+        }
+    }
+
+    for(unsigned int n = 0; n < phiCount; n++)
+    {
+        Index phi = b->insts[n];
+        Index value = function->insts[phi].operands[p];
+
+        if(temporaries[n] != -1) EmitBytecode(builder, BC_MOVE, builder->registerOf[phi], temporaries[n], -1);
+        else if(value != phi) EmitValueInto(builder, builder->registerOf[phi], value);
+    }
+
+    free(temporaries);
+}
+
+Index GetEdgeLabel(BytecodeBuilder *builder, Index from, Index to)
+{
+    if(!HasPhis(builder->function, to)) return to;
+
+    builder->stubCount++;
+    builder->stubs = (EdgeStub*)realloc(builder->stubs, sizeof(EdgeStub) * builder->stubCount);
+    builder->stubs[builder->stubCount - 1] = (EdgeStub){NewLabel(builder), from, to};
+
+    return builder->stubs[builder->stubCount - 1].label;
+}
+
+void GenerateSwitch(BytecodeBuilder *builder, Index block, IRInst *inst)
+{
+    BytecodeFunction *out = builder->out;
+    int selector = EmitOperand(builder, inst->operands[0]);
+
+    // one label per distinct successor, there is one edge to each
+    Index *labels = (Index*)malloc(sizeof(Index) * (inst->caseCount + 1));
+    Index defaultLabel = GetEdgeLabel(builder, block, inst->falseTarget);
+
+    for(unsigned int n = 0; n < inst->caseCount; n++)
+    {
+        Index target = inst->caseTargets[n];
+        labels[n] = (target == inst->falseTarget) ? defaultLabel : IR_NONE;
+
+        for(unsigned int m = 0; m < n && labels[n] == IR_NONE; m++)
+        {
+            if(inst->caseTargets[m] == target) labels[n] = labels[m];
+        }
+
+        if(labels[n] == IR_NONE) labels[n] = GetEdgeLabel(builder, block, target);
+    }
+
+    Index table = EmitJumpTo(builder, BC_SWITCH, selector, defaultLabel);
+    out->code[table].imm = inst->value;
+    out->code[table].extra = inst->caseCount;
+    out->code[table].pool = out->poolCount;
+
+    for(unsigned int n = 0; n < inst->caseCount; n++) PushIndex(&out->pool, &out->poolCount, labels[n]);
+
+    free(labels);
+}
+
+void GenerateTerminator(BytecodeBuilder *builder, Index block, Index next)
+{
+    IRFunction *function = builder->function;
+    IRInst *inst = &function->insts[GetTerminator(function, block)];
+
+    switch(inst->opcode)
+    {
+        case IR_RET:
+        {
+            unsigned int words = function->hasReturnValue ? GetValueWords(builder->module, function->returnType) : 0;
+
+            if(inst->operandCount == 0 || words == 0)
+            {
+                EmitBytecode(builder, BC_RET, -1, inst->operandCount ? EmitOperand(builder, inst->operands[0]) : -1, -1);
+                break;
+            }
+
+            int address = EmitOperand(builder, inst->operands[0]);
+            int results[2] = {-1, -1};
+
+            for(unsigned int w = 0; w < words; w++)
+            {
+                results[w] = NewRegister(builder);
+                EmitWordAccess(builder, BC_LOAD, address, results[w], function->returnType, w);
+            }
+
+            EmitBytecode(builder, BC_RET, -1, results[0], results[1]);
+        }
+        break;
+
+        case IR_JUMP:
+        {
+            EmitPhiMoves(builder, block, inst->trueTarget);
+            if(inst->trueTarget != next) EmitJumpTo(builder, BC_JUMP, -1, inst->trueTarget);
+        }
+        break;
+
+        case IR_BRANCH:
+        {
+            Index trueTarget = inst->trueTarget;
+            Index falseTarget = inst->falseTarget;
+            int condition = EmitOperand(builder, inst->operands[0]);
+
+            if(trueTarget == next && !HasPhis(function, trueTarget))
+            {
+                EmitJumpTo(builder, BC_JUMP_IF_NOT, condition, GetEdgeLabel(builder, block, falseTarget));
+                break;
+            }
+
+            EmitJumpTo(builder, BC_JUMP_IF, condition, GetEdgeLabel(builder, block, trueTarget));
+            EmitPhiMoves(builder, block, falseTarget);
+            if(falseTarget != next) EmitJumpTo(builder, BC_JUMP, -1, falseTarget);
+        }
+        break;
+
+        case IR_SWITCH:
+        {
+            GenerateSwitch(builder, block, inst);
+        }
+        break;
+    }
+}
+
+void GenerateCall(BytecodeBuilder *builder, Index index)
+{
+    IRFunction *function = builder->function;
+    BytecodeFunction *out = builder->out;
+    IRInst *inst = &function->insts[index];
+    int dest = builder->registerOf[index];
+
+    if(!strcmp(inst->name, "print"))
+    {
+        if(inst->operandCount != 1) BytecodeError(builder, "wrong number of arguments to", inst->name);
+
+        unsigned int opcode = IsStringValue(function, inst->operands[0], 0) ? BC_PRINT_STR : BC_PRINT_INT;
+        EmitBytecode(builder, opcode, dest, EmitOperand(builder, inst->operands[0]), -1);
+        return;
+    }
+
+    if(!strcmp(inst->name, "memset") || !strcmp(inst->name, "memmove"))
+    {
+        if(inst->operandCount != 3 || function->insts[inst->operands[2]].opcode != IR_CONST)
+        {
+            BytecodeError(builder, "runtime call without a constant size", inst->name);
+        }
+
+        int address = EmitOperand(builder, inst->operands[0]);
+        int value = EmitOperand(builder, inst->operands[1]);
+
+        Index call = EmitBytecode(builder, !strcmp(inst->name, "memset") ? BC_MEMSET : BC_MEMMOVE, -1, address, value);
+        out->code[call].imm = function->insts[inst->operands[2]].value;
+        return;
+    }
+
+    int callee = LookupName(builder->functions, inst->name, -1);
+    if(callee == -1) BytecodeError(builder, "call to unknown function", inst->name);
+
+    IRFunction *calleeFunction = &builder->module->functions[callee];
+    if(inst->operandCount != calleeFunction->parameterCount) BytecodeError(builder, "wrong number of arguments to", inst->name);
+
+    int *arguments = 0;
+    unsigned int argumentCount = 0;
+
+    for(unsigned int o = 0; o < function->insts[index].operandCount; o++)
+    {
+        Index operand = function->insts[index].operands[o];
+        unsigned int words = GetParameterWords(builder->module, calleeFunction, o);
+
+        if(words == 0)
+        {
+            PushIndex(&arguments, &argumentCount, EmitOperand(builder, operand));
+            continue;
+        }
+
+        // small structs are loaded into registers instead of being handed over by address
+        int address = EmitOperand(builder, operand);
+        IRType type = calleeFunction->insts[FindParam(calleeFunction, o)].type;
+
+        for(unsigned int w = 0; w < words; w++)
+        {
+            int word = NewRegister(builder);
+            EmitWordAccess(builder, BC_LOAD, address, word, type, w);
+            PushIndex(&arguments, &argumentCount, word);
+        }
+    }
+
+    unsigned int resultWords = calleeFunction->hasReturnValue ? GetValueWords(builder->module, calleeFunction->returnType) : 0;
+    int results[2] = {dest, -1};
+
+    for(unsigned int w = 0; w < resultWords; w++) results[w] = NewRegister(builder);
+
+    Index call = EmitBytecode(builder, BC_CALL, results[0], -1, results[1]);
+    out->code[call].imm = callee;
+    out->code[call].extra = argumentCount;
+    out->code[call].pool = out->poolCount;
+
+    for(unsigned int n = 0; n < argumentCount; n++) PushIndex(&out->pool, &out->poolCount, arguments[n]);
+
+    // a struct returned in registers goes back into memory here, the call's value is its address
+    if(resultWords > 0)
+    {
+        Index slot = EmitBytecode(builder, BC_FRAME_ADDR, dest, -1, -1);
+        out->code[slot].imm = AddFrameSlot(out, resultWords);
+
+        for(unsigned int w = 0; w < resultWords; w++) EmitWordAccess(builder, BC_STORE, dest, results[w], calleeFunction->returnType, w);
+    }
+
+    free(arguments);
+}
+
+void GenerateInst(BytecodeBuilder *builder, Index index)
+{
+    IRFunction *function = builder->function;
+    BytecodeFunction *out = builder->out;
+    IRInst *inst = &function->insts[index];
+    int dest = builder->registerOf[index];
+
+    switch(inst->opcode)
+    {
+        case IR_PARAM:
+        case IR_PHI:
+        case IR_CONST:
+        case IR_UNDEF:
+        case IR_ALLOCA:
+        case IR_STRING:
+        break;
+
+        case IR_COPY:
+        {
+            EmitBytecode(builder, BC_MOVE, dest, EmitOperand(builder, inst->operands[0]), -1);
+        }
+        break;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_LT:
+        case IR_GT:
+        case IR_EQ_EQ:
+        case IR_NOT_EQ:
+        case IR_LT_EQ:
+        case IR_GT_EQ:
+        {
+            unsigned int opcode = (inst->opcode >= IR_LT) ? BC_LT + (inst->opcode - IR_LT) : BC_ADD + (inst->opcode - IR_ADD);
+            if(inst->opcode == IR_ADD && IsStringValue(function, index, 0)) opcode = BC_CONCAT;
+
+            int left = EmitOperand(builder, inst->operands[0]);
+            int right = EmitOperand(builder, inst->operands[1]);
+            EmitBytecode(builder, opcode, dest, left, right);
+        }
+        break;
+
+        case IR_NOT:
+        {
+            EmitBytecode(builder, BC_NOT, dest, EmitOperand(builder, inst->operands[0]), -1);
+        }
+        break;
+
+        case IR_FIELD_ADDR:
+        {
+            IRStruct *s = FindStruct(builder->module, function->insts[inst->operands[0]].type.id);
+            if(!s) BytecodeError(builder, "field of a value that is not a struct", inst->name);
+
+            unsigned int f = 0;
+            while(f < s->fieldCount && strcmp(s->fields[f].name, inst->name)) f++;
+            if(f == s->fieldCount) BytecodeError(builder, "unknown field", inst->name);
+
+            Index address = EmitBytecode(builder, BC_ADDR, dest, EmitOperand(builder, inst->operands[0]), -1);
+            out->code[address].imm = s->fields[f].offset;
+        }
+        break;
+
+        case IR_INDEX_ADDR:
+        case IR_ADVANCE_ADDR:
+        case IR_OFFSET_ADDR:
+        {
+            bool isFolded = inst->opcode == IR_OFFSET_ADDR;
+
+            int base = EmitOperand(builder, inst->operands[0]);
+            int step = (inst->operandCount > 1) ? EmitOperand(builder, inst->operands[1]) : -1;
+
+            Index address = EmitBytecode(builder, BC_ADDR, dest, base, step);
+            out->code[address].imm = isFolded ? inst->value : 0;
+            out->code[address].extra = isFolded ? inst->scale : GetTypeLayout(builder->module, inst->type).size;
+        }
+        break;
+
+        case IR_LOAD:
+        {
+            Index load = EmitBytecode(builder, BC_LOAD, dest, EmitOperand(builder, inst->operands[0]), -1);
+            SetAccessSize(&out->code[load], inst->type);
+        }
+        break;
+
+        case IR_STORE:
+        {
+            // the address last, next to the store it folds into
+            int value = EmitOperand(builder, inst->operands[1]);
+            int address = EmitOperand(builder, inst->operands[0]);
+
+            Index store = EmitBytecode(builder, BC_STORE, -1, address, value);
+            SetAccessSize(&out->code[store], inst->type);
+        }
+        break;
+
+        case IR_ZERO:
+        case IR_MEMCOPY:
+        {
+            int address = EmitOperand(builder, inst->operands[0]);
+            int value;
+
+            if(inst->opcode == IR_ZERO)
+            {
+                value = NewRegister(builder);
+                EmitBytecode(builder, BC_CONST, value, -1, -1);
+            }
+            else
+            {
+                value = EmitOperand(builder, inst->operands[1]);
+            }
+
+            Index bulk = EmitBytecode(builder, inst->opcode == IR_ZERO ? BC_MEMSET : BC_MEMMOVE, -1, address, value);
+            out->code[bulk].imm = GetTypeLayout(builder->module, inst->type).size;
+        }
+        break;
+
+        case IR_BOUNDS_CHECK:
+        {
+            Index check = EmitBytecode(builder, BC_BOUNDS_CHECK, -1, EmitOperand(builder, inst->operands[0]), -1);
+            out->code[check].imm = inst->value;
+        }
+        break;
+
+        case IR_CALL:
+        {
+            GenerateCall(builder, index);
+        }
+        break;
+
+        default:
+        {
+            BytecodeError(builder, "instruction the vm cannot run", IROpcodeToString(inst->opcode));
+        }
+        break;
+    }
+}
+
+// parameters come first, in the registers they are passed in. a struct passed in registers gets one more for its address
+void AssignRegisters(BytecodeBuilder *builder, int *firstRegisters)
+{
+    IRFunction *function = builder->function;
+
+    builder->registerOf = (int*)malloc(sizeof(int) * (function->instCount ? function->instCount : 1));
+    builder->out->registerCount = builder->out->parameterCount;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        builder->registerOf[n] = -1;
+
+        if(inst->isDead || IsRematerialized(inst->opcode)) continue;
+
+        bool isPassedAsWords = inst->opcode == IR_PARAM && GetParameterWords(builder->module, function, inst->value) > 0;
+
+        if(inst->opcode == IR_PARAM && !isPassedAsWords) builder->registerOf[n] = firstRegisters[inst->value];
+        else if(!HasSideEffects(inst->opcode) || inst->opcode == IR_CALL) builder->registerOf[n] = NewRegister(builder);
+    }
+}
+
+// structs that arrived in registers are stored into the frame, the rest of the function uses them by address
+void StoreParameterWords(BytecodeBuilder *builder, int *firstRegisters)
+{
+    IRFunction *function = builder->function;
+    BytecodeFunction *out = builder->out;
+
+    for(unsigned int position = 0; position < function->parameterCount; position++)
+    {
+        unsigned int words = GetParameterWords(builder->module, function, position);
+        if(words == 0) continue;
+
+        Index param = FindParam(function, position);
+        int address = builder->registerOf[param];
+
+        Index slot = EmitBytecode(builder, BC_FRAME_ADDR, address, -1, -1);
+        out->code[slot].imm = AddFrameSlot(out, words);
+
+        for(unsigned int w = 0; w < words; w++) EmitWordAccess(builder, BC_STORE, address, firstRegisters[position] + w, function->insts[param].type, w);
+    }
+}
+
+bool IsJumpOpcode(unsigned int opcode)
+{
+    return opcode == BC_JUMP || opcode == BC_JUMP_IF || opcode == BC_JUMP_IF_NOT || opcode == BC_SWITCH ||
+           (opcode >= BC_JUMP_IF_LT && opcode <= BC_JUMP_IF_GE_IMM);
+}
+
+// labels become pcs once the peephole pass is done moving code around
+void ResolveLabels(BytecodeBuilder *builder)
+{
+    BytecodeFunction *out = builder->out;
+
+    for(unsigned int pc = 0; pc < out->codeCount; pc++)
+    {
+        BytecodeInst *inst = &out->code[pc];
+        if(!IsJumpOpcode(inst->opcode)) continue;
+
+        inst->target = builder->labels[inst->target];
+
+        if(inst->opcode == BC_SWITCH)
+        {
+            for(int n = 0; n < inst->extra; n++) out->pool[inst->pool + n] = builder->labels[out->pool[inst->pool + n]];
+        }
+    }
+}
+
+void GenerateFunction(BytecodeBuilder *builder)
+{
+    IRFunction *function = builder->function;
+    BytecodeFunction *out = builder->out;
+
+    out->name = function->name;
+    out->frameSize = function->frameSize;
+
+    int *firstRegisters = (int*)malloc(sizeof(int) * (function->parameterCount ? function->parameterCount : 1));
+    out->parameterCount = GetParameterRegisters(builder->module, function, firstRegisters);
+
+    AssignRegisters(builder, firstRegisters);
+    for(unsigned int block = 0; block < function->blockCount; block++) NewLabel(builder);
+
+    StoreParameterWords(builder, firstRegisters);
+    free(firstRegisters);
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        IRBlock *b = &function->blocks[block];
+        if(b->isDead) continue;
+
+        Index next = block + 1;
+        while(next < (Index)function->blockCount && function->blocks[next].isDead) next++;
+
+        builder->labels[block] = out->codeCount;
+
+        for(unsigned int n = 0; n + 1 < b->instCount; n++) GenerateInst(builder, b->insts[n]);
+        GenerateTerminator(builder, block, next);
+    }
+
+    for(unsigned int n = 0; n < builder->stubCount; n++)
+    {
+        EdgeStub stub = builder->stubs[n];
+
+        builder->labels[stub.label] = out->codeCount;
+        EmitPhiMoves(builder, stub.from, stub.to);
+        EmitJumpTo(builder, BC_JUMP, -1, stub.to);
+    }
+
+    if(!builder->module->options->bytecode.noSuperinstructions) out->fusedCount = FuseSuperinstructions(out, builder->labels, builder->labelCount);
+
+    ResolveLabels(builder);
+}
+
+typedef struct {
+    IRModule *module;
+    BytecodeModule *bytecode;
+    BytecodeModule *strings;    // per function, the strings it uses numbered from zero
+    NameTable *functions;
+} BytecodeBatch;
+
+void GenerateFunctionTask(void *data, unsigned int task)
+{
+    BytecodeBatch *batch = (BytecodeBatch*)data;
+
+    BytecodeBuilder builder = {0};
+    builder.module = batch->module;
+    builder.function = &batch->module->functions[task];
+    builder.bytecode = &batch->strings[task];
+    builder.out = &batch->bytecode->functions[task];
+    builder.functions = batch->functions;
+
+    GenerateFunction(&builder);
+
+    free(builder.registerOf);
+    free(builder.labels);
+    free(builder.stubs);
+}
+
+// functions are generated in parallel, then their strings are appended to the module's table in source order,
+// so the module is the same for any number of threads
+BytecodeModule GenerateBytecode(IRModule *module)
+{
+    BytecodeModule bytecode = {0};
+    bytecode.functionCount = module->functionCount;
+    bytecode.functions = (BytecodeFunction*)calloc(module->functionCount ? module->functionCount : 1, sizeof(BytecodeFunction));
+
+    NameTable functions = {0};
+    for(unsigned int n = 0; n < module->functionCount; n++) InsertName(&functions, module->functions[n].name, n);
+
+    BytecodeBatch batch = {0};
+    batch.module = module;
+    batch.bytecode = &bytecode;
+    batch.strings = (BytecodeModule*)calloc(module->functionCount ? module->functionCount : 1, sizeof(BytecodeModule));
+    batch.functions = &functions;
+
+    RunTasks(module->options->threadCount, module->functionCount, GenerateFunctionTask, &batch);
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        BytecodeFunction *out = &bytecode.functions[n];
+        unsigned int firstString = bytecode.stringCount;
+
+        for(unsigned int s = 0; s < batch.strings[n].stringCount; s++) AddString(&bytecode, batch.strings[n].strings[s]);
+
+        for(unsigned int pc = 0; pc < out->codeCount; pc++)
+        {
+            if(out->code[pc].opcode == BC_STRING) out->code[pc].imm += firstString;
+        }
+
+        if(module->options->printReport && !module->isQuiet)
+        {
+            printf("bytecode: '%s': %u instructions, %u registers, %u fused into superinstructions\n",
+                   out->name, out->codeCount, out->registerCount, out->fusedCount);
+        }
+
+        free(batch.strings[n].strings);
+    }
+
+    free(batch.strings);
+    FreeNameTable(&functions);
+    return bytecode;
+}
+
+bool HasDest(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case BC_NOP:
+        case BC_STORE:
+        case BC_STORE_FRAME:
+        case BC_STORE_OFFSET:
+        case BC_MEMSET:
+        case BC_MEMMOVE:
+        case BC_BOUNDS_CHECK:
+        case BC_RET:
+        return false;
+
+        default:
+        return !IsJumpOpcode(opcode);
+    }
+}
+
+bool IsBytecodeComparison(unsigned int opcode)
+{
+    return opcode >= BC_LT && opcode <= BC_GE;
+}
+
+// a < b is b > a, equality reads the same both ways
+unsigned int MirrorBytecodeComparison(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case BC_LT: return BC_GT;
+        case BC_GT: return BC_LT;
+        case BC_LE: return BC_GE;
+        case BC_GE: return BC_LE;
+        default:    return opcode;
+    }
+}
+
+unsigned int NegateBytecodeComparison(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case BC_LT: return BC_GE;
+        case BC_GT: return BC_LE;
+        case BC_EQ: return BC_NE;
+        case BC_NE: return BC_EQ;
+        case BC_LE: return BC_GT;
+        case BC_GE: return BC_LT;
+        default:    return opcode;
+    }
+}
+
+// folds 'a', whose result only 'b' reads, into 'b', true when 'a' is no longer needed
+bool FuseIntoNext(BytecodeInst *a, BytecodeInst *b)
+{
+    int t = a->dest;
+    bool readsLeft = (b->left == t && b->right != t);
+    bool readsRight = (b->right == t && b->left != t);
+
+    switch(a->opcode)
+    {
+        // 'n + 1', 'n < 10'
+        case BC_CONST:
+        {
+            bool isArithmetic = b->opcode == BC_ADD || b->opcode == BC_SUB || b->opcode == BC_MUL;
+            bool isCommutative = b->opcode == BC_ADD || b->opcode == BC_MUL;
+
+            if(isArithmetic && (readsRight || (readsLeft && isCommutative)))
+            {
+                if(readsLeft) b->left = b->right;
+                b->opcode = BC_ADD_IMM + (b->opcode - BC_ADD);
+            }
+            else if(IsBytecodeComparison(b->opcode) && (readsLeft || readsRight))
+            {
+                if(readsLeft)
+                {
+                    b->left = b->right;
+                    b->opcode = MirrorBytecodeComparison(b->opcode);
+                }
+
+                b->opcode = BC_LT_IMM + (b->opcode - BC_LT);
+            }
+            else
+            {
+                return false;
+            }
+
+            b->right = -1;
+            b->imm = a->imm;
+        }
+        return true;
+
+        // compare and branch on the result
+        case BC_LT: case BC_GT: case BC_EQ: case BC_NE: case BC_LE: case BC_GE:
+        case BC_LT_IMM: case BC_GT_IMM: case BC_EQ_IMM: case BC_NE_IMM: case BC_LE_IMM: case BC_GE_IMM:
+        {
+            if((b->opcode != BC_JUMP_IF && b->opcode != BC_JUMP_IF_NOT) || b->left != t) return false;
+
+            bool hasImmediate = a->opcode >= BC_LT_IMM;
+            unsigned int comparison = hasImmediate ? BC_LT + (a->opcode - BC_LT_IMM) : a->opcode;
+            if(b->opcode == BC_JUMP_IF_NOT) comparison = NegateBytecodeComparison(comparison);
+
+            b->opcode = (hasImmediate ? BC_JUMP_IF_LT_IMM : BC_JUMP_IF_LT) + (comparison - BC_LT);
+            b->left = a->left;
+            b->right = a->right;
+            b->imm = a->imm;
+        }
+        return true;
+
+        // field and element accesses of locals
+        case BC_FRAME_ADDR:
+        {
+            if(b->opcode == BC_LOAD && b->left == t) b->opcode = BC_LOAD_FRAME;
+            else if(b->opcode == BC_STORE && readsLeft) b->opcode = BC_STORE_FRAME;
+            else if(b->opcode == BC_ADDR && b->right == -1 && b->left == t) b->opcode = BC_FRAME_ADDR;
+            else return false;
+
+            b->left = -1;
+            b->imm += a->imm;
+        }
+        return true;
+
+        case BC_ADDR:
+        {
+            if(a->right != -1) return false;
+
+            if(b->opcode == BC_LOAD && b->left == t) b->opcode = BC_LOAD_OFFSET;
+            else if(b->opcode == BC_STORE && readsLeft) b->opcode = BC_STORE_OFFSET;
+            else if(b->opcode == BC_ADDR && readsLeft) b->opcode = BC_ADDR;
+            else return false;
+
+            b->left = a->left;
+            b->imm += a->imm;
+        }
+        return true;
+
+        default:
+        return false;
+    }
+}
+
+unsigned int FuseSuperinstructions(BytecodeFunction *function, Index *labels, unsigned int labelCount)
+{
+    unsigned int count = function->codeCount;
+
+    unsigned int *readCounts = (unsigned int*)calloc(function->registerCount + 1, sizeof(unsigned int));
+    unsigned int *writeCounts = (unsigned int*)calloc(function->registerCount + 1, sizeof(unsigned int));
+    bool *isLabelTarget = (bool*)calloc(count + 1, sizeof(bool));
+
+    for(unsigned int pc = 0; pc < count; pc++)
+    {
+        BytecodeInst *inst = &function->code[pc];
+
+        if(inst->left >= 0) readCounts[inst->left]++;
+        if(inst->right >= 0 && inst->opcode != BC_CALL) readCounts[inst->right]++;
+        if(inst->right >= 0 && inst->opcode == BC_CALL) writeCounts[inst->right]++;
+        if(HasDest(inst->opcode) && inst->dest >= 0) writeCounts[inst->dest]++;
+
+        for(int n = 0; inst->opcode == BC_CALL && n < inst->extra; n++) readCounts[function->pool[inst->pool + n]]++;
+    }
+
+    for(unsigned int n = 0; n < labelCount; n++)
+    {
+        if(labels[n] >= 0) isLabelTarget[labels[n]] = true;
+    }
+
+    // one pass forward, a fused instruction can take part in the next fusion right away
+    unsigned int fused = 0;
+    unsigned int a = 0;
+
+    while(a < count)
+    {
+        unsigned int b = a + 1;
+        while(b < count && function->code[b].opcode == BC_NOP) b++;
+        if(b == count) break;
+
+        BytecodeInst *first = &function->code[a];
+        BytecodeInst *second = &function->code[b];
+        int t = first->dest;
+
+        // nothing jumps in between, a label on a fused away instruction ends up on the next one
+        bool isJumpedInto = false;
+        for(unsigned int pc = a + 1; pc <= b; pc++) isJumpedInto |= isLabelTarget[pc];
+
+        // only 'b' reads the result of 'a'
+        bool isPrivate = HasDest(first->opcode) && t >= 0 && readCounts[t] == 1 && writeCounts[t] == 1 && !isJumpedInto;
+
+        if(isPrivate && second->opcode == BC_MOVE && second->left == t)
+        {
+            // the producer writes the destination of the move directly
+            first->dest = second->dest;
+            second->opcode = BC_NOP;
+            fused++;
+            continue;
+        }
+
+        if(isPrivate && first->opcode != BC_CALL && FuseIntoNext(first, second))
+        {
+            first->opcode = BC_NOP;
+            fused++;
+        }
+
+        a = b;
+    }
+
+    // drop what was fused away, labels move along with the code
+    unsigned int *newPc = (unsigned int*)malloc(sizeof(unsigned int) * (count + 1));
+    unsigned int kept = 0;
+
+    for(unsigned int pc = 0; pc <= count; pc++)
+    {
+        newPc[pc] = kept;
+        if(pc < count && function->code[pc].opcode != BC_NOP) function->code[kept++] = function->code[pc];
+    }
+
+    for(unsigned int n = 0; n < labelCount; n++)
+    {
+        if(labels[n] >= 0) labels[n] = newPc[labels[n]];
+    }
+
+    function->codeCount = kept;
+
+    free(readCounts);
+    free(writeCounts);
+    free(isLabelTarget);
+    free(newPc);
+
+    return fused;
+}
+
+int FindBytecodeFunction(BytecodeModule *module, const char *name)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        if(!strcmp(module->functions[n].name, name)) return n;
+    }
+
+    return -1;
+}
+
+const char *BytecodeOpcodeToString(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case BC_NOP:                return "nop"; break;
+        case BC_CONST:              return "const"; break;
+        case BC_STRING:             return "string"; break;
+        case BC_MOVE:               return "move"; break;
+        case BC_ADD:                return "add"; break;
+        case BC_SUB:                return "sub"; break;
+        case BC_MUL:                return "mul"; break;
+        case BC_DIV:                return "div"; break;
+        case BC_MOD:                return "mod"; break;
+        case BC_LT:                 return "lt"; break;
+        case BC_GT:                 return "gt"; break;
+        case BC_EQ:                 return "eq"; break;
+        case BC_NE:                 return "ne"; break;
+        case BC_LE:                 return "le"; break;
+        case BC_GE:                 return "ge"; break;
+        case BC_NOT:                return "not"; break;
+        case BC_CONCAT:             return "concat"; break;
+        case BC_FRAME_ADDR:         return "frame_addr"; break;
+        case BC_ADDR:               return "addr"; break;
+        case BC_LOAD:               return "load"; break;
+        case BC_STORE:              return "store"; break;
+        case BC_MEMSET:             return "memset"; break;
+        case BC_MEMMOVE:            return "memmove"; break;
+        case BC_BOUNDS_CHECK:       return "bounds_check"; break;
+        case BC_CALL:               return "call"; break;
+        case BC_PRINT_INT:          return "print_int"; break;
+        case BC_PRINT_STR:          return "print_str"; break;
+        case BC_JUMP:               return "jump"; break;
+        case BC_JUMP_IF:            return "jump_if"; break;
+        case BC_JUMP_IF_NOT:        return "jump_if_not"; break;
+        case BC_SWITCH:             return "switch"; break;
+        case BC_RET:                return "ret"; break;
+        case BC_ADD_IMM:            return "add_imm"; break;
+        case BC_SUB_IMM:            return "sub_imm"; break;
+        case BC_MUL_IMM:            return "mul_imm"; break;
+        case BC_LT_IMM:             return "lt_imm"; break;
+        case BC_GT_IMM:             return "gt_imm"; break;
+        case BC_EQ_IMM:             return "eq_imm"; break;
+        case BC_NE_IMM:             return "ne_imm"; break;
+        case BC_LE_IMM:             return "le_imm"; break;
+        case BC_GE_IMM:             return "ge_imm"; break;
+        case BC_JUMP_IF_LT:         return "jump_if_lt"; break;
+        case BC_JUMP_IF_GT:         return "jump_if_gt"; break;
+        case BC_JUMP_IF_EQ:         return "jump_if_eq"; break;
+        case BC_JUMP_IF_NE:         return "jump_if_ne"; break;
+        case BC_JUMP_IF_LE:         return "jump_if_le"; break;
+        case BC_JUMP_IF_GE:         return "jump_if_ge"; break;
+        case BC_JUMP_IF_LT_IMM:     return "jump_if_lt_imm"; break;
+        case BC_JUMP_IF_GT_IMM:     return "jump_if_gt_imm"; break;
+        case BC_JUMP_IF_EQ_IMM:     return "jump_if_eq_imm"; break;
+        case BC_JUMP_IF_NE_IMM:     return "jump_if_ne_imm"; break;
+        case BC_JUMP_IF_LE_IMM:     return "jump_if_le_imm"; break;
+        case BC_JUMP_IF_GE_IMM:     return "jump_if_ge_imm"; break;
+        case BC_LOAD_FRAME:         return "load_frame"; break;
+        case BC_STORE_FRAME:        return "store_frame"; break;
+        case BC_LOAD_OFFSET:        return "load_offset"; break;
+        case BC_STORE_OFFSET:       return "store_offset"; break;
+        default:                    return "unknown_opcode";
+    }
+}
+
+unsigned int BytecodeOpcodeFromString(const char *name)
+{
+    for(unsigned int opcode = BC_NOP; opcode < BC_OPCODE_COUNT; opcode++)
+    {
+        if(!strcmp(BytecodeOpcodeToString(opcode), name)) return opcode;
+    }
+
+    return 0;
+}
+
+void PrintBytecodeInst(BytecodeModule *module, BytecodeFunction *function, unsigned int pc)
+{
+    BytecodeInst *inst = &function->code[pc];
+
+    printf("  %4u: ", pc);
+    if(HasDest(inst->opcode) && inst->dest >= 0) printf("r%d", inst->dest);
+    if(inst->opcode == BC_CALL && inst->right >= 0) printf(", r%d", inst->right);
+    if(HasDest(inst->opcode) && inst->dest >= 0) printf(" = ");
+    printf("%s", BytecodeOpcodeToString(inst->opcode));
+
+    switch(inst->opcode)
+    {
+        case BC_STRING:
+        {
+            printf(" \"%s\"\n", module->strings[inst->imm]);
+        }
+        return;
+
+        case BC_CALL:
+        {
+            printf(" %s", module->functions[inst->imm].name);
+            for(int n = 0; n < inst->extra; n++) printf("%sr%d", n == 0 ? " " : ", ", function->pool[inst->pool + n]);
+            printf("\n");
+        }
+        return;
+
+        case BC_SWITCH:
+        {
+            printf(" r%d, default %d [", inst->left, inst->target);
+            for(int n = 0; n < inst->extra; n++) printf("%s%d: %d", n == 0 ? "" : ", ", inst->imm + n, function->pool[inst->pool + n]);
+            printf("]\n");
+        }
+        return;
+    }
+
+    bool hasImmediate = inst->opcode == BC_CONST || inst->opcode == BC_FRAME_ADDR || inst->opcode == BC_ADDR ||
+                        inst->opcode == BC_MEMSET || inst->opcode == BC_MEMMOVE || inst->opcode == BC_BOUNDS_CHECK ||
+                        (inst->opcode >= BC_ADD_IMM && inst->opcode <= BC_GE_IMM) ||
+                        (inst->opcode >= BC_JUMP_IF_LT_IMM && inst->opcode <= BC_STORE_OFFSET);
+
+    bool isFirst = true;
+    if(inst->left >= 0) printf(" r%d", inst->left);
+    if(inst->right >= 0) printf("%sr%d", inst->left >= 0 ? ", " : " ", inst->right);
+    if(inst->left >= 0 || inst->right >= 0) isFirst = false;
+
+    if(hasImmediate) printf("%s%d", isFirst ? " " : ", ", inst->imm);
+    if(inst->opcode == BC_ADDR && inst->right >= 0) printf(" * %d", inst->extra);
+    if(inst->size) printf(" (%u byte%s)", inst->size, inst->size == 1 ? "" : "s");
+    if(IsJumpOpcode(inst->opcode)) printf(" -> %d", inst->target);
+
+    printf("\n");
+}
+
+void PrintBytecodeModule(BytecodeModule *module)
+{
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        BytecodeFunction *function = &module->functions[f];
+        printf("bc %s (params: %u, registers: %u, frame: %u bytes)\n", function->name, function->parameterCount, function->registerCount, function->frameSize);
+
+        for(unsigned int pc = 0; pc < function->codeCount; pc++) PrintBytecodeInst(module, function, pc);
+        printf("\n");
+    }
+}
+
+void FreeBytecodeModule(BytecodeModule *module)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        free(module->functions[n].code);
+        free(module->functions[n].pool);
+    }
+
+    free(module->functions);
+    free(module->strings);
+}
@@ -0,0 +1,131 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ir.h"
+
+enum BytecodeOpcode
+{
+    BC_NOP = 1,
+    BC_CONST,
+    BC_STRING,
+    BC_MOVE,
+
+    BC_ADD,
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_MOD,
+
+    // comparisons, in the order of the ir ones
+    BC_LT,
+    BC_GT,
+    BC_EQ,
+    BC_NE,
+    BC_LE,
+    BC_GE,
+    BC_NOT,
+    BC_CONCAT,
+
+    // memory
+    BC_FRAME_ADDR,          // frame base + imm
+    BC_ADDR,                // left + imm + right * extra
+    BC_LOAD,
+    BC_STORE,
+    BC_MEMSET,
+    BC_MEMMOVE,
+    BC_BOUNDS_CHECK,
+
+    BC_CALL,
+    BC_PRINT_INT,
+    BC_PRINT_STR,
+
+    BC_JUMP,
+    BC_JUMP_IF,
+    BC_JUMP_IF_NOT,
+    BC_SWITCH,
+    BC_RET,
+
+    // superinstructions, only made by the peephole pass
+    BC_ADD_IMM,
+    BC_SUB_IMM,
+    BC_MUL_IMM,
+
+    BC_LT_IMM,
+    BC_GT_IMM,
+    BC_EQ_IMM,
+    BC_NE_IMM,
+    BC_LE_IMM,
+    BC_GE_IMM,
+
+    BC_JUMP_IF_LT,
+    BC_JUMP_IF_GT,
+    BC_JUMP_IF_EQ,
+    BC_JUMP_IF_NE,
+    BC_JUMP_IF_LE,
+    BC_JUMP_IF_GE,
+
+    BC_JUMP_IF_LT_IMM,
+    BC_JUMP_IF_GT_IMM,
+    BC_JUMP_IF_EQ_IMM,
+    BC_JUMP_IF_NE_IMM,
+    BC_JUMP_IF_LE_IMM,
+    BC_JUMP_IF_GE_IMM,
+
+    BC_LOAD_FRAME,          // load from frame base + imm
+    BC_STORE_FRAME,
+    BC_LOAD_OFFSET,         // load from left + imm
+    BC_STORE_OFFSET,
+
+    BC_OPCODE_COUNT,
+};
+
+// registers are numbered per function, parameters first, unused register operands are -1
+typedef struct {
+    unsigned short opcode;
+    unsigned char size;     // memory access bytes
+    bool isSigned;          // loads sign extend
+
+    int dest;
+    int left;
+    int right;              // BC_CALL and BC_RET, the second word of a struct passed back in two registers
+
+    int imm;                // constant, string, byte offset, callee, array dimension, lowest switch case
+    int extra;              // BC_ADDR scale, BC_CALL argument count, BC_SWITCH table size
+    int pool;               // BC_CALL arguments, BC_SWITCH table, where they start in the function's pool
+    int target;             // jumps, BC_SWITCH default, a label until the function is finished, then a pc
+} BytecodeInst;
+
+typedef struct {
+    const char *name;
+
+    BytecodeInst *code;
+    unsigned int codeCount;
+
+    Index *pool;
+    unsigned int poolCount;
+
+    unsigned int registerCount;
+    unsigned int parameterCount;
+    unsigned int frameSize;
+
+    unsigned int fusedCount;    // instructions the peephole pass folded into superinstructions
+} BytecodeFunction;
+
+typedef struct {
+    BytecodeFunction *functions;
+    unsigned int functionCount;
+
+    const char **strings;
+    unsigned int stringCount;
+} BytecodeModule;
+
+BytecodeModule GenerateBytecode(IRModule *module);
+unsigned int FuseSuperinstructions(BytecodeFunction *function, Index *labels, unsigned int labelCount);
+Index AddString(BytecodeModule *module, const char *string);
+int FindBytecodeFunction(BytecodeModule *module, const char *name);
+const char *BytecodeOpcodeToString(unsigned int opcode);
+unsigned int BytecodeOpcodeFromString(const char *name);
+void PrintBytecodeModule(BytecodeModule *module);
+void FreeBytecodeModule(BytecodeModule *module);
+
+#endif //BYTECODE_H
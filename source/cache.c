@@ -0,0 +1,504 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "hash.h"
+
+// bump whenever the compiler starts producing different bytecode for the same source
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_MAX_COUNT (1u << 24)
+
+// shared by every compilation in the process, entries are copied in and out under the lock
+typedef struct {
+    NameTable keys;             // key in hex -> function
+    char **keyNames;
+    CachedFunction *functions;
+    unsigned int functionCount;
+    pthread_mutex_t lock;
+} MemoryCache;
+
+MemoryCache memoryCache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// a key covers the function itself and every function it can reach, with their bodies:
+// inlining copies callee bodies and the calling convention looks at how callees use their parameters
+unsigned long long *ComputeFunctionKeys(AST *ast, Index program, CallGraph *graph, unsigned long long optionHash)
+{
+    unsigned long long *hashes = HashASTNodes(ast, program);
+    unsigned long long *ownHashes = (unsigned long long*)calloc(graph->nodeCount ? graph->nodeCount : 1, sizeof(unsigned long long));
+    unsigned long long *keys = (unsigned long long*)calloc(graph->nodeCount ? graph->nodeCount : 1, sizeof(unsigned long long));
+
+    // struct layouts are shared by every function
+    unsigned long long structHash = HashValue(HASH_SEED, CACHE_FORMAT_VERSION);
+    Node *node = &ast->nodeList[program];
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        if(ast->nodeList[def].type == NODE_STRUCT_DEF) structHash = HashValue(structHash, hashes[def]);
+    }
+
+    for(unsigned int n = 0; n < graph->nodeCount; n++)
+    {
+        Index def = graph->nodes[n].definition;
+        ownHashes[n] = HashString(HashValue(HASH_SEED, hashes[def]), ast->nodeList[def].functionDef.name);
+    }
+
+    bool *isVisited = (bool*)calloc(graph->nodeCount ? graph->nodeCount : 1, sizeof(bool));
+    Index *worklist = 0;
+    unsigned int worklistCount = 0;
+    Index *visited = 0;
+    unsigned int visitedCount = 0;
+
+    for(unsigned int n = 0; n < graph->nodeCount; n++)
+    {
+        // summed so the order callees are found in does not matter
+        unsigned long long calleeSum = 0;
+
+        isVisited[n] = true;
+        PushIndex(&worklist, &worklistCount, n);
+        PushIndex(&visited, &visitedCount, n);
+
+        while(worklistCount > 0)
+        {
+            CallGraphNode *caller = &graph->nodes[worklist[--worklistCount]];
+
+            for(unsigned int c = 0; c < caller->calleeCount; c++)
+            {
+                Index callee = caller->callees[c];
+                if(isVisited[callee]) continue;
+
+                isVisited[callee] = true;
+                calleeSum += HashValue(HASH_SEED, ownHashes[callee]);
+                PushIndex(&worklist, &worklistCount, callee);
+                PushIndex(&visited, &visitedCount, callee);
+            }
+        }
+
+        for(unsigned int v = 0; v < visitedCount; v++) isVisited[visited[v]] = false;
+        visitedCount = 0;
+
+        keys[n] = HashValue(HashValue(HashValue(optionHash, structHash), ownHashes[n]), calleeSum);
+    }
+
+    free(visited);
+    free(worklist);
+    free(isVisited);
+    free(ownHashes);
+    free(hashes);
+
+    return keys;
+}
+
+void GetCacheFileName(char *buffer, unsigned int size, const char *directory, unsigned long long key)
+{
+    snprintf(buffer, size, "%s/%016llx.bc", directory, key);
+}
+
+char *ReadSymbol(FILE *file)
+{
+    unsigned int length;
+    if(fscanf(file, " %u", &length) != 1 || length > CACHE_MAX_COUNT || fgetc(file) != ' ') return 0;
+
+    char *symbol = (char*)malloc(length + 1);
+
+    if(fread(symbol, 1, length, file) != length)
+    {
+        free(symbol);
+        return 0;
+    }
+
+    symbol[length] = 0;
+    return symbol;
+}
+
+bool IsRegisterOperand(int operand, unsigned int registerCount)
+{
+    return operand >= -1 && operand < (int)registerCount;
+}
+
+// the pool entries and frame bytes an instruction uses must lie inside its function
+bool IsValidCachedInst(BytecodeFunction *function, BytecodeInst *inst)
+{
+    switch(inst->opcode)
+    {
+        case BC_CALL:
+        case BC_SWITCH:
+        {
+            if(inst->pool < 0 || inst->extra < 0 || (unsigned int)inst->pool + (unsigned int)inst->extra > function->poolCount) return false;
+
+            // call arguments are registers, switch entries are pcs
+            unsigned int limit = (inst->opcode == BC_CALL) ? function->registerCount : function->codeCount;
+
+            for(int n = 0; n < inst->extra; n++)
+            {
+                Index entry = function->pool[inst->pool + n];
+                if(entry < 0 || (unsigned int)entry >= limit) return false;
+            }
+        } break;
+
+        case BC_FRAME_ADDR:
+            if(inst->imm < 0 || (unsigned int)inst->imm > function->frameSize) return false;
+            break;
+
+        case BC_LOAD_FRAME:
+        case BC_STORE_FRAME:
+            if(inst->imm < 0 || (unsigned int)inst->imm + inst->size > function->frameSize) return false;
+            break;
+
+        default: break;
+    }
+
+    return true;
+}
+
+// a file that does not match what was asked for in every detail is treated as a miss
+bool ReadCachedFunction(FILE *file, unsigned long long key, const char *name, CachedFunction *out)
+{
+    BytecodeFunction *function = &out->function;
+
+    unsigned int version;
+    unsigned long long fileKey;
+    if(fscanf(file, "bee-bytecode %u %llx", &version, &fileKey) != 2 || version != CACHE_FORMAT_VERSION || fileKey != key) return false;
+
+    char fileName[256];
+    if(fscanf(file, " function %255s", fileName) != 1 || strcmp(fileName, name)) return false;
+
+    if(fscanf(file, " shape %u %u %u %u %u %u %u", &function->registerCount, &function->parameterCount, &function->frameSize, &function->fusedCount,
+              &function->codeCount, &function->poolCount, &out->relocationCount) != 7)
+    {
+        return false;
+    }
+
+    if(function->codeCount > CACHE_MAX_COUNT || function->poolCount > CACHE_MAX_COUNT || out->relocationCount > CACHE_MAX_COUNT) return false;
+    if(function->parameterCount > function->registerCount) return false;
+
+    function->code = (BytecodeInst*)calloc(function->codeCount ? function->codeCount : 1, sizeof(BytecodeInst));
+    function->pool = (Index*)calloc(function->poolCount ? function->poolCount : 1, sizeof(Index));
+    out->relocations = (unsigned int*)calloc(out->relocationCount ? out->relocationCount : 1, sizeof(unsigned int));
+    out->symbols = (char**)calloc(out->relocationCount ? out->relocationCount : 1, sizeof(char*));
+
+    for(unsigned int n = 0; n < function->codeCount; n++)
+    {
+        BytecodeInst *inst = &function->code[n];
+        char opcode[32];
+        unsigned int size, isSigned;
+
+        if(fscanf(file, " %31s %u %u %d %d %d %d %d %d %d", opcode, &size, &isSigned, &inst->dest, &inst->left, &inst->right,
+                  &inst->imm, &inst->extra, &inst->pool, &inst->target) != 10)
+        {
+            return false;
+        }
+
+        inst->opcode = BytecodeOpcodeFromString(opcode);
+        inst->size = size;
+        inst->isSigned = isSigned;
+
+        if(!inst->opcode || size > 8) return false;
+        if(!IsRegisterOperand(inst->dest, function->registerCount) || !IsRegisterOperand(inst->left, function->registerCount)) return false;
+        if(!IsRegisterOperand(inst->right, function->registerCount) || inst->target < -1 || inst->target >= (int)function->codeCount) return false;
+    }
+
+    for(unsigned int n = 0; n < function->poolCount; n++)
+    {
+        if(fscanf(file, " %d", &function->pool[n]) != 1) return false;
+    }
+
+    for(unsigned int n = 0; n < function->codeCount; n++)
+    {
+        if(!IsValidCachedInst(function, &function->code[n])) return false;
+    }
+
+    for(unsigned int n = 0; n < out->relocationCount; n++)
+    {
+        if(fscanf(file, " reloc %u", &out->relocations[n]) != 1 || out->relocations[n] >= function->codeCount) return false;
+
+        unsigned int opcode = function->code[out->relocations[n]].opcode;
+        if(opcode != BC_CALL && opcode != BC_STRING) return false;
+
+        out->symbols[n] = ReadSymbol(file);
+        if(!out->symbols[n]) return false;
+    }
+
+    // every call and string must have been named, or its imm would point into some other module
+    unsigned int symbolCount = 0;
+    for(unsigned int n = 0; n < function->codeCount; n++) symbolCount += (function->code[n].opcode == BC_CALL || function->code[n].opcode == BC_STRING);
+    if(symbolCount != out->relocationCount) return false;
+
+    function->name = strdup(name);
+    return true;
+}
+
+CachedFunction CopyCachedFunction(CachedFunction *function)
+{
+    CachedFunction copy = *function;
+    BytecodeFunction *f = &copy.function;
+
+    f->name = strdup(function->function.name);
+    f->code = (BytecodeInst*)malloc(sizeof(BytecodeInst) * (f->codeCount ? f->codeCount : 1));
+    f->pool = (Index*)malloc(sizeof(Index) * (f->poolCount ? f->poolCount : 1));
+    if(f->codeCount > 0) memcpy(f->code, function->function.code, sizeof(BytecodeInst) * f->codeCount);
+    if(f->poolCount > 0) memcpy(f->pool, function->function.pool, sizeof(Index) * f->poolCount);
+
+    copy.relocations = (unsigned int*)malloc(sizeof(unsigned int) * (copy.relocationCount ? copy.relocationCount : 1));
+    copy.symbols = (char**)malloc(sizeof(char*) * (copy.relocationCount ? copy.relocationCount : 1));
+
+    for(unsigned int n = 0; n < copy.relocationCount; n++)
+    {
+        copy.relocations[n] = function->relocations[n];
+        copy.symbols[n] = strdup(function->symbols[n]);
+    }
+
+    return copy;
+}
+
+bool LoadMemoryFunction(unsigned long long key, const char *name, CachedFunction *function)
+{
+    char keyName[17];
+    snprintf(keyName, sizeof(keyName), "%016llx", key);
+
+    pthread_mutex_lock(&memoryCache.lock);
+
+    int index = LookupName(&memoryCache.keys, keyName, -1);
+    bool isFound = index != -1 && !strcmp(memoryCache.functions[index].function.name, name);
+    if(isFound) *function = CopyCachedFunction(&memoryCache.functions[index]);
+
+    pthread_mutex_unlock(&memoryCache.lock);
+    return isFound;
+}
+
+void KeepMemoryFunction(unsigned long long key, CachedFunction *function)
+{
+    char keyName[17];
+    snprintf(keyName, sizeof(keyName), "%016llx", key);
+
+    CachedFunction copy = CopyCachedFunction(function);
+
+    pthread_mutex_lock(&memoryCache.lock);
+
+    int index = LookupName(&memoryCache.keys, keyName, -1);
+
+    if(index != -1)
+    {
+        FreeCachedFunction(&memoryCache.functions[index]);
+        memoryCache.functions[index] = copy;
+    }
+    else
+    {
+        memoryCache.functionCount++;
+        memoryCache.functions = (CachedFunction*)realloc(memoryCache.functions, sizeof(CachedFunction) * memoryCache.functionCount);
+        memoryCache.keyNames = (char**)realloc(memoryCache.keyNames, sizeof(char*) * memoryCache.functionCount);
+        memoryCache.functions[memoryCache.functionCount - 1] = copy;
+        memoryCache.keyNames[memoryCache.functionCount - 1] = strdup(keyName);
+        InsertName(&memoryCache.keys, memoryCache.keyNames[memoryCache.functionCount - 1], memoryCache.functionCount - 1);
+    }
+
+    pthread_mutex_unlock(&memoryCache.lock);
+}
+
+// functions in memory are looked up first, the ones read from disk are kept there too
+bool LoadCachedFunction(const Options *options, unsigned long long key, const char *name, CachedFunction *function)
+{
+    if(options->cache.keepInMemory && LoadMemoryFunction(key, name, function)) return true;
+    if(!options->cache.directory) return false;
+
+    char path[1024];
+    GetCacheFileName(path, sizeof(path), options->cache.directory, key);
+
+    FILE *file = fopen(path, "rb");
+    if(!file) return false;
+
+    CachedFunction loaded = {0};
+    bool isLoaded = ReadCachedFunction(file, key, name, &loaded);
+    fclose(file);
+
+    if(!isLoaded)
+    {
+        if(options->printReport) printf("cache: '%s' ignored, not a valid entry for '%s'\n", path, name);
+        FreeCachedFunction(&loaded);
+        return false;
+    }
+
+    if(options->cache.keepInMemory) KeepMemoryFunction(key, &loaded);
+
+    *function = loaded;
+    return true;
+}
+
+// takes the function's code out of the module, callees and strings are named from the module's tables
+CachedFunction DetachFunction(BytecodeModule *module, unsigned int function)
+{
+    CachedFunction out = {0};
+    out.function = module->functions[function];
+    out.function.name = strdup(module->functions[function].name);
+
+    module->functions[function].code = 0;
+    module->functions[function].pool = 0;
+
+    for(unsigned int n = 0; n < out.function.codeCount; n++)
+    {
+        BytecodeInst *inst = &out.function.code[n];
+        if(inst->opcode != BC_CALL && inst->opcode != BC_STRING) continue;
+
+        const char *symbol = (inst->opcode == BC_CALL) ? module->functions[inst->imm].name : module->strings[inst->imm];
+
+        out.relocationCount++;
+        out.relocations = (unsigned int*)realloc(out.relocations, sizeof(unsigned int) * out.relocationCount);
+        out.symbols = (char**)realloc(out.symbols, sizeof(char*) * out.relocationCount);
+        out.relocations[out.relocationCount - 1] = n;
+        out.symbols[out.relocationCount - 1] = strdup(symbol);
+    }
+
+    return out;
+}
+
+// a unique file next to path, so writers in other processes and on other threads never share one
+FILE *CreateTemporaryFile(const char *path, char *temporaryPath, unsigned int size)
+{
+    snprintf(temporaryPath, size, "%s.XXXXXX", path);
+
+    int descriptor = mkstemp(temporaryPath);
+    if(descriptor == -1) return 0;
+
+    // mkstemp leaves the file private, cache files are as readable as the directory
+    fchmod(descriptor, 0644);
+
+    FILE *file = fdopen(descriptor, "wb");
+    if(!file)
+    {
+        close(descriptor);
+        remove(temporaryPath);
+    }
+
+    return file;
+}
+
+// written under a temporary name and renamed, so concurrent builds never read half a file
+void StoreCachedFunction(const Options *options, unsigned long long key, CachedFunction *function)
+{
+    if(options->cache.keepInMemory) KeepMemoryFunction(key, function);
+    if(!options->cache.directory) return;
+
+    BytecodeFunction *f = &function->function;
+
+    char path[1024];
+    char temporaryPath[1100];
+    GetCacheFileName(path, sizeof(path), options->cache.directory, key);
+
+    mkdir(options->cache.directory, 0755);
+
+    FILE *file = CreateTemporaryFile(path, temporaryPath, sizeof(temporaryPath));
+    if(!file)
+    {
+        if(options->printReport) printf("cache: cannot write '%s'\n", path);
+        return;
+    }
+
+    fprintf(file, "bee-bytecode %u %016llx\n", CACHE_FORMAT_VERSION, key);
+    fprintf(file, "function %s\n", f->name);
+    fprintf(file, "shape %u %u %u %u %u %u %u\n", f->registerCount, f->parameterCount, f->frameSize, f->fusedCount, f->codeCount, f->poolCount, function->relocationCount);
+
+    for(unsigned int n = 0; n < f->codeCount; n++)
+    {
+        BytecodeInst *inst = &f->code[n];
+        fprintf(file, "%s %u %u %d %d %d %d %d %d %d\n", BytecodeOpcodeToString(inst->opcode), inst->size, inst->isSigned, inst->dest, inst->left, inst->right,
+                inst->imm, inst->extra, inst->pool, inst->target);
+    }
+
+    for(unsigned int n = 0; n < f->poolCount; n++) fprintf(file, "%d\n", f->pool[n]);
+
+    for(unsigned int n = 0; n < function->relocationCount; n++)
+    {
+        fprintf(file, "reloc %u %u ", function->relocations[n], (unsigned int)strlen(function->symbols[n]));
+        fputs(function->symbols[n], file);
+        fputc('\n', file);
+    }
+
+    bool isWritten = !ferror(file);
+    if(fclose(file) != 0) isWritten = false;
+
+    if(!isWritten || rename(temporaryPath, path) != 0)
+    {
+        if(options->printReport) printf("cache: cannot write '%s'\n", path);
+        remove(temporaryPath);
+    }
+}
+
+// copies the code into a module of its own and resolves every relocation against it
+BytecodeModule LinkCachedFunctions(CachedFunction *functions, unsigned int functionCount)
+{
+    BytecodeModule module = {0};
+    module.functionCount = functionCount;
+    module.functions = (BytecodeFunction*)calloc(functionCount ? functionCount : 1, sizeof(BytecodeFunction));
+
+    NameTable names = {0};
+    for(unsigned int n = 0; n < functionCount; n++) InsertName(&names, functions[n].function.name, n);
+
+    for(unsigned int n = 0; n < functionCount; n++)
+    {
+        BytecodeFunction *out = &module.functions[n];
+        *out = functions[n].function;
+
+        out->code = (BytecodeInst*)malloc(sizeof(BytecodeInst) * (out->codeCount ? out->codeCount : 1));
+        out->pool = (Index*)malloc(sizeof(Index) * (out->poolCount ? out->poolCount : 1));
+        if(out->codeCount > 0) memcpy(out->code, functions[n].function.code, sizeof(BytecodeInst) * out->codeCount);
+        if(out->poolCount > 0) memcpy(out->pool, functions[n].function.pool, sizeof(Index) * out->poolCount);
+
+        for(unsigned int r = 0; r < functions[n].relocationCount; r++)
+        {
+            BytecodeInst *inst = &out->code[functions[n].relocations[r]];
+            const char *symbol = functions[n].symbols[r];
+
+            if(inst->opcode == BC_STRING)
+            {
+                inst->imm = AddString(&module, symbol);
+                continue;
+            }
+
+            int callee = LookupName(&names, symbol, -1);
+
+            if(callee == -1)
+            {
+                CompileError("cache error: '%s' calls '%s', which is not in the program", out->name, symbol);
+            }
+
+            // the arguments are copied into the callee's first registers
+            if(inst->extra != (int)functions[callee].function.parameterCount)
+            {
+                CompileError("cache error: '%s' calls '%s' with %d arguments, it takes %u", out->name, symbol, inst->extra, functions[callee].function.parameterCount);
+            }
+
+            inst->imm = callee;
+        }
+    }
+
+    FreeNameTable(&names);
+    return module;
+}
+
+void FreeCachedFunction(CachedFunction *function)
+{
+    for(unsigned int n = 0; n < function->relocationCount && function->symbols; n++) free(function->symbols[n]);
+
+    free(function->symbols);
+    free(function->relocations);
+    free(function->function.code);
+    free(function->function.pool);
+    free((char*)function->function.name);
+}
+
+void FreeMemoryCache(void)
+{
+    for(unsigned int n = 0; n < memoryCache.functionCount; n++)
+    {
+        FreeCachedFunction(&memoryCache.functions[n]);
+        free(memoryCache.keyNames[n]);
+    }
+
+    free(memoryCache.functions);
+    free(memoryCache.keyNames);
+    FreeNameTable(&memoryCache.keys);
+
+    memoryCache.functions = 0;
+    memoryCache.keyNames = 0;
+    memoryCache.functionCount = 0;
+}
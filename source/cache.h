@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "callgraph.h"
+#include "bytecode.h"
+
+// names the compiler that wrote a cache entry, a rebuilt compiler may generate different bytecode
+#ifndef BEE_BUILD_ID
+#define BEE_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+// bytecode of one function with its calls and strings named instead of numbered,
+// so it links into any module. owns every string it points to
+typedef struct {
+    BytecodeFunction function;
+
+    unsigned int *relocations;  // instructions whose imm is a callee or a string
+    char **symbols;             // callee name or string literal, per relocation
+    unsigned int relocationCount;
+} CachedFunction;
+
+unsigned long long *ComputeFunctionKeys(AST *ast, Index program, CallGraph *graph, unsigned long long optionHash);
+bool LoadCachedFunction(const Options *options, unsigned long long key, const char *name, CachedFunction *function);
+CachedFunction DetachFunction(BytecodeModule *module, unsigned int function);
+void StoreCachedFunction(const Options *options, unsigned long long key, CachedFunction *function);
+BytecodeModule LinkCachedFunctions(CachedFunction *functions, unsigned int functionCount);
+void FreeCachedFunction(CachedFunction *function);
+void FreeMemoryCache(void);
+FILE *CreateTemporaryFile(const char *path, char *temporaryPath, unsigned int size);
+
+#endif //CACHE_H
@@ -0,0 +1,200 @@
+#include "callgraph.h"
+
+typedef struct {
+    CallGraph *graph;
+    Index node;
+} CallSiteCollector;
+
+void CollectCallSite(AST *ast, Index index, void *data)
+{
+    Node *node = &ast->nodeList[index];
+    if(node->type != NODE_FUNC_CALL) return;
+
+    CallSiteCollector *collector = (CallSiteCollector*)data;
+    CallGraphNode *caller = &collector->graph->nodes[collector->node];
+
+    // builtins like print have no definition and no call graph node
+    int callee = LookupName(&collector->graph->functions, node->functionCall.id, -1);
+    if(callee != -1) PushIndex(&caller->callees, &caller->calleeCount, callee);
+}
+
+CallGraph BuildCallGraph(AST *ast, Index program)
+{
+    CallGraph graph = {0};
+    Node *node = &ast->nodeList[program];
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        Node *defNode = &ast->nodeList[def];
+
+        if(defNode->type == NODE_FUNC_DEF)
+        {
+            CallGraphNode graphNode = {0};
+            graphNode.definition = def;
+
+            graph.nodeCount++;
+            graph.nodes = (CallGraphNode*)realloc(graph.nodes, sizeof(CallGraphNode) * graph.nodeCount);
+            graph.nodes[graph.nodeCount - 1] = graphNode;
+
+            InsertName(&graph.functions, defNode->functionDef.name, graph.nodeCount - 1);
+        }
+        else if(defNode->type == NODE_STRUCT_DEF)
+        {
+            InsertName(&graph.structs, defNode->structDef.name, def);
+        }
+    }
+
+    for(unsigned int n = 0; n < graph.nodeCount; n++)
+    {
+        CallSiteCollector collector = {.graph = &graph, .node = n};
+        VisitNodes(ast, graph.nodes[n].definition, CollectCallSite, &collector);
+    }
+
+    return graph;
+}
+
+void FreeCallGraph(CallGraph *graph)
+{
+    for(unsigned int n = 0; n < graph->nodeCount; n++) free(graph->nodes[n].callees);
+
+    free(graph->nodes);
+    FreeNameTable(&graph->functions);
+    FreeNameTable(&graph->structs);
+
+    graph->nodes = 0;
+    graph->nodeCount = 0;
+}
+
+// worklist instead of recursion, call chains in generated code can be very deep
+void MarkReachableFunctions(CallGraph *graph, Index node)
+{
+    Index *worklist = 0;
+    unsigned int worklistCount = 0;
+
+    graph->nodes[node].isReachable = true;
+    PushIndex(&worklist, &worklistCount, node);
+
+    while(worklistCount > 0)
+    {
+        CallGraphNode *caller = &graph->nodes[worklist[--worklistCount]];
+
+        for(unsigned int n = 0; n < caller->calleeCount; n++)
+        {
+            CallGraphNode *callee = &graph->nodes[caller->callees[n]];
+            if(callee->isReachable) continue;
+
+            callee->isReachable = true;
+            PushIndex(&worklist, &worklistCount, caller->callees[n]);
+        }
+    }
+
+    free(worklist);
+}
+
+typedef struct {
+    CallGraph *graph;
+    bool *isStructUsed;
+    Index *worklist;
+    unsigned int worklistCount;
+} StructUseCollector;
+
+void CollectStructUse(AST *ast, Index index, void *data)
+{
+    Node *node = &ast->nodeList[index];
+    if(node->type != NODE_TYPE_ANNOTATION) return;
+
+    StructUseCollector *collector = (StructUseCollector*)data;
+
+    int def = LookupName(&collector->graph->structs, node->typeAnnotation.id, -1);
+    if(def == -1 || collector->isStructUsed[def]) return;
+
+    collector->isStructUsed[def] = true;
+    PushIndex(&collector->worklist, &collector->worklistCount, def);
+}
+
+// drops functions not reachable from entry and structs not used by any reachable function
+bool EliminateDeadDefinitions(AST *ast, Index program, const char *entry, bool printStats)
+{
+    CallGraph graph = BuildCallGraph(ast, program);
+
+    int entryNode = LookupName(&graph.functions, entry, -1);
+    if(entryNode == -1)
+    {
+        if(printStats) printf("dead definition elimination: entry function '%s' not found, nothing dropped\n", entry);
+        FreeCallGraph(&graph);
+        return false;
+    }
+
+    MarkReachableFunctions(&graph, entryNode);
+
+    StructUseCollector collector = {0};
+    collector.graph = &graph;
+    collector.isStructUsed = (bool*)calloc(ast->nodeCount, sizeof(bool));
+
+    for(unsigned int n = 0; n < graph.nodeCount; n++)
+    {
+        if(graph.nodes[n].isReachable) VisitNodes(ast, graph.nodes[n].definition, CollectStructUse, &collector);
+    }
+
+    // fields pull in the structs they contain
+    while(collector.worklistCount > 0)
+    {
+        Index def = collector.worklist[--collector.worklistCount];
+        VisitNodes(ast, def, CollectStructUse, &collector);
+    }
+
+    Node *node = &ast->nodeList[program];
+
+    Index *definitions = 0;
+    unsigned int defCount = 0;
+    DeadDefinitionStats stats = {0};
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        Node *defNode = &ast->nodeList[def];
+        bool keep = true;
+
+        if(defNode->type == NODE_FUNC_DEF)
+        {
+            // call graph nodes were created in definition order
+            keep = graph.nodes[stats.functionCount++].isReachable;
+
+            if(!keep)
+            {
+                stats.droppedFunctionCount++;
+                if(printStats) printf("  dropped fn '%s'\n", defNode->functionDef.name);
+            }
+        }
+        else if(defNode->type == NODE_STRUCT_DEF)
+        {
+            stats.structCount++;
+            keep = collector.isStructUsed[def];
+
+            if(!keep)
+            {
+                stats.droppedStructCount++;
+                if(printStats) printf("  dropped struct '%s'\n", defNode->structDef.name);
+            }
+        }
+
+        if(keep) PushIndex(&definitions, &defCount, def);
+    }
+
+    free(node->program.definitions);
+    node->program.definitions = definitions;
+    node->program.defCount = defCount;
+
+    if(printStats)
+    {
+        printf("dead definition elimination (entry '%s'): dropped %u of %u functions, %u of %u structs\n",
+               entry, stats.droppedFunctionCount, stats.functionCount, stats.droppedStructCount, stats.structCount);
+    }
+
+    free(collector.isStructUsed);
+    free(collector.worklist);
+    FreeCallGraph(&graph);
+
+    return (stats.droppedFunctionCount + stats.droppedStructCount) > 0;
+}
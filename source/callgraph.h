@@ -0,0 +1,33 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include "ast.h"
+#include "symbol.h"
+
+typedef struct {
+    Index definition;       // NODE_FUNC_DEF
+    Index *callees;         // call graph nodes called from the body, one entry per call site
+    unsigned int calleeCount;
+    bool isReachable;
+} CallGraphNode;
+
+typedef struct {
+    CallGraphNode *nodes;
+    unsigned int nodeCount;
+    NameTable functions;    // function name -> call graph node
+    NameTable structs;      // struct name -> definition
+} CallGraph;
+
+typedef struct {
+    unsigned int functionCount;
+    unsigned int structCount;
+    unsigned int droppedFunctionCount;
+    unsigned int droppedStructCount;
+} DeadDefinitionStats;
+
+CallGraph BuildCallGraph(AST *ast, Index program);
+void FreeCallGraph(CallGraph *graph);
+void MarkReachableFunctions(CallGraph *graph, Index node);
+bool EliminateDeadDefinitions(AST *ast, Index program, const char *entry, bool printStats);
+
+#endif //CALLGRAPH_H
@@ -0,0 +1,1199 @@
+#include <stdarg.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "cgen.h"
+#include "layout.h"
+
+typedef struct {
+    const char *name;
+    const char *cName;
+    IRType type;
+} CLocal;
+
+typedef struct {
+    AST *ast;
+    Index program;
+    const Options *options;
+    FILE *out;
+    unsigned int indent;
+    unsigned int lineCount;
+
+    CLocal *locals;             // visible variables, innermost last
+    unsigned int localCount;
+    const char **cNames;        // every name declared in the current function
+    unsigned int cNameCount;
+    char **strings;             // names made up by the generator, freed at the end
+    unsigned int stringCount;
+
+    const char *functionName;
+    Index function;
+
+    unsigned char *structState; // per struct definition node, 1 while its fields are emitted, 2 once done
+    bool *isPointerField;       // per field node, a struct reached again while its own fields are emitted is held by pointer
+    IRModule layout;            // structs laid out like the vm lays them out, only lowered when fields are reordered
+} CGen;
+
+// everything the runtime shim, the c keywords and the headers it includes claim
+static const char *cReservedNames[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern",
+    "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short", "signed",
+    "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while",
+    "bool", "true", "false", "main", "NULL", "exit", "malloc", "memcpy", "memset", "printf", "strcat", "strcpy", "strlen",
+    "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t", "uint32_t", "uint64_t", "intptr_t",
+};
+
+static const char *cRuntime =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "static int bee2_print_int(long long value)\n"
+    "{\n"
+    "    printf(\"%lld\\n\", value);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static int bee2_print_str(const char *value)\n"
+    "{\n"
+    "    printf(\"%s\\n\", value);\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static const char *bee2_concat(const char *left, const char *right)\n"
+    "{\n"
+    "    char *string = (char*)malloc(strlen(left) + strlen(right) + 1);\n"
+    "    strcpy(string, left);\n"
+    "    strcat(string, right);\n"
+    "    return string;\n"
+    "}\n"
+    "\n"
+    "static long long bee2_check(long long index, long long dim, const char *name)\n"
+    "{\n"
+    "    if(index < 0 || index >= dim)\n"
+    "    {\n"
+    "        printf(\"error: index %lld out of bounds for '%s' [%lld]\\n\", index, name, dim);\n"
+    "        exit(1);\n"
+    "    }\n"
+    "\n"
+    "    return index;\n"
+    "}\n"
+    "\n";
+
+void CGenError(CGen *gen, const char *message, const char *name)
+{
+    if(gen->functionName) CompileError("error: c backend: function '%s': %s '%s'", gen->functionName, message, name);
+    else CompileError("error: c backend: %s '%s'", message, name);
+}
+
+void EmitC(CGen *gen, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(0, 0, format, args);
+    va_end(args);
+
+    char *text = (char*)malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+
+    fputs(text, gen->out);
+    for(char *c = text; *c; c++) if(*c == '\n') gen->lineCount++;
+
+    free(text);
+}
+
+void EmitCIndent(CGen *gen)
+{
+    for(unsigned int n = 0; n < gen->indent; n++) EmitC(gen, "    ");
+}
+
+const char *KeepCString(CGen *gen, char *string)
+{
+    gen->stringCount++;
+    gen->strings = (char**)realloc(gen->strings, sizeof(char*) * gen->stringCount);
+    gen->strings[gen->stringCount - 1] = string;
+
+    return string;
+}
+
+// user functions are emitted as bee_<name>, renamed variables and types and the runtime shim use bee0_, bee1_ and bee2_
+bool IsCReservedName(const char *name)
+{
+    if(!strncmp(name, "bee", 3) && (name[3] == '_' || (name[3] >= '0' && name[3] <= '9'))) return true;
+
+    for(unsigned int n = 0; n < sizeof(cReservedNames) / sizeof(cReservedNames[0]); n++)
+    {
+        if(!strcmp(cReservedNames[n], name)) return true;
+    }
+
+    return false;
+}
+
+// struct and field names only have to stay clear of what c reserves
+const char *CSafeName(CGen *gen, const char *name)
+{
+    if(!IsCReservedName(name)) return name;
+
+    char *safe = (char*)malloc(strlen(name) + 6);
+    sprintf(safe, "bee1_%s", name);
+    return KeepCString(gen, safe);
+}
+
+bool IsCNameTaken(CGen *gen, const char *name)
+{
+    if(FindDefinition(gen->ast, gen->program, NODE_STRUCT_DEF, name) != IR_NONE) return true;
+
+    for(unsigned int n = 0; n < gen->cNameCount; n++)
+    {
+        if(!strcmp(gen->cNames[n], name)) return true;
+    }
+
+    return false;
+}
+
+// every variable of a function gets a name of its own, so bee shadowing never meets c scoping
+const char *NewCName(CGen *gen, const char *name)
+{
+    const char *base = name;
+
+    // only the bee name can be reserved, what it is renamed to never is
+    if(IsCReservedName(name))
+    {
+        char *renamed = (char*)malloc(strlen(name) + 6);
+        sprintf(renamed, "bee0_%s", name);
+        base = KeepCString(gen, renamed);
+    }
+
+    const char *cName = base;
+
+    for(unsigned int suffix = 1; IsCNameTaken(gen, cName); suffix++)
+    {
+        char *candidate = (char*)malloc(strlen(base) + 16);
+        sprintf(candidate, "%s_%u", base, suffix);
+        cName = KeepCString(gen, candidate);
+    }
+
+    gen->cNameCount++;
+    gen->cNames = (const char**)realloc(gen->cNames, sizeof(const char*) * gen->cNameCount);
+    gen->cNames[gen->cNameCount - 1] = cName;
+
+    return cName;
+}
+
+void PushCLocal(CGen *gen, const char *name, const char *cName, IRType type)
+{
+    gen->localCount++;
+    gen->locals = (CLocal*)realloc(gen->locals, sizeof(CLocal) * gen->localCount);
+    gen->locals[gen->localCount - 1] = (CLocal){name, cName, type};
+}
+
+CLocal *FindCLocal(CGen *gen, const char *name)
+{
+    for(int n = gen->localCount - 1; n >= 0; n--)
+    {
+        if(!strcmp(gen->locals[n].name, name)) return &gen->locals[n];
+    }
+
+    return 0;
+}
+
+bool IsCStruct(CGen *gen, IRType type)
+{
+    return type.id && FindDefinition(gen->ast, gen->program, NODE_STRUCT_DEF, type.id) != IR_NONE;
+}
+
+bool IsCAggregate(CGen *gen, IRType type)
+{
+    return type.isArrayType || IsCStruct(gen, type);
+}
+
+bool IsCString(IRType type)
+{
+    return !type.isArrayType && type.id && !strcmp(type.id, "str");
+}
+
+// scalars keep the size and signedness the vm gives them, names nothing declares are pointer sized
+const char *CScalarTypeName(const char *id)
+{
+    if(!strcmp(id, "int")) return "int";
+    if(!strcmp(id, "str")) return "const char*";
+    if(!strcmp(id, "i32")) return "int32_t";
+    if(!strcmp(id, "u32")) return "uint32_t";
+    if(!strcmp(id, "i16")) return "int16_t";
+    if(!strcmp(id, "u16")) return "uint16_t";
+    if(!strcmp(id, "char") || !strcmp(id, "i8")) return "int8_t";
+    if(!strcmp(id, "bool") || !strcmp(id, "u8")) return "uint8_t";
+
+    return id[0] == 'u' ? "uint64_t" : "int64_t";
+}
+
+const char *CTypeName(CGen *gen, IRType type)
+{
+    if(IsCStruct(gen, type)) return CSafeName(gen, type.id);
+    return CScalarTypeName(type.id);
+}
+
+void EmitCDeclaration(CGen *gen, IRType type, const char *name, bool isPointer)
+{
+    EmitC(gen, "%s %s%s", CTypeName(gen, type), isPointer ? "*" : "", name);
+    if(type.isArrayType) EmitC(gen, "[%u]", type.arrayDim);
+}
+
+bool IsCZero(CGen *gen, Index expr)
+{
+    Node *node = &gen->ast->nodeList[expr];
+    return node->type == NODE_INTEGER_CONSTANT && node->integer.value == 0;
+}
+
+Index FindCField(CGen *gen, Index structDef, const char *name)
+{
+    Node *def = &gen->ast->nodeList[structDef];
+
+    for(unsigned int f = 0; f < def->structDef.fieldCount; f++)
+    {
+        Node *field = &gen->ast->nodeList[def->structDef.fields[f]];
+        if(!strcmp(gen->ast->nodeList[field->field.id].identifier.value, name)) return def->structDef.fields[f];
+    }
+
+    return IR_NONE;
+}
+
+// fields in the order of their offsets, c then places them where the vm does. fixed structs keep their declaration order
+unsigned int *GetCFieldOrder(CGen *gen, Index structDef)
+{
+    Node *node = &gen->ast->nodeList[structDef];
+    unsigned int *order = (unsigned int*)malloc(sizeof(unsigned int) * (node->structDef.fieldCount ? node->structDef.fieldCount : 1));
+    IRStruct *s = gen->layout.structCount ? FindStruct(&gen->layout, node->structDef.name) : 0;
+
+    for(unsigned int f = 0; f < node->structDef.fieldCount; f++)
+    {
+        unsigned int m = f;
+
+        while(s && m > 0 && s->fields[f].offset < s->fields[order[m - 1]].offset)
+        {
+            order[m] = order[m - 1];
+            m--;
+        }
+
+        order[m] = f;
+    }
+
+    return order;
+}
+
+// contained structs are emitted first, so every by value field has a complete type
+void EmitCStruct(CGen *gen, Index structDef)
+{
+    AST *ast = gen->ast;
+    gen->structState[structDef] = 1;
+
+    for(unsigned int f = 0; f < ast->nodeList[structDef].structDef.fieldCount; f++)
+    {
+        Index field = ast->nodeList[structDef].structDef.fields[f];
+        IRType type = GetAnnotationType(ast, ast->nodeList[field].field.type);
+
+        Index contained = FindDefinition(ast, gen->program, NODE_STRUCT_DEF, type.id);
+        if(contained == IR_NONE) continue;
+
+        if(gen->structState[contained] == 1) gen->isPointerField[field] = true;
+        else if(gen->structState[contained] == 0) EmitCStruct(gen, contained);
+    }
+
+    Node *node = &ast->nodeList[structDef];
+    EmitC(gen, "struct %s\n{\n", CSafeName(gen, node->structDef.name));
+
+    unsigned int *order = GetCFieldOrder(gen, structDef);
+
+    for(unsigned int f = 0; f < node->structDef.fieldCount; f++)
+    {
+        Index field = node->structDef.fields[order[f]];
+        IRType type = GetAnnotationType(ast, ast->nodeList[field].field.type);
+
+        EmitC(gen, "    ");
+        EmitCDeclaration(gen, type, CSafeName(gen, ast->nodeList[ast->nodeList[field].field.id].identifier.value), gen->isPointerField[field]);
+        EmitC(gen, ";\n");
+    }
+
+    // iso c has no empty structs
+    if(node->structDef.fieldCount == 0) EmitC(gen, "    char unused;\n");
+
+    free(order);
+
+    EmitC(gen, "};\n\n");
+    gen->structState[structDef] = 2;
+}
+
+void EmitCExpression(CGen *gen, Index expr);
+void EmitCExpressionIn(CGen *gen, Index expr, bool isAlone);
+
+void EmitCIndex(CGen *gen, Index expr, unsigned int arrayDim, const char *name)
+{
+    if(!gen->options->bounds.insertChecks)
+    {
+        EmitCExpressionIn(gen, expr, true);
+        return;
+    }
+
+    EmitC(gen, "bee2_check(");
+    EmitCExpressionIn(gen, expr, true);
+    EmitC(gen, ", %u, \"%s\")", arrayDim, name);
+}
+
+// follows an l value chain like 'a.b[n].c', emitting it when asked, and tells if the end of it is held by pointer
+IRType WalkCLValue(CGen *gen, Index lValue, bool emit, bool *isReference)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[lValue];
+
+    IRType type = {0};
+    bool isPointer = false;
+
+    for(unsigned int n = 0; n < node->lValue.simpleLValueCount; n++)
+    {
+        Node *simple = &ast->nodeList[node->lValue.simpleLValues[n]];
+        bool isArrayAccess = (simple->type == NODE_ARRAY_ACCESS);
+        const char *name = isArrayAccess ? ast->nodeList[simple->arrayAccess.id].identifier.value : simple->identifier.value;
+
+        if(n == 0)
+        {
+            CLocal *local = FindCLocal(gen, name);
+            if(!local) CGenError(gen, "use of undeclared variable", name);
+
+            type = local->type;
+            if(emit) EmitC(gen, "%s", local->cName);
+        }
+        else
+        {
+            if(type.isArrayType) CGenError(gen, "member access on array", name);
+
+            Index structDef = FindDefinition(ast, gen->program, NODE_STRUCT_DEF, type.id);
+            if(structDef == IR_NONE) CGenError(gen, "member access on non struct type", type.id);
+
+            Index field = FindCField(gen, structDef, name);
+            if(field == IR_NONE) CGenError(gen, "no such struct field", name);
+
+            if(emit) EmitC(gen, "%s%s", isPointer ? "->" : ".", CSafeName(gen, name));
+
+            type = GetAnnotationType(ast, ast->nodeList[field].field.type);
+            isPointer = gen->isPointerField[field];
+        }
+
+        if(isArrayAccess)
+        {
+            if(!type.isArrayType) CGenError(gen, "indexing a value that is not an array of", type.id);
+
+            if(emit)
+            {
+                EmitC(gen, "[");
+                EmitCIndex(gen, simple->arrayAccess.expr, type.arrayDim, name);
+                EmitC(gen, "]");
+            }
+
+            type.isArrayType = false;
+            type.arrayDim = 0;
+        }
+    }
+
+    *isReference = isPointer;
+    return type;
+}
+
+IRType EmitCLValue(CGen *gen, Index lValue)
+{
+    bool isReference;
+    IRType type = WalkCLValue(gen, lValue, false, &isReference);
+
+    if(isReference) EmitC(gen, "(*");
+    WalkCLValue(gen, lValue, true, &isReference);
+    if(isReference) EmitC(gen, ")");
+
+    return type;
+}
+
+// a bare name nothing declared, lowering reads it as undefined
+bool IsUndeclaredCRead(CGen *gen, Index lValue)
+{
+    Node *node = &gen->ast->nodeList[lValue];
+    Node *first = &gen->ast->nodeList[node->lValue.simpleLValues[0]];
+
+    return node->lValue.simpleLValueCount == 1 && first->type == NODE_IDENTIFIER && !FindCLocal(gen, first->identifier.value);
+}
+
+IRType CExpressionType(CGen *gen, Index expr)
+{
+    Node *node = &gen->ast->nodeList[expr];
+
+    IRType type = {0};
+    type.id = "int";
+
+    switch(node->type)
+    {
+        case NODE_STRING_CONSTANT:
+        {
+            type.id = "str";
+        }
+        break;
+
+        case NODE_L_VALUE:
+        {
+            bool isReference;
+            if(!IsUndeclaredCRead(gen, expr)) type = WalkCLValue(gen, expr, false, &isReference);
+        }
+        break;
+
+        case NODE_FUNC_CALL:
+        {
+            Index callee = FindDefinition(gen->ast, gen->program, NODE_FUNC_DEF, node->functionCall.id);
+            if(callee != IR_NONE && gen->ast->nodeList[callee].functionDef.isReturnTypeDeclared)
+            {
+                type = GetAnnotationType(gen->ast, gen->ast->nodeList[callee].functionDef.returnType);
+            }
+        }
+        break;
+
+        case NODE_OPERATOR:
+        {
+            unsigned int opType = node->operator.opType;
+
+            if(opType == ARITHMETIC_OP_ADD && IsCString(CExpressionType(gen, node->operator.right))) type.id = "str";
+            else if(opType >= ARITHMETIC_OP_ADD && opType <= ARITHMETIC_OP_MOD) type = CExpressionType(gen, node->operator.left);
+        }
+        break;
+    }
+
+    return type;
+}
+
+void EmitCConverted(CGen *gen, Index expr, IRType target);
+
+// a string anywhere else than a concatenation takes part as its address
+void EmitCOperand(CGen *gen, Index expr, bool isAlone)
+{
+    bool isCast = IsCString(CExpressionType(gen, expr));
+    if(isCast) EmitC(gen, "(intptr_t)");
+    EmitCExpressionIn(gen, expr, isAlone && !isCast);
+}
+
+const char *COperatorToString(unsigned int opType)
+{
+    switch(opType)
+    {
+        case ARITHMETIC_OP_ADD:     return "+";
+        case ARITHMETIC_OP_SUB:     return "-";
+        case ARITHMETIC_OP_MUL:     return "*";
+        case ARITHMETIC_OP_DIV:     return "/";
+        case ARITHMETIC_OP_MOD:     return "%";
+        case COMPARE_OP_LT:         return "<";
+        case COMPARE_OP_GT:         return ">";
+        case COMPARE_OP_EQ_EQ:      return "==";
+        case COMPARE_OP_NOT_EQ:     return "!=";
+        case COMPARE_OP_LT_EQ:      return "<=";
+        case COMPARE_OP_GT_EQ:      return ">=";
+        case BOOL_OP_AND:           return "&&";
+        case BOOL_OP_OR:            return "||";
+        default:                    return 0;
+    }
+}
+
+void EmitCStringLiteral(CGen *gen, const char *value)
+{
+    EmitC(gen, "\"");
+
+    for(const unsigned char *c = (const unsigned char*)value; *c; c++)
+    {
+        if(*c == '\\' || *c == '"') EmitC(gen, "\\%c", *c);
+        else if(*c == '\n') EmitC(gen, "\\n");
+        else if(*c == '\t') EmitC(gen, "\\t");
+        else if(isprint(*c)) EmitC(gen, "%c", *c);
+        else EmitC(gen, "\\%03o", *c);
+    }
+
+    EmitC(gen, "\"");
+}
+
+void EmitCCall(CGen *gen, Index expr)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[expr];
+    const char *name = node->functionCall.id;
+
+    if(!strcmp(name, "print"))
+    {
+        if(node->functionCall.argumentCount != 1) CGenError(gen, "wrong number of arguments to", name);
+
+        Index argument = node->functionCall.arguments[0];
+        EmitC(gen, IsCString(CExpressionType(gen, argument)) ? "bee2_print_str(" : "bee2_print_int(");
+        EmitCExpressionIn(gen, argument, true);
+        EmitC(gen, ")");
+        return;
+    }
+
+    Index callee = FindDefinition(ast, gen->program, NODE_FUNC_DEF, name);
+    if(callee == IR_NONE) CGenError(gen, "call to unknown function", name);
+    if(ast->nodeList[callee].functionDef.parameterCount != node->functionCall.argumentCount) CGenError(gen, "wrong number of arguments to", name);
+
+    EmitC(gen, "bee_%s(", name);
+
+    for(unsigned int n = 0; n < node->functionCall.argumentCount; n++)
+    {
+        Index param = ast->nodeList[callee].functionDef.parameters[n];
+        IRType type = GetAnnotationType(ast, ast->nodeList[param].param.type);
+
+        if(n > 0) EmitC(gen, ", ");
+        EmitCConverted(gen, node->functionCall.arguments[n], type);
+    }
+
+    EmitC(gen, ")");
+}
+
+// operators are parenthesized unless they stand alone, like a whole condition or right hand side
+void EmitCExpressionIn(CGen *gen, Index expr, bool isAlone)
+{
+    Node *node = &gen->ast->nodeList[expr];
+
+    switch(node->type)
+    {
+        case NODE_INTEGER_CONSTANT:
+        {
+            // a plain -2147483648 would be a long, and everything around it would no longer wrap at 32 bits
+            if(node->integer.value == INT_MIN) EmitC(gen, "(-2147483647 - 1)");
+            else EmitC(gen, "%d", node->integer.value);
+        }
+        break;
+
+        case NODE_STRING_CONSTANT:
+        {
+            EmitCStringLiteral(gen, node->string.value);
+        }
+        break;
+
+        case NODE_L_VALUE:
+        {
+            if(IsUndeclaredCRead(gen, expr))
+            {
+                const char *name = gen->ast->nodeList[node->lValue.simpleLValues[0]].identifier.value;
+
+                if(!node->lValue.isReported)
+                {
+                    ReportDiagnostic("warning: function '%s': use of undeclared variable '%s'", gen->functionName, name);
+                    node->lValue.isReported = true;
+                }
+
+                EmitC(gen, "0");
+            }
+            else
+            {
+                EmitCLValue(gen, expr);
+            }
+        }
+        break;
+
+        case NODE_FUNC_CALL:
+        {
+            EmitCCall(gen, expr);
+        }
+        break;
+
+        case NODE_OPERATOR:
+        {
+            Index left = node->operator.left;
+            Index right = node->operator.right;
+            IRType stringType = {.id = "str"};
+
+            if(node->operator.opType == BOOL_OP_NOT)
+            {
+                EmitC(gen, "(!");
+                EmitCOperand(gen, left, false);
+                EmitC(gen, ")");
+            }
+            else if(IsCString(CExpressionType(gen, expr)))
+            {
+                EmitC(gen, "bee2_concat(");
+                EmitCConverted(gen, left, stringType);
+                EmitC(gen, ", ");
+                EmitCConverted(gen, right, stringType);
+                EmitC(gen, ")");
+            }
+            else
+            {
+                if(!isAlone) EmitC(gen, "(");
+                EmitCOperand(gen, left, false);
+                EmitC(gen, " %s ", COperatorToString(node->operator.opType));
+                EmitCOperand(gen, right, false);
+                if(!isAlone) EmitC(gen, ")");
+            }
+        }
+        break;
+
+        default:
+        {
+            CompileError("error: c backend: function '%s': unexpected node in expression (type %u)", gen->functionName, node->type);
+        }
+    }
+}
+
+void EmitCExpression(CGen *gen, Index expr)
+{
+    EmitCExpressionIn(gen, expr, false);
+}
+
+// the value of expr as a target type, aggregates must already be one and arrays decay to their address, strings and numbers convert through their address
+void EmitCConverted(CGen *gen, Index expr, IRType target)
+{
+    if(IsCAggregate(gen, target))
+    {
+        if(IsCZero(gen, expr) && !target.isArrayType)
+        {
+            EmitC(gen, "(%s){0}", CTypeName(gen, target));
+            return;
+        }
+
+        if(!IsCAggregate(gen, CExpressionType(gen, expr))) CGenError(gen, "cannot assign scalar value to aggregate of type", target.id);
+
+        EmitCExpression(gen, expr);
+        return;
+    }
+
+    bool isCast = IsCString(target) != IsCString(CExpressionType(gen, expr));
+    if(isCast) EmitC(gen, "(%s)(intptr_t)", CScalarTypeName(target.id));
+    EmitCExpressionIn(gen, expr, !isCast);
+}
+
+void EmitCArrayCopy(CGen *gen, Index lValue, Index expr, const char *cName)
+{
+    Node *node = &gen->ast->nodeList[expr];
+    if(node->type != NODE_L_VALUE || !CExpressionType(gen, expr).isArrayType) CGenError(gen, "cannot assign scalar value to aggregate of type", CExpressionType(gen, expr).id);
+
+    // sizeof does not evaluate its operand, so the destination is only indexed once
+    EmitC(gen, "memcpy(");
+    if(cName) EmitC(gen, "%s", cName);
+    else EmitCLValue(gen, lValue);
+    EmitC(gen, ", ");
+    EmitCLValue(gen, expr);
+    EmitC(gen, ", sizeof(");
+    if(cName) EmitC(gen, "%s", cName);
+    else EmitCLValue(gen, lValue);
+    EmitC(gen, "));\n");
+}
+
+void EmitCVarDecl(CGen *gen, Index varDecl, Index init)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[varDecl];
+
+    const char *name = ast->nodeList[node->varDecl.id].identifier.value;
+    IRType type = GetAnnotationType(ast, node->varDecl.type);
+    bool isAggregate = IsCAggregate(gen, type);
+
+    // the initializer is emitted before the new variable comes into scope
+    const char *cName = NewCName(gen, name);
+
+    EmitCIndent(gen);
+    EmitCDeclaration(gen, type, cName, false);
+
+    if(init == IR_NONE || (isAggregate && IsCZero(gen, init)))
+    {
+        EmitC(gen, isAggregate ? " = {0};\n" : " = 0;\n");
+    }
+    else if(type.isArrayType)
+    {
+        EmitC(gen, ";\n");
+        EmitCIndent(gen);
+        EmitCArrayCopy(gen, IR_NONE, init, cName);
+    }
+    else
+    {
+        EmitC(gen, " = ");
+        EmitCConverted(gen, init, type);
+        EmitC(gen, ";\n");
+    }
+
+    PushCLocal(gen, name, cName, type);
+}
+
+void EmitCAssignment(CGen *gen, Index stmt)
+{
+    AST *ast = gen->ast;
+    Node node = ast->nodeList[stmt];
+    Index lValue = node.assignStmt.lValue;
+    Index expr = node.assignStmt.expression;
+
+    if(ast->nodeList[lValue].type == NODE_VAR_DECL)
+    {
+        EmitCVarDecl(gen, lValue, expr);
+        return;
+    }
+
+    if(IsUndeclaredCRead(gen, lValue))
+    {
+        CGenError(gen, "assignment to undeclared variable", ast->nodeList[ast->nodeList[lValue].lValue.simpleLValues[0]].identifier.value);
+    }
+
+    bool isReference;
+    IRType type = WalkCLValue(gen, lValue, false, &isReference);
+
+    EmitCIndent(gen);
+
+    if(IsCAggregate(gen, type) && IsCZero(gen, expr))
+    {
+        EmitC(gen, type.isArrayType ? "memset(" : "memset(&");
+        EmitCLValue(gen, lValue);
+        EmitC(gen, ", 0, sizeof(");
+        EmitCLValue(gen, lValue);
+        EmitC(gen, "));\n");
+    }
+    else if(type.isArrayType)
+    {
+        EmitCArrayCopy(gen, lValue, expr, 0);
+    }
+    else
+    {
+        EmitCLValue(gen, lValue);
+        EmitC(gen, " = ");
+        EmitCConverted(gen, expr, type);
+        EmitC(gen, ";\n");
+    }
+}
+
+void EmitCStatement(CGen *gen, Index stmt);
+
+void EmitCBlock(CGen *gen, Index stmt)
+{
+    unsigned int scopeStart = gen->localCount;
+    Node *node = &gen->ast->nodeList[stmt];
+
+    EmitCIndent(gen);
+    EmitC(gen, "{\n");
+    gen->indent++;
+
+    if(node->type == NODE_STATEMENT_LIST)
+    {
+        for(unsigned int n = 0; n < node->statementList.statementCount; n++)
+        {
+            EmitCStatement(gen, gen->ast->nodeList[stmt].statementList.statements[n]);
+        }
+    }
+    else
+    {
+        EmitCStatement(gen, stmt);
+    }
+
+    gen->indent--;
+    EmitCIndent(gen);
+    EmitC(gen, "}\n");
+
+    gen->localCount = scopeStart;
+}
+
+void EmitCIf(CGen *gen, Index stmt)
+{
+    Node node = gen->ast->nodeList[stmt];
+
+    EmitC(gen, "if(");
+    EmitCOperand(gen, node.ifStmt.conditionExpr, true);
+    EmitC(gen, ")\n");
+    EmitCBlock(gen, node.ifStmt.trueBlock);
+
+    if(!node.ifStmt.falseBlockExist) return;
+
+    EmitCIndent(gen);
+
+    if(gen->ast->nodeList[node.ifStmt.falseBlock].type == NODE_IF_STATEMENT)
+    {
+        EmitC(gen, "else ");
+        EmitCIf(gen, node.ifStmt.falseBlock);
+    }
+    else
+    {
+        EmitC(gen, "else\n");
+        EmitCBlock(gen, node.ifStmt.falseBlock);
+    }
+}
+
+void EmitCZeroValue(CGen *gen, IRType type)
+{
+    if(IsCStruct(gen, type)) EmitC(gen, "(%s){0}", CTypeName(gen, type));
+    else EmitC(gen, "0");
+}
+
+void EmitCReturn(CGen *gen, Index stmt)
+{
+    Node node = gen->ast->nodeList[stmt];
+    Node def = gen->ast->nodeList[gen->function];
+
+    EmitCIndent(gen);
+
+    if(!def.functionDef.isReturnTypeDeclared)
+    {
+        if(node.returnStmt.exprExist)
+        {
+            EmitC(gen, "(void)");
+            EmitCExpression(gen, node.returnStmt.expression);
+            EmitC(gen, ";\n");
+            EmitCIndent(gen);
+        }
+
+        EmitC(gen, "return;\n");
+        return;
+    }
+
+    IRType type = GetAnnotationType(gen->ast, def.functionDef.returnType);
+    EmitC(gen, "return ");
+
+    if(node.returnStmt.exprExist) EmitCConverted(gen, node.returnStmt.expression, type);
+    else EmitCZeroValue(gen, type);
+
+    EmitC(gen, ";\n");
+}
+
+void EmitCStatement(CGen *gen, Index stmt)
+{
+    Node *node = &gen->ast->nodeList[stmt];
+
+    switch(node->type)
+    {
+        case NODE_STATEMENT_LIST:       EmitCBlock(gen, stmt); break;
+        case NODE_VAR_DECL:             EmitCVarDecl(gen, stmt, IR_NONE); break;
+        case NODE_ASSIGN_STATEMENT:     EmitCAssignment(gen, stmt); break;
+        case NODE_RETURN_STATEMENT:     EmitCReturn(gen, stmt); break;
+
+        case NODE_IF_STATEMENT:
+        {
+            EmitCIndent(gen);
+            EmitCIf(gen, stmt);
+        }
+        break;
+
+        case NODE_WHILE_STATEMENT:
+        {
+            EmitCIndent(gen);
+            EmitC(gen, "while(");
+            EmitCOperand(gen, node->whileStmt.conditionExpr, true);
+            EmitC(gen, ")\n");
+            EmitCBlock(gen, gen->ast->nodeList[stmt].whileStmt.block);
+        }
+        break;
+
+        default:
+        {
+            EmitCIndent(gen);
+            EmitC(gen, "(void)");
+            EmitCExpression(gen, stmt);
+            EmitC(gen, ";\n");
+        }
+        break;
+    }
+}
+
+// parameter names are only given with the definition, arrays arrive as a pointer to the caller's copy
+void EmitCSignature(CGen *gen, Index function, const char **names)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[function];
+
+    if(node->functionDef.isReturnTypeDeclared)
+    {
+        IRType type = GetAnnotationType(ast, node->functionDef.returnType);
+        if(type.isArrayType) CGenError(gen, "cannot return an array by value from", node->functionDef.name);
+
+        EmitC(gen, "%s bee_%s(", CTypeName(gen, type), node->functionDef.name);
+    }
+    else
+    {
+        EmitC(gen, "void bee_%s(", node->functionDef.name);
+    }
+
+    if(node->functionDef.parameterCount == 0) EmitC(gen, "void");
+
+    for(unsigned int n = 0; n < node->functionDef.parameterCount; n++)
+    {
+        Node *param = &ast->nodeList[node->functionDef.parameters[n]];
+        IRType type = GetAnnotationType(ast, param->param.type);
+
+        if(n > 0) EmitC(gen, ", ");
+
+        if(type.isArrayType) EmitC(gen, "%s *%s", CTypeName(gen, type), names ? names[n] : "");
+        else EmitC(gen, "%s%s%s", CTypeName(gen, type), names ? " " : "", names ? names[n] : "");
+    }
+
+    EmitC(gen, ")");
+}
+
+bool EndsInCReturn(AST *ast, Index body)
+{
+    Node *node = &ast->nodeList[body];
+    if(node->type != NODE_STATEMENT_LIST || node->statementList.statementCount == 0) return false;
+
+    return ast->nodeList[node->statementList.statements[node->statementList.statementCount - 1]].type == NODE_RETURN_STATEMENT;
+}
+
+void EmitCFunction(CGen *gen, Index function)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[function];
+
+    gen->functionName = node->functionDef.name;
+    gen->localCount = 0;
+    gen->cNameCount = 0;
+    gen->function = function;
+
+    const char **names = (const char**)calloc(node->functionDef.parameterCount + 1, sizeof(const char*));
+
+    for(unsigned int n = 0; n < node->functionDef.parameterCount; n++)
+    {
+        Node *param = &ast->nodeList[node->functionDef.parameters[n]];
+        const char *name = ast->nodeList[param->param.id].identifier.value;
+        IRType type = GetAnnotationType(ast, param->param.type);
+
+        if(type.isArrayType)
+        {
+            char *argument = (char*)malloc(strlen(name) + 5);
+            sprintf(argument, "%s_arg", name);
+            names[n] = NewCName(gen, KeepCString(gen, argument));
+        }
+        else
+        {
+            names[n] = NewCName(gen, name);
+            PushCLocal(gen, name, names[n], type);
+        }
+    }
+
+    EmitCSignature(gen, function, names);
+    EmitC(gen, "\n{\n");
+    gen->indent = 1;
+
+    // arrays are passed by value, the callee works on a copy of its own
+    for(unsigned int n = 0; n < node->functionDef.parameterCount; n++)
+    {
+        Node *param = &ast->nodeList[node->functionDef.parameters[n]];
+        const char *name = ast->nodeList[param->param.id].identifier.value;
+        IRType type = GetAnnotationType(ast, param->param.type);
+        if(!type.isArrayType) continue;
+
+        const char *cName = NewCName(gen, name);
+
+        EmitC(gen, "    ");
+        EmitCDeclaration(gen, type, cName, false);
+        EmitC(gen, ";\n    memcpy(%s, %s, sizeof(%s));\n", cName, names[n], cName);
+        PushCLocal(gen, name, cName, type);
+    }
+
+    Node *body = &ast->nodeList[node->functionDef.body];
+
+    for(unsigned int n = 0; n < body->statementList.statementCount; n++)
+    {
+        EmitCStatement(gen, ast->nodeList[node->functionDef.body].statementList.statements[n]);
+    }
+
+    // running off the end returns zero, like the undefined value lowering gives it
+    node = &ast->nodeList[function];
+    if(node->functionDef.isReturnTypeDeclared && !EndsInCReturn(ast, node->functionDef.body))
+    {
+        EmitC(gen, "    return ");
+        EmitCZeroValue(gen, GetAnnotationType(ast, node->functionDef.returnType));
+        EmitC(gen, ";\n");
+    }
+
+    EmitC(gen, "}\n\n");
+
+    free(names);
+    gen->functionName = 0;
+}
+
+// the entry function is called with every parameter zero, like the vm does
+void EmitCMain(CGen *gen, Index function)
+{
+    AST *ast = gen->ast;
+    Node *node = &ast->nodeList[function];
+
+    EmitC(gen, "int main(void)\n{\n    ");
+
+    bool isScalarResult = node->functionDef.isReturnTypeDeclared && !IsCAggregate(gen, GetAnnotationType(ast, node->functionDef.returnType));
+    if(isScalarResult) EmitC(gen, "return (int)");
+
+    EmitC(gen, "bee_%s(", node->functionDef.name);
+
+    for(unsigned int n = 0; n < node->functionDef.parameterCount; n++)
+    {
+        IRType type = GetAnnotationType(ast, ast->nodeList[node->functionDef.parameters[n]].param.type);
+
+        if(n > 0) EmitC(gen, ", ");
+
+        if(type.isArrayType) EmitC(gen, "(%s[%u]){0}", CTypeName(gen, type), type.arrayDim);
+        else EmitCZeroValue(gen, type);
+    }
+
+    EmitC(gen, ");\n");
+    if(!isScalarResult) EmitC(gen, "    return 0;\n");
+    EmitC(gen, "}\n");
+}
+
+// outputName is only used in the report
+void EmitCProgramToFile(AST *ast, Index program, const Options *options, FILE *file, const char *outputName)
+{
+    CGen gen = {0};
+    gen.ast = ast;
+    gen.program = program;
+    gen.options = options;
+    gen.out = file;
+    gen.structState = (unsigned char*)calloc(ast->nodeCount, sizeof(unsigned char));
+    gen.isPointerField = (bool*)calloc(ast->nodeCount, sizeof(bool));
+
+    if(options->layout.fieldOrder != FIELD_ORDER_DECLARED)
+    {
+        gen.layout = LowerProgram(ast, program, options);
+        ChooseStructLayouts(&gen.layout);
+    }
+
+    Node *node = &ast->nodeList[program];
+    unsigned int structCount = 0, functionCount = 0;
+
+    EmitC(&gen, "// generated from bee source by the c backend\n");
+    EmitC(&gen, "%s", cRuntime);
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Node *def = &ast->nodeList[node->program.definitions[n]];
+        if(def->type != NODE_STRUCT_DEF) continue;
+
+        const char *name = CSafeName(&gen, def->structDef.name);
+        EmitC(&gen, "typedef struct %s %s;\n", name, name);
+        structCount++;
+    }
+
+    if(structCount) EmitC(&gen, "\n");
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        if(ast->nodeList[def].type == NODE_STRUCT_DEF && gen.structState[def] == 0) EmitCStruct(&gen, def);
+    }
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        if(ast->nodeList[def].type != NODE_FUNC_DEF) continue;
+
+        gen.functionName = ast->nodeList[def].functionDef.name;
+        EmitC(&gen, "static ");
+        EmitCSignature(&gen, def, 0);
+        EmitC(&gen, ";\n");
+        functionCount++;
+    }
+
+    if(functionCount) EmitC(&gen, "\n");
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Index def = node->program.definitions[n];
+        if(ast->nodeList[def].type != NODE_FUNC_DEF) continue;
+
+        EmitC(&gen, "static ");
+        EmitCFunction(&gen, def);
+    }
+
+    Index entryFunction = FindDefinition(ast, program, NODE_FUNC_DEF, options->entry);
+    if(entryFunction != IR_NONE) EmitCMain(&gen, entryFunction);
+    else ReportDiagnostic("warning: c backend: entry function '%s' not found, no main emitted", options->entry);
+
+    if(options->printReport)
+    {
+        printf("cgen: %u struct%s, %u function%s, %u lines -> %s\n", structCount, structCount == 1 ? "" : "s",
+               functionCount, functionCount == 1 ? "" : "s", gen.lineCount, outputName);
+    }
+
+    for(unsigned int n = 0; n < gen.stringCount; n++) free(gen.strings[n]);
+
+    free(gen.strings);
+    free(gen.locals);
+    free(gen.cNames);
+    free(gen.structState);
+    free(gen.isPointerField);
+    FreeIRModule(&gen.layout);
+}
+
+bool EmitCProgram(AST *ast, Index program, const Options *options, const char *fileName)
+{
+    FILE *file = fopen(fileName, "w");
+
+    if(!file)
+    {
+        ReportDiagnostic("error: cannot write c output '%s'", fileName);
+        return false;
+    }
+
+    EmitCProgramToFile(ast, program, options, file, fileName);
+    fclose(file);
+
+    return true;
+}
+
+extern char **environ;
+
+// a name starting with a dash would be read as a compiler option
+char *MakeArgumentPath(const char *fileName)
+{
+    char *path = (char*)malloc(strlen(fileName) + 3);
+    sprintf(path, "%s%s", fileName[0] == '-' ? "./" : "", fileName);
+    return path;
+}
+
+// bee arithmetic wraps, so signed overflow must not be undefined for the c optimizer.
+// array loops are vectorized by the c compiler, arrays are private copies in c so it can prove them independent.
+// the compiler is started directly, never through a shell, so file names are passed as they are
+bool BuildNative(const Options *options, const char *cFileName, const char *exeFileName)
+{
+    const CGenOptions *cgen = &options->cgen;
+    char *exePath = MakeArgumentPath(exeFileName);
+    char *cPath = MakeArgumentPath(cFileName);
+
+    char *arguments[16];
+    unsigned int argumentCount = 0;
+
+    arguments[argumentCount++] = (char*)cgen->compiler;
+    arguments[argumentCount++] = "-O2";
+    arguments[argumentCount++] = "-fwrapv";
+    arguments[argumentCount++] = cgen->noVectorize ? "-fno-tree-vectorize" : "-ftree-vectorize";
+    if(cgen->vectorTarget && !cgen->noVectorize) arguments[argumentCount++] = (char*)cgen->vectorTarget;
+
+    // the c compiler names the loops it vectorized
+    if(options->printReport && !cgen->noVectorize)
+    {
+        arguments[argumentCount++] = strstr(cgen->compiler, "clang") ? "-Rpass=loop-vectorize" : "-fopt-info-vec-optimized";
+    }
+
+    arguments[argumentCount++] = "-o";
+    arguments[argumentCount++] = exePath;
+    arguments[argumentCount++] = cPath;
+    arguments[argumentCount] = 0;
+
+    pid_t child;
+    int status = -1;
+
+    // the c compiler reports on stderr, what is printed so far comes first
+    fflush(stdout);
+
+    if(posix_spawnp(&child, cgen->compiler, 0, 0, arguments, environ) == 0)
+    {
+        while(waitpid(child, &status, 0) == -1 && errno == EINTR);
+    }
+
+    bool isBuilt = status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if(!isBuilt) ReportDiagnostic("error: native build of '%s' with %s failed", exeFileName, cgen->compiler);
+    else if(options->printReport)
+    {
+        printf("cgen: built '%s' with %s -O2, vectorized for %s\n", exeFileName, cgen->compiler,
+               cgen->noVectorize ? "nothing" : (cgen->vectorTarget ? cgen->vectorTarget + 2 : "the default target"));
+    }
+
+    free(exePath);
+    free(cPath);
+    return isBuilt;
+}
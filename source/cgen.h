@@ -0,0 +1,10 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include "ir.h"
+
+void EmitCProgramToFile(AST *ast, Index program, const Options *options, FILE *file, const char *outputName);
+bool EmitCProgram(AST *ast, Index program, const Options *options, const char *fileName);
+bool BuildNative(const Options *options, const char *cFileName, const char *exeFileName);
+
+#endif //CGEN_H
@@ -0,0 +1,281 @@
+// the whole compiler as one translation unit, shared by the command line driver and libbee
+
+#include "options.c"
+#include "context.c"
+#include "lexer.c"
+#include "parser.c"
+#include "ast.c"
+#include "symbol.c"
+#include "threads.c"
+#include "ir.c"
+#include "layout.c"
+#include "lower.c"
+#include "pass.c"
+#include "callgraph.c"
+#include "hash.c"
+#include "inline.c"
+#include "specialize.c"
+#include "loop.c"
+#include "bounds.c"
+#include "switch.c"
+#include "address.c"
+#include "abi.c"
+#include "frame.c"
+#include "bulk.c"
+#include "bytecode.c"
+#include "vm.c"
+#include "consteval.c"
+#include "cgen.c"
+#include "cache.c"
+#include "module.c"
+
+// whole-program work on the linked AST, before anything is lowered
+void SimplifyProgram(AST *ast, Index program, const Options *options)
+{
+    EliminateDeadDefinitions(ast, program, options->entry, options->printReport);
+    if(!options->noMerge) MergeIdenticalFunctions(ast, program, options->entry, options->printReport);
+
+    // functions only ever called with constants are dead once their calls are evaluated
+    if(!options->noConstEval && EvaluateConstantCalls(ast, program, options)) EliminateDeadDefinitions(ast, program, options->entry, options->printReport);
+}
+
+// cached functions are compiled on their own, so nothing may depend on how a function is called
+IRModule OptimizeProgram(AST *ast, Index program, const Options *options, bool isCached)
+{
+    IRModule module = LowerProgram(ast, program, options);
+    module.entry = options->entry;
+
+    if(!VerifyIRModule(&module)) CompileError("ir error: verification failed after lowering");
+
+    PassManager manager = {0};
+    manager.verifyEachPass = options->verifyEachPass;
+    manager.timePasses = options->timePasses;
+
+    AddFunctionPass(&manager, "remove-unreachable", RemoveUnreachableBlocks);
+
+    if(!options->noIpcp && !isCached) AddModulePass(&manager, "ipcp", PropagateConstantArguments);
+
+    if(!options->noInline) AddModulePass(&manager, "inline", InlineFunctions);
+    AddFunctionPass(&manager, "cleanup-unreachable", RemoveUnreachableBlocks);
+    AddFunctionPass(&manager, "constant-fold", FoldConstants);
+    if(!options->noCse) AddFunctionPass(&manager, "cse", EliminateCommonSubexpressions);
+
+    if(!options->noLoopOpts)
+    {
+        AddFunctionPass(&manager, "licm", HoistLoopInvariants);
+        AddFunctionPass(&manager, "bounds-check-elim", EliminateBoundsChecks);
+        AddFunctionPass(&manager, "loop-strength-reduce", ReduceInductionVariables);
+        AddFunctionPass(&manager, "loop-unroll", UnrollLoops);
+    }
+
+    AddFunctionPass(&manager, "lower-switches", LowerSwitches);
+    AddModulePass(&manager, "struct-layout", LayoutStructs);
+    AddModulePass(&manager, "calling-convention", LowerCallingConvention);
+    AddModulePass(&manager, "fold-addresses", FoldAddresses);
+    AddFunctionPass(&manager, "dce", EliminateDeadCode);
+    AddModulePass(&manager, "stack-coloring", LayoutStackFrames);
+    AddModulePass(&manager, "lower-bulk-memory", LowerBulkMemory);
+
+    RunPasses(&manager, &module);
+
+    if(!VerifyIRModule(&module)) CompileError("ir error: verification failed after optimization");
+
+    if(options->printIR) PrintIRModule(&module);
+    if(options->timePasses) PrintPassTimings(&manager);
+
+    return module;
+}
+
+// everything that changes what a function compiles to, report flags do not
+unsigned long long HashBuildOptions(AST *ast, Index program, const Options *options)
+{
+    unsigned long long hash = HashString(HASH_SEED, BEE_BUILD_ID);
+
+    hash = HashValue(hash, options->noInline);
+    hash = HashValue(hash, options->noLoopOpts);
+    hash = HashValue(hash, options->noCse);
+    hash = HashValue(hash, (unsigned int)options->inlining.threshold);
+    hash = HashValue(hash, options->inlining.maxDepth);
+    hash = HashValue(hash, (unsigned int)options->inlining.constantArgBonus);
+    hash = HashValue(hash, (unsigned int)options->inlining.aggregateArgBonus);
+    hash = HashValue(hash, (unsigned int)options->inlining.callBonus);
+    hash = HashValue(hash, options->loops.maxFullUnrollTripCount);
+    hash = HashValue(hash, options->loops.maxUnrolledSize);
+    hash = HashValue(hash, options->loops.partialUnrollFactor);
+    hash = HashValue(hash, options->loops.noUnroll);
+    hash = HashValue(hash, options->bounds.insertChecks);
+    hash = HashValue(hash, options->switches.minCases);
+    hash = HashValue(hash, options->switches.minTableCases);
+    hash = HashValue(hash, options->switches.minTableDensity);
+    hash = HashValue(hash, options->switches.maxTableSize);
+    hash = HashValue(hash, options->switches.noJumpTables);
+    hash = HashValue(hash, options->layout.fieldOrder);
+    hash = HashValue(hash, options->abi.maxRegisterBytes);
+    hash = HashValue(hash, options->abi.noCopyElision);
+    hash = HashValue(hash, options->bulk.inlineLimit);
+    hash = HashValue(hash, options->frame.noColoring);
+    hash = HashValue(hash, options->bytecode.noSuperinstructions);
+
+    // hot field order counts accesses, from the profile or from every function in the program
+    if(options->layout.fieldOrder == FIELD_ORDER_HOT && options->layout.profileFileName)
+    {
+        char *profile = LoadFileNullTerminated(options->layout.profileFileName);
+        hash = HashString(hash, profile);
+        free(profile);
+    }
+    else if(options->layout.fieldOrder == FIELD_ORDER_HOT)
+    {
+        unsigned long long *hashes = HashASTNodes(ast, program);
+        hash = HashValue(hash, hashes[program]);
+        free(hashes);
+    }
+
+    return hash;
+}
+
+// functions found in the cache are loaded, the others are compiled along with everything they call, which inlining needs
+BytecodeModule LinkCachedBytecode(CompilerContext *context, AST *ast, Index program, const Options *options)
+{
+    CallGraph graph = BuildCallGraph(ast, program);
+    unsigned long long *keys = ComputeFunctionKeys(ast, program, &graph, HashBuildOptions(ast, program, options));
+
+    CachedFunction *functions = (CachedFunction*)calloc(graph.nodeCount ? graph.nodeCount : 1, sizeof(CachedFunction));
+    bool *isLoaded = (bool*)calloc(graph.nodeCount ? graph.nodeCount : 1, sizeof(bool));
+    unsigned int loadedCount = 0;
+
+    for(unsigned int n = 0; n < graph.nodeCount; n++)
+    {
+        const char *name = ast->nodeList[graph.nodes[n].definition].functionDef.name;
+        isLoaded[n] = LoadCachedFunction(options, keys[n], name, &functions[n]);
+
+        if(isLoaded[n]) loadedCount++;
+        else MarkReachableFunctions(&graph, n);
+    }
+
+    if(loadedCount < graph.nodeCount)
+    {
+        Node *node = &ast->nodeList[program];
+        Index *definitions = node->program.definitions;
+        unsigned int defCount = node->program.defCount;
+
+        Index *compiled = 0;
+        unsigned int compiledCount = 0;
+        unsigned int function = 0;
+
+        // call graph nodes were created in definition order
+        for(unsigned int n = 0; n < defCount; n++)
+        {
+            bool isFunction = ast->nodeList[definitions[n]].type == NODE_FUNC_DEF;
+            if(!isFunction || graph.nodes[function].isReachable) PushIndex(&compiled, &compiledCount, definitions[n]);
+            if(isFunction) function++;
+        }
+
+        node->program.definitions = compiled;
+        node->program.defCount = compiledCount;
+        IRModule module = OptimizeProgram(ast, program, options, true);
+        node->program.definitions = definitions;
+        node->program.defCount = defCount;
+        free(compiled);
+
+        BytecodeModule bytecode = GenerateBytecode(&module);
+        FreeIRModule(&module);
+
+        for(unsigned int m = 0; m < bytecode.functionCount; m++)
+        {
+            int n = LookupName(&graph.functions, bytecode.functions[m].name, -1);
+            if(n == -1 || isLoaded[n]) continue;
+
+            functions[n] = DetachFunction(&bytecode, m);
+            StoreCachedFunction(options, keys[n], &functions[n]);
+
+            if(options->printReport) printf("cache: '%s' compiled, key %016llx\n", functions[n].function.name, keys[n]);
+        }
+
+        FreeBytecodeModule(&bytecode);
+    }
+
+    for(unsigned int n = 0; n < graph.nodeCount; n++)
+    {
+        if(functions[n].function.name) continue;
+
+        CompileError("cache error: '%s' was neither loaded nor compiled", ast->nodeList[graph.nodes[n].definition].functionDef.name);
+    }
+
+    if(options->printReport)
+    {
+        printf("cache: %u of %u function%s loaded from '%s', %u compiled\n", loadedCount, graph.nodeCount, graph.nodeCount == 1 ? "" : "s",
+               options->cache.directory ? options->cache.directory : "memory", graph.nodeCount - loadedCount);
+    }
+
+    BytecodeModule bytecode = LinkCachedFunctions(functions, graph.nodeCount);
+
+    // names and strings point into the cached functions until they are interned
+    for(unsigned int n = 0; n < bytecode.functionCount; n++) bytecode.functions[n].name = InternString(context, bytecode.functions[n].name, strlen(bytecode.functions[n].name));
+    for(unsigned int n = 0; n < bytecode.stringCount; n++) bytecode.strings[n] = InternString(context, bytecode.strings[n], strlen(bytecode.strings[n]));
+    for(unsigned int n = 0; n < graph.nodeCount; n++) FreeCachedFunction(&functions[n]);
+
+    free(functions);
+    free(isLoaded);
+    free(keys);
+    FreeCallGraph(&graph);
+
+    return bytecode;
+}
+
+void BuildCachedBytecode(CompilerContext *context, AST *ast, Index program, const Options *options)
+{
+    BytecodeModule bytecode = LinkCachedBytecode(context, ast, program, options);
+
+    if(options->bytecode.printBytecode) PrintBytecodeModule(&bytecode);
+    if(options->runProgram) RunProgram(&bytecode, options->entry ? options->entry : "main", options->vm);
+
+    FreeBytecodeModule(&bytecode);
+}
+
+void CompileModule(CompilerContext *context, AST *ast, Index program, const Options *options)
+{
+    bool isBytecodeBuild = options->runProgram || options->bytecode.printBytecode;
+
+    if(isBytecodeBuild && options->cache.directory)
+    {
+        BuildCachedBytecode(context, ast, program, options);
+        return;
+    }
+
+    // a native or c build only reads the ast, the ir is made when something looks at it
+    bool isIRUsed = isBytecodeBuild || options->printIR || options->printReport || options->timePasses || options->verifyEachPass;
+    if(!isIRUsed) return;
+
+    IRModule module = OptimizeProgram(ast, program, options, false);
+
+    if(isBytecodeBuild)
+    {
+        BytecodeModule bytecode = GenerateBytecode(&module);
+
+        if(options->bytecode.printBytecode) PrintBytecodeModule(&bytecode);
+        if(options->runProgram) RunProgram(&bytecode, options->entry ? options->entry : "main", options->vm);
+
+        FreeBytecodeModule(&bytecode);
+    }
+
+    FreeIRModule(&module);
+}
+
+// a native build without an explicit c file keeps it next to the executable
+void TranspileToC(AST *ast, Index program, const Options *options)
+{
+    const char *cFileName = options->cgen.outputFileName;
+    char *defaultName = 0;
+
+    if(!cFileName)
+    {
+        defaultName = (char*)malloc(strlen(options->cgen.nativeFileName) + 3);
+        sprintf(defaultName, "%s.c", options->cgen.nativeFileName);
+        cFileName = defaultName;
+    }
+
+    if(!EmitCProgram(ast, program, options, cFileName)) AbortCompilation();
+    if(options->cgen.nativeFileName && !BuildNative(options, cFileName, options->cgen.nativeFileName)) AbortCompilation();
+
+    free(defaultName);
+}
@@ -0,0 +1,324 @@
+#include "consteval.h"
+#include "callgraph.h"
+#include "lower.h"
+#include "layout.h"
+#include "frame.h"
+#include "bounds.h"
+#include "vm.h"
+
+typedef struct {
+    CallGraph *graph;
+    bool *isPure;
+    bool isPureSoFar;
+} PurityChecker;
+
+typedef struct {
+    CallGraph *graph;
+    bool *isPure;
+    bool *isTried;
+    Index *calls;
+    unsigned int callCount;
+} ConstantCallCollector;
+
+// only plain integers, whatever the vm returns for one can be written as a constant
+bool IsIntegerAnnotation(AST *ast, Index annotation)
+{
+    Node *node = &ast->nodeList[annotation];
+    return !node->typeAnnotation.isArrayType && !strcmp(node->typeAnnotation.id, "int");
+}
+
+bool HasIntegerSignature(AST *ast, Index def)
+{
+    Node *node = &ast->nodeList[def];
+    if(!node->functionDef.isReturnTypeDeclared || !IsIntegerAnnotation(ast, node->functionDef.returnType)) return false;
+
+    for(unsigned int n = 0; n < node->functionDef.parameterCount; n++)
+    {
+        Node *param = &ast->nodeList[node->functionDef.parameters[n]];
+        if(!IsIntegerAnnotation(ast, param->param.type)) return false;
+    }
+
+    return true;
+}
+
+// builtins print, strings live outside the frame, anything impure makes the caller impure too
+void CheckPurity(AST *ast, Index index, void *data)
+{
+    PurityChecker *checker = (PurityChecker*)data;
+    Node *node = &ast->nodeList[index];
+
+    if(node->type == NODE_STRING_CONSTANT)
+    {
+        checker->isPureSoFar = false;
+    }
+    else if(node->type == NODE_TYPE_ANNOTATION && !strcmp(node->typeAnnotation.id, "str"))
+    {
+        checker->isPureSoFar = false;
+    }
+    else if(node->type == NODE_FUNC_CALL)
+    {
+        int callee = LookupName(&checker->graph->functions, node->functionCall.id, -1);
+        if(callee == -1 || !checker->isPure[callee]) checker->isPureSoFar = false;
+    }
+}
+
+// optimistic, so recursion stays pure: every integer function starts out pure until it calls something that is not
+bool *FindPureFunctions(AST *ast, CallGraph *graph, unsigned int *pureCount)
+{
+    bool *isPure = (bool*)calloc(graph->nodeCount ? graph->nodeCount : 1, sizeof(bool));
+    for(unsigned int n = 0; n < graph->nodeCount; n++) isPure[n] = HasIntegerSignature(ast, graph->nodes[n].definition);
+
+    bool changed = true;
+
+    while(changed)
+    {
+        changed = false;
+
+        for(unsigned int n = 0; n < graph->nodeCount; n++)
+        {
+            if(!isPure[n]) continue;
+
+            PurityChecker checker = {graph, isPure, true};
+            VisitNodes(ast, graph->nodes[n].definition, CheckPurity, &checker);
+
+            if(!checker.isPureSoFar)
+            {
+                isPure[n] = false;
+                changed = true;
+            }
+        }
+    }
+
+    *pureCount = 0;
+    for(unsigned int n = 0; n < graph->nodeCount; n++) *pureCount += isPure[n];
+
+    return isPure;
+}
+
+// the pure functions on their own, lowered just far enough for the vm to run them
+BytecodeModule BuildEvaluator(AST *ast, Index program, CallGraph *graph, bool *isPure, IRModule *module, const Options *options)
+{
+    // an index out of bounds must stop the vm before it reaches compiler memory
+    *module = LowerProgramWithChecks(ast, program, options, true);
+
+    // the real pipeline reports on these functions later
+    module->isQuiet = true;
+
+    unsigned int keptCount = 0;
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        IRFunction *function = &module->functions[n];
+        int node = LookupName(&graph->functions, function->name, -1);
+
+        if(node != -1 && isPure[node]) module->functions[keptCount++] = *function;
+        else FreeIRFunction(function);
+    }
+
+    module->functionCount = keptCount;
+
+    for(unsigned int n = 0; n < module->functionCount; n++) RemoveUnreachableBlocks(&module->functions[n], options);
+    ComputeStructLayouts(module);
+
+    LayoutStackFrames(module);
+    return GenerateBytecode(module);
+}
+
+void FreeEvaluator(BytecodeModule *bytecode, IRModule *module)
+{
+    FreeBytecodeModule(bytecode);
+    FreeIRModule(module);
+}
+
+void CollectConstantCall(AST *ast, Index index, void *data)
+{
+    ConstantCallCollector *collector = (ConstantCallCollector*)data;
+    Node *node = &ast->nodeList[index];
+
+    if(node->type != NODE_FUNC_CALL || collector->isTried[index]) return;
+
+    int callee = LookupName(&collector->graph->functions, node->functionCall.id, -1);
+    if(callee == -1 || !collector->isPure[callee]) return;
+
+    for(unsigned int n = 0; n < node->functionCall.argumentCount; n++)
+    {
+        if(ast->nodeList[node->functionCall.arguments[n]].type != NODE_INTEGER_CONSTANT) return;
+    }
+
+    PushIndex(&collector->calls, &collector->callCount, index);
+}
+
+// a fresh vm with the evaluation limits for every call, a runaway call only costs its own budget
+bool EvaluateCall(AST *ast, BytecodeModule *bytecode, const ConstEvalOptions *limits, Index call, long long *result, unsigned long long *dispatchCount, const char **error)
+{
+    Node *node = &ast->nodeList[call];
+
+    int function = FindBytecodeFunction(bytecode, node->functionCall.id);
+    if(function == -1)
+    {
+        *error = "function has no bytecode";
+        return false;
+    }
+
+    unsigned int argumentCount = node->functionCall.argumentCount;
+    long long *arguments = (long long*)calloc(argumentCount ? argumentCount : 1, sizeof(long long));
+
+    for(unsigned int n = 0; n < argumentCount; n++) arguments[n] = ast->nodeList[node->functionCall.arguments[n]].integer.value;
+
+    VMOptions options = {0};
+    options.registerCapacity = limits->registerCapacity;
+    options.stackBytes = limits->stackBytes;
+    options.maxDepth = limits->maxDepth;
+    options.stepLimit = limits->stepLimit;
+
+    VM vm = CreateVM(bytecode, options);
+    bool isEvaluated = CallBytecode(&vm, function, arguments, argumentCount, result);
+
+    *error = vm.error;
+    *dispatchCount = vm.dispatchCount;
+
+    FreeVM(&vm);
+    free(arguments);
+
+    // the vm wraps int arithmetic like the native code does, this only guards against a wider value
+    if(isEvaluated && *result != (int)*result)
+    {
+        *error = "result does not fit an integer constant";
+        return false;
+    }
+
+    return isEvaluated;
+}
+
+void ReplaceWithConstant(AST *ast, Index index, int value)
+{
+    Node *node = &ast->nodeList[index];
+    if(node->type == NODE_FUNC_CALL) free(node->functionCall.arguments);
+
+    Node constant = {0};
+    constant.type = NODE_INTEGER_CONSTANT;
+    constant.integer.value = value;
+    *node = constant;
+}
+
+// operators around an evaluated call can become constant, fold them like the parser would have
+bool FoldOperatorInPlace(AST *ast, Index index, unsigned int *foldCount)
+{
+    Node *node = &ast->nodeList[index];
+    if(node->type != NODE_OPERATOR) return node->type == NODE_INTEGER_CONSTANT;
+
+    bool isUnary = node->operator.opType == BOOL_OP_NOT;
+    bool isLeftConstant = FoldOperatorInPlace(ast, node->operator.left, foldCount);
+    bool isRightConstant = isUnary || FoldOperatorInPlace(ast, node->operator.right, foldCount);
+
+    if(!isLeftConstant || !isRightConstant) return false;
+
+    int left = ast->nodeList[node->operator.left].integer.value;
+    int right = isUnary ? 0 : ast->nodeList[node->operator.right].integer.value;
+    int value;
+
+    if(!EvaluateOperator(node->operator.opType, left, right, &value)) return false;
+
+    ReplaceWithConstant(ast, index, value);
+    (*foldCount)++;
+    return true;
+}
+
+void FoldConstantOperators(AST *ast, Index index, void *data)
+{
+    if(ast->nodeList[index].type == NODE_OPERATOR) FoldOperatorInPlace(ast, index, (unsigned int*)data);
+}
+
+void PrintConstantCall(AST *ast, Index call)
+{
+    Node *node = &ast->nodeList[call];
+    printf("consteval: '%s'(", node->functionCall.id);
+
+    for(unsigned int n = 0; n < node->functionCall.argumentCount; n++)
+    {
+        printf("%s%d", n == 0 ? "" : ", ", ast->nodeList[node->functionCall.arguments[n]].integer.value);
+    }
+
+    printf(")");
+}
+
+// calls to pure functions with constant arguments run on the vm and become their result
+bool EvaluateConstantCalls(AST *ast, Index program, const Options *options)
+{
+    CallGraph graph = BuildCallGraph(ast, program);
+
+    unsigned int pureCount;
+    bool *isPure = FindPureFunctions(ast, &graph, &pureCount);
+
+    if(pureCount == 0)
+    {
+        if(options->printReport) printf("consteval: no pure functions\n");
+
+        free(isPure);
+        FreeCallGraph(&graph);
+        return false;
+    }
+
+    IRModule module = {0};
+    BytecodeModule bytecode = BuildEvaluator(ast, program, &graph, isPure, &module, options);
+
+    ConstantCallCollector collector = {0};
+    collector.graph = &graph;
+    collector.isPure = isPure;
+    collector.isTried = (bool*)calloc(ast->nodeCount, sizeof(bool));
+
+    unsigned int triedCount = 0;
+    unsigned int evaluatedCount = 0;
+    unsigned int foldCount = 0;
+
+    for(unsigned int round = 0; round < options->constEval.maxRounds; round++)
+    {
+        collector.callCount = 0;
+        for(unsigned int n = 0; n < graph.nodeCount; n++) VisitNodes(ast, graph.nodes[n].definition, CollectConstantCall, &collector);
+
+        if(collector.callCount == 0) break;
+
+        for(unsigned int n = 0; n < collector.callCount; n++)
+        {
+            Index call = collector.calls[n];
+            collector.isTried[call] = true;
+            triedCount++;
+
+            long long result;
+            unsigned long long dispatchCount;
+            const char *error;
+
+            bool isEvaluated = EvaluateCall(ast, &bytecode, &options->constEval, call, &result, &dispatchCount, &error);
+
+            if(options->printReport)
+            {
+                PrintConstantCall(ast, call);
+
+                if(isEvaluated) printf(" = %lld after %llu dispatches\n", result, dispatchCount);
+                else printf(" left to run time (%s)\n", error);
+            }
+
+            if(isEvaluated)
+            {
+                ReplaceWithConstant(ast, call, (int)result);
+                evaluatedCount++;
+            }
+        }
+
+        for(unsigned int n = 0; n < graph.nodeCount; n++) VisitNodes(ast, graph.nodes[n].definition, FoldConstantOperators, &foldCount);
+    }
+
+    if(options->printReport)
+    {
+        printf("consteval: %u pure function%s, %u of %u constant call%s evaluated, %u operator%s folded\n", pureCount, pureCount == 1 ? "" : "s",
+               evaluatedCount, triedCount, triedCount == 1 ? "" : "s", foldCount, foldCount == 1 ? "" : "s");
+    }
+
+    free(collector.calls);
+    free(collector.isTried);
+    FreeEvaluator(&bytecode, &module);
+    free(isPure);
+    FreeCallGraph(&graph);
+
+    return evaluatedCount > 0;
+}
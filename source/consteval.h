@@ -0,0 +1,9 @@
+#ifndef CONSTEVAL_H
+#define CONSTEVAL_H
+
+#include "ast.h"
+#include "options.h"
+
+bool EvaluateConstantCalls(AST *ast, Index program, const Options *options);
+
+#endif //CONSTEVAL_H
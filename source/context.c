@@ -0,0 +1,212 @@
+#include <stdarg.h>
+
+#include "context.h"
+#include "hash.h"
+
+__thread DiagnosticTrap *diagnosticTrap = 0;
+
+// pointer sized alignment is enough for anything the compiler puts in an arena
+void *ArenaAllocate(Arena *arena, unsigned int size)
+{
+    size = (size + sizeof(void*) - 1) & ~(unsigned int)(sizeof(void*) - 1);
+
+    ArenaBlock *block = arena->blocks;
+
+    if(!block || block->used + size > block->capacity)
+    {
+        unsigned int capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+        block->next = arena->blocks;
+        block->used = 0;
+        block->capacity = capacity;
+
+        arena->blocks = block;
+        arena->allocatedBytes += capacity;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+void FreeArena(Arena *arena)
+{
+    ArenaBlock *block = arena->blocks;
+
+    while(block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = 0;
+    arena->allocatedBytes = 0;
+}
+
+unsigned int FindStringSlot(StringTable *table, const char *text, unsigned int length, unsigned long long hash)
+{
+    unsigned int slot = (unsigned int)hash & (table->capacity - 1);
+
+    while(table->entries[slot])
+    {
+        const char *entry = table->entries[slot];
+        if(!strncmp(entry, text, length) && entry[length] == 0) break;
+
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    return slot;
+}
+
+void GrowStringTable(StringTable *table)
+{
+    StringTable grown = {0};
+    grown.capacity = table->capacity ? table->capacity * 2 : 256;
+    grown.entries = (const char**)calloc(grown.capacity, sizeof(const char*));
+
+    for(unsigned int n = 0; n < table->capacity; n++)
+    {
+        const char *entry = table->entries[n];
+        if(!entry) continue;
+
+        unsigned int length = strlen(entry);
+        grown.entries[FindStringSlot(&grown, entry, length, HashBytes(HASH_SEED, entry, length))] = entry;
+        grown.count++;
+    }
+
+    free(table->entries);
+    *table = grown;
+}
+
+// the same text always gives back the same pointer, so names from one context compare by address
+const char *InternString(CompilerContext *context, const char *text, unsigned int length)
+{
+    StringTable *table = &context->strings;
+    unsigned long long hash = HashBytes(HASH_SEED, text, length);
+
+    pthread_mutex_lock(&context->lock);
+
+    if((table->count + 1) * 4 > table->capacity * 3) GrowStringTable(table);
+
+    unsigned int slot = FindStringSlot(table, text, length, hash);
+
+    if(!table->entries[slot])
+    {
+        char *copy = (char*)ArenaAllocate(&context->arena, length + 1);
+        memcpy(copy, text, length);
+        copy[length] = 0;
+
+        table->entries[slot] = copy;
+        table->count++;
+    }
+
+    const char *interned = table->entries[slot];
+
+    pthread_mutex_unlock(&context->lock);
+    return interned;
+}
+
+CompilerContext *CreateContext(void)
+{
+    CompilerContext *context = (CompilerContext*)calloc(1, sizeof(CompilerContext));
+    pthread_mutex_init(&context->lock, 0);
+
+    // primitive types
+    Type integerType = {.id = (char*)InternString(context, "int", 3), .size = 1};
+    Type stringType = {.id = (char*)InternString(context, "str", 3), .size = 1};
+
+    PushType(&context->types, integerType);
+    PushType(&context->types, stringType);
+
+    return context;
+}
+
+// a second source with the same name replaces the first
+void AddSource(CompilerContext *context, const char *name, const char *text)
+{
+    name = InternString(context, name, strlen(name));
+
+    for(unsigned int n = 0; n < context->sourceCount; n++)
+    {
+        if(context->sourceNames[n] != name) continue;
+
+        free(context->sourceTexts[n]);
+        context->sourceTexts[n] = strdup(text);
+        return;
+    }
+
+    context->sourceCount++;
+    context->sourceNames = (const char**)realloc(context->sourceNames, sizeof(const char*) * context->sourceCount);
+    context->sourceTexts = (char**)realloc(context->sourceTexts, sizeof(char*) * context->sourceCount);
+    context->sourceNames[context->sourceCount - 1] = name;
+    context->sourceTexts[context->sourceCount - 1] = strdup(text);
+}
+
+const char *FindSource(CompilerContext *context, const char *name)
+{
+    for(unsigned int n = 0; n < context->sourceCount; n++)
+    {
+        if(!strcmp(context->sourceNames[n], name)) return context->sourceTexts[n];
+    }
+
+    return 0;
+}
+
+void DestroyContext(CompilerContext *context)
+{
+    for(unsigned int n = 0; n < context->sourceCount; n++) free(context->sourceTexts[n]);
+
+    free(context->sourceNames);
+    free(context->sourceTexts);
+    FreeArena(&context->arena);
+    free(context->strings.entries);
+    free(context->types.types);
+    free(context->symbols.symbols);
+    pthread_mutex_destroy(&context->lock);
+    free(context);
+}
+
+void ReportDiagnosticList(const char *format, va_list arguments)
+{
+    char message[1024];
+    vsnprintf(message, sizeof(message), format, arguments);
+
+    DiagnosticTrap *trap = diagnosticTrap;
+
+    if(!trap)
+    {
+        printf("%s\n", message);
+        return;
+    }
+
+    trap->messageCount++;
+    trap->messages = (char**)realloc(trap->messages, sizeof(char*) * trap->messageCount);
+    trap->messages[trap->messageCount - 1] = strdup(message);
+}
+
+// a problem that does not stop the compilation by itself
+void ReportDiagnostic(const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    ReportDiagnosticList(format, arguments);
+    va_end(arguments);
+}
+
+void AbortCompilation(void)
+{
+    if(diagnosticTrap) longjmp(diagnosticTrap->recover, 1);
+    exit(1);
+}
+
+void CompileError(const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    ReportDiagnosticList(format, arguments);
+    va_end(arguments);
+
+    AbortCompilation();
+}
@@ -0,0 +1,73 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+
+#include "symbol.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+    ArenaBlock *next;
+    unsigned int used;
+    unsigned int capacity;
+    char data[];
+};
+
+// memory that lives exactly as long as its context, freed all at once
+typedef struct {
+    ArenaBlock *blocks;
+    unsigned long long allocatedBytes;
+} Arena;
+
+// open addressing set of strings, every distinct text is stored once in the arena
+typedef struct {
+    const char **entries;
+    unsigned int capacity;
+    unsigned int count;
+} StringTable;
+
+// everything one compilation owns. compilations with different contexts share no mutable state,
+// so they can run on different threads at the same time
+typedef struct {
+    Arena arena;
+    StringTable strings;
+    TypeTable types;
+    SymbolTable symbols;
+
+    // files handed over in memory. while there are any, modules are only looked up here, never on disk
+    const char **sourceNames;   // interned
+    char **sourceTexts;
+    unsigned int sourceCount;
+
+    // the modules of one compilation are lexed in parallel and intern into the same table
+    pthread_mutex_t lock;
+} CompilerContext;
+
+// while a trap is set on a thread, errors found on it are collected and unwind to the trap.
+// without one they are printed and end the process, which is all the command line needs
+typedef struct {
+    jmp_buf recover;
+    char **messages;
+    unsigned int messageCount;
+} DiagnosticTrap;
+
+extern __thread DiagnosticTrap *diagnosticTrap;
+
+CompilerContext *CreateContext(void);
+void DestroyContext(CompilerContext *context);
+
+void *ArenaAllocate(Arena *arena, unsigned int size);
+const char *InternString(CompilerContext *context, const char *text, unsigned int length);
+
+void AddSource(CompilerContext *context, const char *name, const char *text);
+const char *FindSource(CompilerContext *context, const char *name);
+
+void ReportDiagnostic(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void AbortCompilation(void) __attribute__((noreturn));
+void CompileError(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif //CONTEXT_H
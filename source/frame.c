@@ -0,0 +1,362 @@
+#include "frame.h"
+#include "layout.h"
+
+// variables living in the stack frame, one per alloca
+typedef struct {
+    IRFunction *function;
+
+    Index *objects;
+    unsigned int objectCount;
+    TypeLayout *layouts;
+
+    int *objectOf;          // per value, the object an address points into or -1
+    bool *isEscaped;        // per object, its address went somewhere the analysis cannot follow
+    bool *interferes;       // objectCount x objectCount
+
+    bool **liveIn;          // per block, per object
+    bool **liveOut;
+
+    bool noColoring;        // every object keeps a slot of its own
+} FrameBuilder;
+
+void FindFrameObjects(FrameBuilder *frame, IRModule *module)
+{
+    IRFunction *function = frame->function;
+
+    frame->objectOf = (int*)malloc(sizeof(int) * function->instCount);
+    for(unsigned int n = 0; n < function->instCount; n++) frame->objectOf[n] = -1;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead || inst->opcode != IR_ALLOCA) continue;
+
+        frame->objectOf[n] = frame->objectCount;
+        PushIndex(&frame->objects, &frame->objectCount, n);
+
+        frame->layouts = (TypeLayout*)realloc(frame->layouts, sizeof(TypeLayout) * frame->objectCount);
+        frame->layouts[frame->objectCount - 1] = GetTypeLayout(module, inst->type);
+    }
+
+    frame->isEscaped = (bool*)calloc(frame->objectCount, sizeof(bool));
+    frame->interferes = (bool*)calloc(frame->objectCount * frame->objectCount, sizeof(bool));
+
+    // derived addresses, also through phis of strength reduced loops
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead) continue;
+
+            bool isAddress = inst->opcode == IR_FIELD_ADDR || inst->opcode == IR_INDEX_ADDR ||
+                             inst->opcode == IR_ADVANCE_ADDR || inst->opcode == IR_OFFSET_ADDR;
+            if(!isAddress && inst->opcode != IR_PHI) continue;
+
+            for(unsigned int o = 0; o < (isAddress ? 1 : inst->operandCount); o++)
+            {
+                int object = frame->objectOf[inst->operands[o]];
+                if(object == -1) continue;
+
+                if(frame->objectOf[n] == -1)
+                {
+                    frame->objectOf[n] = object;
+                    changed = true;
+                }
+                else if(frame->objectOf[n] != object && !frame->isEscaped[object])
+                {
+                    frame->isEscaped[object] = frame->isEscaped[frame->objectOf[n]] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // an address stored to memory may be used anywhere later
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead || inst->opcode != IR_STORE) continue;
+
+        int object = frame->objectOf[inst->operands[1]];
+        if(object != -1) frame->isEscaped[object] = true;
+    }
+}
+
+// object the instruction overwrites completely, its contents before do not matter
+int GetKilledObject(FrameBuilder *frame, IRInst *inst)
+{
+    if(inst->opcode != IR_ZERO && inst->opcode != IR_MEMCOPY) return -1;
+
+    Index dest = inst->operands[0];
+    return frame->function->insts[dest].opcode == IR_ALLOCA ? frame->objectOf[dest] : -1;
+}
+
+bool IsMemoryAccess(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case IR_LOAD:
+        case IR_STORE:
+        case IR_ZERO:
+        case IR_MEMCOPY:
+        case IR_CALL:
+        case IR_RET:
+        return true;
+
+        default:
+        return false;
+    }
+}
+
+void MarkInterference(FrameBuilder *frame, int a, bool *live)
+{
+    for(unsigned int b = 0; b < frame->objectCount; b++)
+    {
+        if(!live[b] || b == (unsigned int)a) continue;
+
+        frame->interferes[a * frame->objectCount + b] = true;
+        frame->interferes[b * frame->objectCount + a] = true;
+    }
+}
+
+// walks a block backwards from its live out set, recording interference on the way when asked to
+void TransferBlock(FrameBuilder *frame, Index block, bool *live, bool recordInterference)
+{
+    IRFunction *function = frame->function;
+    IRBlock *b = &function->blocks[block];
+
+    if(recordInterference)
+    {
+        for(unsigned int n = 0; n < frame->objectCount; n++)
+        {
+            if(live[n]) MarkInterference(frame, n, live);
+        }
+    }
+
+    for(int i = b->instCount - 1; i >= 0; i--)
+    {
+        IRInst *inst = &function->insts[b->insts[i]];
+        if(!IsMemoryAccess(inst->opcode)) continue;
+
+        int killed = GetKilledObject(frame, inst);
+
+        if(killed != -1)
+        {
+            if(recordInterference) MarkInterference(frame, killed, live);
+            live[killed] = false;
+        }
+
+        for(unsigned int o = 0; o < inst->operandCount; o++)
+        {
+            int object = frame->objectOf[inst->operands[o]];
+            if(object == -1 || (o == 0 && object == killed)) continue;
+
+            if(!live[object] && recordInterference) MarkInterference(frame, object, live);
+            live[object] = true;
+        }
+    }
+}
+
+void ComputeFrameInterference(FrameBuilder *frame)
+{
+    IRFunction *function = frame->function;
+    unsigned int count = frame->objectCount;
+
+    frame->liveIn = (bool**)calloc(function->blockCount, sizeof(bool*));
+    frame->liveOut = (bool**)calloc(function->blockCount, sizeof(bool*));
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        frame->liveIn[block] = (bool*)calloc(count, sizeof(bool));
+        frame->liveOut[block] = (bool*)calloc(count, sizeof(bool));
+    }
+
+    bool *live = (bool*)malloc(sizeof(bool) * (count ? count : 1));
+    bool changed = true;
+
+    while(changed)
+    {
+        changed = false;
+
+        for(int block = function->blockCount - 1; block >= 0; block--)
+        {
+            if(function->blocks[block].isDead) continue;
+
+            Index successors[IR_MAX_SUCCESSORS];
+            unsigned int successorCount = GetSuccessors(function, block, successors);
+
+            for(unsigned int s = 0; s < successorCount; s++)
+            {
+                for(unsigned int n = 0; n < count; n++)
+                {
+                    if(frame->liveIn[successors[s]][n]) frame->liveOut[block][n] = true;
+                }
+            }
+
+            memcpy(live, frame->liveOut[block], sizeof(bool) * count);
+            TransferBlock(frame, block, live, false);
+
+            if(memcmp(live, frame->liveIn[block], sizeof(bool) * count))
+            {
+                memcpy(frame->liveIn[block], live, sizeof(bool) * count);
+                changed = true;
+            }
+        }
+    }
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        if(function->blocks[block].isDead) continue;
+
+        memcpy(live, frame->liveOut[block], sizeof(bool) * count);
+        TransferBlock(frame, block, live, true);
+    }
+
+    for(unsigned int n = 0; n < count; n++)
+    {
+        if(!frame->isEscaped[n]) continue;
+
+        for(unsigned int m = 0; m < count; m++)
+        {
+            frame->interferes[n * count + m] = frame->interferes[m * count + n] = (n != m);
+        }
+    }
+
+    free(live);
+}
+
+// objects sharing a slot never live at the same time, a slot is as big and as aligned as its largest member
+void LayoutFrame(FrameBuilder *frame, unsigned int *naiveSize, unsigned int *slotCount)
+{
+    IRFunction *function = frame->function;
+    unsigned int count = frame->objectCount;
+
+    // by alignment then size, largest first
+    Index *order = (Index*)malloc(sizeof(Index) * (count ? count : 1));
+
+    for(unsigned int n = 0; n < count; n++)
+    {
+        unsigned int m = n;
+
+        while(m > 0 && (frame->layouts[order[m - 1]].align < frame->layouts[n].align ||
+                        (frame->layouts[order[m - 1]].align == frame->layouts[n].align && frame->layouts[order[m - 1]].size < frame->layouts[n].size)))
+        {
+            order[m] = order[m - 1];
+            m--;
+        }
+
+        order[m] = n;
+    }
+
+    int *slotOf = (int*)malloc(sizeof(int) * (count ? count : 1));
+    TypeLayout *slots = 0;
+    *slotCount = 0;
+
+    for(unsigned int n = 0; n < count; n++)
+    {
+        Index object = order[n];
+        TypeLayout layout = frame->layouts[object];
+        int best = -1;
+
+        for(unsigned int slot = 0; slot < *slotCount && !frame->noColoring; slot++)
+        {
+            bool isFree = true;
+
+            for(unsigned int m = 0; m < n && isFree; m++)
+            {
+                if(slotOf[order[m]] == (int)slot && frame->interferes[object * count + order[m]]) isFree = false;
+            }
+
+            if(!isFree) continue;
+
+            // the slot wasting the fewest bytes
+            unsigned int waste = abs((int)slots[slot].size - (int)layout.size);
+            if(best == -1 || waste < (unsigned int)abs((int)slots[best].size - (int)layout.size)) best = slot;
+        }
+
+        if(best == -1)
+        {
+            (*slotCount)++;
+            slots = (TypeLayout*)realloc(slots, sizeof(TypeLayout) * *slotCount);
+            slots[*slotCount - 1] = layout;
+            best = *slotCount - 1;
+        }
+
+        if(layout.size > slots[best].size) slots[best].size = layout.size;
+        if(layout.align > slots[best].align) slots[best].align = layout.align;
+        slotOf[object] = best;
+    }
+
+    // slots came out ordered by alignment already, so there is padding only where sizes demand it
+    unsigned int *slotOffsets = (unsigned int*)malloc(sizeof(unsigned int) * (*slotCount ? *slotCount : 1));
+    unsigned int offset = 0;
+
+    for(unsigned int slot = 0; slot < *slotCount; slot++)
+    {
+        offset = AlignUp(offset, slots[slot].align);
+        slotOffsets[slot] = offset;
+        offset += slots[slot].size;
+    }
+
+    for(unsigned int n = 0; n < count; n++) function->insts[frame->objects[n]].value = slotOffsets[slotOf[n]];
+
+    function->frameSize = AlignUp(offset, 16);
+    function->isFrameLaidOut = true;
+
+    // what declaration order without sharing would take
+    offset = 0;
+    for(unsigned int n = 0; n < count; n++) offset = AlignUp(offset, frame->layouts[n].align) + frame->layouts[n].size;
+    *naiveSize = AlignUp(offset, 16);
+
+    free(order);
+    free(slotOf);
+    free(slots);
+    free(slotOffsets);
+}
+
+void FreeFrameBuilder(FrameBuilder *frame)
+{
+    for(unsigned int block = 0; block < frame->function->blockCount; block++)
+    {
+        free(frame->liveIn[block]);
+        free(frame->liveOut[block]);
+    }
+
+    free(frame->liveIn);
+    free(frame->liveOut);
+    free(frame->objects);
+    free(frame->layouts);
+    free(frame->objectOf);
+    free(frame->isEscaped);
+    free(frame->interferes);
+}
+
+bool LayoutStackFrames(IRModule *module)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        FrameBuilder frame = {0};
+        frame.function = &module->functions[n];
+        frame.noColoring = module->options->frame.noColoring;
+
+        FindFrameObjects(&frame, module);
+        ComputeFrameInterference(&frame);
+
+        unsigned int naiveSize, slotCount;
+        LayoutFrame(&frame, &naiveSize, &slotCount);
+
+        if(module->options->printReport && !module->isQuiet && frame.objectCount > 0)
+        {
+            printf("frame: '%s': %u variables in %u slots, %u bytes instead of %u\n",
+                   frame.function->name, frame.objectCount, slotCount, frame.function->frameSize, naiveSize);
+        }
+
+        FreeFrameBuilder(&frame);
+    }
+
+    return module->functionCount > 0;
+}
@@ -0,0 +1,8 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "ir.h"
+
+bool LayoutStackFrames(IRModule *module);
+
+#endif //FRAME_H
@@ -0,0 +1,571 @@
+#include "hash.h"
+#include "symbol.h"
+
+typedef struct {
+    unsigned long long hash;
+    bool isEntry;
+    unsigned int position;      // in the program's definitions
+} FunctionHash;
+
+// 64 bit fnv-1a
+unsigned long long HashBytes(unsigned long long hash, const void *bytes, unsigned int length)
+{
+    const unsigned char *b = (const unsigned char*)bytes;
+
+    for(unsigned int n = 0; n < length; n++)
+    {
+        hash ^= b[n];
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+unsigned long long HashValue(unsigned long long hash, unsigned long long value)
+{
+    return HashBytes(hash, &value, sizeof(value));
+}
+
+// the terminator is hashed too, so "ab" + "c" and "a" + "bc" differ
+unsigned long long HashString(unsigned long long hash, const char *string)
+{
+    if(!string) return HashValue(hash, 0);
+    return HashBytes(hash, string, strlen(string) + 1);
+}
+
+unsigned long long HashNode(AST *ast, Index index, unsigned long long *hashes);
+
+unsigned long long HashNodeList(AST *ast, unsigned long long hash, Index *list, unsigned int count, unsigned long long *hashes)
+{
+    hash = HashValue(hash, count);
+    for(unsigned int n = 0; n < count; n++) hash = HashValue(hash, HashNode(ast, list[n], hashes));
+    return hash;
+}
+
+// function names are left out, so two definitions with the same parameters and body hash the same
+unsigned long long HashNode(AST *ast, Index index, unsigned long long *hashes)
+{
+    if(hashes[index]) return hashes[index];
+
+    Node *node = &ast->nodeList[index];
+    unsigned long long hash = HashValue(HASH_SEED, node->type);
+
+    switch(node->type)
+    {
+        case NODE_PROGRAM:
+        {
+            hash = HashNodeList(ast, hash, node->program.definitions, node->program.defCount, hashes);
+        }
+        break;
+
+        case NODE_STRUCT_DEF:
+        {
+            hash = HashString(hash, node->structDef.name);
+            hash = HashValue(hash, node->structDef.isFixedLayout);
+            hash = HashNodeList(ast, hash, node->structDef.fields, node->structDef.fieldCount, hashes);
+        }
+        break;
+
+        case NODE_FUNC_DEF:
+        {
+            hash = HashNodeList(ast, hash, node->functionDef.parameters, node->functionDef.parameterCount, hashes);
+            hash = HashValue(hash, node->functionDef.isReturnTypeDeclared);
+            if(node->functionDef.isReturnTypeDeclared) hash = HashValue(hash, HashNode(ast, node->functionDef.returnType, hashes));
+            hash = HashValue(hash, HashNode(ast, node->functionDef.body, hashes));
+        }
+        break;
+
+        case NODE_FUNC_CALL:
+        {
+            hash = HashString(hash, node->functionCall.id);
+            hash = HashNodeList(ast, hash, node->functionCall.arguments, node->functionCall.argumentCount, hashes);
+        }
+        break;
+
+        case NODE_STATEMENT_LIST:
+        {
+            hash = HashNodeList(ast, hash, node->statementList.statements, node->statementList.statementCount, hashes);
+        }
+        break;
+
+        case NODE_VAR_DECL:
+        case NODE_FIELD:
+        case NODE_PARAM:
+        {
+            hash = HashValue(hash, HashNode(ast, node->varDecl.id, hashes));
+            hash = HashValue(hash, HashNode(ast, node->varDecl.type, hashes));
+        }
+        break;
+
+        case NODE_L_VALUE:
+        {
+            hash = HashNodeList(ast, hash, node->lValue.simpleLValues, node->lValue.simpleLValueCount, hashes);
+        }
+        break;
+
+        case NODE_ARRAY_ACCESS:
+        {
+            hash = HashValue(hash, HashNode(ast, node->arrayAccess.id, hashes));
+            hash = HashValue(hash, HashNode(ast, node->arrayAccess.expr, hashes));
+        }
+        break;
+
+        case NODE_OPERATOR:
+        {
+            hash = HashValue(hash, node->operator.opType);
+            hash = HashValue(hash, HashNode(ast, node->operator.left, hashes));
+            if(node->operator.opType != BOOL_OP_NOT) hash = HashValue(hash, HashNode(ast, node->operator.right, hashes));
+        }
+        break;
+
+        case NODE_ASSIGN_STATEMENT:
+        {
+            hash = HashValue(hash, HashNode(ast, node->assignStmt.lValue, hashes));
+            hash = HashValue(hash, HashNode(ast, node->assignStmt.expression, hashes));
+        }
+        break;
+
+        case NODE_IF_STATEMENT:
+        {
+            hash = HashValue(hash, HashNode(ast, node->ifStmt.conditionExpr, hashes));
+            hash = HashValue(hash, HashNode(ast, node->ifStmt.trueBlock, hashes));
+            hash = HashValue(hash, node->ifStmt.falseBlockExist);
+            if(node->ifStmt.falseBlockExist) hash = HashValue(hash, HashNode(ast, node->ifStmt.falseBlock, hashes));
+        }
+        break;
+
+        case NODE_WHILE_STATEMENT:
+        {
+            hash = HashValue(hash, HashNode(ast, node->whileStmt.conditionExpr, hashes));
+            hash = HashValue(hash, HashNode(ast, node->whileStmt.block, hashes));
+        }
+        break;
+
+        case NODE_RETURN_STATEMENT:
+        {
+            hash = HashValue(hash, node->returnStmt.exprExist);
+            if(node->returnStmt.exprExist) hash = HashValue(hash, HashNode(ast, node->returnStmt.expression, hashes));
+        }
+        break;
+
+        case NODE_IDENTIFIER:
+        case NODE_STRING_CONSTANT:
+        {
+            hash = HashString(hash, node->identifier.value);
+        }
+        break;
+
+        case NODE_INTEGER_CONSTANT:
+        {
+            hash = HashValue(hash, (unsigned int)node->integer.value);
+        }
+        break;
+
+        case NODE_TYPE_ANNOTATION:
+        {
+            hash = HashString(hash, node->typeAnnotation.id);
+            hash = HashValue(hash, node->typeAnnotation.isArrayType);
+            hash = HashValue(hash, node->typeAnnotation.arrayDim);
+        }
+        break;
+    }
+
+    // zero marks a node not hashed yet
+    if(hash == 0) hash = 1;
+
+    hashes[index] = hash;
+    return hash;
+}
+
+// one hash per node in the list, zero for nodes folding or evaluation left unreachable from root
+unsigned long long *HashASTNodes(AST *ast, Index root)
+{
+    unsigned long long *hashes = (unsigned long long*)calloc(ast->nodeCount ? ast->nodeCount : 1, sizeof(unsigned long long));
+    HashNode(ast, root, hashes);
+    return hashes;
+}
+
+bool AreNamesEqual(const char *a, const char *b)
+{
+    return (a == b) || (a && b && !strcmp(a, b));
+}
+
+bool AreNodeListsEqual(AST *ast, Index *a, unsigned int aCount, Index *b, unsigned int bCount)
+{
+    if(aCount != bCount) return false;
+
+    for(unsigned int n = 0; n < aCount; n++)
+    {
+        if(!AreNodesEqual(ast, a[n], b[n])) return false;
+    }
+
+    return true;
+}
+
+// the same comparison the hash summarizes, hashes only say where to look
+bool AreNodesEqual(AST *ast, Index a, Index b)
+{
+    if(a == b) return true;
+
+    Node *x = &ast->nodeList[a];
+    Node *y = &ast->nodeList[b];
+
+    if(x->type != y->type) return false;
+
+    switch(x->type)
+    {
+        case NODE_PROGRAM:
+        return AreNodeListsEqual(ast, x->program.definitions, x->program.defCount, y->program.definitions, y->program.defCount);
+
+        case NODE_STRUCT_DEF:
+        return AreNamesEqual(x->structDef.name, y->structDef.name) && x->structDef.isFixedLayout == y->structDef.isFixedLayout &&
+               AreNodeListsEqual(ast, x->structDef.fields, x->structDef.fieldCount, y->structDef.fields, y->structDef.fieldCount);
+
+        case NODE_FUNC_DEF:
+        {
+            if(x->functionDef.isReturnTypeDeclared != y->functionDef.isReturnTypeDeclared) return false;
+            if(x->functionDef.isReturnTypeDeclared && !AreNodesEqual(ast, x->functionDef.returnType, y->functionDef.returnType)) return false;
+
+            return AreNodeListsEqual(ast, x->functionDef.parameters, x->functionDef.parameterCount, y->functionDef.parameters, y->functionDef.parameterCount) &&
+                   AreNodesEqual(ast, x->functionDef.body, y->functionDef.body);
+        }
+
+        case NODE_FUNC_CALL:
+        return AreNamesEqual(x->functionCall.id, y->functionCall.id) &&
+               AreNodeListsEqual(ast, x->functionCall.arguments, x->functionCall.argumentCount, y->functionCall.arguments, y->functionCall.argumentCount);
+
+        case NODE_STATEMENT_LIST:
+        return AreNodeListsEqual(ast, x->statementList.statements, x->statementList.statementCount, y->statementList.statements, y->statementList.statementCount);
+
+        case NODE_VAR_DECL:
+        case NODE_FIELD:
+        case NODE_PARAM:
+        return AreNodesEqual(ast, x->varDecl.id, y->varDecl.id) && AreNodesEqual(ast, x->varDecl.type, y->varDecl.type);
+
+        case NODE_L_VALUE:
+        return AreNodeListsEqual(ast, x->lValue.simpleLValues, x->lValue.simpleLValueCount, y->lValue.simpleLValues, y->lValue.simpleLValueCount);
+
+        case NODE_ARRAY_ACCESS:
+        return AreNodesEqual(ast, x->arrayAccess.id, y->arrayAccess.id) && AreNodesEqual(ast, x->arrayAccess.expr, y->arrayAccess.expr);
+
+        case NODE_OPERATOR:
+        {
+            if(x->operator.opType != y->operator.opType || !AreNodesEqual(ast, x->operator.left, y->operator.left)) return false;
+            return x->operator.opType == BOOL_OP_NOT || AreNodesEqual(ast, x->operator.right, y->operator.right);
+        }
+
+        case NODE_ASSIGN_STATEMENT:
+        return AreNodesEqual(ast, x->assignStmt.lValue, y->assignStmt.lValue) && AreNodesEqual(ast, x->assignStmt.expression, y->assignStmt.expression);
+
+        case NODE_IF_STATEMENT:
+        {
+            if(x->ifStmt.falseBlockExist != y->ifStmt.falseBlockExist) return false;
+            if(x->ifStmt.falseBlockExist && !AreNodesEqual(ast, x->ifStmt.falseBlock, y->ifStmt.falseBlock)) return false;
+
+            return AreNodesEqual(ast, x->ifStmt.conditionExpr, y->ifStmt.conditionExpr) && AreNodesEqual(ast, x->ifStmt.trueBlock, y->ifStmt.trueBlock);
+        }
+
+        case NODE_WHILE_STATEMENT:
+        return AreNodesEqual(ast, x->whileStmt.conditionExpr, y->whileStmt.conditionExpr) && AreNodesEqual(ast, x->whileStmt.block, y->whileStmt.block);
+
+        case NODE_RETURN_STATEMENT:
+        {
+            if(x->returnStmt.exprExist != y->returnStmt.exprExist) return false;
+            return !x->returnStmt.exprExist || AreNodesEqual(ast, x->returnStmt.expression, y->returnStmt.expression);
+        }
+
+        case NODE_IDENTIFIER:
+        case NODE_STRING_CONSTANT:
+        return AreNamesEqual(x->identifier.value, y->identifier.value);
+
+        case NODE_INTEGER_CONSTANT:
+        return x->integer.value == y->integer.value;
+
+        case NODE_TYPE_ANNOTATION:
+        return AreNamesEqual(x->typeAnnotation.id, y->typeAnnotation.id) && x->typeAnnotation.isArrayType == y->typeAnnotation.isArrayType &&
+               x->typeAnnotation.arrayDim == y->typeAnnotation.arrayDim;
+
+        default:
+        return false;
+    }
+}
+
+// equal hashes end up next to each other, the entry first so it is the one that survives
+int CompareFunctionHashes(const void *a, const void *b)
+{
+    const FunctionHash *x = (const FunctionHash*)a;
+    const FunctionHash *y = (const FunctionHash*)b;
+
+    if(x->hash != y->hash) return (x->hash < y->hash) ? -1 : 1;
+    if(x->isEntry != y->isEntry) return x->isEntry ? -1 : 1;
+    return (x->position < y->position) ? -1 : (x->position > y->position);
+}
+
+void RedirectAliasCall(AST *ast, Index index, void *data)
+{
+    Node *node = &ast->nodeList[index];
+    if(node->type != NODE_FUNC_CALL) return;
+
+    NameTable *table = (NameTable*)data;
+    int canonical = LookupName(table, node->functionCall.id, -1);
+    if(canonical != -1) node->functionCall.id = ast->nodeList[canonical].functionDef.name;
+}
+
+// finds functions with the same definition and keeps one of each, the others become aliases
+// whose calls go to the one kept. returns the number of aliases made
+unsigned int MergeRound(AST *ast, Index program, const char *entry, bool printReport)
+{
+    Node *node = &ast->nodeList[program];
+    unsigned long long *hashes = HashASTNodes(ast, program);
+
+    FunctionHash *functions = 0;
+    unsigned int functionCount = 0;
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Node *def = &ast->nodeList[node->program.definitions[n]];
+        if(def->type != NODE_FUNC_DEF) continue;
+
+        FunctionHash function = {hashes[node->program.definitions[n]], entry && !strcmp(def->functionDef.name, entry), n};
+
+        functionCount++;
+        functions = (FunctionHash*)realloc(functions, sizeof(FunctionHash) * functionCount);
+        functions[functionCount - 1] = function;
+    }
+
+    if(functionCount > 1) qsort(functions, functionCount, sizeof(FunctionHash), CompareFunctionHashes);
+
+    NameTable aliases = {0};
+    bool *isAlias = (bool*)calloc(node->program.defCount ? node->program.defCount : 1, sizeof(bool));
+    unsigned int aliasCount = 0;
+
+    for(unsigned int n = 0; n < functionCount; n++)
+    {
+        Index def = node->program.definitions[functions[n].position];
+
+        // a hash collision leaves several different definitions in one group, compare against each survivor
+        for(unsigned int k = n; k-- > 0 && functions[k].hash == functions[n].hash;)
+        {
+            Index canonical = node->program.definitions[functions[k].position];
+            if(isAlias[functions[k].position] || !AreNodesEqual(ast, canonical, def)) continue;
+
+            InsertName(&aliases, ast->nodeList[def].functionDef.name, canonical);
+            isAlias[functions[n].position] = true;
+            aliasCount++;
+
+            if(printReport) printf("merge: '%s' is an alias of '%s'\n", ast->nodeList[def].functionDef.name, ast->nodeList[canonical].functionDef.name);
+            break;
+        }
+    }
+
+    if(aliasCount > 0)
+    {
+        for(unsigned int n = 0; n < node->program.defCount; n++)
+        {
+            if(!isAlias[n]) VisitNodes(ast, node->program.definitions[n], RedirectAliasCall, &aliases);
+        }
+
+        unsigned int keptCount = 0;
+
+        for(unsigned int n = 0; n < node->program.defCount; n++)
+        {
+            if(!isAlias[n]) node->program.definitions[keptCount++] = node->program.definitions[n];
+        }
+
+        node->program.defCount = keptCount;
+    }
+
+    free(isAlias);
+    FreeNameTable(&aliases);
+    free(functions);
+    free(hashes);
+
+    return aliasCount;
+}
+
+// merging callees can make their callers identical, so this repeats until nothing merges
+bool MergeIdenticalFunctions(AST *ast, Index program, const char *entry, bool printReport)
+{
+    unsigned int aliasCount = 0;
+    unsigned int roundCount = 0;
+
+    for(;;)
+    {
+        unsigned int merged = MergeRound(ast, program, entry, printReport);
+        if(merged == 0) break;
+
+        aliasCount += merged;
+        roundCount++;
+    }
+
+    if(printReport) printf("merge: %u function%s merged into identical ones in %u round%s\n", aliasCount, aliasCount == 1 ? "" : "s", roundCount, roundCount == 1 ? "" : "s");
+
+    return aliasCount > 0;
+}
+
+bool IsCommonSubexpressionCandidate(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case IR_CONST:
+        case IR_STRING:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_LT:
+        case IR_GT:
+        case IR_EQ_EQ:
+        case IR_NOT_EQ:
+        case IR_LT_EQ:
+        case IR_GT_EQ:
+        case IR_NOT:
+        case IR_FIELD_ADDR:
+        case IR_INDEX_ADDR:
+        case IR_ADVANCE_ADDR:
+        case IR_OFFSET_ADDR:
+        case IR_LOAD:
+        return true;
+
+        default:
+        return false;
+    }
+}
+
+// add is left out, on strings it concatenates
+bool IsCommutative(unsigned int opcode)
+{
+    return opcode == IR_MUL || opcode == IR_EQ_EQ || opcode == IR_NOT_EQ;
+}
+
+bool AreTypesEqual(IRType a, IRType b)
+{
+    return AreNamesEqual(a.id, b.id) && a.isArrayType == b.isArrayType && a.arrayDim == b.arrayDim &&
+           a.isAggregate == b.isAggregate;
+}
+
+unsigned long long HashIRInst(IRInst *inst, unsigned int memoryVersion)
+{
+    unsigned long long hash = HashValue(HASH_SEED, inst->opcode);
+    hash = HashValue(hash, (unsigned int)inst->value);
+    hash = HashValue(hash, inst->scale);
+    hash = HashString(hash, inst->name);
+    hash = HashString(hash, inst->type.id);
+
+    for(unsigned int n = 0; n < inst->operandCount; n++) hash = HashValue(hash, (unsigned int)inst->operands[n]);
+
+    // a load only matches one with no store or call in between
+    if(inst->opcode == IR_LOAD) hash = HashValue(hash, memoryVersion);
+
+    return hash;
+}
+
+bool AreInstsEqual(IRInst *a, IRInst *b)
+{
+    if(a->opcode != b->opcode || a->value != b->value || a->scale != b->scale || a->operandCount != b->operandCount) return false;
+    if(!AreNamesEqual(a->name, b->name) || !AreTypesEqual(a->type, b->type)) return false;
+
+    for(unsigned int n = 0; n < a->operandCount; n++)
+    {
+        if(a->operands[n] != b->operands[n]) return false;
+    }
+
+    return true;
+}
+
+// local value numbering, an instruction computing what an earlier one in the same block already did is replaced by it
+bool EliminateCommonSubexpressions(IRFunction *function, const Options *options)
+{
+    Index *replacement = (Index*)malloc(sizeof(Index) * (function->instCount ? function->instCount : 1));
+    unsigned int *versions = (unsigned int*)calloc(function->instCount ? function->instCount : 1, sizeof(unsigned int));
+    for(unsigned int n = 0; n < function->instCount; n++) replacement[n] = n;
+
+    unsigned int capacity = 0;
+    Index *table = 0;
+    unsigned int eliminatedCount = 0;
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        IRBlock *b = &function->blocks[block];
+        if(b->isDead) continue;
+
+        unsigned int needed = 16;
+        while(needed < b->instCount * 2) needed *= 2;
+
+        if(needed > capacity)
+        {
+            capacity = needed;
+            table = (Index*)realloc(table, sizeof(Index) * capacity);
+        }
+
+        for(unsigned int n = 0; n < capacity; n++) table[n] = IR_NONE;
+
+        unsigned int memoryVersion = 0;
+
+        for(unsigned int i = 0; i < b->instCount; i++)
+        {
+            Index index = b->insts[i];
+            IRInst *inst = &function->insts[index];
+
+            // operands from earlier blocks may already have been replaced
+            for(unsigned int n = 0; n < inst->operandCount; n++) inst->operands[n] = replacement[inst->operands[n]];
+
+            if(HasSideEffects(inst->opcode) && inst->opcode != IR_BOUNDS_CHECK) memoryVersion++;
+            if(!IsCommonSubexpressionCandidate(inst->opcode)) continue;
+
+            if(IsCommutative(inst->opcode) && inst->operands[0] > inst->operands[1])
+            {
+                Index left = inst->operands[0];
+                inst->operands[0] = inst->operands[1];
+                inst->operands[1] = left;
+            }
+
+            versions[index] = memoryVersion;
+            unsigned int slot = HashIRInst(inst, memoryVersion) & (capacity - 1);
+
+            while(table[slot] != IR_NONE)
+            {
+                IRInst *other = &function->insts[table[slot]];
+                if(AreInstsEqual(other, inst) && (inst->opcode != IR_LOAD || versions[table[slot]] == memoryVersion)) break;
+
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            if(table[slot] == IR_NONE)
+            {
+                table[slot] = index;
+                continue;
+            }
+
+            replacement[index] = table[slot];
+            eliminatedCount++;
+        }
+    }
+
+    // uses in phis and in blocks visited before the definition
+    if(eliminatedCount > 0)
+    {
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead) continue;
+
+            if(replacement[n] != (Index)n)
+            {
+                RemoveInst(function, n);
+                continue;
+            }
+
+            for(unsigned int k = 0; k < inst->operandCount; k++) inst->operands[k] = replacement[inst->operands[k]];
+        }
+    }
+
+    if(options->printReport && eliminatedCount > 0) printf("cse: '%s': %u instruction%s computed earlier in the same block\n", function->name, eliminatedCount, eliminatedCount == 1 ? "" : "s");
+
+    free(table);
+    free(versions);
+    free(replacement);
+
+    return eliminatedCount > 0;
+}
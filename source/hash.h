@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "ast.h"
+#include "ir.h"
+
+#define HASH_SEED 14695981039346656037ull
+#define HASH_PRIME 1099511628211ull
+
+// hashes depend only on names, values and operator types, never on node indices or pointers,
+// so the same source hashes the same in every run
+unsigned long long HashBytes(unsigned long long hash, const void *bytes, unsigned int length);
+unsigned long long HashValue(unsigned long long hash, unsigned long long value);
+unsigned long long HashString(unsigned long long hash, const char *string);
+
+unsigned long long *HashASTNodes(AST *ast, Index root);
+bool AreNodesEqual(AST *ast, Index a, Index b);
+bool MergeIdenticalFunctions(AST *ast, Index program, const char *entry, bool printReport);
+bool EliminateCommonSubexpressions(IRFunction *function, const Options *options);
+
+#endif //HASH_H
@@ -0,0 +1,348 @@
+#include "inline.h"
+#include "symbol.h"
+
+// rough size of the code an inlined copy of function adds
+int GetInlineCost(IRFunction *function)
+{
+    int cost = 0;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead) continue;
+
+        switch(inst->opcode)
+        {
+            case IR_PARAM:
+            case IR_PHI:
+            case IR_UNDEF:
+            case IR_CONST:
+            case IR_STRING:
+            case IR_ALLOCA:
+            case IR_JUMP:
+            case IR_RET:
+            break;
+
+            case IR_CALL:       cost += 5; break;
+            case IR_ZERO:
+            case IR_MEMCOPY:    cost += 3; break;
+            default:            cost += 1; break;
+        }
+    }
+
+    return cost;
+}
+
+// true if memory at address may be written or escape through the instructions using it
+bool IsAddressWritten(IRFunction *function, Index address)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead) continue;
+
+        for(unsigned int o = 0; o < inst->operandCount; o++)
+        {
+            if(inst->operands[o] != address) continue;
+
+            switch(inst->opcode)
+            {
+                case IR_FIELD_ADDR:
+                case IR_INDEX_ADDR:
+                case IR_ADVANCE_ADDR:
+                case IR_OFFSET_ADDR:
+                {
+                    if(o != 0 || IsAddressWritten(function, n)) return true;
+                }
+                break;
+
+                case IR_LOAD:
+                break;
+
+                case IR_MEMCOPY:
+                {
+                    if(o == 0) return true;
+                }
+                break;
+
+                default:
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// finds the copy an aggregate argument was made with, if its source can be passed directly
+Index FindForwardableArgumentCopy(IRFunction *caller, Index call, Index argument)
+{
+    IRInst *arg = &caller->insts[argument];
+    if(arg->opcode != IR_ALLOCA || CountUses(caller, argument) != 2) return IR_NONE;
+
+    IRBlock *b = &caller->blocks[caller->insts[call].block];
+    Index copy = IR_NONE;
+
+    for(unsigned int n = 0; n < b->instCount; n++)
+    {
+        IRInst *inst = &caller->insts[b->insts[n]];
+
+        if(b->insts[n] == call) return copy;
+
+        if(inst->opcode == IR_MEMCOPY && inst->operands[0] == argument)
+        {
+            copy = b->insts[n];
+        }
+        else if(copy != IR_NONE && (inst->opcode == IR_STORE || inst->opcode == IR_ZERO))
+        {
+            // the source may change before the call
+            copy = IR_NONE;
+        }
+    }
+
+    return IR_NONE;
+}
+
+Index InlineCallSite(IRFunction *caller, Index call, IRFunction *callee)
+{
+    Index callBlock = caller->insts[call].block;
+    unsigned int position = GetInstPosition(caller, call);
+    Index continueBlock = SplitBlock(caller, callBlock, position + 1);
+
+    Index *blockMap = (Index*)malloc(sizeof(Index) * callee->blockCount);
+    Index *instMap = (Index*)malloc(sizeof(Index) * callee->instCount);
+
+    for(unsigned int n = 0; n < callee->blockCount; n++)
+    {
+        blockMap[n] = callee->blocks[n].isDead ? IR_NONE : NewBlock(caller);
+    }
+
+    for(unsigned int n = 0; n < callee->instCount; n++)
+    {
+        IRInst *inst = &callee->insts[n];
+        instMap[n] = IR_NONE;
+        if(inst->isDead) continue;
+
+        if(inst->opcode == IR_PARAM)
+        {
+            Index argument = caller->insts[call].operands[inst->value];
+
+            // a struct the callee only reads needs no private copy
+            if(inst->type.isAggregate && !IsAddressWritten(callee, n))
+            {
+                Index copy = FindForwardableArgumentCopy(caller, call, argument);
+
+                if(copy != IR_NONE)
+                {
+                    argument = caller->insts[copy].operands[1];
+                    RemoveInst(caller, copy);
+                }
+            }
+
+            instMap[n] = argument;
+        }
+        else
+        {
+            instMap[n] = NewInst(caller, inst->opcode);
+        }
+    }
+
+    Index *returnBlocks = 0;
+    unsigned int returnCount = 0;
+    Index *returnValues = 0;
+    unsigned int returnValueCount = 0;
+
+    for(unsigned int block = 0; block < callee->blockCount; block++)
+    {
+        IRBlock *b = &callee->blocks[block];
+        if(b->isDead) continue;
+
+        for(unsigned int p = 0; p < b->predCount; p++)
+        {
+            PushIndex(&caller->blocks[blockMap[block]].preds, &caller->blocks[blockMap[block]].predCount, blockMap[b->preds[p]]);
+        }
+
+        for(unsigned int n = 0; n < b->instCount; n++)
+        {
+            IRInst *source = &callee->insts[b->insts[n]];
+            if(source->opcode == IR_PARAM) continue;
+
+            Index clone = instMap[b->insts[n]];
+            IRInst *inst = &caller->insts[clone];
+
+            inst->value = source->value;
+            inst->name = source->name;
+            inst->type = source->type;
+            inst->trueTarget = (source->trueTarget != IR_NONE) ? blockMap[source->trueTarget] : IR_NONE;
+            inst->falseTarget = (source->falseTarget != IR_NONE) ? blockMap[source->falseTarget] : IR_NONE;
+
+            for(unsigned int t = 0; t < source->caseCount; t++)
+            {
+                PushIndex(&inst->caseTargets, &inst->caseCount, blockMap[source->caseTargets[t]]);
+            }
+
+            for(unsigned int o = 0; o < source->operandCount; o++)
+            {
+                AddOperand(caller, clone, instMap[source->operands[o]]);
+            }
+
+            if(source->opcode == IR_ALLOCA || source->opcode == IR_UNDEF)
+            {
+                InsertAtEntry(caller, clone);
+            }
+            else if(source->opcode == IR_RET)
+            {
+                // returns become jumps to the code after the call
+                inst = &caller->insts[clone];
+                inst->opcode = IR_JUMP;
+                inst->trueTarget = continueBlock;
+
+                PushIndex(&returnBlocks, &returnCount, blockMap[block]);
+                PushIndex(&returnValues, &returnValueCount, inst->operandCount ? inst->operands[0] : IR_NONE);
+                inst->operandCount = 0;
+
+                AppendInst(caller, blockMap[block], clone);
+                AddEdge(caller, blockMap[block], continueBlock);
+            }
+            else
+            {
+                AppendInst(caller, blockMap[block], clone);
+            }
+        }
+    }
+
+    // enter the inlined body instead of calling
+    RemoveInst(caller, call);
+
+    Index jump = NewInst(caller, IR_JUMP);
+    caller->insts[jump].trueTarget = blockMap[0];
+    AppendInst(caller, callBlock, jump);
+    AddEdge(caller, callBlock, blockMap[0]);
+
+    Index result = IR_NONE;
+
+    if(returnCount == 1 && returnValues[0] != IR_NONE)
+    {
+        result = returnValues[0];
+    }
+    else if(returnCount > 1 && callee->hasReturnValue)
+    {
+        result = NewInst(caller, IR_PHI);
+        caller->insts[result].type = callee->returnType;
+        InsertInst(caller, continueBlock, 0, result);
+
+        for(unsigned int n = 0; n < returnCount; n++)
+        {
+            Index value = returnValues[n];
+
+            if(value == IR_NONE)
+            {
+                value = NewInst(caller, IR_UNDEF);
+                InsertAtEntry(caller, value);
+            }
+
+            AddOperand(caller, result, value);
+        }
+    }
+
+    if(result == IR_NONE && CountUses(caller, call) > 0)
+    {
+        result = NewInst(caller, IR_UNDEF);
+        InsertAtEntry(caller, result);
+    }
+
+    // a returned local can stand in for the caller's copy of the result
+    if(result != IR_NONE && caller->insts[result].opcode == IR_ALLOCA)
+    {
+        for(unsigned int n = 0; n < caller->instCount; n++)
+        {
+            IRInst *inst = &caller->insts[n];
+
+            if(!inst->isDead && inst->opcode == IR_MEMCOPY && inst->operands[1] == call &&
+               caller->insts[inst->operands[0]].opcode == IR_ALLOCA)
+            {
+                Index copy = inst->operands[0];
+                RemoveInst(caller, n);
+                ReplaceAllUses(caller, copy, result);
+                break;
+            }
+        }
+    }
+
+    if(result != IR_NONE) ReplaceAllUses(caller, call, result);
+
+    free(blockMap);
+    free(instMap);
+    free(returnBlocks);
+    free(returnValues);
+
+    return result;
+}
+
+bool InlineFunctions(IRModule *module)
+{
+    const InlineOptions *options = &module->options->inlining;
+    bool printReport = module->options->printReport || options->printReport;
+
+    NameTable functions = {0};
+    for(unsigned int n = 0; n < module->functionCount; n++) InsertName(&functions, module->functions[n].name, n);
+
+    bool changed = false;
+
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *caller = &module->functions[f];
+
+        // how many inlined bodies each call sits in
+        unsigned int *depth = (unsigned int*)calloc(caller->instCount, sizeof(unsigned int));
+
+        for(unsigned int n = 0; n < caller->instCount; n++)
+        {
+            IRInst *inst = &caller->insts[n];
+            if(inst->isDead || inst->opcode != IR_CALL) continue;
+
+            int calleeIndex = LookupName(&functions, inst->name, -1);
+            if(calleeIndex == -1) continue;
+
+            IRFunction *callee = &module->functions[calleeIndex];
+            const char *reason = 0;
+
+            int cost = GetInlineCost(callee);
+            int bonus = options->callBonus;
+
+            for(unsigned int o = 0; o < inst->operandCount; o++)
+            {
+                IRInst *argument = &caller->insts[inst->operands[o]];
+                if(argument->opcode == IR_CONST) bonus += options->constantArgBonus;
+                if(argument->opcode == IR_ALLOCA) bonus += options->aggregateArgBonus;
+            }
+
+            if(callee == caller) reason = "recursive call";
+            else if(depth[n] >= options->maxDepth) reason = "inline depth limit";
+            else if(inst->operandCount != callee->parameterCount) reason = "argument count mismatch";
+            else if(cost - bonus > options->threshold) reason = "over threshold";
+
+            if(printReport)
+            {
+                printf("inline: '%s' into '%s': cost %d, bonus %d, threshold %d -> %s%s%s\n", callee->name, caller->name,
+                       cost, bonus, options->threshold, reason ? "not inlined (" : "inlined", reason ? reason : "", reason ? ")" : "");
+            }
+
+            if(reason) continue;
+
+            unsigned int firstNewInst = caller->instCount;
+            InlineCallSite(caller, n, callee);
+            changed = true;
+
+            depth = (unsigned int*)realloc(depth, sizeof(unsigned int) * caller->instCount);
+            for(unsigned int i = firstNewInst; i < caller->instCount; i++) depth[i] = depth[n] + 1;
+        }
+
+        free(depth);
+    }
+
+    FreeNameTable(&functions);
+    return changed;
+}
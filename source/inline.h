@@ -0,0 +1,11 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ir.h"
+
+int GetInlineCost(IRFunction *function);
+bool IsAddressWritten(IRFunction *function, Index address);
+Index FindForwardableArgumentCopy(IRFunction *caller, Index call, Index argument);
+bool InlineFunctions(IRModule *module);
+
+#endif //INLINE_H
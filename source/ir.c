@@ -0,0 +1,669 @@
+#include "ir.h"
+
+Index NewBlock(IRFunction *function)
+{
+    IRBlock block = {0};
+    block.idom = IR_NONE;
+
+    function->blockCount++;
+    function->blocks = (IRBlock*)realloc(function->blocks, sizeof(IRBlock) * function->blockCount);
+    function->blocks[function->blockCount - 1] = block;
+
+    return function->blockCount - 1;
+}
+
+Index NewInst(IRFunction *function, unsigned int opcode)
+{
+    IRInst inst = {0};
+    inst.opcode = opcode;
+    inst.block = IR_NONE;
+    inst.trueTarget = IR_NONE;
+    inst.falseTarget = IR_NONE;
+
+    function->instCount++;
+    function->insts = (IRInst*)realloc(function->insts, sizeof(IRInst) * function->instCount);
+    function->insts[function->instCount - 1] = inst;
+
+    return function->instCount - 1;
+}
+
+void AppendInst(IRFunction *function, Index block, Index inst)
+{
+    function->insts[inst].block = block;
+    PushIndex(&function->blocks[block].insts, &function->blocks[block].instCount, inst);
+}
+
+void InsertInst(IRFunction *function, Index block, unsigned int position, Index inst)
+{
+    IRBlock *b = &function->blocks[block];
+
+    PushIndex(&b->insts, &b->instCount, inst);
+    memmove(&b->insts[position + 1], &b->insts[position], sizeof(Index) * (b->instCount - 1 - position));
+    b->insts[position] = inst;
+
+    function->insts[inst].block = block;
+}
+
+// undefs and allocas live at the top of the entry block so they dominate every use
+void InsertAtEntry(IRFunction *function, Index inst)
+{
+    IRBlock *entry = &function->blocks[0];
+
+    unsigned int position = 0;
+    while(position < entry->instCount)
+    {
+        unsigned int opcode = function->insts[entry->insts[position]].opcode;
+        if(opcode != IR_PARAM && opcode != IR_ALLOCA && opcode != IR_UNDEF) break;
+        position++;
+    }
+
+    InsertInst(function, 0, position, inst);
+}
+
+void DetachInst(IRFunction *function, Index inst)
+{
+    IRInst *i = &function->insts[inst];
+
+    if(i->block != IR_NONE)
+    {
+        IRBlock *b = &function->blocks[i->block];
+
+        for(unsigned int n = 0; n < b->instCount; n++)
+        {
+            if(b->insts[n] == inst)
+            {
+                memmove(&b->insts[n], &b->insts[n + 1], sizeof(Index) * (b->instCount - n - 1));
+                b->instCount--;
+                break;
+            }
+        }
+    }
+
+    i->block = IR_NONE;
+}
+
+void RemoveInst(IRFunction *function, Index inst)
+{
+    DetachInst(function, inst);
+    function->insts[inst].isDead = true;
+}
+
+void MoveInst(IRFunction *function, Index inst, Index block, unsigned int position)
+{
+    DetachInst(function, inst);
+    InsertInst(function, block, position, inst);
+}
+
+void AddEdge(IRFunction *function, Index from, Index to)
+{
+    PushIndex(&function->blocks[to].preds, &function->blocks[to].predCount, from);
+}
+
+// removes one edge 'from' -> 'to' together with the matching phi operands in 'to'
+void RemoveEdge(IRFunction *function, Index from, Index to)
+{
+    IRBlock *b = &function->blocks[to];
+
+    for(unsigned int p = 0; p < b->predCount; p++)
+    {
+        if(b->preds[p] != from) continue;
+
+        memmove(&b->preds[p], &b->preds[p + 1], sizeof(Index) * (b->predCount - p - 1));
+        b->predCount--;
+
+        for(unsigned int n = 0; n < b->instCount; n++)
+        {
+            IRInst *phi = &function->insts[b->insts[n]];
+            if(phi->opcode != IR_PHI) break;
+
+            memmove(&phi->operands[p], &phi->operands[p + 1], sizeof(Index) * (phi->operandCount - p - 1));
+            phi->operandCount--;
+        }
+
+        break;
+    }
+}
+
+void ReplacePredecessor(IRFunction *function, Index block, Index oldPred, Index newPred)
+{
+    IRBlock *b = &function->blocks[block];
+
+    for(unsigned int p = 0; p < b->predCount; p++)
+    {
+        if(b->preds[p] == oldPred) b->preds[p] = newPred;
+    }
+}
+
+// moves the instructions from position onwards into a new block, the old block is left without a terminator
+Index SplitBlock(IRFunction *function, Index block, unsigned int position)
+{
+    Index tail = NewBlock(function);
+    IRBlock *b = &function->blocks[block];
+
+    for(unsigned int n = position; n < b->instCount; n++)
+    {
+        AppendInst(function, tail, b->insts[n]);
+        b = &function->blocks[block];
+    }
+
+    b->instCount = position;
+
+    Index successors[IR_MAX_SUCCESSORS];
+    unsigned int successorCount = GetSuccessors(function, tail, successors);
+
+    for(unsigned int n = 0; n < successorCount; n++)
+    {
+        ReplacePredecessor(function, successors[n], block, tail);
+    }
+
+    return tail;
+}
+
+bool IsTerminator(unsigned int opcode)
+{
+    return (opcode == IR_JUMP) || (opcode == IR_BRANCH) || (opcode == IR_SWITCH) || (opcode == IR_RET);
+}
+
+bool HasSideEffects(unsigned int opcode)
+{
+    return (opcode == IR_STORE) ||
+           (opcode == IR_ZERO) ||
+           (opcode == IR_MEMCOPY) ||
+           (opcode == IR_BOUNDS_CHECK) ||
+           (opcode == IR_CALL) ||
+           IsTerminator(opcode);
+}
+
+Index GetTerminator(IRFunction *function, Index block)
+{
+    IRBlock *b = &function->blocks[block];
+    if(b->instCount == 0) return IR_NONE;
+
+    Index last = b->insts[b->instCount - 1];
+    return IsTerminator(function->insts[last].opcode) ? last : IR_NONE;
+}
+
+unsigned int GetSuccessors(IRFunction *function, Index block, Index successors[IR_MAX_SUCCESSORS])
+{
+    Index terminator = GetTerminator(function, block);
+    if(terminator == IR_NONE) return 0;
+
+    IRInst *inst = &function->insts[terminator];
+
+    if(inst->opcode == IR_JUMP)
+    {
+        successors[0] = inst->trueTarget;
+        return 1;
+    }
+    else if(inst->opcode == IR_BRANCH)
+    {
+        successors[0] = inst->trueTarget;
+        successors[1] = inst->falseTarget;
+        return 2;
+    }
+    else if(inst->opcode == IR_SWITCH)
+    {
+        // the default first, then each distinct table entry once
+        unsigned int count = 0;
+        successors[count++] = inst->falseTarget;
+
+        for(unsigned int n = 0; n < inst->caseCount; n++)
+        {
+            bool isListed = false;
+            for(unsigned int s = 0; s < count && !isListed; s++) isListed = (successors[s] == inst->caseTargets[n]);
+
+            if(!isListed) successors[count++] = inst->caseTargets[n];
+        }
+
+        return count;
+    }
+
+    return 0;
+}
+
+void ReplaceAllUses(IRFunction *function, Index oldValue, Index newValue)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead) continue;
+
+        for(unsigned int o = 0; o < inst->operandCount; o++)
+        {
+            if(inst->operands[o] == oldValue) inst->operands[o] = newValue;
+        }
+    }
+}
+
+void AddOperand(IRFunction *function, Index inst, Index operand)
+{
+    PushIndex(&function->insts[inst].operands, &function->insts[inst].operandCount, operand);
+}
+
+unsigned int CountUses(IRFunction *function, Index value)
+{
+    unsigned int count = 0;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead) continue;
+
+        for(unsigned int o = 0; o < inst->operandCount; o++)
+        {
+            if(inst->operands[o] == value) count++;
+        }
+    }
+
+    return count;
+}
+
+void NumberBlocksPostOrder(IRFunction *function, Index block, bool *visited, Index *order, unsigned int *count)
+{
+    visited[block] = true;
+
+    Index successors[IR_MAX_SUCCESSORS];
+    unsigned int successorCount = GetSuccessors(function, block, successors);
+
+    for(unsigned int n = 0; n < successorCount; n++)
+    {
+        if(!visited[successors[n]]) NumberBlocksPostOrder(function, successors[n], visited, order, count);
+    }
+
+    function->blocks[block].postOrder = *count;
+    order[(*count)++] = block;
+}
+
+Index IntersectDominators(IRFunction *function, Index a, Index b)
+{
+    while(a != b)
+    {
+        while(function->blocks[a].postOrder < function->blocks[b].postOrder) a = function->blocks[a].idom;
+        while(function->blocks[b].postOrder < function->blocks[a].postOrder) b = function->blocks[b].idom;
+    }
+
+    return a;
+}
+
+// iterative dominator computation - Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm"
+void ComputeDominators(IRFunction *function)
+{
+    if(function->blockCount == 0) return;
+
+    bool *visited = (bool*)calloc(function->blockCount, sizeof(bool));
+    Index *order = (Index*)malloc(sizeof(Index) * function->blockCount);
+    unsigned int count = 0;
+
+    for(unsigned int n = 0; n < function->blockCount; n++) function->blocks[n].idom = IR_NONE;
+
+    NumberBlocksPostOrder(function, 0, visited, order, &count);
+    function->blocks[0].idom = 0;
+
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+
+        // reverse post order, skipping the entry block
+        for(int n = count - 2; n >= 0; n--)
+        {
+            Index block = order[n];
+            IRBlock *b = &function->blocks[block];
+            Index newIdom = IR_NONE;
+
+            for(unsigned int p = 0; p < b->predCount; p++)
+            {
+                Index pred = b->preds[p];
+                if(function->blocks[pred].idom == IR_NONE) continue;
+
+                if(newIdom == IR_NONE) newIdom = pred;
+                else newIdom = IntersectDominators(function, pred, newIdom);
+            }
+
+            if(b->idom != newIdom)
+            {
+                b->idom = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    free(visited);
+    free(order);
+}
+
+bool Dominates(IRFunction *function, Index a, Index b)
+{
+    if(function->blocks[b].idom == IR_NONE) return false;
+
+    while(true)
+    {
+        if(a == b) return true;
+        if(b == 0) return false;
+        b = function->blocks[b].idom;
+    }
+}
+
+unsigned int GetInstPosition(IRFunction *function, Index inst)
+{
+    IRBlock *b = &function->blocks[function->insts[inst].block];
+
+    for(unsigned int n = 0; n < b->instCount; n++)
+    {
+        if(b->insts[n] == inst) return n;
+    }
+
+    return b->instCount;
+}
+
+Index FindParam(IRFunction *function, unsigned int position)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(!inst->isDead && inst->opcode == IR_PARAM && (unsigned int)inst->value == position) return n;
+    }
+
+    return IR_NONE;
+}
+
+Index *CopyIndices(Index *indices, unsigned int count)
+{
+    if(count == 0) return 0;
+
+    Index *copy = (Index*)malloc(sizeof(Index) * count);
+    memcpy(copy, indices, sizeof(Index) * count);
+    return copy;
+}
+
+// deep copy, instructions and blocks keep their indices
+IRFunction CloneIRFunction(IRFunction *function, const char *name)
+{
+    IRFunction clone = *function;
+    clone.name = name;
+
+    clone.insts = (IRInst*)malloc(sizeof(IRInst) * function->instCount);
+    memcpy(clone.insts, function->insts, sizeof(IRInst) * function->instCount);
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &clone.insts[n];
+        inst->operands = CopyIndices(inst->operands, inst->operandCount);
+        inst->caseTargets = CopyIndices(inst->caseTargets, inst->caseCount);
+    }
+
+    clone.blocks = (IRBlock*)malloc(sizeof(IRBlock) * function->blockCount);
+    memcpy(clone.blocks, function->blocks, sizeof(IRBlock) * function->blockCount);
+
+    for(unsigned int n = 0; n < function->blockCount; n++)
+    {
+        IRBlock *b = &clone.blocks[n];
+        b->insts = CopyIndices(b->insts, b->instCount);
+        b->preds = CopyIndices(b->preds, b->predCount);
+    }
+
+    return clone;
+}
+
+void FreeIRFunction(IRFunction *function)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        free(function->insts[n].operands);
+        free(function->insts[n].caseTargets);
+    }
+
+    for(unsigned int n = 0; n < function->blockCount; n++)
+    {
+        free(function->blocks[n].insts);
+        free(function->blocks[n].preds);
+    }
+
+    free(function->insts);
+    free(function->blocks);
+}
+
+void FreeIRModule(IRModule *module)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++) FreeIRFunction(&module->functions[n]);
+    for(unsigned int n = 0; n < module->structCount; n++) free(module->structs[n].fields);
+
+    free(module->functions);
+    free(module->structs);
+}
+
+bool VerifyError(IRFunction *function, const char *message, Index index)
+{
+    ReportDiagnostic("ir error: function '%s': %s (%d)", function->name, message, index);
+    return false;
+}
+
+bool VerifyIRFunction(IRFunction *function)
+{
+    if(function->blockCount == 0) return VerifyError(function, "function has no blocks", 0);
+
+    ComputeDominators(function);
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        IRBlock *b = &function->blocks[block];
+        if(b->isDead) continue;
+
+        if(b->instCount == 0) return VerifyError(function, "empty block", block);
+        if(GetTerminator(function, block) == IR_NONE) return VerifyError(function, "block does not end in a terminator", block);
+
+        Index successors[IR_MAX_SUCCESSORS];
+        unsigned int successorCount = GetSuccessors(function, block, successors);
+
+        for(unsigned int s = 0; s < successorCount; s++)
+        {
+            if(successors[s] < 0 || successors[s] >= function->blockCount || function->blocks[successors[s]].isDead)
+            {
+                return VerifyError(function, "branch to invalid block", block);
+            }
+
+            bool found = false;
+            IRBlock *succ = &function->blocks[successors[s]];
+            for(unsigned int p = 0; p < succ->predCount; p++)
+            {
+                if(succ->preds[p] == block) found = true;
+            }
+
+            if(!found) return VerifyError(function, "successor is missing predecessor edge", block);
+        }
+
+        bool phiSection = true;
+
+        for(unsigned int n = 0; n < b->instCount; n++)
+        {
+            Index index = b->insts[n];
+            IRInst *inst = &function->insts[index];
+
+            if(inst->isDead) return VerifyError(function, "dead instruction in block", index);
+            if(inst->block != block) return VerifyError(function, "instruction block mismatch", index);
+            if(IsTerminator(inst->opcode) && n != b->instCount - 1) return VerifyError(function, "terminator in middle of block", index);
+
+            if(inst->opcode == IR_PHI)
+            {
+                if(!phiSection) return VerifyError(function, "phi after non phi instruction", index);
+                if(inst->operandCount != b->predCount) return VerifyError(function, "phi operand count does not match predecessors", index);
+            }
+            else
+            {
+                phiSection = false;
+            }
+
+            for(unsigned int o = 0; o < inst->operandCount; o++)
+            {
+                Index operand = inst->operands[o];
+
+                if(operand < 0 || operand >= function->instCount || function->insts[operand].isDead)
+                {
+                    return VerifyError(function, "operand refers to invalid value", index);
+                }
+
+                Index defBlock = function->insts[operand].block;
+                Index useBlock = (inst->opcode == IR_PHI) ? b->preds[o] : block;
+
+                // uses in unreachable code are not checked for dominance
+                if(function->blocks[useBlock].idom == IR_NONE) continue;
+
+                if(inst->opcode != IR_PHI && defBlock == useBlock)
+                {
+                    if(GetInstPosition(function, operand) >= n) return VerifyError(function, "value used before definition", index);
+                }
+                else if(!Dominates(function, defBlock, useBlock))
+                {
+                    return VerifyError(function, "definition does not dominate use", index);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+char *IROpcodeToString(unsigned int opcode)
+{
+    switch(opcode)
+    {
+        case IR_UNDEF:          return "undef"; break;
+        case IR_CONST:          return "const"; break;
+        case IR_STRING:         return "string"; break;
+        case IR_PARAM:          return "param"; break;
+        case IR_PHI:            return "phi"; break;
+        case IR_COPY:           return "copy"; break;
+        case IR_ADD:            return "add"; break;
+        case IR_SUB:            return "sub"; break;
+        case IR_MUL:            return "mul"; break;
+        case IR_DIV:            return "div"; break;
+        case IR_MOD:            return "mod"; break;
+        case IR_LT:             return "lt"; break;
+        case IR_GT:             return "gt"; break;
+        case IR_EQ_EQ:          return "eq"; break;
+        case IR_NOT_EQ:         return "ne"; break;
+        case IR_LT_EQ:          return "le"; break;
+        case IR_GT_EQ:          return "ge"; break;
+        case IR_NOT:            return "not"; break;
+        case IR_ALLOCA:         return "alloca"; break;
+        case IR_FIELD_ADDR:     return "field_addr"; break;
+        case IR_INDEX_ADDR:     return "index_addr"; break;
+        case IR_ADVANCE_ADDR:   return "advance_addr"; break;
+        case IR_OFFSET_ADDR:    return "offset_addr"; break;
+        case IR_LOAD:           return "load"; break;
+        case IR_STORE:          return "store"; break;
+        case IR_ZERO:           return "zero"; break;
+        case IR_MEMCOPY:        return "memcopy"; break;
+        case IR_BOUNDS_CHECK:   return "bounds_check"; break;
+        case IR_CALL:           return "call"; break;
+        case IR_JUMP:           return "jump"; break;
+        case IR_BRANCH:         return "branch"; break;
+        case IR_SWITCH:         return "switch"; break;
+        case IR_RET:            return "ret"; break;
+        default:                return "unknown_opcode";
+    }
+}
+
+void PrintIRType(IRType type)
+{
+    if(!type.id) return;
+
+    if(type.isArrayType) printf(" : %s [%u]", type.id, type.arrayDim);
+    else printf(" : %s", type.id);
+}
+
+void PrintIRInst(IRFunction *function, Index index)
+{
+    IRInst *inst = &function->insts[index];
+
+    printf("    ");
+    if(!HasSideEffects(inst->opcode) || (inst->opcode == IR_CALL)) printf("%%%d = ", index);
+    printf("%s", IROpcodeToString(inst->opcode));
+
+    if(inst->opcode == IR_CONST || inst->opcode == IR_PARAM || inst->opcode == IR_BOUNDS_CHECK) printf(" %d", inst->value);
+    if(inst->opcode == IR_STRING) printf(" \"%s\"", inst->name);
+    else if(inst->name) printf(" %s", inst->name);
+
+    if(inst->opcode == IR_ALLOCA && function->isFrameLaidOut) printf(" @%d", inst->value);
+
+    if(inst->opcode == IR_OFFSET_ADDR)
+    {
+        printf(" %%%d + %d", inst->operands[0], inst->value);
+        if(inst->operandCount > 1) printf(" + %%%d * %u", inst->operands[1], inst->scale);
+
+        PrintIRType(inst->type);
+        printf("\n");
+        return;
+    }
+
+    if(inst->opcode == IR_SWITCH)
+    {
+        printf(" %%%d, default block%d [", inst->operands[0], inst->falseTarget);
+
+        bool isFirst = true;
+        for(unsigned int n = 0; n < inst->caseCount; n++)
+        {
+            if(inst->caseTargets[n] == inst->falseTarget) continue;
+
+            printf("%s%d: block%d", isFirst ? "" : ", ", inst->value + (int)n, inst->caseTargets[n]);
+            isFirst = false;
+        }
+
+        printf("]\n");
+        return;
+    }
+
+    for(unsigned int n = 0; n < inst->operandCount; n++)
+    {
+        printf("%s%%%d", n == 0 ? " " : ", ", inst->operands[n]);
+        if(inst->opcode == IR_PHI) printf(" [block%d]", function->blocks[inst->block].preds[n]);
+    }
+
+    if(inst->trueTarget != IR_NONE) printf("%sblock%d", inst->operandCount ? ", " : " ", inst->trueTarget);
+    if(inst->falseTarget != IR_NONE) printf(", block%d", inst->falseTarget);
+
+    PrintIRType(inst->type);
+    printf("\n");
+}
+
+void PrintIRFunction(IRFunction *function)
+{
+    printf("fn %s (params: %u)", function->name, function->parameterCount);
+    if(function->hasReturnValue) PrintIRType(function->returnType);
+    if(function->hasStructReturn)
+    {
+        PrintIRType(function->returnType);
+        printf(" (sret)");
+    }
+    if(function->isFrameLaidOut) printf(" (frame: %u bytes)", function->frameSize);
+    printf("\n");
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        IRBlock *b = &function->blocks[block];
+        if(b->isDead) continue;
+
+        printf("  block%d:", block);
+        if(b->predCount > 0)
+        {
+            printf(" ; preds:");
+            for(unsigned int p = 0; p < b->predCount; p++) printf(" block%d", b->preds[p]);
+        }
+        printf("\n");
+
+        for(unsigned int n = 0; n < b->instCount; n++)
+        {
+            PrintIRInst(function, b->insts[n]);
+        }
+    }
+
+    printf("\n");
+}
+
+void PrintIRModule(IRModule *module)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        PrintIRFunction(&module->functions[n]);
+    }
+}
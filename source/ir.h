@@ -0,0 +1,180 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ast.h"
+#include "options.h"
+
+#define IR_NONE -1
+#define IR_MAX_SUCCESSORS 64    // a jump table branches to at most this many distinct blocks
+
+enum IROpcode
+{
+    IR_UNDEF = 1,
+    IR_CONST,
+    IR_STRING,
+    IR_PARAM,
+    IR_PHI,
+    IR_COPY,
+
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+
+    IR_LT,
+    IR_GT,
+    IR_EQ_EQ,
+    IR_NOT_EQ,
+    IR_LT_EQ,
+    IR_GT_EQ,
+    IR_NOT,
+
+    // memory
+    IR_ALLOCA,
+    IR_FIELD_ADDR,
+    IR_INDEX_ADDR,
+    IR_ADVANCE_ADDR,        // element address moved by a number of elements
+    IR_OFFSET_ADDR,         // base + value + index * scale, a folded chain of address steps
+    IR_LOAD,
+    IR_STORE,
+    IR_ZERO,
+    IR_MEMCOPY,
+    IR_BOUNDS_CHECK,        // traps unless 0 <= operand < value
+
+    IR_CALL,
+
+    // terminators
+    IR_JUMP,
+    IR_BRANCH,
+    IR_SWITCH,              // jump table, entry n taken for operand == value + n, anything else goes to the default
+    IR_RET,
+};
+
+// type of the value an address points to, or of a loaded value
+typedef struct {
+    const char *id;
+    bool isArrayType;
+    unsigned int arrayDim;
+    bool isAggregate;       // arrays and structs, handled by address
+} IRType;
+
+typedef struct {
+    unsigned int opcode;
+    Index block;
+
+    Index *operands;
+    unsigned int operandCount;
+
+    int value;              // IR_CONST value, IR_PARAM position, IR_BOUNDS_CHECK array dimension, IR_ALLOCA frame offset, IR_OFFSET_ADDR byte offset, IR_SWITCH lowest case
+    unsigned int scale;     // IR_OFFSET_ADDR bytes per index step
+    const char *name;       // IR_CALL callee, IR_FIELD_ADDR field, IR_STRING literal, IR_ALLOCA variable, IR_BOUNDS_CHECK array
+    IRType type;
+
+    Index trueTarget;       // IR_JUMP target, IR_BRANCH true target
+    Index falseTarget;      // IR_BRANCH false target, IR_SWITCH default
+    Index *caseTargets;     // IR_SWITCH jump table
+    unsigned int caseCount;
+
+    bool isDead;
+} IRInst;
+
+typedef struct {
+    Index *insts;
+    unsigned int instCount;
+
+    Index *preds;
+    unsigned int predCount;
+
+    Index idom;
+    unsigned int postOrder;
+    bool isDead;
+} IRBlock;
+
+typedef struct {
+    const char *name;
+
+    IRInst *insts;
+    unsigned int instCount;
+
+    IRBlock *blocks;
+    unsigned int blockCount;
+
+    unsigned int parameterCount;
+    bool hasReturnValue;
+    IRType returnType;
+    bool hasStructReturn;       // returns returnType through the address in parameter 0
+
+    unsigned int frameSize;     // bytes, valid once isFrameLaidOut is set and alloca values hold frame offsets
+    bool isFrameLaidOut;
+} IRFunction;
+
+typedef struct {
+    const char *name;
+    IRType type;
+    unsigned int offset;
+    unsigned int size;
+    unsigned int accessCount;   // from a profile or estimated, orders hot fields first
+} IRField;
+
+typedef struct {
+    const char *name;
+    IRField *fields;
+    unsigned int fieldCount;
+
+    unsigned int size;
+    unsigned int align;
+    bool isLaidOut;
+    bool isFixedLayout;         // fields keep their declaration order
+} IRStruct;
+
+typedef struct {
+    IRFunction *functions;
+    unsigned int functionCount;
+
+    IRStruct *structs;
+    unsigned int structCount;
+
+    const Options *options;     // of the compilation the module belongs to
+    const char *entry;          // called from outside, its parameters are never assumed
+    bool isQuiet;               // built for the compiler's own use, passes do not report on it
+} IRModule;
+
+Index NewBlock(IRFunction *function);
+Index NewInst(IRFunction *function, unsigned int opcode);
+void AppendInst(IRFunction *function, Index block, Index inst);
+void InsertInst(IRFunction *function, Index block, unsigned int position, Index inst);
+void InsertAtEntry(IRFunction *function, Index inst);
+void RemoveInst(IRFunction *function, Index inst);
+void MoveInst(IRFunction *function, Index inst, Index block, unsigned int position);
+void AddEdge(IRFunction *function, Index from, Index to);
+void RemoveEdge(IRFunction *function, Index from, Index to);
+void ReplacePredecessor(IRFunction *function, Index block, Index oldPred, Index newPred);
+Index SplitBlock(IRFunction *function, Index block, unsigned int position);
+
+bool IsTerminator(unsigned int opcode);
+bool HasSideEffects(unsigned int opcode);
+Index GetTerminator(IRFunction *function, Index block);
+unsigned int GetSuccessors(IRFunction *function, Index block, Index successors[IR_MAX_SUCCESSORS]);
+void ReplaceAllUses(IRFunction *function, Index oldValue, Index newValue);
+void AddOperand(IRFunction *function, Index inst, Index operand);
+unsigned int CountUses(IRFunction *function, Index value);
+unsigned int GetInstPosition(IRFunction *function, Index inst);
+Index FindParam(IRFunction *function, unsigned int position);
+IRFunction CloneIRFunction(IRFunction *function, const char *name);
+void FreeIRFunction(IRFunction *function);
+void FreeIRModule(IRModule *module);
+
+void ComputeDominators(IRFunction *function);
+bool Dominates(IRFunction *function, Index a, Index b);
+
+bool VerifyIRFunction(IRFunction *function);
+void PrintIRFunction(IRFunction *function);
+void PrintIRModule(IRModule *module);
+
+#endif //IR_H
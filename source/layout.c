@@ -0,0 +1,240 @@
+#include "layout.h"
+#include "loop.h"
+
+// a field is hot with at least this fraction of the accesses of the hottest field
+#define HOT_FIELD_SHARE 8
+#define MAX_WEIGHTED_LOOP_DEPTH 4
+
+unsigned int AlignUp(unsigned int value, unsigned int align)
+{
+    return (value + align - 1) / align * align;
+}
+
+IRStruct *FindStruct(IRModule *module, const char *name)
+{
+    for(unsigned int n = 0; n < module->structCount; n++)
+    {
+        if(!strcmp(module->structs[n].name, name)) return &module->structs[n];
+    }
+
+    return 0;
+}
+
+TypeLayout GetScalarLayout(const char *id)
+{
+    TypeLayout layout = {8, 8};
+
+    if(!strcmp(id, "int") || !strcmp(id, "u32") || !strcmp(id, "i32")) layout = (TypeLayout){4, 4};
+    else if(!strcmp(id, "u16") || !strcmp(id, "i16")) layout = (TypeLayout){2, 2};
+    else if(!strcmp(id, "char") || !strcmp(id, "bool") || !strcmp(id, "u8") || !strcmp(id, "i8")) layout = (TypeLayout){1, 1};
+
+    // strings and names nothing declares are pointer sized
+    return layout;
+}
+
+void LayoutStruct(IRModule *module, IRStruct *s);
+
+TypeLayout GetTypeLayout(IRModule *module, IRType type)
+{
+    TypeLayout layout;
+    IRStruct *s = FindStruct(module, type.id);
+
+    // a struct reached again while its own fields are laid out, like a tree node's children,
+    // can only be held by reference
+    if(s && s->align == (unsigned int)-1)
+    {
+        layout = (TypeLayout){8, 8};
+    }
+    else if(s)
+    {
+        LayoutStruct(module, s);
+        layout = (TypeLayout){s->size, s->align};
+    }
+    else
+    {
+        layout = GetScalarLayout(type.id);
+    }
+
+    if(type.isArrayType) layout.size *= type.arrayDim;
+
+    return layout;
+}
+
+bool IsHotField(IRStruct *s, unsigned int field)
+{
+    unsigned int hottest = 0;
+
+    for(unsigned int f = 0; f < s->fieldCount; f++)
+    {
+        if(s->fields[f].accessCount > hottest) hottest = s->fields[f].accessCount;
+    }
+
+    return hottest > 0 && s->fields[field].accessCount * HOT_FIELD_SHARE >= hottest;
+}
+
+// true if field a goes before field b, ties keep declaration order
+bool IsFieldBefore(IRModule *module, IRStruct *s, TypeLayout *layouts, unsigned int a, unsigned int b)
+{
+    if(module->options->layout.fieldOrder == FIELD_ORDER_HOT && IsHotField(s, a) != IsHotField(s, b)) return IsHotField(s, a);
+    return layouts[a].align > layouts[b].align;
+}
+
+// each field at the next offset its alignment allows, in declaration order unless a field order is asked for
+void LayoutStruct(IRModule *module, IRStruct *s)
+{
+    if(s->isLaidOut) return;
+
+    // align is -1 while the struct's own fields are being laid out
+    s->align = (unsigned int)-1;
+
+    TypeLayout *layouts = (TypeLayout*)malloc(sizeof(TypeLayout) * (s->fieldCount ? s->fieldCount : 1));
+    unsigned int *order = (unsigned int*)malloc(sizeof(unsigned int) * (s->fieldCount ? s->fieldCount : 1));
+
+    for(unsigned int f = 0; f < s->fieldCount; f++)
+    {
+        layouts[f] = GetTypeLayout(module, s->fields[f].type);
+
+        unsigned int m = f;
+
+        while(m > 0 && !s->isFixedLayout && module->options->layout.fieldOrder != FIELD_ORDER_DECLARED && IsFieldBefore(module, s, layouts, f, order[m - 1]))
+        {
+            order[m] = order[m - 1];
+            m--;
+        }
+
+        order[m] = f;
+    }
+
+    unsigned int offset = 0;
+    unsigned int align = 1;
+
+    for(unsigned int n = 0; n < s->fieldCount; n++)
+    {
+        unsigned int f = order[n];
+
+        offset = AlignUp(offset, layouts[f].align);
+        s->fields[f].offset = offset;
+        s->fields[f].size = layouts[f].size;
+        offset += layouts[f].size;
+
+        if(layouts[f].align > align) align = layouts[f].align;
+    }
+
+    free(layouts);
+    free(order);
+
+    s->size = AlignUp(offset, align);
+    s->align = align;
+    s->isLaidOut = true;
+}
+
+void ComputeStructLayouts(IRModule *module)
+{
+    for(unsigned int n = 0; n < module->structCount; n++) LayoutStruct(module, &module->structs[n]);
+}
+
+void ReadFieldProfile(IRModule *module, const char *fileName)
+{
+    FILE *input = fopen(fileName, "r");
+
+    if(!input) CompileError("error: failed to open field profile '%s'", fileName);
+
+    char structName[256];
+    char fieldName[256];
+    unsigned int count;
+
+    while(fscanf(input, " %255[^.].%255s %u", structName, fieldName, &count) == 3)
+    {
+        IRStruct *s = FindStruct(module, structName);
+        if(!s) continue;
+
+        for(unsigned int f = 0; f < s->fieldCount; f++)
+        {
+            if(!strcmp(s->fields[f].name, fieldName)) s->fields[f].accessCount += count;
+        }
+    }
+
+    fclose(input);
+}
+
+// without a profile every field access counts once per level of loop nesting it sits in
+void EstimateFieldAccesses(IRModule *module)
+{
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        IRFunction *function = &module->functions[n];
+        LoopInfo loops = FindLoops(function);
+
+        for(unsigned int i = 0; i < function->instCount; i++)
+        {
+            IRInst *inst = &function->insts[i];
+            if(inst->isDead || inst->opcode != IR_FIELD_ADDR) continue;
+
+            IRStruct *s = FindStruct(module, function->insts[inst->operands[0]].type.id);
+            if(!s) continue;
+
+            unsigned int weight = 1;
+            unsigned int depth = 0;
+
+            for(unsigned int l = 0; l < loops.loopCount; l++)
+            {
+                if(IsInLoop(&loops.loops[l], inst->block) && depth++ < MAX_WEIGHTED_LOOP_DEPTH) weight *= 8;
+            }
+
+            for(unsigned int f = 0; f < s->fieldCount; f++)
+            {
+                if(!strcmp(s->fields[f].name, inst->name)) s->fields[f].accessCount += weight;
+            }
+        }
+
+        FreeLoopInfo(&loops);
+    }
+}
+
+void PrintStructLayout(IRModule *module, IRStruct *s)
+{
+    unsigned int used = 0;
+
+    for(unsigned int f = 0; f < s->fieldCount; f++) used += s->fields[f].size;
+
+    printf("layout: '%s': %u bytes, %u of padding%s:", s->name, s->size, s->size > used ? s->size - used : 0,
+           s->isFixedLayout ? ", fixed" : "");
+
+    for(unsigned int offset = 0, printed = 0; printed < s->fieldCount; offset++)
+    {
+        for(unsigned int f = 0; f < s->fieldCount; f++)
+        {
+            if(s->fields[f].offset != offset) continue;
+
+            printf(" %s@%u", s->fields[f].name, offset);
+            if(module->options->layout.fieldOrder == FIELD_ORDER_HOT) printf("(%u)", s->fields[f].accessCount);
+            printed++;
+        }
+    }
+
+    printf("\n");
+}
+
+// counts accesses when hot fields go first, then lays out every struct
+void ChooseStructLayouts(IRModule *module)
+{
+    const LayoutOptions *options = &module->options->layout;
+
+    if(options->fieldOrder == FIELD_ORDER_HOT)
+    {
+        if(options->profileFileName) ReadFieldProfile(module, options->profileFileName);
+        else EstimateFieldAccesses(module);
+    }
+
+    ComputeStructLayouts(module);
+}
+
+// field offsets are settled here, before anything turns field steps into byte offsets
+bool LayoutStructs(IRModule *module)
+{
+    ChooseStructLayouts(module);
+
+    for(unsigned int n = 0; n < module->structCount && module->options->printReport; n++) PrintStructLayout(module, &module->structs[n]);
+
+    return false;
+}
@@ -0,0 +1,17 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "ir.h"
+
+typedef struct {
+    unsigned int size;
+    unsigned int align;
+} TypeLayout;
+
+IRStruct *FindStruct(IRModule *module, const char *name);
+TypeLayout GetTypeLayout(IRModule *module, IRType type);
+void ComputeStructLayouts(IRModule *module);
+void ChooseStructLayouts(IRModule *module);
+bool LayoutStructs(IRModule *module);
+
+#endif //LAYOUT_H
@@ -1,7 +1,8 @@
 #include "lexer.h"
 #include "ast.h"
 
-Keyword keywordList[] = {
+// read only, shared by every compilation
+const Keyword keywordList[] = {
     {.keywordString = "fn", .len = 2, .tokenType = TOKEN_KEYWORD_FN},
     {.keywordString = "struct", .len = 6, .tokenType = TOKEN_KEYWORD_STRUCT},
     {.keywordString = "if", .len = 2, .tokenType = TOKEN_KEYWORD_IF},
@@ -9,6 +10,8 @@ Keyword keywordList[] = {
     {.keywordString = "while", .len = 5, .tokenType = TOKEN_KEYWORD_WHILE},
     {.keywordString = "return", .len = 6, .tokenType = TOKEN_KEYWORD_RETURN},
     {.keywordString = "let", .len = 3, .tokenType = TOKEN_KEYWORD_LET},
+    {.keywordString = "fixed", .len = 5, .tokenType = TOKEN_KEYWORD_FIXED},
+    {.keywordString = "import", .len = 6, .tokenType = TOKEN_KEYWORD_IMPORT},
 };
 
 char GetNextCharacter(Lexer *lexer)
@@ -40,7 +43,7 @@ char *LoadFileNullTerminated(const char *fileName)
     }
     else
     {
-        printf("error: failed to open input file '%s'\n", fileName);
+        ReportDiagnostic("error: failed to open input file '%s'", fileName);
     }
     
     return data;
@@ -98,8 +101,7 @@ Token TokenizeIntegerConstant(Lexer *lexer)
     char character = PeekNextCharacter(lexer);
     if(IsIdentifierCharacter(character))
     {
-        printf("error:%u:%u an identifier name cannot start with a number\n", lexer->line+1, lexer->column+1);
-        exit(1);
+        CompileError("error:%u:%u an identifier name cannot start with a number", lexer->line+1, lexer->column+1);
     }
     
     unsigned int end = lexer->pos;
@@ -136,8 +138,7 @@ Token TokenizeStringLiteral(Lexer *lexer)
         }
         else if(character == 0)
         {
-            printf("error:%u:%u string literal closing quote missing\n", lexer->line+1, lexer->column+1);
-            exit(1);
+            CompileError("error:%u:%u string literal closing quote missing", lexer->line+1, lexer->column+1);
         }
     }
 
@@ -145,8 +146,7 @@ Token TokenizeStringLiteral(Lexer *lexer)
 
     if(len == 0)
     {
-        printf("error:%u:%u a string literal cannot be empty\n", lexer->line+1, lexer->column+1);
-        exit(1);
+        CompileError("error:%u:%u a string literal cannot be empty", lexer->line+1, lexer->column+1);
     }
         
     Token token = {0};
@@ -155,9 +155,7 @@ Token TokenizeStringLiteral(Lexer *lexer)
     token.column = lexer->column;
     token.line = lexer->line;
 
-    token.stringValue = (char*)malloc(len + 1);
-    strncpy(token.stringValue, &lexer->source[start], len);
-    token.stringValue[len] = 0;
+    token.stringValue = InternString(lexer->context, &lexer->source[start], len);
 
     return token;
 }
@@ -187,9 +185,7 @@ Token TokenizeIdentifier(Lexer *lexer)
     token.column = lexer->column;
     token.line = lexer->line;
     
-    token.identifier = (char*)malloc(len + 1);
-    strncpy(token.identifier, &lexer->source[start], len);
-    token.identifier[len] = 0;
+    token.identifier = InternString(lexer->context, &lexer->source[start], len);
     
     return token;
 }
@@ -252,11 +248,12 @@ void PushToken(TokenList *tokenList, Token token)
     tokenList->tokens[tokenList->count - 1] = token;
 }
 
-TokenList TokenizeSource(const char *source)
+TokenList TokenizeSource(CompilerContext *context, const char *source)
 {
     TokenList tokenList = {0};
     
     Lexer lexer = {0};
+    lexer.context = context;
     lexer.source = source;
     
     while(true)
@@ -491,8 +488,7 @@ TokenList TokenizeSource(const char *source)
             
             if(c != '&')
             {
-                printf("%u:%u: error: found '&' expected '&&'\n",  lexer.line + 1, lexer.column + 1);
-                exit(1);
+                CompileError("%u:%u: error: found '&' expected '&&'",  lexer.line + 1, lexer.column + 1);
             }
 
             GetNextCharacter(&lexer);
@@ -514,8 +510,7 @@ TokenList TokenizeSource(const char *source)
 
             if(c != '|')
             {
-                printf("%u:%u: error: found '|' expected '||'\n",  lexer.line + 1, lexer.column + 1);
-                exit(1);
+                CompileError("%u:%u: error: found '|' expected '||'",  lexer.line + 1, lexer.column + 1);
             }
 
             GetNextCharacter(&lexer);
@@ -682,8 +677,7 @@ TokenList TokenizeSource(const char *source)
         }
         else
         {
-            printf("%u:%u: error: unsupported character '%c'\n",  lexer.line + 1, lexer.column + 1, character);
-            exit(1);
+            CompileError("%u:%u: error: unsupported character '%c'",  lexer.line + 1, lexer.column + 1, character);
         }
     }
     
@@ -719,6 +713,8 @@ char *TokenTypeToString(unsigned int type)
         case TOKEN_KEYWORD_WHILE:           return "token_keyword_while"; break;
         case TOKEN_KEYWORD_RETURN:          return "token_keyword_return"; break;
         case TOKEN_KEYWORD_LET:             return "token_keyword_let"; break;
+        case TOKEN_KEYWORD_FIXED:           return "token_keyword_fixed"; break;
+        case TOKEN_KEYWORD_IMPORT:          return "token_keyword_import"; break;
         case TOKEN_LEFT_PAREN:              return "token_left_paren"; break;
         case TOKEN_RIGHT_PAREN:             return "token_right_paren"; break;
         case TOKEN_LEFT_BRACE:              return "token_left_brace"; break;
@@ -6,6 +6,8 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "context.h"
+
 enum TokenType
 {
     // constants
@@ -46,6 +48,8 @@ enum TokenType
     TOKEN_KEYWORD_WHILE,
     TOKEN_KEYWORD_LET,
     TOKEN_KEYWORD_RETURN,
+    TOKEN_KEYWORD_FIXED,
+    TOKEN_KEYWORD_IMPORT,
 
     TOKEN_LEFT_PAREN, // '('
     TOKEN_RIGHT_PAREN, // ')'
@@ -74,8 +78,8 @@ typedef struct {
     
     // token data
     int integerValue;
-    char *identifier;
-    char *stringValue;
+    const char *identifier;     // interned in the context
+    const char *stringValue;
     unsigned int opType;
 
     // pos data
@@ -91,6 +95,7 @@ typedef struct {
 } TokenList;
 
 typedef struct {
+    CompilerContext *context;
     const char *source;
     unsigned int pos;
     unsigned int line;
@@ -0,0 +1,236 @@
+#include "compiler.c"
+#include "libbee.h"
+
+#define BEE_EXPORT __attribute__((visibility("default")))
+
+struct BeeContext {
+    CompilerContext *compiler;
+    Options options;
+
+    ModuleGraph modules;
+    AST ast;
+    Index program;
+    BytecodeModule bytecode;
+
+    char *cText;
+    size_t cLength;
+
+    bool isParsed;
+    bool isCompiled;
+    bool hasFailed;
+
+    char **diagnostics;
+    unsigned int diagnosticCount;
+};
+
+BEE_EXPORT BeeContext *BeeCreateContext(void)
+{
+    BeeContext *context = (BeeContext*)calloc(1, sizeof(BeeContext));
+    context->compiler = CreateContext();
+    context->options = DefaultOptions();
+
+    InitAST(&context->ast);
+    return context;
+}
+
+BEE_EXPORT void BeeDestroyContext(BeeContext *context)
+{
+    for(unsigned int n = 0; n < context->diagnosticCount; n++) free(context->diagnostics[n]);
+
+    if(context->isCompiled) FreeBytecodeModule(&context->bytecode);
+
+    FreeModuleGraph(&context->modules);
+    free(context->ast.nodeList);
+    free(context->diagnostics);
+    free(context->cText);
+    DestroyContext(context->compiler);
+    free(context);
+}
+
+BEE_EXPORT void BeeAddSource(BeeContext *context, const char *name, const char *text)
+{
+    AddSource(context->compiler, name, text);
+}
+
+BEE_EXPORT void BeeSetEntry(BeeContext *context, const char *entry)
+{
+    context->options.entry = InternString(context->compiler, entry, strlen(entry));
+}
+
+// the option is interned, a value in it lives as long as the context
+BEE_EXPORT bool BeeSetOption(BeeContext *context, const char *option)
+{
+    return ParseOption(&context->options, InternString(context->compiler, option, strlen(option)));
+}
+
+void AddLibraryDiagnostic(BeeContext *context, char *message)
+{
+    context->diagnosticCount++;
+    context->diagnostics = (char**)realloc(context->diagnostics, sizeof(char*) * context->diagnosticCount);
+    context->diagnostics[context->diagnosticCount - 1] = message;
+}
+
+typedef void (*LibraryStep)(BeeContext *context, void *data);
+
+// runs a step under a trap of its own, a step that fails leaves the whole compilation failed.
+// whatever the step had allocated when it failed is not freed
+bool RunLibraryStep(BeeContext *context, LibraryStep step, void *data)
+{
+    if(context->hasFailed) return false;
+
+    DiagnosticTrap trap = {0};
+    DiagnosticTrap *outer = diagnosticTrap;
+    diagnosticTrap = &trap;
+
+    if(setjmp(trap.recover) == 0) step(context, data);
+    else context->hasFailed = true;
+
+    diagnosticTrap = outer;
+
+    for(unsigned int n = 0; n < trap.messageCount; n++) AddLibraryDiagnostic(context, trap.messages[n]);
+    free(trap.messages);
+
+    return !context->hasFailed;
+}
+
+bool FailLibraryStep(BeeContext *context, const char *message)
+{
+    AddLibraryDiagnostic(context, strdup(message));
+    context->hasFailed = true;
+    return false;
+}
+
+void ParseStep(BeeContext *context, void *data)
+{
+    const char *name = (const char*)data;
+
+    if(!FindSource(context->compiler, name)) CompileError("error: no source named '%s'", name);
+
+    context->modules = LoadModules(context->compiler, 0, name, &context->options);
+    if(context->modules.moduleCount == 0) AbortCompilation();
+
+    CheckModules(&context->modules);
+    context->program = LinkModules(&context->modules, &context->ast);
+
+    SimplifyProgram(&context->ast, context->program, &context->options);
+    context->isParsed = true;
+}
+
+BEE_EXPORT bool BeeParse(BeeContext *context, const char *name)
+{
+    if(context->isParsed) return FailLibraryStep(context, "error: a context parses one program");
+    return RunLibraryStep(context, ParseStep, (void*)name);
+}
+
+void CompileBytecodeStep(BeeContext *context, void *data)
+{
+    IRModule module = OptimizeProgram(&context->ast, context->program, &context->options, false);
+    context->bytecode = GenerateBytecode(&module);
+    context->isCompiled = true;
+
+    FreeIRModule(&module);
+}
+
+BEE_EXPORT bool BeeCompileBytecode(BeeContext *context)
+{
+    if(context->hasFailed) return false;
+    if(!context->isParsed) return FailLibraryStep(context, "error: nothing parsed");
+    if(context->isCompiled) return true;
+
+    return RunLibraryStep(context, CompileBytecodeStep, 0);
+}
+
+void RunStep(BeeContext *context, void *data)
+{
+    const char *entry = context->options.entry;
+    int function = FindBytecodeFunction(&context->bytecode, entry);
+
+    if(function == -1) CompileError("error: entry function '%s' not found", entry);
+
+    VM vm = CreateVM(&context->bytecode, context->options.vm);
+    bool isDone = CallBytecode(&vm, function, 0, 0, (long long*)data);
+    const char *error = vm.error;
+
+    FreeVM(&vm);
+
+    if(!isDone) CompileError("vm error: %s", error);
+}
+
+// runs the entry without arguments. a failed run does not fail the compilation
+BEE_EXPORT bool BeeRun(BeeContext *context, long long *result)
+{
+    if(context->hasFailed) return false;
+    if(!context->isCompiled) return FailLibraryStep(context, "error: nothing compiled to bytecode");
+
+    bool isDone = RunLibraryStep(context, RunStep, result);
+    context->hasFailed = false;
+
+    return isDone;
+}
+
+void EmitCStep(BeeContext *context, void *data)
+{
+    free(context->cText);
+    context->cText = 0;
+    context->cLength = 0;
+
+    FILE *file = open_memstream(&context->cText, &context->cLength);
+    EmitCProgramToFile(&context->ast, context->program, &context->options, file, "memory");
+    fclose(file);
+}
+
+// the text stays with the context until it is destroyed or the c is emitted again
+BEE_EXPORT bool BeeEmitC(BeeContext *context, const char **text, size_t *length)
+{
+    if(context->hasFailed) return false;
+    if(!context->isParsed) return FailLibraryStep(context, "error: nothing parsed");
+    if(!RunLibraryStep(context, EmitCStep, 0)) return false;
+
+    *text = context->cText;
+    if(length) *length = context->cLength;
+    return true;
+}
+
+void BuildNativeStep(BeeContext *context, void *data)
+{
+    const char *exeFileName = (const char*)data;
+
+    char *cFileName = (char*)malloc(strlen(exeFileName) + 3);
+    sprintf(cFileName, "%s.c", exeFileName);
+
+    bool isBuilt = EmitCProgram(&context->ast, context->program, &context->options, cFileName) && BuildNative(&context->options, cFileName, exeFileName);
+    free(cFileName);
+
+    if(!isBuilt) AbortCompilation();
+}
+
+// writes the c next to the executable and runs the c compiler on it
+BEE_EXPORT bool BeeBuildNative(BeeContext *context, const char *exeFileName)
+{
+    if(context->hasFailed) return false;
+    if(!context->isParsed) return FailLibraryStep(context, "error: nothing parsed");
+    return RunLibraryStep(context, BuildNativeStep, (void*)exeFileName);
+}
+
+BEE_EXPORT const void *BeeGetAST(BeeContext *context, unsigned int *program)
+{
+    if(!context->isParsed) return 0;
+
+    if(program) *program = context->program;
+    return &context->ast;
+}
+
+BEE_EXPORT const void *BeeGetBytecode(BeeContext *context)
+{
+    return context->isCompiled ? &context->bytecode : 0;
+}
+
+BEE_EXPORT unsigned int BeeGetDiagnosticCount(BeeContext *context)
+{
+    return context->diagnosticCount;
+}
+
+BEE_EXPORT const char *BeeGetDiagnostic(BeeContext *context, unsigned int index)
+{
+    return index < context->diagnosticCount ? context->diagnostics[index] : 0;
+}
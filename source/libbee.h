@@ -0,0 +1,42 @@
+#ifndef LIBBEE_H
+#define LIBBEE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// the compiler as a library. sources are handed over in memory, nothing is read from disk and nothing
+// is printed unless a call asks for it. problems are collected as diagnostics instead of ending the process.
+// a context is used by one thread at a time, different contexts can compile on different threads at once
+
+typedef struct BeeContext BeeContext;
+
+BeeContext *BeeCreateContext(void);
+void BeeDestroyContext(BeeContext *context);
+
+// the text is copied. imports name other sources of the same context, relative to the importing name
+void BeeAddSource(BeeContext *context, const char *name, const char *text);
+
+// "main" unless set, must be set before parsing
+void BeeSetEntry(BeeContext *context, const char *entry);
+
+// a command line option such as "-inline-threshold=50" or "-field-order=packed", for this context only.
+// must be set before parsing, false when there is no such option
+bool BeeSetOption(BeeContext *context, const char *option);
+
+// each step needs the ones above it. false once the compilation has failed, the diagnostics say why
+bool BeeParse(BeeContext *context, const char *name);
+bool BeeCompileBytecode(BeeContext *context);
+bool BeeRun(BeeContext *context, long long *result);
+bool BeeEmitC(BeeContext *context, const char **text, size_t *length);
+bool BeeBuildNative(BeeContext *context, const char *exeFileName);
+
+// the linked program once dead definitions are gone, as declared in ast.h, and the bytecode as
+// declared in bytecode.h. both are owned by the context
+const void *BeeGetAST(BeeContext *context, unsigned int *program);
+const void *BeeGetBytecode(BeeContext *context);
+
+// errors, and warnings from steps that succeeded, in the order they were found
+unsigned int BeeGetDiagnosticCount(BeeContext *context);
+const char *BeeGetDiagnostic(BeeContext *context, unsigned int index);
+
+#endif //LIBBEE_H
@@ -0,0 +1,876 @@
+#include "loop.h"
+
+// trip counts are found by running the induction variable, up to this many steps
+#define MAX_SIMULATED_TRIP_COUNT 1000000
+
+bool IsInLoop(IRLoop *loop, Index block)
+{
+    return block >= 0 && (unsigned int)block < loop->containsCount && loop->contains[block];
+}
+
+unsigned int GetPredIndex(IRFunction *function, Index block, Index pred)
+{
+    IRBlock *b = &function->blocks[block];
+
+    for(unsigned int p = 0; p < b->predCount; p++)
+    {
+        if(b->preds[p] == pred) return p;
+    }
+
+    return b->predCount;
+}
+
+void AddLoopBlock(IRLoop *loop, Index block)
+{
+    loop->contains[block] = true;
+    PushIndex(&loop->blocks, &loop->blockCount, block);
+}
+
+// walks back from the latch until the header, everything on the way is in the loop
+void CollectLoopBlocks(IRFunction *function, IRLoop *loop, Index latch)
+{
+    Index *worklist = 0;
+    unsigned int worklistCount = 0;
+
+    if(!loop->contains[latch])
+    {
+        AddLoopBlock(loop, latch);
+        PushIndex(&worklist, &worklistCount, latch);
+    }
+
+    while(worklistCount > 0)
+    {
+        IRBlock *b = &function->blocks[worklist[--worklistCount]];
+
+        for(unsigned int p = 0; p < b->predCount; p++)
+        {
+            Index pred = b->preds[p];
+            if(loop->contains[pred] || function->blocks[pred].idom == IR_NONE) continue;
+
+            AddLoopBlock(loop, pred);
+            PushIndex(&worklist, &worklistCount, pred);
+        }
+    }
+
+    free(worklist);
+}
+
+void FreeLoopInfo(LoopInfo *info)
+{
+    for(unsigned int n = 0; n < info->loopCount; n++)
+    {
+        free(info->loops[n].blocks);
+        free(info->loops[n].contains);
+    }
+
+    free(info->loops);
+    info->loops = 0;
+    info->loopCount = 0;
+}
+
+// gives a loop entered from a branch its own block to hoist into
+bool InsertPreheader(IRFunction *function, IRLoop *loop, Index outside)
+{
+    Index terminator = GetTerminator(function, outside);
+    if(function->insts[terminator].opcode == IR_JUMP) return false;
+
+    Index preheader = NewBlock(function);
+    Index jump = NewInst(function, IR_JUMP);
+    function->insts[jump].trueTarget = loop->header;
+    AppendInst(function, preheader, jump);
+
+    IRInst *branch = &function->insts[terminator];
+    if(branch->trueTarget == loop->header) branch->trueTarget = preheader;
+    if(branch->falseTarget == loop->header) branch->falseTarget = preheader;
+
+    AddEdge(function, outside, preheader);
+    ReplacePredecessor(function, loop->header, outside, preheader);
+    return true;
+}
+
+LoopInfo FindLoops(IRFunction *function)
+{
+    LoopInfo info = {0};
+    ComputeDominators(function);
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        IRBlock *b = &function->blocks[block];
+        if(b->isDead || b->idom == IR_NONE) continue;
+
+        for(unsigned int p = 0; p < b->predCount; p++)
+        {
+            Index latch = function->blocks[block].preds[p];
+            if(!Dominates(function, block, latch)) continue;
+
+            IRLoop *loop = 0;
+            for(unsigned int n = 0; n < info.loopCount; n++)
+            {
+                if(info.loops[n].header == (Index)block) loop = &info.loops[n];
+            }
+
+            if(loop)
+            {
+                loop->latch = IR_NONE;
+            }
+            else
+            {
+                IRLoop newLoop = {0};
+                newLoop.header = block;
+                newLoop.latch = latch;
+                newLoop.preheader = IR_NONE;
+                newLoop.containsCount = function->blockCount;
+                newLoop.contains = (bool*)calloc(function->blockCount, sizeof(bool));
+                AddLoopBlock(&newLoop, block);
+
+                info.loopCount++;
+                info.loops = (IRLoop*)realloc(info.loops, sizeof(IRLoop) * info.loopCount);
+                info.loops[info.loopCount - 1] = newLoop;
+                loop = &info.loops[info.loopCount - 1];
+            }
+
+            CollectLoopBlocks(function, loop, latch);
+        }
+    }
+
+    bool insertedPreheader = false;
+
+    for(unsigned int n = 0; n < info.loopCount; n++)
+    {
+        IRLoop *loop = &info.loops[n];
+        IRBlock *header = &function->blocks[loop->header];
+        Index outside = IR_NONE;
+        unsigned int outsideCount = 0;
+
+        for(unsigned int p = 0; p < header->predCount; p++)
+        {
+            if(IsInLoop(loop, header->preds[p])) continue;
+
+            outside = header->preds[p];
+            outsideCount++;
+        }
+
+        // several entries would need their phi operands merged first
+        if(outsideCount != 1) continue;
+
+        if(InsertPreheader(function, loop, outside)) insertedPreheader = true;
+        else loop->preheader = outside;
+    }
+
+    // new blocks change both the dominator tree and loop membership
+    if(insertedPreheader)
+    {
+        FreeLoopInfo(&info);
+        return FindLoops(function);
+    }
+
+    // inner loops first, a nested loop always has fewer blocks than the loop around it
+    for(unsigned int n = 1; n < info.loopCount; n++)
+    {
+        IRLoop loop = info.loops[n];
+        unsigned int m = n;
+
+        while(m > 0 && info.loops[m - 1].blockCount > loop.blockCount)
+        {
+            info.loops[m] = info.loops[m - 1];
+            m--;
+        }
+
+        info.loops[m] = loop;
+    }
+
+    return info;
+}
+
+// the variable or parameter an address points into
+Index GetAddressRoot(IRFunction *function, Index address)
+{
+    while(true)
+    {
+        unsigned int opcode = function->insts[address].opcode;
+        if(opcode != IR_FIELD_ADDR && opcode != IR_INDEX_ADDR && opcode != IR_ADVANCE_ADDR && opcode != IR_OFFSET_ADDR) return address;
+
+        address = function->insts[address].operands[0];
+    }
+}
+
+bool IsKnownRoot(IRFunction *function, Index root)
+{
+    unsigned int opcode = function->insts[root].opcode;
+    return opcode == IR_ALLOCA || opcode == IR_PARAM;
+}
+
+// field and element steps from the root out to address
+unsigned int GetAddressPath(IRFunction *function, Index address, Index **path)
+{
+    unsigned int count = 0;
+    *path = 0;
+
+    while(address != GetAddressRoot(function, address))
+    {
+        PushIndex(path, &count, address);
+        address = function->insts[address].operands[0];
+    }
+
+    for(unsigned int n = 0; n < count / 2; n++)
+    {
+        Index step = (*path)[n];
+        (*path)[n] = (*path)[count - 1 - n];
+        (*path)[count - 1 - n] = step;
+    }
+
+    return count;
+}
+
+// two addresses into the same root overlap unless they part at different fields or constant elements
+bool MayAlias(IRFunction *function, Index a, Index b)
+{
+    Index rootA = GetAddressRoot(function, a);
+    Index rootB = GetAddressRoot(function, b);
+
+    if(!IsKnownRoot(function, rootA) || !IsKnownRoot(function, rootB)) return true;
+    if(rootA != rootB) return false;
+
+    Index *pathA, *pathB;
+    unsigned int countA = GetAddressPath(function, a, &pathA);
+    unsigned int countB = GetAddressPath(function, b, &pathB);
+    bool alias = true;
+
+    for(unsigned int n = 0; n < countA && n < countB && alias; n++)
+    {
+        IRInst *stepA = &function->insts[pathA[n]];
+        IRInst *stepB = &function->insts[pathB[n]];
+
+        if(stepA->opcode == IR_FIELD_ADDR && stepB->opcode == IR_FIELD_ADDR)
+        {
+            if(strcmp(stepA->name, stepB->name)) alias = false;
+        }
+        else if(stepA->opcode == IR_INDEX_ADDR && stepB->opcode == IR_INDEX_ADDR)
+        {
+            IRInst *indexA = &function->insts[stepA->operands[1]];
+            IRInst *indexB = &function->insts[stepB->operands[1]];
+
+            if(indexA->opcode == IR_CONST && indexB->opcode == IR_CONST && indexA->value != indexB->value) alias = false;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    free(pathA);
+    free(pathB);
+    return alias;
+}
+
+// aggregates are passed as private copies, so only a write through the same variable can change it
+bool MayWriteAddress(IRFunction *function, IRLoop *loop, Index address)
+{
+    for(unsigned int n = 0; n < loop->blockCount; n++)
+    {
+        IRBlock *b = &function->blocks[loop->blocks[n]];
+
+        for(unsigned int i = 0; i < b->instCount; i++)
+        {
+            IRInst *inst = &function->insts[b->insts[i]];
+            unsigned int writtenCount = 0;
+
+            if(inst->opcode == IR_STORE || inst->opcode == IR_ZERO || inst->opcode == IR_MEMCOPY) writtenCount = 1;
+            else if(inst->opcode == IR_CALL) writtenCount = inst->operandCount;
+
+            for(unsigned int o = 0; o < writtenCount; o++)
+            {
+                if(inst->opcode == IR_CALL && !function->insts[inst->operands[o]].type.isAggregate) continue;
+                if(MayAlias(function, inst->operands[o], address)) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// loads hoisted out of the body run even when the loop does not, the address must always be valid
+bool IsSafeToSpeculateLoad(IRFunction *function, Index address)
+{
+    while(true)
+    {
+        IRInst *inst = &function->insts[address];
+
+        if(inst->opcode == IR_INDEX_ADDR)
+        {
+            IRInst *index = &function->insts[inst->operands[1]];
+            IRType arrayType = function->insts[inst->operands[0]].type;
+
+            if(index->opcode != IR_CONST || index->value < 0 || (unsigned int)index->value >= arrayType.arrayDim) return false;
+        }
+        else if(inst->opcode != IR_FIELD_ADDR)
+        {
+            return IsKnownRoot(function, address);
+        }
+
+        address = inst->operands[0];
+    }
+}
+
+bool CanHoist(IRFunction *function, IRLoop *loop, Index index)
+{
+    IRInst *inst = &function->insts[index];
+
+    for(unsigned int o = 0; o < inst->operandCount; o++)
+    {
+        if(IsInLoop(loop, function->insts[inst->operands[o]].block)) return false;
+    }
+
+    switch(inst->opcode)
+    {
+        case IR_CONST:
+        case IR_STRING:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_LT:
+        case IR_GT:
+        case IR_EQ_EQ:
+        case IR_NOT_EQ:
+        case IR_LT_EQ:
+        case IR_GT_EQ:
+        case IR_NOT:
+        case IR_FIELD_ADDR:
+        case IR_INDEX_ADDR:
+        case IR_ADVANCE_ADDR:
+        case IR_OFFSET_ADDR:
+        return true;
+
+        case IR_DIV:
+        case IR_MOD:
+        {
+            // must not trap where the loop would not have run
+            IRInst *divisor = &function->insts[inst->operands[1]];
+            return divisor->opcode == IR_CONST && divisor->value != 0 && divisor->value != -1;
+        }
+
+        case IR_LOAD:
+        {
+            // a dynamic index is only known to be in range after its bounds check ran
+            return IsSafeToSpeculateLoad(function, inst->operands[0]) && !MayWriteAddress(function, loop, inst->operands[0]);
+        }
+
+        default:
+        return false;
+    }
+}
+
+unsigned int HoistFromLoop(IRFunction *function, IRLoop *loop)
+{
+    unsigned int hoistedCount = 0;
+    bool moved = true;
+
+    // hoisting an instruction can make the ones using it invariant
+    while(moved)
+    {
+        moved = false;
+
+        for(unsigned int n = 0; n < loop->blockCount; n++)
+        {
+            Index block = loop->blocks[n];
+
+            for(unsigned int i = 0; i < function->blocks[block].instCount; i++)
+            {
+                Index inst = function->blocks[block].insts[i];
+                if(!CanHoist(function, loop, inst)) continue;
+
+                MoveInst(function, inst, loop->preheader, function->blocks[loop->preheader].instCount - 1);
+                hoistedCount++;
+                moved = true;
+                i--;
+            }
+        }
+    }
+
+    return hoistedCount;
+}
+
+bool HoistLoopInvariants(IRFunction *function, const Options *options)
+{
+    LoopInfo info = FindLoops(function);
+    bool changed = false;
+
+    for(unsigned int n = 0; n < info.loopCount; n++)
+    {
+        IRLoop *loop = &info.loops[n];
+        if(loop->preheader == IR_NONE) continue;
+
+        unsigned int hoistedCount = HoistFromLoop(function, loop);
+        if(hoistedCount > 0) changed = true;
+
+        if(options->printReport && hoistedCount > 0)
+        {
+            printf("loop: '%s' block%d: hoisted %u invariant instructions\n", function->name, loop->header, hoistedCount);
+        }
+    }
+
+    FreeLoopInfo(&info);
+    return changed;
+}
+
+bool FindInductionVariable(IRFunction *function, IRLoop *loop, Index phi, InductionVariable *iv)
+{
+    IRInst *inst = &function->insts[phi];
+    if(inst->opcode != IR_PHI || inst->operandCount != 2) return false;
+
+    Index init = inst->operands[GetPredIndex(function, loop->header, loop->preheader)];
+    Index next = inst->operands[GetPredIndex(function, loop->header, loop->latch)];
+    IRInst *nextInst = &function->insts[next];
+
+    if(nextInst->opcode != IR_ADD && nextInst->opcode != IR_SUB) return false;
+
+    IRInst *left = &function->insts[nextInst->operands[0]];
+    IRInst *right = &function->insts[nextInst->operands[1]];
+
+    if(nextInst->operands[0] == phi && right->opcode == IR_CONST) iv->step = right->value;
+    else if(nextInst->opcode == IR_ADD && nextInst->operands[1] == phi && left->opcode == IR_CONST) iv->step = left->value;
+    else return false;
+
+    if(nextInst->opcode == IR_SUB) iv->step = (int)(0u - (unsigned int)iv->step);
+
+    iv->phi = phi;
+    iv->init = init;
+    iv->next = next;
+    return true;
+}
+
+Index EmitBefore(IRFunction *function, Index block, unsigned int opcode, Index left, Index right)
+{
+    Index inst = NewInst(function, opcode);
+    if(left != IR_NONE) AddOperand(function, inst, left);
+    if(right != IR_NONE) AddOperand(function, inst, right);
+
+    InsertInst(function, block, function->blocks[block].instCount - 1, inst);
+    return inst;
+}
+
+Index EmitConstBefore(IRFunction *function, Index block, int value)
+{
+    Index inst = EmitBefore(function, block, IR_CONST, IR_NONE, IR_NONE);
+    function->insts[inst].value = value;
+    return inst;
+}
+
+// a value recomputed from the induction variable on every iteration becomes its own phi,
+// stepped next to it: start is its value before the loop, each iteration adds opcode(step)
+Index AddDerivedPhi(IRFunction *function, IRLoop *loop, Index start, unsigned int stepOpcode, int step, IRType type)
+{
+    Index phi = NewInst(function, IR_PHI);
+    function->insts[phi].type = type;
+    InsertInst(function, loop->header, 0, phi);
+
+    Index stepConst = EmitConstBefore(function, loop->preheader, step);
+    Index next = EmitBefore(function, loop->latch, stepOpcode, phi, stepConst);
+    function->insts[next].type = type;
+
+    unsigned int preheaderIndex = GetPredIndex(function, loop->header, loop->preheader);
+    AddOperand(function, phi, preheaderIndex == 0 ? start : next);
+    AddOperand(function, phi, preheaderIndex == 0 ? next : start);
+
+    return phi;
+}
+
+unsigned int ReduceLoop(IRFunction *function, IRLoop *loop)
+{
+    unsigned int reducedCount = 0;
+    IRBlock *header = &function->blocks[loop->header];
+
+    Index *phis = 0;
+    unsigned int phiCount = 0;
+
+    for(unsigned int n = 0; n < header->instCount && function->insts[header->insts[n]].opcode == IR_PHI; n++)
+    {
+        PushIndex(&phis, &phiCount, header->insts[n]);
+    }
+
+    for(unsigned int p = 0; p < phiCount; p++)
+    {
+        InductionVariable iv;
+        if(!FindInductionVariable(function, loop, phis[p], &iv)) continue;
+
+        unsigned int instCount = function->instCount;
+
+        for(unsigned int n = 0; n < instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead || !IsInLoop(loop, inst->block) || inst->operandCount != 2) continue;
+
+            Index left = inst->operands[0];
+            Index right = inst->operands[1];
+            Index reduced = IR_NONE;
+
+            if(inst->opcode == IR_MUL && (left == iv.phi || right == iv.phi))
+            {
+                // i * k steps by step * k
+                Index factor = (left == iv.phi) ? right : left;
+                if(function->insts[factor].opcode != IR_CONST) continue;
+
+                int k = function->insts[factor].value;
+                IRType type = inst->type;
+
+                Index kConst = EmitConstBefore(function, loop->preheader, k);
+                Index start = EmitBefore(function, loop->preheader, IR_MUL, iv.init, kConst);
+                reduced = AddDerivedPhi(function, loop, start, IR_ADD, (int)((unsigned int)iv.step * (unsigned int)k), type);
+            }
+            else if(inst->opcode == IR_INDEX_ADDR && right == iv.phi && !IsInLoop(loop, function->insts[left].block))
+            {
+                // a[i] moves one element per step
+                IRType type = inst->type;
+
+                Index start = EmitBefore(function, loop->preheader, IR_INDEX_ADDR, left, iv.init);
+                function->insts[start].type = type;
+                reduced = AddDerivedPhi(function, loop, start, IR_ADVANCE_ADDR, iv.step, type);
+            }
+
+            if(reduced == IR_NONE) continue;
+
+            ReplaceAllUses(function, n, reduced);
+            RemoveInst(function, n);
+            reducedCount++;
+        }
+    }
+
+    free(phis);
+    return reducedCount;
+}
+
+bool ReduceInductionVariables(IRFunction *function, const Options *options)
+{
+    LoopInfo info = FindLoops(function);
+    bool changed = false;
+
+    for(unsigned int n = 0; n < info.loopCount; n++)
+    {
+        IRLoop *loop = &info.loops[n];
+        if(loop->preheader == IR_NONE || loop->latch == IR_NONE) continue;
+
+        unsigned int reducedCount = ReduceLoop(function, loop);
+        if(reducedCount > 0) changed = true;
+
+        if(options->printReport && reducedCount > 0)
+        {
+            printf("loop: '%s' block%d: strength reduced %u induction variable uses\n", function->name, loop->header, reducedCount);
+        }
+    }
+
+    FreeLoopInfo(&info);
+    return changed;
+}
+
+// while (i < C) { ... i = i + s; } with constant i, C and s
+typedef struct {
+    Index body;
+    Index exit;
+    unsigned int tripCount;
+    unsigned int size;
+} UnrollCandidate;
+
+bool CompareInt(unsigned int opcode, long long left, long long right)
+{
+    switch(opcode)
+    {
+        case IR_LT:     return left < right;
+        case IR_GT:     return left > right;
+        case IR_LT_EQ:  return left <= right;
+        case IR_GT_EQ:  return left >= right;
+        case IR_EQ_EQ:  return left == right;
+        case IR_NOT_EQ: return left != right;
+        default:        return false;
+    }
+}
+
+bool FindUnrollCandidate(IRFunction *function, IRLoop *loop, unsigned int maxTripCount, UnrollCandidate *candidate)
+{
+    if(loop->preheader == IR_NONE || loop->latch == IR_NONE || loop->blockCount != 2 || loop->latch == loop->header) return false;
+
+    IRBlock *header = &function->blocks[loop->header];
+    IRBlock *body = &function->blocks[loop->latch];
+    Index branch = GetTerminator(function, loop->header);
+    IRInst *branchInst = &function->insts[branch];
+
+    if(branchInst->opcode != IR_BRANCH) return false;
+
+    // a side effect in the header would run once more than the body
+    for(unsigned int n = 0; n < header->instCount - 1; n++)
+    {
+        if(HasSideEffects(function->insts[header->insts[n]].opcode)) return false;
+    }
+
+    bool continueOnTrue = (branchInst->trueTarget == loop->latch);
+    candidate->body = loop->latch;
+    candidate->exit = continueOnTrue ? branchInst->falseTarget : branchInst->trueTarget;
+
+    IRInst *condition = &function->insts[branchInst->operands[0]];
+    if(condition->operandCount != 2) return false;
+
+    IRInst *left = &function->insts[condition->operands[0]];
+    IRInst *right = &function->insts[condition->operands[1]];
+    bool ivOnLeft = (right->opcode == IR_CONST);
+
+    InductionVariable iv;
+    if(!FindInductionVariable(function, loop, ivOnLeft ? condition->operands[0] : condition->operands[1], &iv)) return false;
+    if((ivOnLeft ? right : left)->opcode != IR_CONST || function->insts[iv.init].opcode != IR_CONST) return false;
+
+    long long i = function->insts[iv.init].value;
+    long long bound = (ivOnLeft ? right : left)->value;
+    unsigned int tripCount = 0;
+
+    while(true)
+    {
+        bool taken = ivOnLeft ? CompareInt(condition->opcode, i, bound) : CompareInt(condition->opcode, bound, i);
+        if(taken != continueOnTrue) break;
+
+        i += iv.step;
+        tripCount++;
+
+        // give up instead of modelling wraparound
+        if(tripCount > maxTripCount || i > 2147483647LL || i < -2147483648LL) return false;
+    }
+
+    candidate->tripCount = tripCount;
+    candidate->size = (header->instCount - 1) + (body->instCount - 1);
+
+    for(unsigned int n = 0; n < header->instCount; n++)
+    {
+        if(function->insts[header->insts[n]].opcode == IR_PHI) candidate->size--;
+    }
+
+    return true;
+}
+
+void CloneInstInto(IRFunction *function, Index source, Index block, Index *valueMap, unsigned int mapCount)
+{
+    Index clone = NewInst(function, function->insts[source].opcode);
+    IRInst *s = &function->insts[source];
+    IRInst *c = &function->insts[clone];
+
+    c->value = s->value;
+    c->name = s->name;
+    c->type = s->type;
+    c->trueTarget = s->trueTarget;
+    c->falseTarget = s->falseTarget;
+
+    for(unsigned int o = 0; o < function->insts[source].operandCount; o++)
+    {
+        Index operand = function->insts[source].operands[o];
+        AddOperand(function, clone, (operand >= 0 && (unsigned int)operand < mapCount) ? valueMap[operand] : operand);
+    }
+
+    AppendInst(function, block, clone);
+    valueMap[source] = clone;
+}
+
+// clones everything but phis and the terminator, in order
+void CloneBlockBody(IRFunction *function, Index *insts, unsigned int instCount, Index block, Index *valueMap, unsigned int mapCount)
+{
+    for(unsigned int n = 0; n < instCount; n++)
+    {
+        unsigned int opcode = function->insts[insts[n]].opcode;
+        if(opcode == IR_PHI || IsTerminator(opcode)) continue;
+
+        CloneInstInto(function, insts[n], block, valueMap, mapCount);
+    }
+}
+
+// header phis take the values the latch hands to the next iteration
+void AdvancePhis(IRFunction *function, IRLoop *loop, Index *valueMap)
+{
+    IRBlock *header = &function->blocks[loop->header];
+    unsigned int latchIndex = GetPredIndex(function, loop->header, loop->latch);
+
+    Index *next = 0;
+    unsigned int nextCount = 0;
+
+    for(unsigned int n = 0; n < header->instCount && function->insts[header->insts[n]].opcode == IR_PHI; n++)
+    {
+        PushIndex(&next, &nextCount, valueMap[function->insts[header->insts[n]].operands[latchIndex]]);
+    }
+
+    for(unsigned int n = 0; n < nextCount; n++) valueMap[header->insts[n]] = next[n];
+
+    free(next);
+}
+
+Index *CopyInstList(IRFunction *function, Index block, unsigned int *count)
+{
+    *count = function->blocks[block].instCount;
+    Index *insts = (Index*)malloc(sizeof(Index) * (*count));
+    memcpy(insts, function->blocks[block].insts, sizeof(Index) * (*count));
+    return insts;
+}
+
+void KillBlock(IRFunction *function, Index block)
+{
+    IRBlock *b = &function->blocks[block];
+    while(b->instCount > 0) RemoveInst(function, b->insts[b->instCount - 1]);
+
+    b->isDead = true;
+    b->predCount = 0;
+}
+
+// replaces the loop with trip count copies of its body in one straight block
+void FullyUnrollLoop(IRFunction *function, IRLoop *loop, UnrollCandidate *candidate)
+{
+    unsigned int mapCount = function->instCount;
+    Index *valueMap = (Index*)malloc(sizeof(Index) * mapCount);
+    for(unsigned int n = 0; n < mapCount; n++) valueMap[n] = n;
+
+    unsigned int headerCount, bodyCount;
+    Index *headerInsts = CopyInstList(function, loop->header, &headerCount);
+    Index *bodyInsts = CopyInstList(function, candidate->body, &bodyCount);
+
+    unsigned int preheaderIndex = GetPredIndex(function, loop->header, loop->preheader);
+
+    for(unsigned int n = 0; n < headerCount && function->insts[headerInsts[n]].opcode == IR_PHI; n++)
+    {
+        valueMap[headerInsts[n]] = function->insts[headerInsts[n]].operands[preheaderIndex];
+    }
+
+    Index unrolled = NewBlock(function);
+
+    // the header runs once more than the body, its values are what the code after the loop sees
+    for(unsigned int iteration = 0; iteration <= candidate->tripCount; iteration++)
+    {
+        CloneBlockBody(function, headerInsts, headerCount, unrolled, valueMap, mapCount);
+        if(iteration == candidate->tripCount) break;
+
+        CloneBlockBody(function, bodyInsts, bodyCount, unrolled, valueMap, mapCount);
+        AdvancePhis(function, loop, valueMap);
+    }
+
+    Index jump = NewInst(function, IR_JUMP);
+    function->insts[jump].trueTarget = candidate->exit;
+    AppendInst(function, unrolled, jump);
+
+    function->insts[GetTerminator(function, loop->preheader)].trueTarget = unrolled;
+    AddEdge(function, loop->preheader, unrolled);
+    ReplacePredecessor(function, candidate->exit, loop->header, unrolled);
+
+    for(unsigned int n = 0; n < headerCount; n++)
+    {
+        if(!IsTerminator(function->insts[headerInsts[n]].opcode)) ReplaceAllUses(function, headerInsts[n], valueMap[headerInsts[n]]);
+    }
+
+    KillBlock(function, loop->header);
+    KillBlock(function, candidate->body);
+
+    free(valueMap);
+    free(headerInsts);
+    free(bodyInsts);
+}
+
+// repeats the body factor times per back edge, the trip count is a multiple of factor
+// so the skipped header tests would all have continued the loop
+void PartiallyUnrollLoop(IRFunction *function, IRLoop *loop, UnrollCandidate *candidate, unsigned int factor)
+{
+    unsigned int mapCount = function->instCount;
+    Index *valueMap = (Index*)malloc(sizeof(Index) * mapCount);
+    for(unsigned int n = 0; n < mapCount; n++) valueMap[n] = n;
+
+    unsigned int headerCount, bodyCount;
+    Index *headerInsts = CopyInstList(function, loop->header, &headerCount);
+    Index *bodyInsts = CopyInstList(function, candidate->body, &bodyCount);
+
+    Index jump = GetTerminator(function, candidate->body);
+    function->blocks[candidate->body].instCount--;
+
+    for(unsigned int copy = 1; copy < factor; copy++)
+    {
+        AdvancePhis(function, loop, valueMap);
+        CloneBlockBody(function, headerInsts, headerCount, candidate->body, valueMap, mapCount);
+        CloneBlockBody(function, bodyInsts, bodyCount, candidate->body, valueMap, mapCount);
+    }
+
+    AppendInst(function, candidate->body, jump);
+
+    unsigned int latchIndex = GetPredIndex(function, loop->header, loop->latch);
+
+    for(unsigned int n = 0; n < headerCount && function->insts[headerInsts[n]].opcode == IR_PHI; n++)
+    {
+        IRInst *phi = &function->insts[headerInsts[n]];
+        phi->operands[latchIndex] = valueMap[phi->operands[latchIndex]];
+    }
+
+    free(valueMap);
+    free(headerInsts);
+    free(bodyInsts);
+}
+
+bool UnrollLoop(IRFunction *function, IRLoop *loop, const Options *options)
+{
+    UnrollCandidate candidate;
+    if(!FindUnrollCandidate(function, loop, MAX_SIMULATED_TRIP_COUNT, &candidate)) return false;
+
+    unsigned int size = candidate.size > 0 ? candidate.size : 1;
+    unsigned int factor = options->loops.partialUnrollFactor;
+
+    while(factor > 1 && (candidate.tripCount % factor != 0 || factor * size > options->loops.maxUnrolledSize)) factor /= 2;
+
+    if(candidate.tripCount <= options->loops.maxFullUnrollTripCount && candidate.tripCount * size <= options->loops.maxUnrolledSize)
+    {
+        if(options->printReport)
+        {
+            printf("loop: '%s' block%d: trip count %u, fully unrolled\n", function->name, loop->header, candidate.tripCount);
+        }
+
+        FullyUnrollLoop(function, loop, &candidate);
+        return true;
+    }
+
+    if(factor > 1)
+    {
+        if(options->printReport)
+        {
+            printf("loop: '%s' block%d: trip count %u, unrolled by %u\n", function->name, loop->header, candidate.tripCount, factor);
+        }
+
+        PartiallyUnrollLoop(function, loop, &candidate, factor);
+        return true;
+    }
+
+    return false;
+}
+
+bool UnrollLoops(IRFunction *function, const Options *options)
+{
+    if(options->loops.noUnroll) return false;
+
+    Index *visited = 0;
+    unsigned int visitedCount = 0;
+    bool unrolledAny = false;
+    bool changed = true;
+
+    // unrolling changes the blocks of the loops around it, so find loops again after each one
+    while(changed)
+    {
+        changed = false;
+        LoopInfo info = FindLoops(function);
+
+        for(unsigned int n = 0; n < info.loopCount && !changed; n++)
+        {
+            IRLoop *loop = &info.loops[n];
+            bool isVisited = false;
+
+            for(unsigned int v = 0; v < visitedCount; v++)
+            {
+                if(visited[v] == loop->header) isVisited = true;
+            }
+
+            if(isVisited) continue;
+            PushIndex(&visited, &visitedCount, loop->header);
+
+            changed = UnrollLoop(function, loop, options);
+            if(changed) unrolledAny = true;
+        }
+
+        FreeLoopInfo(&info);
+    }
+
+    free(visited);
+    return unrolledAny;
+}
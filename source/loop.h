@@ -0,0 +1,49 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ir.h"
+
+// natural loop of a back edge, while statements lower to one loop each
+typedef struct {
+    Index header;
+    Index preheader;        // the single block entering the loop, IR_NONE if there is none
+    Index latch;            // source of the back edge, IR_NONE if there are several
+
+    Index *blocks;
+    unsigned int blockCount;
+
+    bool *contains;         // indexed by block
+    unsigned int containsCount;
+} IRLoop;
+
+typedef struct {
+    IRLoop *loops;          // inner loops come before the loops containing them
+    unsigned int loopCount;
+} LoopInfo;
+
+// i = phi(init, i + step), stepping by a constant on every iteration
+typedef struct {
+    Index phi;
+    Index init;
+    Index next;
+    int step;
+} InductionVariable;
+
+LoopInfo FindLoops(IRFunction *function);
+void FreeLoopInfo(LoopInfo *info);
+bool IsInLoop(IRLoop *loop, Index block);
+unsigned int GetPredIndex(IRFunction *function, Index block, Index pred);
+bool FindInductionVariable(IRFunction *function, IRLoop *loop, Index phi, InductionVariable *iv);
+
+Index GetAddressRoot(IRFunction *function, Index address);
+bool IsKnownRoot(IRFunction *function, Index root);
+bool MayAlias(IRFunction *function, Index a, Index b);
+
+Index EmitBefore(IRFunction *function, Index block, unsigned int opcode, Index left, Index right);
+Index EmitConstBefore(IRFunction *function, Index block, int value);
+
+bool HoistLoopInvariants(IRFunction *function, const Options *options);
+bool ReduceInductionVariables(IRFunction *function, const Options *options);
+bool UnrollLoops(IRFunction *function, const Options *options);
+
+#endif //LOOP_H
@@ -0,0 +1,987 @@
+#include "lower.h"
+#include "pass.h"
+#include "bounds.h"
+#include "threads.h"
+
+Index FindDefinition(AST *ast, Index program, unsigned int nodeType, const char *name)
+{
+    Node *node = &ast->nodeList[program];
+
+    for(unsigned int n = 0; n < node->program.defCount; n++)
+    {
+        Node *def = &ast->nodeList[node->program.definitions[n]];
+        if(def->type != nodeType) continue;
+
+        const char *defName = (nodeType == NODE_STRUCT_DEF) ? def->structDef.name : def->functionDef.name;
+        if(!strcmp(defName, name)) return node->program.definitions[n];
+    }
+
+    return IR_NONE;
+}
+
+IRType GetAnnotationType(AST *ast, Index annotation)
+{
+    Node *node = &ast->nodeList[annotation];
+
+    IRType type = {0};
+    type.id = node->typeAnnotation.id;
+    type.isArrayType = node->typeAnnotation.isArrayType;
+    type.arrayDim = node->typeAnnotation.arrayDim;
+
+    return type;
+}
+
+bool IsAggregateType(IRBuilder *builder, IRType type)
+{
+    if(!type.id) return false;
+    return type.isArrayType || FindDefinition(builder->ast, builder->program, NODE_STRUCT_DEF, type.id) != IR_NONE;
+}
+
+IRType LowerType(IRBuilder *builder, Index annotation)
+{
+    IRType type = GetAnnotationType(builder->ast, annotation);
+    type.isAggregate = IsAggregateType(builder, type);
+    return type;
+}
+
+IRType GetElementType(IRBuilder *builder, IRType type)
+{
+    IRType element = type;
+    element.isArrayType = false;
+    element.arrayDim = 0;
+    element.isAggregate = IsAggregateType(builder, element);
+    return element;
+}
+
+bool IsAggregateValue(IRBuilder *builder, Index value)
+{
+    return builder->function->insts[value].type.isAggregate;
+}
+
+void LowerError(IRBuilder *builder, const char *message, const char *name)
+{
+    CompileError("error: function '%s': %s '%s'", builder->function->name, message, name);
+}
+
+Index LowerNewBlock(IRBuilder *builder)
+{
+    Index block = NewBlock(builder->function);
+
+    builder->sealedCount++;
+    builder->sealed = (bool*)realloc(builder->sealed, sizeof(bool) * builder->sealedCount);
+    builder->sealed[block] = false;
+
+    return block;
+}
+
+bool IsBlockTerminated(IRBuilder *builder)
+{
+    return GetTerminator(builder->function, builder->currentBlock) != IR_NONE;
+}
+
+// code following a return lands in a block nothing jumps to
+bool IsBlockUnreachable(IRBuilder *builder)
+{
+    return builder->currentBlock != 0 && builder->function->blocks[builder->currentBlock].predCount == 0;
+}
+
+Index EmitInst(IRBuilder *builder, unsigned int opcode)
+{
+    Index inst = NewInst(builder->function, opcode);
+    AppendInst(builder->function, builder->currentBlock, inst);
+    return inst;
+}
+
+Index EmitEntryInst(IRBuilder *builder, unsigned int opcode)
+{
+    Index inst = NewInst(builder->function, opcode);
+    InsertAtEntry(builder->function, inst);
+    return inst;
+}
+
+Index EmitConst(IRBuilder *builder, int value)
+{
+    Index inst = EmitInst(builder, IR_CONST);
+    builder->function->insts[inst].value = value;
+    return inst;
+}
+
+Index EmitUnary(IRBuilder *builder, unsigned int opcode, Index operand)
+{
+    Index inst = EmitInst(builder, opcode);
+    PushIndex(&builder->function->insts[inst].operands, &builder->function->insts[inst].operandCount, operand);
+    return inst;
+}
+
+Index EmitBinary(IRBuilder *builder, unsigned int opcode, Index left, Index right)
+{
+    Index inst = EmitUnary(builder, opcode, left);
+    PushIndex(&builder->function->insts[inst].operands, &builder->function->insts[inst].operandCount, right);
+    return inst;
+}
+
+void EmitJump(IRBuilder *builder, Index target)
+{
+    Index inst = EmitInst(builder, IR_JUMP);
+    builder->function->insts[inst].trueTarget = target;
+    AddEdge(builder->function, builder->currentBlock, target);
+}
+
+// falls through to target unless control never gets here
+void EmitFallthrough(IRBuilder *builder, Index target)
+{
+    if(!IsBlockTerminated(builder) && !IsBlockUnreachable(builder)) EmitJump(builder, target);
+}
+
+void EmitBranch(IRBuilder *builder, Index condition, Index trueTarget, Index falseTarget)
+{
+    Index inst = EmitUnary(builder, IR_BRANCH, condition);
+    builder->function->insts[inst].trueTarget = trueTarget;
+    builder->function->insts[inst].falseTarget = falseTarget;
+    AddEdge(builder->function, builder->currentBlock, trueTarget);
+    AddEdge(builder->function, builder->currentBlock, falseTarget);
+}
+
+// ssa construction - Braun et al.: "Simple and Efficient Construction of Static Single Assignment Form"
+void WriteVariable(IRBuilder *builder, Index variable, Index block, Index value)
+{
+    for(unsigned int n = 0; n < builder->definitionCount; n++)
+    {
+        IRDefinition *def = &builder->definitions[n];
+        if(def->variable == variable && def->block == block)
+        {
+            def->value = value;
+            return;
+        }
+    }
+
+    IRDefinition def = {.variable = variable, .block = block, .value = value};
+    builder->definitionCount++;
+    builder->definitions = (IRDefinition*)realloc(builder->definitions, sizeof(IRDefinition) * builder->definitionCount);
+    builder->definitions[builder->definitionCount - 1] = def;
+}
+
+Index ResolveCopies(IRFunction *function, Index value)
+{
+    while(function->insts[value].opcode == IR_COPY) value = function->insts[value].operands[0];
+    return value;
+}
+
+Index NewPhi(IRBuilder *builder, Index block)
+{
+    Index phi = NewInst(builder->function, IR_PHI);
+    InsertInst(builder->function, block, 0, phi);
+    return phi;
+}
+
+Index ReadVariable(IRBuilder *builder, Index variable, Index block);
+
+Index TryRemoveTrivialPhi(IRBuilder *builder, Index phi)
+{
+    IRFunction *function = builder->function;
+    if(!builder->sealed[function->insts[phi].block]) return phi;
+
+    Index same = IR_NONE;
+
+    for(unsigned int n = 0; n < function->insts[phi].operandCount; n++)
+    {
+        Index operand = ResolveCopies(function, function->insts[phi].operands[n]);
+        if(operand == same || operand == phi) continue;
+        if(same != IR_NONE) return phi;
+        same = operand;
+    }
+
+    if(same == IR_NONE) same = EmitEntryInst(builder, IR_UNDEF);
+
+    // the phi becomes a copy, which is removed once the function is complete
+    IRInst *inst = &function->insts[phi];
+    inst->opcode = IR_COPY;
+    inst->operandCount = 0;
+    PushIndex(&inst->operands, &inst->operandCount, same);
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *user = &function->insts[n];
+        if(user->isDead || user->opcode != IR_PHI) continue;
+
+        for(unsigned int o = 0; o < user->operandCount; o++)
+        {
+            if(user->operands[o] == phi)
+            {
+                TryRemoveTrivialPhi(builder, n);
+                break;
+            }
+        }
+    }
+
+    return same;
+}
+
+Index AddPhiOperands(IRBuilder *builder, Index variable, Index phi)
+{
+    Index block = builder->function->insts[phi].block;
+
+    for(unsigned int p = 0; p < builder->function->blocks[block].predCount; p++)
+    {
+        Index operand = ReadVariable(builder, variable, builder->function->blocks[block].preds[p]);
+        PushIndex(&builder->function->insts[phi].operands, &builder->function->insts[phi].operandCount, operand);
+    }
+
+    return TryRemoveTrivialPhi(builder, phi);
+}
+
+Index ReadVariableRecursive(IRBuilder *builder, Index variable, Index block)
+{
+    IRBlock *b = &builder->function->blocks[block];
+    Index value;
+
+    if(!builder->sealed[block])
+    {
+        value = NewPhi(builder, block);
+
+        IRIncompletePhi incomplete = {.variable = variable, .block = block, .phi = value};
+        builder->incompletePhiCount++;
+        builder->incompletePhis = (IRIncompletePhi*)realloc(builder->incompletePhis, sizeof(IRIncompletePhi) * builder->incompletePhiCount);
+        builder->incompletePhis[builder->incompletePhiCount - 1] = incomplete;
+    }
+    else if(b->predCount == 1)
+    {
+        value = ReadVariable(builder, variable, b->preds[0]);
+    }
+    else if(b->predCount == 0)
+    {
+        value = EmitEntryInst(builder, IR_UNDEF);
+    }
+    else
+    {
+        value = NewPhi(builder, block);
+        WriteVariable(builder, variable, block, value);
+        value = AddPhiOperands(builder, variable, value);
+    }
+
+    WriteVariable(builder, variable, block, value);
+    return value;
+}
+
+Index ReadVariable(IRBuilder *builder, Index variable, Index block)
+{
+    for(unsigned int n = 0; n < builder->definitionCount; n++)
+    {
+        IRDefinition *def = &builder->definitions[n];
+        if(def->variable == variable && def->block == block) return ResolveCopies(builder->function, def->value);
+    }
+
+    return ReadVariableRecursive(builder, variable, block);
+}
+
+void SealBlock(IRBuilder *builder, Index block)
+{
+    for(unsigned int n = 0; n < builder->incompletePhiCount; n++)
+    {
+        IRIncompletePhi incomplete = builder->incompletePhis[n];
+        if(incomplete.block != block) continue;
+
+        builder->incompletePhis[n].block = IR_NONE;
+        builder->sealed[block] = true;
+        AddPhiOperands(builder, incomplete.variable, incomplete.phi);
+    }
+
+    builder->sealed[block] = true;
+}
+
+Index DeclareVariable(IRBuilder *builder, const char *name, IRType type)
+{
+    IRVariable variable = {0};
+    variable.name = name;
+    variable.type = type;
+    variable.isAggregate = type.isAggregate;
+    variable.slot = IR_NONE;
+
+    builder->variableCount++;
+    builder->variables = (IRVariable*)realloc(builder->variables, sizeof(IRVariable) * builder->variableCount);
+    builder->variables[builder->variableCount - 1] = variable;
+
+    Index index = builder->variableCount - 1;
+    PushIndex(&builder->scope, &builder->scopeCount, index);
+
+    return index;
+}
+
+Index LookupVariable(IRBuilder *builder, const char *name)
+{
+    for(int n = builder->scopeCount - 1; n >= 0; n--)
+    {
+        Index variable = builder->scope[n];
+        if(!strcmp(builder->variables[variable].name, name)) return variable;
+    }
+
+    return IR_NONE;
+}
+
+Index EmitAlloca(IRBuilder *builder, const char *name, IRType type)
+{
+    Index slot = EmitEntryInst(builder, IR_ALLOCA);
+    builder->function->insts[slot].name = name;
+    builder->function->insts[slot].type = type;
+    return slot;
+}
+
+Index LowerExpression(IRBuilder *builder, Index expr);
+
+Index GetAggregateVariable(IRBuilder *builder, const char *name)
+{
+    Index variable = LookupVariable(builder, name);
+
+    if(variable == IR_NONE) LowerError(builder, "use of undeclared variable", name);
+    if(!builder->variables[variable].isAggregate) LowerError(builder, "member or element access on scalar variable", name);
+
+    return variable;
+}
+
+Index EmitIndexAddress(IRBuilder *builder, Index base, IRType type, const char *name, Index indexExpr, IRType *resultType)
+{
+    if(!type.isArrayType) LowerError(builder, "indexing a value that is not an array of", type.id);
+
+    Index index = LowerExpression(builder, indexExpr);
+
+    if(builder->insertChecks)
+    {
+        Index check = EmitUnary(builder, IR_BOUNDS_CHECK, index);
+        builder->function->insts[check].value = type.arrayDim;
+        builder->function->insts[check].name = name;
+    }
+
+    Index address = EmitBinary(builder, IR_INDEX_ADDR, base, index);
+
+    *resultType = GetElementType(builder, type);
+    builder->function->insts[address].type = *resultType;
+
+    return address;
+}
+
+// computes the address of an l value chain like 'a.b[n].c', with explicit field and element address steps
+Index LowerAddress(IRBuilder *builder, Index lValue, IRType *resultType)
+{
+    AST *ast = builder->ast;
+    Node *node = &ast->nodeList[lValue];
+
+    Index address = IR_NONE;
+    IRType type = {0};
+
+    for(unsigned int n = 0; n < node->lValue.simpleLValueCount; n++)
+    {
+        Node *simple = &ast->nodeList[node->lValue.simpleLValues[n]];
+        bool isArrayAccess = (simple->type == NODE_ARRAY_ACCESS);
+        const char *name = isArrayAccess ? ast->nodeList[simple->arrayAccess.id].identifier.value : simple->identifier.value;
+
+        if(n == 0)
+        {
+            Index variable = GetAggregateVariable(builder, name);
+            address = builder->variables[variable].slot;
+            type = builder->variables[variable].type;
+        }
+        else
+        {
+            if(type.isArrayType) LowerError(builder, "member access on array", name);
+
+            Index structDef = FindDefinition(ast, builder->program, NODE_STRUCT_DEF, type.id);
+            if(structDef == IR_NONE) LowerError(builder, "member access on non struct type", type.id);
+
+            Node *def = &ast->nodeList[structDef];
+            Index field = IR_NONE;
+
+            for(unsigned int f = 0; f < def->structDef.fieldCount; f++)
+            {
+                Node *fieldNode = &ast->nodeList[def->structDef.fields[f]];
+                if(!strcmp(ast->nodeList[fieldNode->field.id].identifier.value, name)) field = def->structDef.fields[f];
+            }
+
+            if(field == IR_NONE) LowerError(builder, "no such struct field", name);
+
+            type = LowerType(builder, ast->nodeList[field].field.type);
+            address = EmitUnary(builder, IR_FIELD_ADDR, address);
+            builder->function->insts[address].name = name;
+            builder->function->insts[address].type = type;
+        }
+
+        if(isArrayAccess)
+        {
+            address = EmitIndexAddress(builder, address, type, name, simple->arrayAccess.expr, &type);
+        }
+    }
+
+    *resultType = type;
+    return address;
+}
+
+bool IsScalarVariableLValue(IRBuilder *builder, Index lValue, Index *variable)
+{
+    Node *node = &builder->ast->nodeList[lValue];
+    Node *first = &builder->ast->nodeList[node->lValue.simpleLValues[0]];
+
+    if(node->lValue.simpleLValueCount != 1 || first->type != NODE_IDENTIFIER) return false;
+
+    *variable = LookupVariable(builder, first->identifier.value);
+    if(*variable == IR_NONE) return true;
+
+    return !builder->variables[*variable].isAggregate;
+}
+
+Index LowerLValueRead(IRBuilder *builder, Index lValue)
+{
+    Index variable = IR_NONE;
+
+    if(IsScalarVariableLValue(builder, lValue, &variable))
+    {
+        if(variable == IR_NONE)
+        {
+            Node *node = &builder->ast->nodeList[lValue];
+
+            if(!node->lValue.isReported)
+            {
+                ReportDiagnostic("warning: function '%s': use of undeclared variable '%s'", builder->function->name, builder->ast->nodeList[node->lValue.simpleLValues[0]].identifier.value);
+                node->lValue.isReported = true;
+            }
+
+            return EmitEntryInst(builder, IR_UNDEF);
+        }
+
+        return ReadVariable(builder, variable, builder->currentBlock);
+    }
+
+    IRType type;
+    Index address = LowerAddress(builder, lValue, &type);
+
+    // aggregates are passed around by address
+    if(type.isAggregate) return address;
+
+    Index load = EmitUnary(builder, IR_LOAD, address);
+    builder->function->insts[load].type = type;
+    return load;
+}
+
+// stores the value of expr into memory at address
+void LowerStore(IRBuilder *builder, Index address, IRType type, Index expr)
+{
+    Node *exprNode = &builder->ast->nodeList[expr];
+
+    if(type.isAggregate)
+    {
+        if(exprNode->type == NODE_INTEGER_CONSTANT && exprNode->integer.value == 0)
+        {
+            Index zero = EmitUnary(builder, IR_ZERO, address);
+            builder->function->insts[zero].type = type;
+            return;
+        }
+
+        Index value = LowerExpression(builder, expr);
+        if(!IsAggregateValue(builder, value)) LowerError(builder, "cannot assign scalar value to aggregate of type", type.id);
+
+        Index copy = EmitBinary(builder, IR_MEMCOPY, address, value);
+        builder->function->insts[copy].type = type;
+        return;
+    }
+
+    Index value = LowerExpression(builder, expr);
+    Index store = EmitBinary(builder, IR_STORE, address, value);
+    builder->function->insts[store].type = type;
+}
+
+Index LowerFunctionCall(IRBuilder *builder, Index expr)
+{
+    AST *ast = builder->ast;
+    Node *node = &ast->nodeList[expr];
+
+    Index *arguments = 0;
+    unsigned int argumentCount = 0;
+
+    for(unsigned int n = 0; n < node->functionCall.argumentCount; n++)
+    {
+        Index argument = LowerExpression(builder, ast->nodeList[expr].functionCall.arguments[n]);
+
+        // aggregates are passed by value, the callee receives the address of a private copy
+        if(IsAggregateValue(builder, argument))
+        {
+            IRType type = builder->function->insts[argument].type;
+            Index copy = EmitAlloca(builder, "arg", type);
+            Index memcopy = EmitBinary(builder, IR_MEMCOPY, copy, argument);
+            builder->function->insts[memcopy].type = type;
+            argument = copy;
+        }
+
+        PushIndex(&arguments, &argumentCount, argument);
+    }
+
+    node = &ast->nodeList[expr];
+
+    Index call = EmitInst(builder, IR_CALL);
+    builder->function->insts[call].name = node->functionCall.id;
+    builder->function->insts[call].operands = arguments;
+    builder->function->insts[call].operandCount = argumentCount;
+
+    Index callee = FindDefinition(ast, builder->program, NODE_FUNC_DEF, node->functionCall.id);
+    if(callee != IR_NONE && ast->nodeList[callee].functionDef.isReturnTypeDeclared)
+    {
+        IRType type = LowerType(builder, ast->nodeList[callee].functionDef.returnType);
+        builder->function->insts[call].type = type;
+
+        // returned aggregates are copied out of the callee right away
+        if(type.isAggregate)
+        {
+            Index result = EmitAlloca(builder, "ret", type);
+            Index memcopy = EmitBinary(builder, IR_MEMCOPY, result, call);
+            builder->function->insts[memcopy].type = type;
+            return result;
+        }
+    }
+
+    return call;
+}
+
+Index LowerShortCircuit(IRBuilder *builder, Node node)
+{
+    bool isAnd = (node.operator.opType == BOOL_OP_AND);
+
+    Index left = LowerExpression(builder, node.operator.left);
+    Index shortValue = EmitConst(builder, isAnd ? 0 : 1);
+
+    Index rightBlock = LowerNewBlock(builder);
+    Index joinBlock = LowerNewBlock(builder);
+
+    if(isAnd) EmitBranch(builder, left, rightBlock, joinBlock);
+    else EmitBranch(builder, left, joinBlock, rightBlock);
+    SealBlock(builder, rightBlock);
+
+    builder->currentBlock = rightBlock;
+    Index right = LowerExpression(builder, node.operator.right);
+    Index rightBool = EmitBinary(builder, IR_NOT_EQ, right, EmitConst(builder, 0));
+    EmitJump(builder, joinBlock);
+    SealBlock(builder, joinBlock);
+
+    builder->currentBlock = joinBlock;
+    Index phi = NewPhi(builder, joinBlock);
+    PushIndex(&builder->function->insts[phi].operands, &builder->function->insts[phi].operandCount, shortValue);
+    PushIndex(&builder->function->insts[phi].operands, &builder->function->insts[phi].operandCount, rightBool);
+
+    return phi;
+}
+
+unsigned int OperatorToOpcode(unsigned int opType)
+{
+    switch(opType)
+    {
+        case ARITHMETIC_OP_ADD:     return IR_ADD;
+        case ARITHMETIC_OP_SUB:     return IR_SUB;
+        case ARITHMETIC_OP_MUL:     return IR_MUL;
+        case ARITHMETIC_OP_DIV:     return IR_DIV;
+        case ARITHMETIC_OP_MOD:     return IR_MOD;
+        case COMPARE_OP_LT:         return IR_LT;
+        case COMPARE_OP_GT:         return IR_GT;
+        case COMPARE_OP_EQ_EQ:      return IR_EQ_EQ;
+        case COMPARE_OP_NOT_EQ:     return IR_NOT_EQ;
+        case COMPARE_OP_LT_EQ:      return IR_LT_EQ;
+        case COMPARE_OP_GT_EQ:      return IR_GT_EQ;
+        case BOOL_OP_NOT:           return IR_NOT;
+        default:                    return 0;
+    }
+}
+
+Index LowerExpression(IRBuilder *builder, Index expr)
+{
+    Node node = builder->ast->nodeList[expr];
+
+    switch(node.type)
+    {
+        case NODE_INTEGER_CONSTANT:
+        {
+            return EmitConst(builder, node.integer.value);
+        }
+
+        case NODE_STRING_CONSTANT:
+        {
+            Index inst = EmitInst(builder, IR_STRING);
+            builder->function->insts[inst].name = node.string.value;
+            return inst;
+        }
+
+        case NODE_L_VALUE:
+        {
+            return LowerLValueRead(builder, expr);
+        }
+
+        case NODE_FUNC_CALL:
+        {
+            return LowerFunctionCall(builder, expr);
+        }
+
+        case NODE_OPERATOR:
+        {
+            if(node.operator.opType == BOOL_OP_AND || node.operator.opType == BOOL_OP_OR)
+            {
+                return LowerShortCircuit(builder, node);
+            }
+
+            if(node.operator.opType == BOOL_OP_NOT)
+            {
+                return EmitUnary(builder, IR_NOT, LowerExpression(builder, node.operator.left));
+            }
+
+            Index left = LowerExpression(builder, node.operator.left);
+            Index right = LowerExpression(builder, node.operator.right);
+            return EmitBinary(builder, OperatorToOpcode(node.operator.opType), left, right);
+        }
+
+        default:
+        {
+            CompileError("error: function '%s': unexpected node in expression (type %u)", builder->function->name, node.type);
+        }
+    }
+}
+
+Index DeclareLocal(IRBuilder *builder, Index varDecl)
+{
+    AST *ast = builder->ast;
+    Node *node = &ast->nodeList[varDecl];
+
+    const char *name = ast->nodeList[node->varDecl.id].identifier.value;
+    IRType type = LowerType(builder, node->varDecl.type);
+
+    Index variable = DeclareVariable(builder, name, type);
+
+    if(builder->variables[variable].isAggregate)
+    {
+        builder->variables[variable].slot = EmitAlloca(builder, name, type);
+    }
+
+    return variable;
+}
+
+void LowerAssignment(IRBuilder *builder, Index stmt)
+{
+    AST *ast = builder->ast;
+    Node node = ast->nodeList[stmt];
+    Node target = ast->nodeList[node.assignStmt.lValue];
+
+    if(target.type == NODE_VAR_DECL)
+    {
+        IRType type = LowerType(builder, target.varDecl.type);
+
+        if(type.isAggregate)
+        {
+            Index variable = DeclareLocal(builder, node.assignStmt.lValue);
+            LowerStore(builder, builder->variables[variable].slot, type, node.assignStmt.expression);
+        }
+        else
+        {
+            // the initializer is evaluated before the new variable comes into scope
+            Index value = LowerExpression(builder, node.assignStmt.expression);
+            Index variable = DeclareLocal(builder, node.assignStmt.lValue);
+            WriteVariable(builder, variable, builder->currentBlock, value);
+        }
+
+        return;
+    }
+
+    Index variable = IR_NONE;
+
+    if(IsScalarVariableLValue(builder, node.assignStmt.lValue, &variable))
+    {
+        if(variable == IR_NONE)
+        {
+            LowerError(builder, "assignment to undeclared variable", ast->nodeList[target.lValue.simpleLValues[0]].identifier.value);
+        }
+
+        Index value = LowerExpression(builder, node.assignStmt.expression);
+        WriteVariable(builder, variable, builder->currentBlock, value);
+        return;
+    }
+
+    IRType type;
+    Index address = LowerAddress(builder, node.assignStmt.lValue, &type);
+    LowerStore(builder, address, type, node.assignStmt.expression);
+}
+
+void LowerStatement(IRBuilder *builder, Index stmt);
+
+void LowerStatementList(IRBuilder *builder, Index list)
+{
+    unsigned int scopeStart = builder->scopeCount;
+    Node node = builder->ast->nodeList[list];
+
+    for(unsigned int n = 0; n < node.statementList.statementCount; n++)
+    {
+        LowerStatement(builder, node.statementList.statements[n]);
+    }
+
+    builder->scopeCount = scopeStart;
+}
+
+void LowerIfStatement(IRBuilder *builder, Index stmt)
+{
+    Node node = builder->ast->nodeList[stmt];
+
+    Index condition = LowerExpression(builder, node.ifStmt.conditionExpr);
+
+    Index trueBlock = LowerNewBlock(builder);
+    Index falseBlock = node.ifStmt.falseBlockExist ? LowerNewBlock(builder) : IR_NONE;
+    Index joinBlock = LowerNewBlock(builder);
+
+    EmitBranch(builder, condition, trueBlock, node.ifStmt.falseBlockExist ? falseBlock : joinBlock);
+    SealBlock(builder, trueBlock);
+    if(node.ifStmt.falseBlockExist) SealBlock(builder, falseBlock);
+
+    builder->currentBlock = trueBlock;
+    LowerStatement(builder, node.ifStmt.trueBlock);
+    EmitFallthrough(builder, joinBlock);
+
+    if(node.ifStmt.falseBlockExist)
+    {
+        builder->currentBlock = falseBlock;
+        LowerStatement(builder, node.ifStmt.falseBlock);
+        EmitFallthrough(builder, joinBlock);
+    }
+
+    SealBlock(builder, joinBlock);
+    builder->currentBlock = joinBlock;
+}
+
+void LowerWhileStatement(IRBuilder *builder, Index stmt)
+{
+    Node node = builder->ast->nodeList[stmt];
+
+    // the header stays unsealed until the back edge is known
+    Index headerBlock = LowerNewBlock(builder);
+    EmitJump(builder, headerBlock);
+    builder->currentBlock = headerBlock;
+
+    Index condition = LowerExpression(builder, node.whileStmt.conditionExpr);
+
+    Index bodyBlock = LowerNewBlock(builder);
+    Index exitBlock = LowerNewBlock(builder);
+
+    EmitBranch(builder, condition, bodyBlock, exitBlock);
+    SealBlock(builder, bodyBlock);
+    SealBlock(builder, exitBlock);
+
+    builder->currentBlock = bodyBlock;
+    LowerStatement(builder, node.whileStmt.block);
+    EmitFallthrough(builder, headerBlock);
+
+    SealBlock(builder, headerBlock);
+    builder->currentBlock = exitBlock;
+}
+
+void LowerReturnStatement(IRBuilder *builder, Index stmt)
+{
+    Node node = builder->ast->nodeList[stmt];
+
+    if(node.returnStmt.exprExist)
+    {
+        Index value = LowerExpression(builder, node.returnStmt.expression);
+        EmitUnary(builder, IR_RET, value);
+    }
+    else
+    {
+        EmitInst(builder, IR_RET);
+    }
+
+    // code after a return is unreachable and is collected by the cfg cleanup pass
+    builder->currentBlock = LowerNewBlock(builder);
+    SealBlock(builder, builder->currentBlock);
+}
+
+void LowerStatement(IRBuilder *builder, Index stmt)
+{
+    Node node = builder->ast->nodeList[stmt];
+
+    switch(node.type)
+    {
+        case NODE_STATEMENT_LIST:       LowerStatementList(builder, stmt); break;
+        case NODE_VAR_DECL:             DeclareLocal(builder, stmt); break;
+        case NODE_ASSIGN_STATEMENT:     LowerAssignment(builder, stmt); break;
+        case NODE_IF_STATEMENT:         LowerIfStatement(builder, stmt); break;
+        case NODE_WHILE_STATEMENT:      LowerWhileStatement(builder, stmt); break;
+        case NODE_RETURN_STATEMENT:     LowerReturnStatement(builder, stmt); break;
+        default:                        LowerExpression(builder, stmt); break;
+    }
+}
+
+// phis replaced during construction left copies behind, forward their uses and drop them
+void RemoveCopies(IRFunction *function)
+{
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(inst->isDead) continue;
+
+        for(unsigned int o = 0; o < inst->operandCount; o++)
+        {
+            inst->operands[o] = ResolveCopies(function, inst->operands[o]);
+        }
+    }
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        if(!function->insts[n].isDead && function->insts[n].opcode == IR_COPY) RemoveInst(function, n);
+    }
+}
+
+void ResetBuilder(IRBuilder *builder)
+{
+    free(builder->variables);
+    free(builder->scope);
+    free(builder->definitions);
+    free(builder->incompletePhis);
+    free(builder->sealed);
+
+    builder->variables = 0;
+    builder->variableCount = 0;
+    builder->scope = 0;
+    builder->scopeCount = 0;
+    builder->definitions = 0;
+    builder->definitionCount = 0;
+    builder->incompletePhis = 0;
+    builder->incompletePhiCount = 0;
+    builder->sealed = 0;
+    builder->sealedCount = 0;
+}
+
+IRFunction LowerFunction(IRBuilder *builder, Index functionDef)
+{
+    AST *ast = builder->ast;
+    Node node = ast->nodeList[functionDef];
+
+    IRFunction function = {0};
+    function.name = node.functionDef.name;
+    function.parameterCount = node.functionDef.parameterCount;
+    function.hasReturnValue = node.functionDef.isReturnTypeDeclared;
+    if(function.hasReturnValue) function.returnType = LowerType(builder, node.functionDef.returnType);
+
+    ResetBuilder(builder);
+    builder->function = &function;
+    builder->currentBlock = LowerNewBlock(builder);
+    SealBlock(builder, builder->currentBlock);
+
+    for(unsigned int n = 0; n < node.functionDef.parameterCount; n++)
+    {
+        Node param = ast->nodeList[node.functionDef.parameters[n]];
+        const char *name = ast->nodeList[param.param.id].identifier.value;
+        IRType type = LowerType(builder, param.param.type);
+
+        Index value = EmitInst(builder, IR_PARAM);
+        function.insts[value].value = n;
+        function.insts[value].name = name;
+        function.insts[value].type = type;
+
+        Index variable = DeclareVariable(builder, name, type);
+
+        if(builder->variables[variable].isAggregate) builder->variables[variable].slot = value;
+        else WriteVariable(builder, variable, builder->currentBlock, value);
+    }
+
+    LowerStatement(builder, node.functionDef.body);
+
+    if(!IsBlockTerminated(builder))
+    {
+        if(function.hasReturnValue && !function.returnType.isAggregate) EmitUnary(builder, IR_RET, EmitEntryInst(builder, IR_UNDEF));
+        else EmitInst(builder, IR_RET);
+    }
+
+    RemoveCopies(&function);
+    RemoveUnreachableBlocks(&function, builder->options);
+
+    builder->function = 0;
+    return function;
+}
+
+typedef struct {
+    AST *ast;
+    Index program;
+
+    Index *definitions;     // of the functions, in source order
+    unsigned int definitionCount;
+    IRFunction *functions;
+    const Options *options;
+    bool insertChecks;
+} LoweringBatch;
+
+// a builder per task, functions only read the ast and each other's signatures
+void LowerFunctionTask(void *data, unsigned int task)
+{
+    LoweringBatch *batch = (LoweringBatch*)data;
+
+    IRBuilder builder = {0};
+    builder.ast = batch->ast;
+    builder.program = batch->program;
+    builder.options = batch->options;
+    builder.insertChecks = batch->insertChecks;
+
+    batch->functions[task] = LowerFunction(&builder, batch->definitions[task]);
+    ResetBuilder(&builder);
+}
+
+// checks are asked for explicitly instead of through the options, so a compilation that needs them
+// does not have to change the options its passes read
+IRModule LowerProgramWithChecks(AST *ast, Index program, const Options *options, bool insertChecks)
+{
+    IRModule module = {0};
+    module.options = options;
+
+    IRBuilder builder = {0};
+    builder.ast = ast;
+    builder.program = program;
+
+    Node node = ast->nodeList[program];
+
+    for(unsigned int n = 0; n < node.program.defCount; n++)
+    {
+        Node *def = &ast->nodeList[node.program.definitions[n]];
+        if(def->type != NODE_STRUCT_DEF) continue;
+
+        IRStruct s = {0};
+        s.name = def->structDef.name;
+        s.isFixedLayout = def->structDef.isFixedLayout;
+
+        for(unsigned int f = 0; f < def->structDef.fieldCount; f++)
+        {
+            Node *field = &ast->nodeList[def->structDef.fields[f]];
+
+            s.fieldCount++;
+            s.fields = (IRField*)realloc(s.fields, sizeof(IRField) * s.fieldCount);
+            s.fields[s.fieldCount - 1] = (IRField){ast->nodeList[field->field.id].identifier.value, LowerType(&builder, field->field.type), 0, 0, 0};
+        }
+
+        module.structCount++;
+        module.structs = (IRStruct*)realloc(module.structs, sizeof(IRStruct) * module.structCount);
+        module.structs[module.structCount - 1] = s;
+    }
+
+    LoweringBatch batch = {0};
+    batch.ast = ast;
+    batch.program = program;
+    batch.options = options;
+    batch.insertChecks = insertChecks;
+
+    for(unsigned int n = 0; n < node.program.defCount; n++)
+    {
+        Index def = node.program.definitions[n];
+        if(ast->nodeList[def].type == NODE_FUNC_DEF) PushIndex(&batch.definitions, &batch.definitionCount, def);
+    }
+
+    // functions land in source order whichever thread lowered them
+    module.functionCount = batch.definitionCount;
+    module.functions = (IRFunction*)calloc(batch.definitionCount ? batch.definitionCount : 1, sizeof(IRFunction));
+    batch.functions = module.functions;
+
+    RunTasks(options->threadCount, batch.definitionCount, LowerFunctionTask, &batch);
+
+    free(batch.definitions);
+    ResetBuilder(&builder);
+
+    return module;
+}
+
+IRModule LowerProgram(AST *ast, Index program, const Options *options)
+{
+    return LowerProgramWithChecks(ast, program, options, options->bounds.insertChecks);
+}
@@ -0,0 +1,57 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "ast.h"
+#include "ir.h"
+
+typedef struct {
+    const char *name;
+    IRType type;
+    bool isAggregate;
+    Index slot;         // address of an aggregate variable (alloca or param)
+} IRVariable;
+
+// current SSA definition of a scalar variable at the end of a block
+typedef struct {
+    Index variable;
+    Index block;
+    Index value;
+} IRDefinition;
+
+typedef struct {
+    Index variable;
+    Index block;
+    Index phi;
+} IRIncompletePhi;
+
+typedef struct {
+    AST *ast;
+    Index program;
+
+    IRFunction *function;
+    Index currentBlock;
+
+    IRVariable *variables;
+    unsigned int variableCount;
+
+    // visible variables, innermost last
+    Index *scope;
+    unsigned int scopeCount;
+
+    IRDefinition *definitions;
+    unsigned int definitionCount;
+
+    IRIncompletePhi *incompletePhis;
+    unsigned int incompletePhiCount;
+
+    bool *sealed;
+    unsigned int sealedCount;
+
+    const Options *options;
+    bool insertChecks;  // bounds checks on array indexing
+} IRBuilder;
+
+IRModule LowerProgram(AST *ast, Index program, const Options *options);
+IRModule LowerProgramWithChecks(AST *ast, Index program, const Options *options, bool insertChecks);
+
+#endif //LOWER_H
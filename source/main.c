@@ -1,37 +1,54 @@
-#include "lexer.c"
-#include "parser.c"
-#include "ast.c"
-#include "symbol.c"
+#include "compiler.c"
+#include "server.c"
 
-TypeTable globalTypeTable;
-SymbolTable globalSymbolTable;
+Options ParseOptions(int argc, char *argv[])
+{
+    Options options = DefaultOptions();
+
+    for(int n = 1; n < argc; n++)
+    {
+        if(ParseOption(&options, argv[n])) continue;
+
+        if(argv[n][0] == '-')
+        {
+            printf("error: unknown option '%s'\n", argv[n]);
+            exit(1);
+        }
+
+        options.fileName = argv[n];
+    }
+
+    return options;
+}
 
 int main(int argc, char *argv[])
 {
-    // push primitve type to global type table
-    Type integerType = {.id = "int", .size = 1};
-    Type stringType = {.id = "str", .size = 1};
+    Options options = ParseOptions(argc, argv);
+
+    if(options.server.connectPath) return RunClient(options);
+
+    if(options.server.socketPath)
+    {
+        int status = RunServer(options);
+        StopThreads(options.printReport);
+        return status;
+    }
 
-    PushType(&globalTypeTable, integerType);
-    PushType(&globalTypeTable, stringType);
+    // owns the type tables and every name the lexer sees
+    CompilerContext *context = CreateContext();
 
     AST ast = {0};
     InitAST(&ast);
 
     printf("size of ast node: %ld bytes\n", sizeof(Node));
 
-    if(argc > 1)
+    if(options.fileName)
     {
-        char *source = LoadFileNullTerminated(argv[1]);
+        ModuleGraph modules = LoadModules(context, 0, options.fileName, &options);
         
-        if(source)
+        if(modules.moduleCount > 0)
         {
-            Parser parser = {0};
-            parser.fileName = argv[1];
-            parser.source = source;            
-            parser.tokenList = TokenizeSource(source);
-            
-            printf("token count: %u\n", parser.tokenList.count);
+            printf("token count: %u\n", modules.tokenCount);
 
             // for(int n = 0; n < parser.tokenList.count; n++)
             // {
@@ -42,15 +59,20 @@ int main(int argc, char *argv[])
             //     }
             // }
             
-            Index rootIndex = ParseProgram(&ast, &parser);
+            CheckModules(&modules);
+            Index rootIndex = LinkModules(&modules, &ast);
             printf("parsing completed, AST build complete\n");
             printf("AST memory usage: %ld bytes\n", ast.nodeCount * sizeof(Node));
 
             PrintNode(ast, rootIndex, 0);
 
-            // BuildSymbolAndTypeTables(ast, globalSymbolTable, globalTypeTable);
+            // BuildSymbolAndTypeTables(ast, context->symbols, context->types);
+
+            SimplifyProgram(&ast, rootIndex, &options);
+            CompileModule(context, &ast, rootIndex, &options);
+            if(options.cgen.outputFileName || options.cgen.nativeFileName) TranspileToC(&ast, rootIndex, &options);
             
-            free(source);
+            FreeModuleGraph(&modules);
         }
     }
     else
@@ -67,13 +89,16 @@ int main(int argc, char *argv[])
         Parser parser = {0};        
         parser.fileName = "source";
         parser.source = source;
-        parser.tokenList = TokenizeSource(source);
+        parser.tokenList = TokenizeSource(context, source);
 
         Index index = ParseExpression(&ast, &parser, 1);
         // Index index = ParseIfStatement(&ast, &parser);
     
         PrintNode(ast, index, 0);
     }
+
+    DestroyContext(context);
+    StopThreads(options.printReport);
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,848 @@
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "module.h"
+#include "hash.h"
+#include "cache.h"
+#include "threads.h"
+
+// bump whenever the check starts accepting or rejecting different programs
+#define MODULE_MANIFEST_VERSION 1
+
+// every struct with its fields and every function with its parameter and return types, in order
+void ComputeModuleHashes(Module *module)
+{
+    AST *ast = &module->ast;
+    unsigned long long *hashes = HashASTNodes(ast, module->program);
+    Node *program = &ast->nodeList[module->program];
+
+    unsigned long long interface = HashValue(HASH_SEED, MODULE_MANIFEST_VERSION);
+
+    for(unsigned int n = 0; n < program->program.defCount; n++)
+    {
+        Index def = program->program.definitions[n];
+        Node *node = &ast->nodeList[def];
+
+        if(node->type == NODE_STRUCT_DEF)
+        {
+            interface = HashValue(interface, hashes[def]);
+            continue;
+        }
+
+        interface = HashString(interface, node->functionDef.name);
+        interface = HashValue(interface, node->functionDef.parameterCount);
+
+        for(unsigned int p = 0; p < node->functionDef.parameterCount; p++) interface = HashValue(interface, hashes[node->functionDef.parameters[p]]);
+
+        interface = HashValue(interface, node->functionDef.isReturnTypeDeclared);
+        if(node->functionDef.isReturnTypeDeclared) interface = HashValue(interface, hashes[node->functionDef.returnType]);
+    }
+
+    // function names are part of the interface, the program hash covers the rest
+    unsigned long long body = HashValue(interface, hashes[module->program]);
+    for(unsigned int n = 0; n < module->importCount; n++) body = HashString(body, module->importNames[n]);
+
+    module->interfaceHash = interface;
+    module->bodyHash = body;
+
+    free(hashes);
+}
+
+// a copy either way, sources in memory never fall back to the disk
+char *LoadModuleSource(CompilerContext *context, const char *fileName)
+{
+    if(!context->sourceCount) return LoadFileNullTerminated(fileName);
+
+    const char *source = FindSource(context, fileName);
+    return source ? strdup(source) : 0;
+}
+
+bool HasModuleSource(CompilerContext *context, const char *fileName)
+{
+    if(!context->sourceCount) return access(fileName, R_OK) == 0;
+    return FindSource(context, fileName) != 0;
+}
+
+ModuleCache *CreateModuleCache(CompilerContext *context)
+{
+    ModuleCache *cache = (ModuleCache*)calloc(1, sizeof(ModuleCache));
+    cache->context = context;
+    pthread_mutex_init(&cache->lock, 0);
+
+    return cache;
+}
+
+void FreeModuleCache(ModuleCache *cache)
+{
+    for(unsigned int n = 0; n < cache->fileCount; n++)
+    {
+        free(cache->files[n].path);
+        free(cache->files[n].importNames);
+        FreeAST(&cache->files[n].ast);
+    }
+
+    free(cache->files);
+    FreeNameTable(&cache->paths);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+const char **CopyImportNames(const char **names, unsigned int count)
+{
+    const char **copy = (const char**)malloc(sizeof(const char*) * (count ? count : 1));
+    if(count > 0) memcpy(copy, names, sizeof(const char*) * count);
+    return copy;
+}
+
+// the module gets a copy, linking changes its AST
+bool TakeCachedModule(ModuleCache *cache, Module *module, unsigned long long sourceHash)
+{
+    pthread_mutex_lock(&cache->lock);
+
+    int index = LookupName(&cache->paths, module->path, -1);
+    bool isFound = index != -1 && cache->files[index].sourceHash == sourceHash;
+
+    if(isFound)
+    {
+        CachedModule *file = &cache->files[index];
+
+        CopyAST(&module->ast, &file->ast);
+        module->program = file->program;
+        module->tokenCount = file->tokenCount;
+        module->importNames = CopyImportNames(file->importNames, file->importCount);
+        module->importCount = file->importCount;
+
+        cache->hitCount++;
+    }
+    else cache->missCount++;
+
+    pthread_mutex_unlock(&cache->lock);
+    return isFound;
+}
+
+// a changed file replaces what was kept for its path
+void KeepCachedModule(ModuleCache *cache, Module *module, unsigned long long sourceHash)
+{
+    CachedModule file = {0};
+    file.sourceHash = sourceHash;
+    file.program = module->program;
+    file.tokenCount = module->tokenCount;
+    file.importNames = CopyImportNames(module->importNames, module->importCount);
+    file.importCount = module->importCount;
+    CopyAST(&file.ast, &module->ast);
+
+    pthread_mutex_lock(&cache->lock);
+
+    int index = LookupName(&cache->paths, module->path, -1);
+
+    if(index != -1)
+    {
+        CachedModule *old = &cache->files[index];
+        file.path = old->path;
+
+        free(old->importNames);
+        FreeAST(&old->ast);
+        *old = file;
+    }
+    else
+    {
+        file.path = strdup(module->path);
+
+        cache->fileCount++;
+        cache->files = (CachedModule*)realloc(cache->files, sizeof(CachedModule) * cache->fileCount);
+        cache->files[cache->fileCount - 1] = file;
+        InsertName(&cache->paths, file.path, cache->fileCount - 1);
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+typedef struct {
+    ModuleGraph *graph;
+    unsigned int first;
+} ParseBatch;
+
+void ParseModuleTask(void *data, unsigned int task)
+{
+    ParseBatch *batch = (ParseBatch*)data;
+    Module *module = &batch->graph->modules[batch->first + task];
+
+    ModuleCache *cache = batch->graph->cache;
+
+    char *source = LoadModuleSource(batch->graph->context, module->fileName);
+    if(!source) return;
+
+    unsigned long long sourceHash = HashString(HASH_SEED, source);
+
+    if(!cache || !TakeCachedModule(cache, module, sourceHash))
+    {
+        Parser parser = {0};
+        parser.fileName = module->fileName;
+        parser.source = source;
+        parser.tokenList = TokenizeSource(batch->graph->context, source);
+
+        InitAST(&module->ast);
+        module->program = ParseProgram(&module->ast, &parser);
+        module->tokenCount = parser.tokenList.count;
+        module->importNames = parser.imports;
+        module->importCount = parser.importCount;
+
+        // identifiers and strings are interned by the lexer, nothing points into the source
+        free(parser.tokenList.tokens);
+
+        if(cache) KeepCachedModule(cache, module, sourceHash);
+    }
+
+    module->isLoaded = true;
+
+    Node *program = &module->ast.nodeList[module->program];
+
+    for(unsigned int n = 0; n < program->program.defCount; n++)
+    {
+        Index def = program->program.definitions[n];
+        Node *node = &module->ast.nodeList[def];
+
+        // the first definition of a name wins, the check reports the others
+        if(node->type == NODE_FUNC_DEF && LookupName(&module->functions, node->functionDef.name, -1) == -1) InsertName(&module->functions, node->functionDef.name, def);
+        else if(node->type == NODE_STRUCT_DEF && LookupName(&module->structs, node->structDef.name, -1) == -1) InsertName(&module->structs, node->structDef.name, def);
+    }
+
+    ComputeModuleHashes(module);
+    free(source);
+}
+
+// imports are relative to the directory of the importing file
+char *ResolveImportPath(const char *importer, const char *name)
+{
+    if(name[0] == '/') return strdup(name);
+
+    const char *slash = strrchr(importer, '/');
+    unsigned int directoryLength = slash ? (unsigned int)(slash - importer + 1) : 0;
+
+    char *fileName = (char*)malloc(directoryLength + strlen(name) + 1);
+    memcpy(fileName, importer, directoryLength);
+    strcpy(fileName + directoryLength, name);
+    return fileName;
+}
+
+// takes ownership of fileName
+Index AddModule(ModuleGraph *graph, char *fileName)
+{
+    // names of sources in memory are only ever joined, never resolved
+    char *path = graph->context->sourceCount ? 0 : realpath(fileName, 0);
+    if(!path) path = strdup(fileName);
+
+    int existing = LookupName(&graph->paths, path, -1);
+    if(existing != -1)
+    {
+        free(path);
+        free(fileName);
+        return existing;
+    }
+
+    Module module = {0};
+    module.fileName = fileName;
+    module.path = path;
+
+    graph->moduleCount++;
+    graph->modules = (Module*)realloc(graph->modules, sizeof(Module) * graph->moduleCount);
+    graph->modules[graph->moduleCount - 1] = module;
+
+    InsertName(&graph->paths, path, graph->moduleCount - 1);
+    return graph->moduleCount - 1;
+}
+
+typedef struct {
+    ModuleGraph *graph;
+    unsigned char *state;   // 0 not seen, 1 on the import chain, 2 done
+    Index *chain;
+    unsigned int orderCount;
+} ModuleOrdering;
+
+void OrderModule(ModuleOrdering *ordering, Index index, unsigned int depth)
+{
+    ModuleGraph *graph = ordering->graph;
+
+    if(ordering->state[index] == 2) return;
+
+    if(ordering->state[index] == 1)
+    {
+        unsigned int start = 0;
+        while(ordering->chain[start] != index) start++;
+
+        char message[1024] = "error: import cycle:";
+        unsigned int length = strlen(message);
+
+        for(unsigned int n = start; n < depth && length < sizeof(message); n++)
+        {
+            length += snprintf(message + length, sizeof(message) - length, " '%s' ->", graph->modules[ordering->chain[n]].fileName);
+        }
+
+        CompileError("%s '%s'", message, graph->modules[index].fileName);
+    }
+
+    ordering->state[index] = 1;
+    ordering->chain[depth] = index;
+
+    unsigned int level = 0;
+
+    for(unsigned int n = 0; n < graph->modules[index].importCount; n++)
+    {
+        Index import = graph->modules[index].imports[n];
+        OrderModule(ordering, import, depth + 1);
+        if(graph->modules[import].level + 1 > level) level = graph->modules[import].level + 1;
+    }
+
+    graph->modules[index].level = level;
+    if(level + 1 > graph->levelCount) graph->levelCount = level + 1;
+
+    ordering->state[index] = 2;
+    PushIndex(&graph->order, &ordering->orderCount, index);
+}
+
+// parses the file and everything it imports. every round parses the files the previous round
+// found in parallel, so a round is as wide as that level of the import graph.
+// returns no modules when the file itself cannot be read
+ModuleGraph LoadModules(CompilerContext *context, ModuleCache *cache, const char *fileName, const Options *options)
+{
+    ModuleGraph graph = {0};
+    graph.context = context;
+    graph.options = options;
+    graph.cache = cache;
+    AddModule(&graph, strdup(fileName));
+
+    unsigned int first = 0;
+
+    while(first < graph.moduleCount)
+    {
+        unsigned int last = graph.moduleCount;
+
+        ParseBatch batch = {.graph = &graph, .first = first};
+        RunTasks(options->threadCount, last - first, ParseModuleTask, &batch);
+
+        if(!graph.modules[0].isLoaded)
+        {
+            FreeModuleGraph(&graph);
+            return graph;
+        }
+
+        for(unsigned int m = first; m < last; m++)
+        {
+            if(!graph.modules[m].isLoaded) CompileError("error: cannot load module '%s'", graph.modules[m].fileName);
+
+            graph.tokenCount += graph.modules[m].tokenCount;
+            graph.modules[m].imports = (Index*)malloc(sizeof(Index) * (graph.modules[m].importCount ? graph.modules[m].importCount : 1));
+
+            for(unsigned int n = 0; n < graph.modules[m].importCount; n++)
+            {
+                const char *importName = graph.modules[m].importNames[n];
+                char *importFileName = ResolveImportPath(graph.modules[m].fileName, importName);
+
+                if(!HasModuleSource(context, importFileName)) CompileError("%s: error: cannot find imported file '%s'", graph.modules[m].fileName, importName);
+
+                // adding a module can move the module list
+                Index import = AddModule(&graph, importFileName);
+                graph.modules[m].imports[n] = import;
+            }
+        }
+
+        first = last;
+    }
+
+    ModuleOrdering ordering = {0};
+    ordering.graph = &graph;
+    ordering.state = (unsigned char*)calloc(graph.moduleCount, sizeof(unsigned char));
+    ordering.chain = (Index*)calloc(graph.moduleCount, sizeof(Index));
+
+    OrderModule(&ordering, 0, 0);
+
+    free(ordering.state);
+    free(ordering.chain);
+
+    return graph;
+}
+
+void SetModuleError(Module *module, const char *message)
+{
+    if(!module->error) module->error = strdup(message);
+}
+
+// the module's own definitions first, then the ones of the modules it imports directly
+Index FindVisibleDefinition(ModuleGraph *graph, Module *module, bool isStruct, const char *name, Module **owner)
+{
+    Index def = LookupName(isStruct ? &module->structs : &module->functions, name, -1);
+
+    if(def != -1)
+    {
+        *owner = module;
+        return def;
+    }
+
+    for(unsigned int n = 0; n < module->importCount; n++)
+    {
+        Module *import = &graph->modules[module->imports[n]];
+        def = LookupName(isStruct ? &import->structs : &import->functions, name, -1);
+
+        if(def != -1)
+        {
+            *owner = import;
+            return def;
+        }
+    }
+
+    return -1;
+}
+
+typedef struct {
+    ModuleGraph *graph;
+    Module *module;
+    const char *definition;
+} ModuleChecker;
+
+// a type nothing declares is a scalar, so only a struct that lives in a module not imported is an error for types
+void ReportUnknownName(ModuleChecker *checker, bool isStruct, const char *name)
+{
+    char message[512];
+    ModuleGraph *graph = checker->graph;
+    const char *kind = isStruct ? "struct" : "function";
+
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *other = &graph->modules[n];
+        if(LookupName(isStruct ? &other->structs : &other->functions, name, -1) == -1) continue;
+
+        snprintf(message, sizeof(message), "%s: error: in '%s': %s '%s' is defined in '%s', which is not imported",
+                 checker->module->fileName, checker->definition, kind, name, other->fileName);
+        SetModuleError(checker->module, message);
+        return;
+    }
+
+    if(isStruct) return;
+
+    snprintf(message, sizeof(message), "%s: error: in '%s': unknown function '%s'", checker->module->fileName, checker->definition, name);
+    SetModuleError(checker->module, message);
+}
+
+void CheckModuleNode(AST *ast, Index index, void *data)
+{
+    ModuleChecker *checker = (ModuleChecker*)data;
+    Node *node = &ast->nodeList[index];
+    Module *owner;
+    char message[512];
+
+    if(node->type == NODE_FUNC_CALL)
+    {
+        const char *name = node->functionCall.id;
+        unsigned int parameterCount;
+
+        // print is the only builtin
+        if(!strcmp(name, "print"))
+        {
+            parameterCount = 1;
+        }
+        else
+        {
+            Index def = FindVisibleDefinition(checker->graph, checker->module, false, name, &owner);
+
+            if(def == -1)
+            {
+                ReportUnknownName(checker, false, name);
+                return;
+            }
+
+            parameterCount = owner->ast.nodeList[def].functionDef.parameterCount;
+        }
+
+        if(node->functionCall.argumentCount != parameterCount)
+        {
+            snprintf(message, sizeof(message), "%s: error: in '%s': '%s' takes %u arguments but is called with %u",
+                     checker->module->fileName, checker->definition, name, parameterCount, node->functionCall.argumentCount);
+            SetModuleError(checker->module, message);
+        }
+    }
+    else if(node->type == NODE_TYPE_ANNOTATION)
+    {
+        const char *name = node->typeAnnotation.id;
+
+        if(FindVisibleDefinition(checker->graph, checker->module, true, name, &owner) == -1) ReportUnknownName(checker, true, name);
+    }
+}
+
+typedef struct {
+    ModuleGraph *graph;
+    Index *modules;
+    unsigned int moduleCount;
+} CheckBatch;
+
+// every name a module uses has to be defined in it or in a module it imports
+void CheckModuleTask(void *data, unsigned int task)
+{
+    CheckBatch *batch = (CheckBatch*)data;
+    ModuleGraph *graph = batch->graph;
+    Module *module = &graph->modules[batch->modules[task]];
+    AST *ast = &module->ast;
+    Node *program = &ast->nodeList[module->program];
+    char message[512];
+
+    for(unsigned int n = 0; n < program->program.defCount; n++)
+    {
+        Index def = program->program.definitions[n];
+        Node *node = &ast->nodeList[def];
+
+        bool isStruct = node->type == NODE_STRUCT_DEF;
+        const char *name = isStruct ? node->structDef.name : node->functionDef.name;
+        NameTable *table = isStruct ? &module->structs : &module->functions;
+
+        if(LookupName(table, name, -1) != def)
+        {
+            snprintf(message, sizeof(message), "%s: error: '%s' is defined twice", module->fileName, name);
+            SetModuleError(module, message);
+        }
+
+        for(unsigned int i = 0; i < module->importCount; i++)
+        {
+            Module *import = &graph->modules[module->imports[i]];
+            if(LookupName(isStruct ? &import->structs : &import->functions, name, -1) == -1) continue;
+
+            snprintf(message, sizeof(message), "%s: error: '%s' is already defined in '%s'", module->fileName, name, import->fileName);
+            SetModuleError(module, message);
+        }
+
+        ModuleChecker checker = {.graph = graph, .module = module, .definition = name};
+        VisitNodes(ast, def, CheckModuleNode, &checker);
+    }
+}
+
+void GetManifestFileName(ModuleGraph *graph, char *buffer, unsigned int size)
+{
+    snprintf(buffer, size, "%s/%016llx.modules", graph->options->cache.directory, HashString(HASH_SEED, graph->modules[0].path));
+}
+
+// a module that passed the check before with the same body and the same imported interfaces passes again
+void ReadModuleManifest(ModuleGraph *graph)
+{
+    char fileName[1024];
+    GetManifestFileName(graph, fileName, sizeof(fileName));
+
+    FILE *file = fopen(fileName, "rb");
+    if(!file) return;
+
+    unsigned int version;
+
+    if(fscanf(file, "bee-modules %u", &version) == 1 && version == MODULE_MANIFEST_VERSION)
+    {
+        unsigned long long bodyHash;
+        unsigned long long importHash;
+        unsigned int length;
+
+        while(fscanf(file, " %llx %llx %u", &bodyHash, &importHash, &length) == 3 && length < PATH_MAX && fgetc(file) == ' ')
+        {
+            char path[PATH_MAX];
+            if(fread(path, 1, length, file) != length) break;
+            path[length] = 0;
+
+            int index = LookupName(&graph->paths, path, -1);
+            if(index == -1) continue;
+
+            Module *module = &graph->modules[index];
+            module->isUpToDate = module->bodyHash == bodyHash && module->importHash == importHash;
+        }
+    }
+
+    fclose(file);
+}
+
+// written under a temporary name and renamed, like cached functions
+void WriteModuleManifest(ModuleGraph *graph)
+{
+    char fileName[1024];
+    char temporaryFileName[1100];
+    GetManifestFileName(graph, fileName, sizeof(fileName));
+
+    mkdir(graph->options->cache.directory, 0755);
+
+    FILE *file = CreateTemporaryFile(fileName, temporaryFileName, sizeof(temporaryFileName));
+    if(!file) return;
+
+    fprintf(file, "bee-modules %u\n", MODULE_MANIFEST_VERSION);
+
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[n];
+        fprintf(file, "%016llx %016llx %u ", module->bodyHash, module->importHash, (unsigned int)strlen(module->path));
+        fputs(module->path, file);
+        fputc('\n', file);
+    }
+
+    bool isWritten = !ferror(file);
+    if(fclose(file) != 0) isWritten = false;
+
+    if(!isWritten || rename(temporaryFileName, fileName) != 0) remove(temporaryFileName);
+}
+
+// like the manifest, but for the files kept in memory
+void FindCheckedModules(ModuleGraph *graph)
+{
+    ModuleCache *cache = graph->cache;
+    pthread_mutex_lock(&cache->lock);
+
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[n];
+        int index = LookupName(&cache->paths, module->path, -1);
+        if(index == -1 || !cache->files[index].isChecked) continue;
+
+        CachedModule *file = &cache->files[index];
+        if(file->checkedBodyHash == module->bodyHash && file->checkedImportHash == module->importHash) module->isUpToDate = true;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void KeepCheckedModules(ModuleGraph *graph)
+{
+    ModuleCache *cache = graph->cache;
+    pthread_mutex_lock(&cache->lock);
+
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[n];
+        int index = LookupName(&cache->paths, module->path, -1);
+        if(index == -1) continue;
+
+        CachedModule *file = &cache->files[index];
+        file->checkedBodyHash = module->bodyHash;
+        file->checkedImportHash = module->importHash;
+        file->isChecked = true;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// modules are checked a level at a time, so every import is checked before its importers and
+// an error is reported in the module it is in, not in every module that uses it
+void CheckModules(ModuleGraph *graph)
+{
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[n];
+        module->importHash = HASH_SEED;
+
+        for(unsigned int i = 0; i < module->importCount; i++) module->importHash = HashValue(module->importHash, graph->modules[module->imports[i]].interfaceHash);
+    }
+
+    if(graph->options->cache.directory) ReadModuleManifest(graph);
+    if(graph->cache) FindCheckedModules(graph);
+
+    unsigned int checkedCount = 0;
+
+    for(unsigned int level = 0; level < graph->levelCount; level++)
+    {
+        CheckBatch batch = {0};
+        batch.graph = graph;
+
+        for(unsigned int n = 0; n < graph->moduleCount; n++)
+        {
+            Module *module = &graph->modules[graph->order[n]];
+            if(module->level == level && !module->isUpToDate) PushIndex(&batch.modules, &batch.moduleCount, graph->order[n]);
+        }
+
+        RunTasks(graph->options->threadCount, batch.moduleCount, CheckModuleTask, &batch);
+
+        bool hasErrors = false;
+
+        for(unsigned int n = 0; n < batch.moduleCount; n++)
+        {
+            Module *module = &graph->modules[batch.modules[n]];
+
+            if(module->error)
+            {
+                ReportDiagnostic("%s", module->error);
+                hasErrors = true;
+            }
+        }
+
+        if(hasErrors) AbortCompilation();
+
+        checkedCount += batch.moduleCount;
+        free(batch.modules);
+    }
+
+    if(graph->options->cache.directory) WriteModuleManifest(graph);
+    if(graph->cache) KeepCheckedModules(graph);
+
+    if(graph->options->printReport)
+    {
+        for(unsigned int n = 0; n < graph->moduleCount; n++)
+        {
+            Module *module = &graph->modules[graph->order[n]];
+            printf("module: '%s': level %u, %u imports, %s\n", module->fileName, module->level, module->importCount, module->isUpToDate ? "up to date" : "checked");
+        }
+
+        printf("modules: %u loaded, %u checked, %u up to date, %u levels\n", graph->moduleCount, checkedCount, graph->moduleCount - checkedCount, graph->levelCount);
+    }
+}
+
+void ShiftIndexList(Index *list, unsigned int count, Index offset)
+{
+    for(unsigned int n = 0; n < count; n++) list[n] += offset;
+}
+
+void ShiftNodeIndices(Node *node, Index offset)
+{
+    switch(node->type)
+    {
+        case NODE_PROGRAM:          ShiftIndexList(node->program.definitions, node->program.defCount, offset); break;
+        case NODE_STRUCT_DEF:       ShiftIndexList(node->structDef.fields, node->structDef.fieldCount, offset); break;
+        case NODE_FUNC_CALL:        ShiftIndexList(node->functionCall.arguments, node->functionCall.argumentCount, offset); break;
+        case NODE_STATEMENT_LIST:   ShiftIndexList(node->statementList.statements, node->statementList.statementCount, offset); break;
+        case NODE_L_VALUE:          ShiftIndexList(node->lValue.simpleLValues, node->lValue.simpleLValueCount, offset); break;
+
+        case NODE_FUNC_DEF:
+        {
+            ShiftIndexList(node->functionDef.parameters, node->functionDef.parameterCount, offset);
+            if(node->functionDef.isReturnTypeDeclared) node->functionDef.returnType += offset;
+            node->functionDef.body += offset;
+        }
+        break;
+
+        case NODE_VAR_DECL:
+        case NODE_FIELD:
+        case NODE_PARAM:
+        {
+            node->varDecl.id += offset;
+            node->varDecl.type += offset;
+        }
+        break;
+
+        case NODE_ARRAY_ACCESS:
+        {
+            node->arrayAccess.id += offset;
+            node->arrayAccess.expr += offset;
+        }
+        break;
+
+        case NODE_OPERATOR:
+        {
+            node->operator.left += offset;
+            if(node->operator.opType != BOOL_OP_NOT) node->operator.right += offset;
+        }
+        break;
+
+        case NODE_ASSIGN_STATEMENT:
+        {
+            node->assignStmt.lValue += offset;
+            node->assignStmt.expression += offset;
+        }
+        break;
+
+        case NODE_IF_STATEMENT:
+        {
+            node->ifStmt.conditionExpr += offset;
+            node->ifStmt.trueBlock += offset;
+            if(node->ifStmt.falseBlockExist) node->ifStmt.falseBlock += offset;
+        }
+        break;
+
+        case NODE_WHILE_STATEMENT:
+        {
+            node->whileStmt.conditionExpr += offset;
+            node->whileStmt.block += offset;
+        }
+        break;
+
+        case NODE_RETURN_STATEMENT:
+        {
+            if(node->returnStmt.exprExist) node->returnStmt.expression += offset;
+        }
+        break;
+    }
+}
+
+// moves every module's nodes into ast, imports first, and returns a program with all their definitions.
+// the modules' ASTs are not usable afterwards
+Index LinkModules(ModuleGraph *graph, AST *ast)
+{
+    Node program = {0};
+    program.type = NODE_PROGRAM;
+
+    NameTable functions = {0};   // name -> module defining it
+    NameTable structs = {0};
+    Index linked = 0;
+
+    // set first, a link that fails part way leaks lists rather than freeing them twice
+    graph->isLinked = true;
+
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[graph->order[n]];
+        Index offset = ast->nodeCount;
+
+        for(unsigned int i = 0; i < module->ast.nodeCount; i++)
+        {
+            Node node = module->ast.nodeList[i];
+            ShiftNodeIndices(&node, offset);
+            PushNode(ast, node);
+        }
+
+        linked = module->program + offset;
+        Node *moduleProgram = &ast->nodeList[linked];
+
+        for(unsigned int d = 0; d < moduleProgram->program.defCount; d++)
+        {
+            Index def = moduleProgram->program.definitions[d];
+            Node *node = &ast->nodeList[def];
+
+            bool isStruct = node->type == NODE_STRUCT_DEF;
+            const char *name = isStruct ? node->structDef.name : node->functionDef.name;
+            NameTable *table = isStruct ? &structs : &functions;
+
+            // two modules that do not import each other can still clash once they share a program
+            int other = LookupName(table, name, -1);
+            if(other != -1 && other != graph->order[n]) CompileError("error: '%s' is defined in both '%s' and '%s'", name, graph->modules[other].fileName, module->fileName);
+
+            InsertName(table, name, graph->order[n]);
+            PushIndex(&program.program.definitions, &program.program.defCount, def);
+        }
+    }
+
+    FreeNameTable(&functions);
+    FreeNameTable(&structs);
+
+    // a single file keeps its own program node
+    if(graph->moduleCount == 1)
+    {
+        free(program.program.definitions);
+        return linked;
+    }
+
+    return PushNode(ast, program);
+}
+
+void FreeModuleGraph(ModuleGraph *graph)
+{
+    for(unsigned int n = 0; n < graph->moduleCount; n++)
+    {
+        Module *module = &graph->modules[n];
+
+        free(module->importNames);
+        free(module->imports);
+
+        if(graph->isLinked) free(module->ast.nodeList);
+        else if(module->ast.nodeList) FreeAST(&module->ast);
+
+        free(module->fileName);
+        free(module->path);
+        free(module->error);
+        FreeNameTable(&module->functions);
+        FreeNameTable(&module->structs);
+    }
+
+    free(graph->modules);
+    free(graph->order);
+    FreeNameTable(&graph->paths);
+
+    ModuleGraph empty = {0};
+    *graph = empty;
+}
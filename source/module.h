@@ -0,0 +1,89 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "ast.h"
+#include "parser.h"
+#include "symbol.h"
+#include "context.h"
+#include "options.h"
+
+// one source file, parsed into an AST of its own until the modules are linked into one program
+typedef struct {
+    char *fileName;         // as reached from the importing file, used in messages
+    char *path;             // resolved, two imports of the same file share a module
+
+    AST ast;
+    Index program;
+    unsigned int tokenCount;
+    bool isLoaded;
+
+    const char **importNames;   // as written in the import statements, interned
+    Index *imports;         // modules
+    unsigned int importCount;
+
+    NameTable functions;    // name -> NODE_FUNC_DEF in this module's AST
+    NameTable structs;      // name -> NODE_STRUCT_DEF
+
+    // the interface is every struct and every function signature, the body hash covers the whole file.
+    // a module has to be checked again when its body or an import's interface changes
+    unsigned long long interfaceHash;
+    unsigned long long bodyHash;
+    unsigned long long importHash;
+
+    unsigned int level;     // 0 without imports, else one above its highest import
+    bool isUpToDate;
+    char *error;            // first problem the check found
+} Module;
+
+// a file as it was parsed the last time, kept for later compilations in the same process.
+// the names in its AST are interned in the cache's context
+typedef struct {
+    char *path;
+    unsigned long long sourceHash;
+
+    AST ast;
+    Index program;
+    unsigned int tokenCount;
+    const char **importNames;
+    unsigned int importCount;
+
+    // what the module hashed to the last time it passed the check
+    unsigned long long checkedBodyHash;
+    unsigned long long checkedImportHash;
+    bool isChecked;
+} CachedModule;
+
+typedef struct {
+    CompilerContext *context;
+    NameTable paths;        // path -> file
+    CachedModule *files;
+    unsigned int fileCount;
+
+    unsigned int hitCount;
+    unsigned int missCount;
+    pthread_mutex_t lock;
+} ModuleCache;
+
+typedef struct {
+    CompilerContext *context;
+    const Options *options;
+    ModuleCache *cache;     // zero to parse and check every file
+    Module *modules;        // the file named on the command line comes first
+    unsigned int moduleCount;
+    NameTable paths;        // resolved path -> module
+
+    Index *order;           // imports before the modules importing them
+    unsigned int levelCount;
+    unsigned int tokenCount;
+    bool isLinked;          // the modules' lists belong to the linked program
+} ModuleGraph;
+
+ModuleCache *CreateModuleCache(CompilerContext *context);
+void FreeModuleCache(ModuleCache *cache);
+
+ModuleGraph LoadModules(CompilerContext *context, ModuleCache *cache, const char *fileName, const Options *options);
+void CheckModules(ModuleGraph *graph);
+Index LinkModules(ModuleGraph *graph, AST *ast);
+void FreeModuleGraph(ModuleGraph *graph);
+
+#endif //MODULE_H
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+
+Options DefaultOptions(void)
+{
+    Options options = {0};
+    options.entry = "main";
+    options.threadCount = 1;
+
+    options.inlining.threshold = 30;
+    options.inlining.maxDepth = 2;
+    options.inlining.constantArgBonus = 4;
+    options.inlining.aggregateArgBonus = 10;
+    options.inlining.callBonus = 5;
+
+    options.specialize.sizeBudget = 200;
+    options.specialize.maxClones = 4;
+    options.specialize.minSavings = 2;
+    options.specialize.maxRounds = 4;
+
+    options.constEval.stepLimit = 100000;
+    options.constEval.registerCapacity = 1 << 16;
+    options.constEval.stackBytes = 1 << 16;
+    options.constEval.maxDepth = 256;
+    options.constEval.maxRounds = 4;
+
+    options.loops.maxFullUnrollTripCount = 16;
+    options.loops.maxUnrolledSize = 64;
+    options.loops.partialUnrollFactor = 4;
+
+    options.bounds.insertChecks = true;
+
+    options.switches.minCases = 4;
+    options.switches.minTableCases = 4;
+    options.switches.minTableDensity = 40;
+    options.switches.maxTableSize = 256;
+
+    options.layout.fieldOrder = FIELD_ORDER_DECLARED;
+    options.abi.maxRegisterBytes = 16;
+    options.bulk.inlineLimit = 64;
+
+    options.vm.registerCapacity = 1 << 20;
+    options.vm.stackBytes = 1 << 20;
+    options.vm.maxDepth = 10000;
+
+    options.cgen.compiler = "gcc";
+
+    return options;
+}
+
+// one '-name' or '-name=value' argument, false when it names no option
+bool ParseOption(Options *options, const char *argument)
+{
+    if(!strcmp(argument, "-ir")) options->printIR = true;
+    else if(!strcmp(argument, "-verify-each")) options->verifyEachPass = true;
+    else if(!strcmp(argument, "-time-passes")) options->timePasses = true;
+    else if(!strcmp(argument, "-stats")) options->printReport = true;
+    else if(!strncmp(argument, "-entry=", 7))
+    {
+        // the entry is called from outside, nothing is known about what it is passed
+        options->entry = argument + 7;
+    }
+    else if(!strcmp(argument, "-no-inline")) options->noInline = true;
+    else if(!strcmp(argument, "-inline-report")) options->inlining.printReport = true;
+    else if(!strncmp(argument, "-inline-threshold=", 18)) options->inlining.threshold = atoi(argument + 18);
+    else if(!strncmp(argument, "-inline-depth=", 14)) options->inlining.maxDepth = atoi(argument + 14);
+    else if(!strcmp(argument, "-no-ipcp")) options->noIpcp = true;
+    else if(!strcmp(argument, "-no-specialize")) options->specialize.noSpecialize = true;
+    else if(!strncmp(argument, "-specialize-budget=", 19)) options->specialize.sizeBudget = atoi(argument + 19);
+    else if(!strcmp(argument, "-no-const-eval")) options->noConstEval = true;
+    else if(!strncmp(argument, "-const-eval-steps=", 18)) options->constEval.stepLimit = strtoull(argument + 18, 0, 10);
+    else if(!strcmp(argument, "-no-merge-functions")) options->noMerge = true;
+    else if(!strcmp(argument, "-no-cse")) options->noCse = true;
+    else if(!strcmp(argument, "-no-loop-opts")) options->noLoopOpts = true;
+    else if(!strcmp(argument, "-no-unroll")) options->loops.noUnroll = true;
+    else if(!strncmp(argument, "-unroll-size=", 13)) options->loops.maxUnrolledSize = atoi(argument + 13);
+    else if(!strcmp(argument, "-no-bounds-checks")) options->bounds.insertChecks = false;
+    else if(!strcmp(argument, "-no-jump-tables")) options->switches.noJumpTables = true;
+    else if(!strcmp(argument, "-field-order=declared")) options->layout.fieldOrder = FIELD_ORDER_DECLARED;
+    else if(!strcmp(argument, "-field-order=packed")) options->layout.fieldOrder = FIELD_ORDER_PACKED;
+    else if(!strcmp(argument, "-field-order=hot")) options->layout.fieldOrder = FIELD_ORDER_HOT;
+    else if(!strncmp(argument, "-field-profile=", 15))
+    {
+        // a profile is only read to order hot fields
+        options->layout.profileFileName = argument + 15;
+        options->layout.fieldOrder = FIELD_ORDER_HOT;
+    }
+    else if(!strcmp(argument, "-no-copy-elision")) options->abi.noCopyElision = true;
+    else if(!strncmp(argument, "-bulk-inline-limit=", 19)) options->bulk.inlineLimit = atoi(argument + 19);
+    else if(!strcmp(argument, "-no-stack-coloring")) options->frame.noColoring = true;
+    else if(!strcmp(argument, "-bytecode")) options->bytecode.printBytecode = true;
+    else if(!strcmp(argument, "-run")) options->runProgram = true;
+    else if(!strcmp(argument, "-no-superinstructions")) options->bytecode.noSuperinstructions = true;
+    else if(!strncmp(argument, "-mine-superinstructions=", 24))
+    {
+        options->vm.mineFileName = argument + 24;
+        options->runProgram = true;
+    }
+    else if(!strncmp(argument, "-threads=", 9)) options->threadCount = atoi(argument + 9);
+    else if(!strncmp(argument, "-cache=", 7)) options->cache.directory = argument + 7;
+    else if(!strncmp(argument, "-server=", 8)) options->server.socketPath = argument + 8;
+    else if(!strncmp(argument, "-server-workers=", 16)) options->server.workerCount = atoi(argument + 16);
+    else if(!strncmp(argument, "-connect=", 9)) options->server.connectPath = argument + 9;
+    else if(!strcmp(argument, "-stop-server")) options->server.stop = true;
+    else if(!strncmp(argument, "-emit-c=", 8)) options->cgen.outputFileName = argument + 8;
+    else if(!strncmp(argument, "-native=", 8)) options->cgen.nativeFileName = argument + 8;
+    else if(!strncmp(argument, "-cc=", 4)) options->cgen.compiler = argument + 4;
+    else if(!strcmp(argument, "-vector-isa=sse2")) options->cgen.vectorTarget = "-msse2";
+    else if(!strcmp(argument, "-vector-isa=avx2")) options->cgen.vectorTarget = "-mavx2";
+    else if(!strcmp(argument, "-vector-isa=none")) options->cgen.noVectorize = true;
+    else return false;
+
+    return true;
+}
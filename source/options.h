@@ -0,0 +1,148 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+    int threshold;              // inline when cost minus bonus is at most this
+    unsigned int maxDepth;      // how many times inlined bodies are inlined into again, bounds recursion
+    int constantArgBonus;
+    int aggregateArgBonus;
+    int callBonus;
+    bool printReport;           // -inline-report, the inliner's decisions without the rest of -stats
+} InlineOptions;
+
+typedef struct {
+    unsigned int sizeBudget;        // cost all specialized clones together may add
+    unsigned int maxClones;         // per function
+    int minSavings;                 // cost a clone must save over the function it was made from
+    unsigned int maxRounds;         // of propagating constants every call agrees on
+    bool noSpecialize;              // propagate only, never clone
+} SpecializeOptions;
+
+typedef struct {
+    unsigned long long stepLimit;       // dispatches per evaluated call
+    unsigned int registerCapacity;
+    unsigned int stackBytes;
+    unsigned int maxDepth;
+    unsigned int maxRounds;             // results become arguments of the next round
+} ConstEvalOptions;
+
+typedef struct {
+    unsigned int maxFullUnrollTripCount;
+    unsigned int maxUnrolledSize;       // instructions in an unrolled loop body
+    unsigned int partialUnrollFactor;
+    bool noUnroll;
+} LoopOptions;
+
+typedef struct {
+    bool insertChecks;      // lower array accesses with a bounds check
+} BoundsOptions;
+
+typedef struct {
+    unsigned int minCases;          // shorter chains stay compares
+    unsigned int minTableCases;
+    unsigned int minTableDensity;   // percent of table entries that must be cases
+    unsigned int maxTableSize;
+    bool noJumpTables;              // binary search only
+} SwitchOptions;
+
+enum FieldOrder
+{
+    FIELD_ORDER_DECLARED = 1,
+    FIELD_ORDER_PACKED,         // by alignment, largest first, so no padding sits between fields
+    FIELD_ORDER_HOT,            // frequently accessed fields first, each group packed
+};
+
+typedef struct {
+    unsigned int fieldOrder;
+    const char *profileFileName;    // 'Struct.field count' per line, static estimates without one
+} LayoutOptions;
+
+typedef struct {
+    unsigned int maxRegisterBytes;
+    bool noCopyElision;
+} AbiOptions;
+
+typedef struct {
+    unsigned int inlineLimit;       // bytes, larger zeroing and copies call the runtime
+} BulkOptions;
+
+typedef struct {
+    bool noColoring;        // every variable keeps a slot of its own
+} FrameOptions;
+
+typedef struct {
+    bool noSuperinstructions;
+    bool printBytecode;
+} BytecodeOptions;
+
+typedef struct {
+    unsigned int registerCapacity;      // values across all active calls
+    unsigned int stackBytes;            // frame memory across all active calls
+    unsigned int maxDepth;
+    unsigned long long stepLimit;       // dispatches, 0 for no limit
+    const char *mineFileName;           // opcode pair and triple counts, accumulated over every run using the file
+    FILE *output;                       // where print writes, stdout when zero
+} VMOptions;
+
+typedef struct {
+    const char *outputFileName;     // the c translation unit
+    const char *nativeFileName;     // executable built from it, empty for none
+    const char *compiler;
+    const char *vectorTarget;       // -msse2 or -mavx2, zero keeps the compiler's default target
+    bool noVectorize;
+} CGenOptions;
+
+typedef struct {
+    const char *directory;      // zero turns the cache on disk off
+    bool keepInMemory;          // functions stay loaded for later compilations in the same process
+} CacheOptions;
+
+typedef struct {
+    const char *socketPath;     // stay resident and serve compilations on this socket
+    const char *connectPath;    // hand the compilation to the server on this socket instead
+    unsigned int workerCount;   // requests served at once, 0 for one per core
+    bool stop;                  // ask the server to exit once its requests are done
+} ServerOptions;
+
+// everything that decides what one compilation does. each compilation has its own, passes are handed
+// them and never look anywhere else, so compilations with different settings can run side by side
+typedef struct Options {
+    const char *fileName;
+    const char *entry;
+    bool printIR;
+    bool verifyEachPass;
+    bool timePasses;
+    bool printReport;           // -stats, every pass says what it did
+    bool noInline;
+    bool noIpcp;
+    bool noConstEval;
+    bool noMerge;
+    bool noCse;
+    bool noLoopOpts;
+    bool runProgram;
+    unsigned int threadCount;   // including the thread that hands out the work, 0 for one per core
+
+    InlineOptions inlining;
+    SpecializeOptions specialize;
+    ConstEvalOptions constEval;
+    LoopOptions loops;
+    BoundsOptions bounds;
+    SwitchOptions switches;
+    LayoutOptions layout;
+    AbiOptions abi;
+    BulkOptions bulk;
+    FrameOptions frame;
+    BytecodeOptions bytecode;
+    VMOptions vm;
+    CGenOptions cgen;
+    CacheOptions cache;
+    ServerOptions server;
+} Options;
+
+Options DefaultOptions(void);
+bool ParseOption(Options *options, const char *argument);
+
+#endif //OPTIONS_H
@@ -33,8 +33,7 @@ Token ExpectToken(Parser *parser, unsigned int tokenType)
     }
     else
     {
-        printf("%s:%u:%u: error: expected '%s' but found '%s'\n", parser->fileName, token.line+1, token.column+1, TokenTypeToString(tokenType), TokenTypeToString(token.type));
-        exit(1);
+        CompileError("%s:%u:%u: error: expected '%s' but found '%s'", parser->fileName, token.line+1, token.column+1, TokenTypeToString(tokenType), TokenTypeToString(token.type));
     }
 }
 
@@ -49,7 +48,8 @@ struct OpInfo {
     unsigned int associatvity;
 };
 
-OpInfo opInfoTable[] = {
+// read only, shared by every compilation
+const OpInfo opInfoTable[] = {
     [ARITHMETIC_OP_ADD] = {.precedence = 4, .associatvity = LEFT_ASSOCIATIVE},
     [ARITHMETIC_OP_SUB] = {.precedence = 4, .associatvity = LEFT_ASSOCIATIVE},
     
@@ -100,6 +100,7 @@ Index ParseStatementList(AST *ast, Parser *parser);
 // precedence climbing - https://eli.thegreenplace.net/2012/08/02/parsing-expressions-by-precedence-climbing
 Index ParseExpression(AST *ast, Parser *parser, int minPrec)
 {
+    unsigned int subtreeStart = ast->nodeCount;
     Index left = ParseAtom(ast, parser);
     
     while(true)
@@ -126,7 +127,7 @@ Index ParseExpression(AST *ast, Parser *parser, int minPrec)
             node.operator.right = ParseExpression(ast, parser, prec);
         }
         
-        left = PushNode(ast, node);
+        left = PushOperatorNode(ast, node, subtreeStart);
     }
     
     return left;
@@ -175,11 +176,13 @@ Index ParseAtom(AST *ast, Parser *parser)
     }
     else if(AcceptToken(parser, TOKEN_NOT))
     {
+        unsigned int subtreeStart = ast->nodeCount;
+        
         Node node = {0};
         node.type = NODE_OPERATOR;
         node.operator.opType = BOOL_OP_NOT;
         node.operator.left = ParseAtom(ast, parser);
-        return PushNode(ast, node);
+        return PushOperatorNode(ast, node, subtreeStart);
     }
     else if(AcceptToken(parser, TOKEN_INTEGER_CONSTANT))
     {
@@ -204,8 +207,7 @@ Index ParseAtom(AST *ast, Parser *parser)
     
     // an atom is always required
     Token next = PeekNextToken(parser);
-    printf("%s:%u:%u: error: expecting an expression before '%s'\n", parser->fileName, next.line+1, next.column+1, TokenTypeToString(next.type));
-    exit(1);
+    CompileError("%s:%u:%u: error: expecting an expression before '%s'", parser->fileName, next.line+1, next.column+1, TokenTypeToString(next.type));
 }
 
 Index ParseArrayAccess(AST *ast, Parser *parser) 
@@ -551,7 +553,7 @@ Index ParseFunction(AST *ast, Parser *parser)
     if(AcceptToken(parser, TOKEN_COLON))
     {
         node.functionDef.returnType = ParseType(ast, parser);
-        node.functionDef.isReturnTypeDeclared = false;
+        node.functionDef.isReturnTypeDeclared = true;
     }
     
     // body    
@@ -562,6 +564,14 @@ Index ParseFunction(AST *ast, Parser *parser)
 
 Index ParseStruct(AST *ast, Parser *parser)
 {
+    bool isFixedLayout = false;
+    
+    if(PeekNextToken(parser).type == TOKEN_KEYWORD_FIXED)
+    {
+        GetNextToken(parser);
+        isFixedLayout = true;
+    }
+    
     ExpectToken(parser, TOKEN_KEYWORD_STRUCT);
     
     Token structId = ExpectToken(parser, TOKEN_IDENTIFIER);
@@ -572,6 +582,7 @@ Index ParseStruct(AST *ast, Parser *parser)
     node.structDef.name = structId.identifier;
     node.structDef.fields = 0;
     node.structDef.fieldCount = 0;
+    node.structDef.isFixedLayout = isFixedLayout;
     
     // parsing struct fields
     while(true)
@@ -607,6 +618,18 @@ Index ParseStruct(AST *ast, Parser *parser)
     return PushNode(ast, node);
 }
 
+// import "path.bee"; only names a file, the definitions it brings in are linked by the module driver
+void ParseImport(Parser *parser)
+{
+    ExpectToken(parser, TOKEN_KEYWORD_IMPORT);
+    Token path = ExpectToken(parser, TOKEN_STRING_CONSTANT);
+    ExpectToken(parser, TOKEN_SEMICOLON);
+
+    parser->importCount++;
+    parser->imports = (const char**)realloc(parser->imports, sizeof(const char*) * parser->importCount);
+    parser->imports[parser->importCount - 1] = path.stringValue;
+}
+
 Index ParseProgram(AST *ast, Parser *parser)
 {
     Node node = {0};
@@ -620,7 +643,7 @@ Index ParseProgram(AST *ast, Parser *parser)
         
         if(token.type == TOKEN_PROGRAM_END) break;
         
-        if(token.type == TOKEN_KEYWORD_STRUCT)
+        if(token.type == TOKEN_KEYWORD_STRUCT || token.type == TOKEN_KEYWORD_FIXED)
         {
             Index index = ParseStruct(ast, parser);
             PushIndex(&node.program.definitions, &node.program.defCount, index);
@@ -630,6 +653,10 @@ Index ParseProgram(AST *ast, Parser *parser)
             Index index = ParseFunction(ast, parser);
             PushIndex(&node.program.definitions, &node.program.defCount, index);
         }
+        else if(token.type == TOKEN_KEYWORD_IMPORT)
+        {
+            ParseImport(parser);
+        }
         else
         {
             GetNextToken(parser);
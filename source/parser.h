@@ -14,6 +14,10 @@ typedef struct {
     const char *source;   
     TokenList tokenList;
     unsigned int tokenIndex;
+
+    // paths named by import statements, as written
+    const char **imports;
+    unsigned int importCount;
 } Parser;
 
 #endif //PARSER_H
\ No newline at end of file
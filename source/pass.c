@@ -0,0 +1,225 @@
+#include <time.h>
+
+#include "pass.h"
+#include "threads.h"
+
+void PushPass(PassManager *manager, Pass pass)
+{
+    manager->passCount++;
+    manager->passes = (Pass*)realloc(manager->passes, sizeof(Pass) * manager->passCount);
+    manager->passes[manager->passCount - 1] = pass;
+}
+
+void AddFunctionPass(PassManager *manager, const char *name, FunctionPassProc run)
+{
+    Pass pass = {0};
+    pass.name = name;
+    pass.runOnFunction = run;
+    PushPass(manager, pass);
+}
+
+void AddModulePass(PassManager *manager, const char *name, ModulePassProc run)
+{
+    Pass pass = {0};
+    pass.name = name;
+    pass.runOnModule = run;
+    PushPass(manager, pass);
+}
+
+bool VerifyIRModule(IRModule *module)
+{
+    bool valid = true;
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        if(!VerifyIRFunction(&module->functions[n])) valid = false;
+    }
+
+    return valid;
+}
+
+typedef struct {
+    PassManager *manager;
+    IRModule *module;
+    unsigned int first;     // passes first up to last run back to back on each function
+    unsigned int last;
+    bool *changed;          // per pass and function
+    double *seconds;
+} FunctionPassBatch;
+
+// cpu time of the calling thread, so passes running side by side do not count each other
+double GetThreadSeconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+void RunFunctionPasses(void *data, unsigned int task)
+{
+    FunctionPassBatch *batch = (FunctionPassBatch*)data;
+    IRFunction *function = &batch->module->functions[task];
+
+    for(unsigned int n = batch->first; n < batch->last; n++)
+    {
+        Pass *pass = &batch->manager->passes[n];
+        unsigned int slot = (n - batch->first) * batch->module->functionCount + task;
+
+        double start = GetThreadSeconds();
+        batch->changed[slot] = pass->runOnFunction(function, batch->module->options);
+        batch->seconds[slot] = GetThreadSeconds() - start;
+
+        if(batch->manager->verifyEachPass && !VerifyIRFunction(function))
+        {
+            CompileError("ir error: verification failed after pass '%s'", pass->name);
+        }
+    }
+}
+
+// runs the passes in the order they were added. a function pass only sees its own function,
+// so a run of them goes through each function in turn and the functions are spread over threads
+void RunPasses(PassManager *manager, IRModule *module)
+{
+    unsigned int n = 0;
+
+    while(n < manager->passCount)
+    {
+        Pass *pass = &manager->passes[n];
+
+        if(pass->runOnModule)
+        {
+            double start = GetThreadSeconds();
+            if(pass->runOnModule(module)) pass->changeCount++;
+            pass->seconds += GetThreadSeconds() - start;
+
+            if(manager->verifyEachPass && !VerifyIRModule(module))
+            {
+                CompileError("ir error: verification failed after pass '%s'", pass->name);
+            }
+
+            n++;
+            continue;
+        }
+
+        FunctionPassBatch batch = {0};
+        batch.manager = manager;
+        batch.module = module;
+        batch.first = n;
+        batch.last = n;
+        while(batch.last < manager->passCount && !manager->passes[batch.last].runOnModule) batch.last++;
+
+        unsigned int slotCount = (batch.last - batch.first) * module->functionCount;
+        batch.changed = (bool*)calloc(slotCount ? slotCount : 1, sizeof(bool));
+        batch.seconds = (double*)calloc(slotCount ? slotCount : 1, sizeof(double));
+
+        RunTasks(module->options->threadCount, module->functionCount, RunFunctionPasses, &batch);
+
+        // summed in a fixed order, so the totals do not depend on which thread finished first
+        for(unsigned int slot = 0; slot < slotCount; slot++)
+        {
+            Pass *p = &manager->passes[batch.first + slot / module->functionCount];
+            p->seconds += batch.seconds[slot];
+            if(batch.changed[slot]) p->changeCount++;
+        }
+
+        free(batch.changed);
+        free(batch.seconds);
+        n = batch.last;
+    }
+}
+
+void PrintPassTimings(PassManager *manager)
+{
+    double total = 0;
+    for(unsigned int n = 0; n < manager->passCount; n++) total += manager->passes[n].seconds;
+
+    printf("pass timings:\n");
+
+    for(unsigned int n = 0; n < manager->passCount; n++)
+    {
+        Pass *pass = &manager->passes[n];
+        printf("  %-24s %10.6f s  %5.1f%%  changed: %u\n", pass->name, pass->seconds, total > 0 ? 100.0 * pass->seconds / total : 0.0, pass->changeCount);
+    }
+
+    printf("  %-24s %10.6f s\n", "total", total);
+}
+
+void MarkReachableBlocks(IRFunction *function, Index block, bool *reachable)
+{
+    reachable[block] = true;
+
+    Index successors[IR_MAX_SUCCESSORS];
+    unsigned int successorCount = GetSuccessors(function, block, successors);
+
+    for(unsigned int n = 0; n < successorCount; n++)
+    {
+        if(!reachable[successors[n]]) MarkReachableBlocks(function, successors[n], reachable);
+    }
+}
+
+bool RemoveUnreachableBlocks(IRFunction *function, const Options *options)
+{
+    bool *reachable = (bool*)calloc(function->blockCount, sizeof(bool));
+    MarkReachableBlocks(function, 0, reachable);
+
+    bool changed = false;
+
+    for(unsigned int block = 0; block < function->blockCount; block++)
+    {
+        if(reachable[block] || function->blocks[block].isDead) continue;
+
+        Index successors[IR_MAX_SUCCESSORS];
+        unsigned int successorCount = GetSuccessors(function, block, successors);
+
+        for(unsigned int n = 0; n < successorCount; n++)
+        {
+            RemoveEdge(function, block, successors[n]);
+        }
+
+        IRBlock *b = &function->blocks[block];
+        while(b->instCount > 0) RemoveInst(function, b->insts[b->instCount - 1]);
+
+        b->isDead = true;
+        b->predCount = 0;
+        changed = true;
+    }
+
+    free(reachable);
+    return changed;
+}
+
+void MarkLive(IRFunction *function, Index inst, bool *live)
+{
+    live[inst] = true;
+
+    IRInst *i = &function->insts[inst];
+    for(unsigned int o = 0; o < i->operandCount; o++)
+    {
+        if(!live[i->operands[o]]) MarkLive(function, i->operands[o], live);
+    }
+}
+
+// mark and sweep, so dead cycles through loop phis are removed as well
+bool EliminateDeadCode(IRFunction *function, const Options *options)
+{
+    bool *live = (bool*)calloc(function->instCount, sizeof(bool));
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        IRInst *inst = &function->insts[n];
+        if(!inst->isDead && !live[n] && HasSideEffects(inst->opcode)) MarkLive(function, n, live);
+    }
+
+    bool changed = false;
+
+    for(unsigned int n = 0; n < function->instCount; n++)
+    {
+        if(function->insts[n].isDead || live[n]) continue;
+
+        RemoveInst(function, n);
+        changed = true;
+    }
+
+    free(live);
+    return changed;
+}
@@ -0,0 +1,36 @@
+#ifndef PASS_H
+#define PASS_H
+
+#include "ir.h"
+
+// a pass returns true when it changed the ir
+typedef bool (*FunctionPassProc)(IRFunction *function, const Options *options);
+typedef bool (*ModulePassProc)(IRModule *module);
+
+typedef struct {
+    const char *name;
+    FunctionPassProc runOnFunction;
+    ModulePassProc runOnModule;
+
+    double seconds;
+    unsigned int changeCount;
+} Pass;
+
+typedef struct {
+    Pass *passes;
+    unsigned int passCount;
+
+    bool verifyEachPass;
+    bool timePasses;
+} PassManager;
+
+void AddFunctionPass(PassManager *manager, const char *name, FunctionPassProc run);
+void AddModulePass(PassManager *manager, const char *name, ModulePassProc run);
+bool VerifyIRModule(IRModule *module);
+void RunPasses(PassManager *manager, IRModule *module);
+void PrintPassTimings(PassManager *manager);
+
+bool RemoveUnreachableBlocks(IRFunction *function, const Options *options);
+bool EliminateDeadCode(IRFunction *function, const Options *options);
+
+#endif //PASS_H
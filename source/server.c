@@ -0,0 +1,447 @@
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+// a request names its file, its entry and its outputs. everything else that changes the code
+// is fixed when the server starts, so the function cache holds across requests
+typedef struct {
+    char *fileName;
+    char *entry;
+    char *cFileName;
+    char *exeFileName;
+    bool runProgram;
+    bool stop;
+} ServerRequest;
+
+typedef struct {
+    Options options;
+    CompilerContext *context;   // shared by every request, so a name is interned once for the life of the server
+    ModuleCache *modules;
+    int listener;
+
+    bool isStopping;
+    unsigned int requestCount;
+    unsigned int failedCount;
+    pthread_mutex_t lock;
+} Server;
+
+bool IsServerStopping(Server *server)
+{
+    pthread_mutex_lock(&server->lock);
+    bool isStopping = server->isStopping;
+    pthread_mutex_unlock(&server->lock);
+
+    return isStopping;
+}
+
+// one field per line, the value is the rest of the line
+bool ReadServerRequest(FILE *input, ServerRequest *request)
+{
+    char line[4096];
+    unsigned int version;
+
+    if(!fgets(line, sizeof(line), input) || sscanf(line, "bee-request %u", &version) != 1 || version != SERVER_PROTOCOL_VERSION) return false;
+
+    while(fgets(line, sizeof(line), input))
+    {
+        line[strcspn(line, "\n")] = 0;
+
+        if(!strcmp(line, "end")) return true;
+        else if(!strcmp(line, "run")) request->runProgram = true;
+        else if(!strcmp(line, "stop")) request->stop = true;
+        else if(!strncmp(line, "file ", 5)) request->fileName = strdup(line + 5);
+        else if(!strncmp(line, "entry ", 6)) request->entry = strdup(line + 6);
+        else if(!strncmp(line, "emit-c ", 7)) request->cFileName = strdup(line + 7);
+        else if(!strncmp(line, "native ", 7)) request->exeFileName = strdup(line + 7);
+        else return false;
+    }
+
+    return false;
+}
+
+void FreeServerRequest(ServerRequest *request)
+{
+    free(request->fileName);
+    free(request->entry);
+    free(request->cFileName);
+    free(request->exeFileName);
+}
+
+void RunServedProgram(BytecodeModule *bytecode, const Options *options, FILE *output)
+{
+    const char *entry = options->entry;
+    int function = FindBytecodeFunction(bytecode, entry);
+    if(function == -1) CompileError("error: entry function '%s' not found", entry);
+
+    VMOptions vmOptions = options->vm;
+    vmOptions.output = output;
+
+    VM vm = CreateVM(bytecode, vmOptions);
+    long long result;
+    bool isDone = CallBytecode(&vm, function, 0, 0, &result);
+    const char *error = vm.error;
+    unsigned long long dispatchCount = vm.dispatchCount;
+
+    FreeVM(&vm);
+
+    if(!isDone) CompileError("vm error: %s", error);
+    fprintf(output, "vm: '%s' returned %lld after %llu dispatches\n", entry, result, dispatchCount);
+}
+
+// what a request has built so far, freed whether it got to the end or not
+typedef struct {
+    ModuleGraph modules;
+    AST ast;
+} ServedProgram;
+
+// the same steps as the command line, with unchanged files and functions taken from memory
+void ServeCompilation(Server *server, ServerRequest *request, const Options *options, FILE *output, ServedProgram *served)
+{
+    served->modules = LoadModules(server->context, server->modules, options->fileName, options);
+    if(served->modules.moduleCount == 0) AbortCompilation();
+
+    AST *ast = &served->ast;
+    InitAST(ast);
+
+    CheckModules(&served->modules);
+    Index program = LinkModules(&served->modules, ast);
+    SimplifyProgram(ast, program, options);
+
+    BytecodeModule bytecode = LinkCachedBytecode(server->context, ast, program, options);
+    if(options->runProgram) RunServedProgram(&bytecode, options, output);
+    FreeBytecodeModule(&bytecode);
+
+    if(request->cFileName || request->exeFileName)
+    {
+        char *cFileName = request->cFileName;
+
+        if(!cFileName)
+        {
+            cFileName = (char*)malloc(strlen(request->exeFileName) + 3);
+            sprintf(cFileName, "%s.c", request->exeFileName);
+        }
+
+        bool isBuilt = EmitCProgram(ast, program, options, cFileName);
+        if(isBuilt && request->exeFileName) isBuilt = BuildNative(options, cFileName, request->exeFileName);
+
+        if(cFileName != request->cFileName) free(cFileName);
+        if(!isBuilt) AbortCompilation();
+    }
+}
+
+// returns the exit status for the client
+int CompileServerRequest(Server *server, ServerRequest *request, FILE *output)
+{
+    Options options = server->options;
+    options.fileName = request->fileName;
+    options.runProgram = request->runProgram;
+    if(request->entry) options.entry = request->entry;
+
+    ServedProgram served = {0};
+    DiagnosticTrap trap = {0};
+    diagnosticTrap = &trap;
+
+    int status = 0;
+
+    if(setjmp(trap.recover) == 0) ServeCompilation(server, request, &options, output, &served);
+    else status = 1;
+
+    diagnosticTrap = 0;
+
+    // the modules were copied for this request, so the linked program owns every list in it.
+    // a step that failed part way can still leave some of its own allocations behind
+    FreeModuleGraph(&served.modules);
+    if(served.ast.nodeList) FreeAST(&served.ast);
+
+    for(unsigned int n = 0; n < trap.messageCount; n++)
+    {
+        fprintf(output, "%s\n", trap.messages[n]);
+        free(trap.messages[n]);
+    }
+
+    free(trap.messages);
+    return status;
+}
+
+bool WriteAll(int socket, const char *data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t written = write(socket, data, size);
+
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) return false;
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+void ServeConnection(Server *server, int connection)
+{
+    FILE *input = fdopen(dup(connection), "r");
+    if(!input) return;
+
+    char *response = 0;
+    size_t responseSize = 0;
+    FILE *output = open_memstream(&response, &responseSize);
+
+    ServerRequest request = {0};
+    int status = 1;
+
+    if(!ReadServerRequest(input, &request)) fprintf(output, "error: not a bee request\n");
+    else if(request.stop)
+    {
+        pthread_mutex_lock(&server->lock);
+        server->isStopping = true;
+        pthread_mutex_unlock(&server->lock);
+
+        // wakes every worker waiting in accept
+        shutdown(server->listener, SHUT_RDWR);
+
+        fprintf(output, "server: stopping\n");
+        status = 0;
+    }
+    else if(!request.fileName) fprintf(output, "error: no input file\n");
+    else status = CompileServerRequest(server, &request, output);
+
+    fprintf(output, "status %d\n", status);
+    fclose(output);
+
+    WriteAll(connection, response, responseSize);
+
+    pthread_mutex_lock(&server->lock);
+    server->requestCount++;
+    if(status != 0) server->failedCount++;
+    pthread_mutex_unlock(&server->lock);
+
+    free(response);
+    FreeServerRequest(&request);
+    fclose(input);
+}
+
+void *RunServerWorker(void *data)
+{
+    Server *server = (Server*)data;
+
+    for(;;)
+    {
+        int connection = accept(server->listener, 0, 0);
+
+        if(connection < 0)
+        {
+            if(IsServerStopping(server)) return 0;
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+
+            printf("error: server: accept failed: %s\n", strerror(errno));
+            return 0;
+        }
+
+        ServeConnection(server, connection);
+        close(connection);
+    }
+}
+
+bool MakeSocketAddress(const char *path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if(strlen(path) >= sizeof(address->sun_path))
+    {
+        printf("error: socket path too long '%s'\n", path);
+        return false;
+    }
+
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+int ConnectToServer(const char *path)
+{
+    struct sockaddr_un address;
+    if(!MakeSocketAddress(path, &address)) return -1;
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connection < 0) return -1;
+
+    if(connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(connection);
+        return -1;
+    }
+
+    return connection;
+}
+
+// serves until a client asks it to stop
+int RunServer(Options options)
+{
+    const char *path = options.server.socketPath;
+
+    struct sockaddr_un address;
+    if(!MakeSocketAddress(path, &address)) return 1;
+
+    // a socket nobody answers on was left behind by a server that did not stop
+    int running = ConnectToServer(path);
+
+    if(running >= 0)
+    {
+        close(running);
+        printf("error: a server is already listening on '%s'\n", path);
+        return 1;
+    }
+
+    unlink(path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        printf("error: cannot listen on '%s': %s\n", path, strerror(errno));
+        if(listener >= 0) close(listener);
+        return 1;
+    }
+
+    // a client that goes away before its answer is written must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server = {0};
+    server.options = options;
+    server.options.cache.keepInMemory = true;
+    server.context = CreateContext();
+    server.modules = CreateModuleCache(server.context);
+    server.listener = listener;
+    pthread_mutex_init(&server.lock, 0);
+
+    unsigned int workerCount = options.server.workerCount;
+
+    if(workerCount == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = cores > 0 ? (unsigned int)cores : 1;
+    }
+
+    printf("server: listening on '%s' with %u worker%s\n", path, workerCount, workerCount == 1 ? "" : "s");
+    fflush(stdout);
+
+    pthread_t *workers = (pthread_t*)calloc(workerCount, sizeof(pthread_t));
+
+    for(unsigned int n = 0; n < workerCount; n++)
+    {
+        if(pthread_create(&workers[n], 0, RunServerWorker, &server) != 0)
+        {
+            printf("error: cannot start server worker %u\n", n);
+            exit(1);
+        }
+    }
+
+    for(unsigned int n = 0; n < workerCount; n++) pthread_join(workers[n], 0);
+
+    close(listener);
+    unlink(path);
+
+    if(options.printReport)
+    {
+        printf("server: %u requests, %u failed, %u of %u files taken from memory, %u distinct names\n", server.requestCount, server.failedCount,
+               server.modules->hitCount, server.modules->hitCount + server.modules->missCount, server.context->strings.count);
+    }
+
+    free(workers);
+    FreeModuleCache(server.modules);
+    DestroyContext(server.context);
+    FreeMemoryCache();
+    pthread_mutex_destroy(&server.lock);
+
+    return 0;
+}
+
+// the server reads files itself, so paths are sent absolute
+char *GetAbsolutePath(const char *fileName)
+{
+    char *path = realpath(fileName, 0);
+    if(path) return path;
+
+    if(fileName[0] == '/') return strdup(fileName);
+
+    char directory[PATH_MAX];
+    if(!getcwd(directory, sizeof(directory))) return strdup(fileName);
+
+    path = (char*)malloc(strlen(directory) + strlen(fileName) + 2);
+    sprintf(path, "%s/%s", directory, fileName);
+    return path;
+}
+
+void WriteRequestPath(FILE *request, const char *field, const char *fileName)
+{
+    char *path = GetAbsolutePath(fileName);
+    fprintf(request, "%s %s\n", field, path);
+    free(path);
+}
+
+// a thin client: sends the file and what to do with it, prints what the server answers and exits with its status
+int RunClient(Options options)
+{
+    int connection = ConnectToServer(options.server.connectPath);
+
+    if(connection < 0)
+    {
+        printf("error: no server listening on '%s'\n", options.server.connectPath);
+        return 1;
+    }
+
+    char *message = 0;
+    size_t messageSize = 0;
+    FILE *request = open_memstream(&message, &messageSize);
+
+    fprintf(request, "bee-request %u\n", SERVER_PROTOCOL_VERSION);
+
+    if(options.server.stop) fprintf(request, "stop\n");
+    if(options.fileName) WriteRequestPath(request, "file", options.fileName);
+    if(options.runProgram) fprintf(request, "run\n");
+    if(options.entry) fprintf(request, "entry %s\n", options.entry);
+    if(options.cgen.outputFileName) WriteRequestPath(request, "emit-c", options.cgen.outputFileName);
+    if(options.cgen.nativeFileName) WriteRequestPath(request, "native", options.cgen.nativeFileName);
+
+    fprintf(request, "end\n");
+    fclose(request);
+
+    bool isSent = WriteAll(connection, message, messageSize);
+    free(message);
+
+    char *response = 0;
+    size_t responseSize = 0;
+    FILE *output = open_memstream(&response, &responseSize);
+
+    char buffer[4096];
+    ssize_t received;
+
+    while(isSent && (received = read(connection, buffer, sizeof(buffer))) != 0)
+    {
+        if(received < 0 && errno == EINTR) continue;
+        if(received < 0) break;
+
+        fwrite(buffer, 1, received, output);
+    }
+
+    fclose(output);
+    close(connection);
+
+    // the last line is the status, everything before it is printed as if the compiler had run here
+    int status = 1;
+    size_t statusStart = responseSize > 0 ? responseSize - 1 : 0;
+    while(statusStart > 0 && response[statusStart - 1] != '\n') statusStart--;
+
+    char *statusLine = response + statusStart;
+
+    if(responseSize > 0 && sscanf(statusLine, "status %d", &status) == 1) fwrite(response, 1, statusLine - response, stdout);
+    else printf("error: no answer from the server on '%s'\n", options.server.connectPath);
+
+    free(response);
+    return status;
+}
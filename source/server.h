@@ -0,0 +1,8 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+#define SERVER_PROTOCOL_VERSION 1
+
+#endif //SERVER_H
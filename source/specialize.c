@@ -0,0 +1,532 @@
+#include "specialize.h"
+#include "inline.h"
+#include "loop.h"
+#include "symbol.h"
+
+typedef struct {
+    Index callee;
+    Index *positions;       // parameters folded, ascending
+    int *values;
+    unsigned int count;
+    Index clone;            // IR_NONE when specializing did not pay off
+} Specialization;
+
+typedef struct {
+    Index function;
+    Index call;
+    unsigned int loopDepth;
+} SpecializationSite;
+
+typedef struct {
+    IRModule *module;
+    NameTable functions;
+
+    Index *origins;             // per function, the one it was cloned from, or itself
+    unsigned int *cloneCounts;  // per function, clones made from it
+
+    Specialization *specializations;
+    unsigned int specializationCount;
+
+    SpecializationSite *sites;
+    unsigned int siteCount;
+
+    unsigned int budgetUsed;
+    unsigned int cloneCount;
+    unsigned int redirectCount;
+} Specializer;
+
+bool IsConstValue(IRFunction *function, Index value, int *constant)
+{
+    if(function->insts[value].opcode != IR_CONST) return false;
+
+    *constant = function->insts[value].value;
+    return true;
+}
+
+// same rules as folding the ast, so a value does not depend on where it was computed
+bool EvaluateIROpcode(unsigned int opcode, int left, int right, int *result)
+{
+    unsigned int opType;
+
+    switch(opcode)
+    {
+        case IR_ADD:        opType = ARITHMETIC_OP_ADD; break;
+        case IR_SUB:        opType = ARITHMETIC_OP_SUB; break;
+        case IR_MUL:        opType = ARITHMETIC_OP_MUL; break;
+        case IR_DIV:        opType = ARITHMETIC_OP_DIV; break;
+        case IR_MOD:        opType = ARITHMETIC_OP_MOD; break;
+        case IR_LT:         opType = COMPARE_OP_LT; break;
+        case IR_GT:         opType = COMPARE_OP_GT; break;
+        case IR_EQ_EQ:      opType = COMPARE_OP_EQ_EQ; break;
+        case IR_NOT_EQ:     opType = COMPARE_OP_NOT_EQ; break;
+        case IR_LT_EQ:      opType = COMPARE_OP_LT_EQ; break;
+        case IR_GT_EQ:      opType = COMPARE_OP_GT_EQ; break;
+        case IR_NOT:        opType = BOOL_OP_NOT; break;
+        default:            return false;
+    }
+
+    return EvaluateOperator(opType, left, right, result);
+}
+
+unsigned int CountEdges(IRFunction *function, Index from, Index to)
+{
+    unsigned int count = 0;
+
+    for(unsigned int p = 0; p < function->blocks[to].predCount; p++)
+    {
+        if(function->blocks[to].preds[p] == from) count++;
+    }
+
+    return count;
+}
+
+// the terminator of block becomes a jump to target, every other edge out of block goes
+void FoldTerminator(IRFunction *function, Index block, Index target)
+{
+    Index successors[IR_MAX_SUCCESSORS];
+    unsigned int successorCount = GetSuccessors(function, block, successors);
+
+    for(unsigned int n = 0; n < successorCount; n++)
+    {
+        unsigned int keep = (successors[n] == target) ? 1 : 0;
+        while(CountEdges(function, block, successors[n]) > keep) RemoveEdge(function, block, successors[n]);
+    }
+
+    IRInst *inst = &function->insts[GetTerminator(function, block)];
+    inst->opcode = IR_JUMP;
+    inst->operandCount = 0;
+    inst->trueTarget = target;
+    inst->falseTarget = IR_NONE;
+
+    free(inst->caseTargets);
+    inst->caseTargets = 0;
+    inst->caseCount = 0;
+}
+
+bool FoldInst(IRFunction *function, Index index)
+{
+    IRInst *inst = &function->insts[index];
+    int left, right = 0, result;
+
+    switch(inst->opcode)
+    {
+        case IR_BRANCH:
+        {
+            if(!IsConstValue(function, inst->operands[0], &left)) return false;
+            FoldTerminator(function, inst->block, left ? inst->trueTarget : inst->falseTarget);
+        }
+        return true;
+
+        case IR_SWITCH:
+        {
+            if(!IsConstValue(function, inst->operands[0], &left)) return false;
+
+            long long entry = (long long)left - inst->value;
+            Index target = (entry >= 0 && entry < inst->caseCount) ? inst->caseTargets[entry] : inst->falseTarget;
+            FoldTerminator(function, inst->block, target);
+        }
+        return true;
+
+        case IR_PHI:
+        {
+            // every edge brings the same value
+            Index same = IR_NONE;
+
+            for(unsigned int o = 0; o < inst->operandCount; o++)
+            {
+                Index operand = inst->operands[o];
+                if(operand == index || operand == same) continue;
+                if(same != IR_NONE) return false;
+                same = operand;
+            }
+
+            if(same == IR_NONE) return false;
+
+            ReplaceAllUses(function, index, same);
+            RemoveInst(function, index);
+        }
+        return true;
+
+        default:
+        {
+            if(inst->operandCount == 0 || inst->operandCount > 2) return false;
+            if(!IsConstValue(function, inst->operands[0], &left)) return false;
+            if(inst->operandCount == 2 && !IsConstValue(function, inst->operands[1], &right)) return false;
+            if(!EvaluateIROpcode(inst->opcode, left, right, &result)) return false;
+
+            inst->opcode = IR_CONST;
+            inst->value = result;
+            inst->operandCount = 0;
+        }
+        return true;
+    }
+}
+
+// folds operations on constants and branches on them, until nothing changes
+bool FoldConstants(IRFunction *function, const Options *options)
+{
+    bool changed = false;
+    bool isFolding = true;
+
+    while(isFolding)
+    {
+        isFolding = false;
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            if(!function->insts[n].isDead && FoldInst(function, n)) isFolding = true;
+        }
+
+        changed = changed || isFolding;
+    }
+
+    if(changed) RemoveUnreachableBlocks(function, options);
+    return changed;
+}
+
+// a scalar parameter the body reads, the only kind worth a constant
+Index FindFoldableParam(IRFunction *function, unsigned int position)
+{
+    Index param = FindParam(function, position);
+    if(param == IR_NONE || function->insts[param].type.isAggregate || CountUses(function, param) == 0) return IR_NONE;
+
+    return param;
+}
+
+// the constant every call passes for a parameter, false when calls disagree or pass something else
+bool FindAgreedArgument(Specializer *specializer, Index callee, unsigned int position, int *value)
+{
+    IRModule *module = specializer->module;
+    bool isSeen = false;
+
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *function = &module->functions[f];
+
+        for(unsigned int n = 0; n < function->instCount; n++)
+        {
+            IRInst *inst = &function->insts[n];
+            if(inst->isDead || inst->opcode != IR_CALL || LookupName(&specializer->functions, inst->name, -1) != callee) continue;
+            if(inst->operandCount <= position) return false;
+
+            // a recursive call passing the parameter on unchanged agrees with whatever the others pass
+            IRInst *argument = &function->insts[inst->operands[position]];
+            if((Index)f == callee && argument->opcode == IR_PARAM && (unsigned int)argument->value == position) continue;
+
+            if(argument->opcode != IR_CONST || (isSeen && argument->value != *value)) return false;
+
+            *value = argument->value;
+            isSeen = true;
+        }
+    }
+
+    return isSeen;
+}
+
+bool PropagateAgreedArguments(Specializer *specializer)
+{
+    IRModule *module = specializer->module;
+    bool changed = false;
+
+    for(unsigned int f = 0; f < module->functionCount; f++)
+    {
+        IRFunction *function = &module->functions[f];
+        if(module->entry && !strcmp(function->name, module->entry)) continue;
+
+        bool isFunctionChanged = false;
+
+        for(unsigned int position = 0; position < function->parameterCount; position++)
+        {
+            Index param = FindFoldableParam(function, position);
+            int value;
+
+            if(param == IR_NONE || !FindAgreedArgument(specializer, f, position, &value)) continue;
+
+            Index constant = NewInst(function, IR_CONST);
+            function->insts[constant].value = value;
+            InsertAtEntry(function, constant);
+            ReplaceAllUses(function, param, constant);
+
+            if(module->options->printReport)
+            {
+                printf("ipcp: '%s': parameter '%s' is %d at every call\n", function->name, function->insts[param].name, value);
+            }
+
+            isFunctionChanged = true;
+        }
+
+        if(isFunctionChanged)
+        {
+            FoldConstants(function, module->options);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+Specialization *FindSpecialization(Specializer *specializer, Index callee, Index *positions, int *values, unsigned int count)
+{
+    for(unsigned int n = 0; n < specializer->specializationCount; n++)
+    {
+        Specialization *s = &specializer->specializations[n];
+        if(s->callee != callee || s->count != count) continue;
+
+        bool isSame = true;
+        for(unsigned int k = 0; k < count && isSame; k++) isSame = (s->positions[k] == positions[k] && s->values[k] == values[k]);
+
+        if(isSame) return s;
+    }
+
+    return 0;
+}
+
+void AddSpecializationSites(Specializer *specializer, Index function)
+{
+    IRFunction *f = &specializer->module->functions[function];
+    LoopInfo loops = FindLoops(f);
+
+    for(unsigned int n = 0; n < f->instCount; n++)
+    {
+        IRInst *inst = &f->insts[n];
+        if(inst->isDead || inst->opcode != IR_CALL) continue;
+
+        unsigned int depth = 0;
+        for(unsigned int l = 0; l < loops.loopCount; l++)
+        {
+            if(IsInLoop(&loops.loops[l], inst->block)) depth++;
+        }
+
+        specializer->siteCount++;
+        specializer->sites = (SpecializationSite*)realloc(specializer->sites, sizeof(SpecializationSite) * specializer->siteCount);
+        specializer->sites[specializer->siteCount - 1] = (SpecializationSite){function, n, depth};
+    }
+
+    FreeLoopInfo(&loops);
+}
+
+void DescribeFoldedParams(IRFunction *callee, Index *positions, int *values, unsigned int count, char *buffer, unsigned int size)
+{
+    unsigned int length = 0;
+    buffer[0] = 0;
+
+    for(unsigned int k = 0; k < count && length < size; k++)
+    {
+        Index param = FindParam(callee, positions[k]);
+        length += snprintf(buffer + length, size - length, "%s%s = %d", k == 0 ? "" : ", ", callee->insts[param].name, values[k]);
+    }
+}
+
+// a copy of callee with the parameters at positions replaced by values and dropped from its signature
+Index MakeSpecialization(Specializer *specializer, Index callee, Index caller, Index *positions, int *values, unsigned int count)
+{
+    IRModule *module = specializer->module;
+    Index origin = specializer->origins[callee];
+    IRFunction *function = &module->functions[callee];
+
+    char folded[256];
+    DescribeFoldedParams(function, positions, values, count, folded, sizeof(folded));
+
+    char *name = (char*)malloc(strlen(module->functions[origin].name) + 16);
+    sprintf(name, "%s.%u", module->functions[origin].name, specializer->cloneCounts[origin] + 1);
+
+    IRFunction clone = CloneIRFunction(function, name);
+
+    for(unsigned int k = 0; k < count; k++)
+    {
+        IRInst *param = &clone.insts[FindParam(&clone, positions[k])];
+        param->opcode = IR_CONST;
+        param->value = values[k];
+    }
+
+    for(unsigned int n = 0; n < clone.instCount; n++)
+    {
+        IRInst *inst = &clone.insts[n];
+        if(inst->isDead || inst->opcode != IR_PARAM) continue;
+
+        int shift = 0;
+        for(unsigned int k = 0; k < count; k++) shift += (positions[k] < inst->value);
+        inst->value -= shift;
+    }
+
+    clone.parameterCount -= count;
+
+    FoldConstants(&clone, module->options);
+    EliminateDeadCode(&clone, module->options);
+
+    int before = GetInlineCost(function);
+    int after = GetInlineCost(&clone);
+    const char *reason = 0;
+
+    if(specializer->cloneCounts[origin] >= module->options->specialize.maxClones) reason = "clone limit";
+    else if(before - after < module->options->specialize.minSavings) reason = "too little saved";
+    else if(specializer->budgetUsed + after > module->options->specialize.sizeBudget) reason = "over size budget";
+
+    if(module->options->printReport)
+    {
+        printf("specialize: '%s' with %s for '%s': cost %d -> %d, ", function->name, folded, module->functions[caller].name, before, after);
+
+        if(reason) printf("not specialized (%s)\n", reason);
+        else printf("as '%s'\n", name);
+    }
+
+    if(reason)
+    {
+        FreeIRFunction(&clone);
+        free(name);
+        return IR_NONE;
+    }
+
+    module->functionCount++;
+    module->functions = (IRFunction*)realloc(module->functions, sizeof(IRFunction) * module->functionCount);
+    module->functions[module->functionCount - 1] = clone;
+
+    Index index = module->functionCount - 1;
+    InsertName(&specializer->functions, name, index);
+
+    specializer->origins = (Index*)realloc(specializer->origins, sizeof(Index) * module->functionCount);
+    specializer->cloneCounts = (unsigned int*)realloc(specializer->cloneCounts, sizeof(unsigned int) * module->functionCount);
+    specializer->origins[index] = origin;
+    specializer->cloneCounts[index] = 0;
+    specializer->cloneCounts[origin]++;
+
+    specializer->budgetUsed += after;
+    specializer->cloneCount++;
+
+    return index;
+}
+
+void SpecializeCallSite(Specializer *specializer, SpecializationSite site)
+{
+    IRModule *module = specializer->module;
+    IRFunction *caller = &module->functions[site.function];
+    IRInst *inst = &caller->insts[site.call];
+    if(inst->isDead || inst->opcode != IR_CALL) return;
+
+    int callee = LookupName(&specializer->functions, inst->name, -1);
+    if(callee == -1 || inst->operandCount != module->functions[callee].parameterCount) return;
+
+    Index *positions = 0;
+    unsigned int count = 0;
+    int *values = 0;
+
+    for(unsigned int position = 0; position < inst->operandCount; position++)
+    {
+        int value;
+        if(!IsConstValue(caller, inst->operands[position], &value)) continue;
+        if(FindFoldableParam(&module->functions[callee], position) == IR_NONE) continue;
+
+        PushIndex(&positions, &count, position);
+        values = (int*)realloc(values, sizeof(int) * count);
+        values[count - 1] = value;
+    }
+
+    Specialization *s = count ? FindSpecialization(specializer, callee, positions, values, count) : 0;
+
+    // clones calling their own family only reuse clones, so recursion cannot keep making new ones
+    bool isRecursive = specializer->origins[site.function] != (Index)site.function && specializer->origins[site.function] == specializer->origins[callee];
+
+    if(count && !s && !isRecursive)
+    {
+        Index clone = MakeSpecialization(specializer, callee, site.function, positions, values, count);
+
+        specializer->specializationCount++;
+        specializer->specializations = (Specialization*)realloc(specializer->specializations, sizeof(Specialization) * specializer->specializationCount);
+        specializer->specializations[specializer->specializationCount - 1] = (Specialization){callee, positions, values, count, clone};
+        s = &specializer->specializations[specializer->specializationCount - 1];
+
+        if(clone != IR_NONE) AddSpecializationSites(specializer, clone);
+    }
+    else
+    {
+        free(positions);
+        free(values);
+    }
+
+    if(!s || s->clone == IR_NONE) return;
+
+    // the call goes to the clone and stops passing what it folded
+    inst = &module->functions[site.function].insts[site.call];
+    inst->name = module->functions[s->clone].name;
+
+    unsigned int kept = 0;
+    for(unsigned int o = 0; o < inst->operandCount; o++)
+    {
+        bool isFolded = false;
+        for(unsigned int k = 0; k < s->count; k++) isFolded = isFolded || (s->positions[k] == (Index)o);
+
+        if(!isFolded) inst->operands[kept++] = inst->operands[o];
+    }
+
+    inst->operandCount = kept;
+    specializer->redirectCount++;
+}
+
+// constants every call agrees on go into the callee, calls with constants of their own get a specialized clone
+bool PropagateConstantArguments(IRModule *module)
+{
+    Specializer specializer = {0};
+    specializer.module = module;
+    specializer.origins = (Index*)malloc(sizeof(Index) * (module->functionCount + 1));
+    specializer.cloneCounts = (unsigned int*)calloc(module->functionCount + 1, sizeof(unsigned int));
+
+    for(unsigned int n = 0; n < module->functionCount; n++)
+    {
+        InsertName(&specializer.functions, module->functions[n].name, n);
+        specializer.origins[n] = n;
+    }
+
+    bool changed = false;
+
+    for(unsigned int round = 0; round < module->options->specialize.maxRounds; round++)
+    {
+        if(!PropagateAgreedArguments(&specializer)) break;
+        changed = true;
+    }
+
+    if(!module->options->specialize.noSpecialize)
+    {
+        unsigned int functionCount = module->functionCount;
+        for(unsigned int f = 0; f < functionCount; f++) AddSpecializationSites(&specializer, f);
+
+        // calls in loops first, they get the budget before colder ones
+        for(unsigned int n = 1; n < specializer.siteCount; n++)
+        {
+            SpecializationSite site = specializer.sites[n];
+            unsigned int m = n;
+
+            while(m > 0 && specializer.sites[m - 1].loopDepth < site.loopDepth)
+            {
+                specializer.sites[m] = specializer.sites[m - 1];
+                m--;
+            }
+
+            specializer.sites[m] = site;
+        }
+
+        // sites of new clones are appended while this runs
+        for(unsigned int n = 0; n < specializer.siteCount; n++) SpecializeCallSite(&specializer, specializer.sites[n]);
+
+        if(specializer.redirectCount) changed = true;
+
+        if(module->options->printReport && specializer.siteCount)
+        {
+            printf("specialize: %u clone%s, cost %u of budget %u, %u call%s redirected\n", specializer.cloneCount, specializer.cloneCount == 1 ? "" : "s",
+                   specializer.budgetUsed, module->options->specialize.sizeBudget, specializer.redirectCount, specializer.redirectCount == 1 ? "" : "s");
+        }
+    }
+
+    for(unsigned int n = 0; n < specializer.specializationCount; n++)
+    {
+        free(specializer.specializations[n].positions);
+        free(specializer.specializations[n].values);
+    }
+
+    free(specializer.specializations);
+    free(specializer.sites);
+    free(specializer.origins);
+    free(specializer.cloneCounts);
+    FreeNameTable(&specializer.functions);
+
+    return changed;
+}
@@ -0,0 +1,9 @@
+#ifndef SPECIALIZE_H
+#define SPECIALIZE_H
+
+#include "ir.h"
+
+bool FoldConstants(IRFunction *function, const Options *options);
+bool PropagateConstantArguments(IRModule *module);
+
+#endif //SPECIALIZE_H
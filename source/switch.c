@@ -0,0 +1,342 @@
+#include "switch.h"
+
+typedef struct {
+    int value;
+    Index target;
+    Index test;             // block the case was compared in
+} SwitchCase;
+
+typedef struct {
+    IRFunction *function;
+    const SwitchOptions *options;
+    Index selector;
+
+    SwitchCase *cases;
+    unsigned int caseCount;
+
+    Index defaultBlock;
+    Index defaultTest;      // block the default was reached from
+
+    unsigned int tableCount;
+    unsigned int compareCount;
+} SwitchBuilder;
+
+// the condition of a block ending in 'branch (x == c)', with x and c
+Index MatchCaseTest(IRFunction *function, Index block, Index *selector, int *value)
+{
+    Index terminator = GetTerminator(function, block);
+    if(terminator == IR_NONE || function->insts[terminator].opcode != IR_BRANCH) return IR_NONE;
+
+    Index condition = function->insts[terminator].operands[0];
+    IRInst *compare = &function->insts[condition];
+    if(compare->opcode != IR_EQ_EQ || compare->block != block || CountUses(function, condition) != 1) return IR_NONE;
+
+    Index left = compare->operands[0];
+    Index right = compare->operands[1];
+
+    if(function->insts[right].opcode == IR_CONST)
+    {
+        *selector = left;
+        *value = function->insts[right].value;
+    }
+    else if(function->insts[left].opcode == IR_CONST)
+    {
+        *selector = right;
+        *value = function->insts[left].value;
+    }
+    else
+    {
+        return IR_NONE;
+    }
+
+    return condition;
+}
+
+// nothing but the test itself, so the block can go once the chain is rewritten
+bool IsBareCaseTest(IRFunction *function, Index block, Index condition)
+{
+    IRBlock *b = &function->blocks[block];
+    IRInst *compare = &function->insts[condition];
+
+    for(unsigned int n = 0; n < b->instCount; n++)
+    {
+        Index index = b->insts[n];
+        if(index == condition || IsTerminator(function->insts[index].opcode)) continue;
+
+        if(function->insts[index].opcode != IR_CONST || CountUses(function, index) != 1) return false;
+        if(compare->operands[0] != index && compare->operands[1] != index) return false;
+    }
+
+    return true;
+}
+
+// the else of a test on the same value, it belongs to the chain starting further up
+bool IsChainContinuation(IRFunction *function, Index block)
+{
+    IRBlock *b = &function->blocks[block];
+    if(b->predCount != 1) return false;
+
+    Index selector, predSelector;
+    int value;
+
+    Index condition = MatchCaseTest(function, block, &selector, &value);
+    if(condition == IR_NONE || !IsBareCaseTest(function, block, condition)) return false;
+
+    Index pred = b->preds[0];
+    if(MatchCaseTest(function, pred, &predSelector, &value) == IR_NONE || predSelector != selector) return false;
+
+    return function->insts[GetTerminator(function, pred)].falseTarget == block;
+}
+
+bool IsChainBlock(SwitchBuilder *builder, Index block)
+{
+    for(unsigned int n = 0; n < builder->caseCount; n++)
+    {
+        if(builder->cases[n].target == block || builder->cases[n].test == block) return true;
+    }
+
+    return false;
+}
+
+bool HasCase(SwitchBuilder *builder, int value)
+{
+    for(unsigned int n = 0; n < builder->caseCount; n++)
+    {
+        if(builder->cases[n].value == value) return true;
+    }
+
+    return false;
+}
+
+// follows 'if (x == c1) ... else if (x == c2) ...' as long as every test compares x against a new constant
+bool CollectChain(SwitchBuilder *builder, Index head)
+{
+    IRFunction *function = builder->function;
+    Index block = head;
+
+    while(true)
+    {
+        Index selector;
+        int value;
+
+        Index condition = MatchCaseTest(function, block, &selector, &value);
+        if(condition == IR_NONE) break;
+
+        if(block != head)
+        {
+            if(function->blocks[block].predCount != 1 || selector != builder->selector) break;
+            if(!IsBareCaseTest(function, block, condition)) break;
+        }
+
+        IRInst *branch = &function->insts[GetTerminator(function, block)];
+        Index target = branch->trueTarget;
+        Index next = branch->falseTarget;
+
+        if(target == next || target == block || next == block) break;
+        if(HasCase(builder, value) || IsChainBlock(builder, target) || IsChainBlock(builder, next)) break;
+
+        builder->selector = selector;
+        builder->caseCount++;
+        builder->cases = (SwitchCase*)realloc(builder->cases, sizeof(SwitchCase) * builder->caseCount);
+        builder->cases[builder->caseCount - 1] = (SwitchCase){value, target, block};
+
+        builder->defaultBlock = next;
+        builder->defaultTest = block;
+        block = next;
+    }
+
+    return builder->caseCount >= builder->options->minCases;
+}
+
+// new edge from -> to, phis in 'to' take the value they had coming from 'like'
+void AddEdgeLike(IRFunction *function, Index from, Index to, Index like)
+{
+    IRBlock *b = &function->blocks[to];
+
+    unsigned int p = 0;
+    while(p < b->predCount && b->preds[p] != like) p++;
+
+    for(unsigned int n = 0; n < b->instCount; n++)
+    {
+        IRInst *phi = &function->insts[b->insts[n]];
+        if(phi->opcode != IR_PHI) break;
+
+        AddOperand(function, b->insts[n], phi->operands[p]);
+    }
+
+    AddEdge(function, from, to);
+}
+
+Index EmitSwitchInst(SwitchBuilder *builder, Index block, unsigned int opcode, Index left, Index right)
+{
+    Index inst = NewInst(builder->function, opcode);
+    if(left != IR_NONE) AddOperand(builder->function, inst, left);
+    if(right != IR_NONE) AddOperand(builder->function, inst, right);
+
+    AppendInst(builder->function, block, inst);
+    return inst;
+}
+
+Index EmitSwitchConst(SwitchBuilder *builder, Index block, int value)
+{
+    Index inst = EmitSwitchInst(builder, block, IR_CONST, IR_NONE, IR_NONE);
+    builder->function->insts[inst].value = value;
+    return inst;
+}
+
+// enough of the values between the lowest and highest case are cases to be worth a table
+bool IsTableWorthy(SwitchBuilder *builder, unsigned int low, unsigned int high)
+{
+    unsigned int count = high - low;
+    const SwitchOptions *options = builder->options;
+    if(options->noJumpTables || count < options->minTableCases || count >= IR_MAX_SUCCESSORS) return false;
+
+    long long range = (long long)builder->cases[high - 1].value - builder->cases[low].value + 1;
+    return range <= options->maxTableSize && count * 100 >= range * options->minTableDensity;
+}
+
+void EmitJumpTable(SwitchBuilder *builder, Index block, unsigned int low, unsigned int high)
+{
+    IRFunction *function = builder->function;
+    int lowest = builder->cases[low].value;
+    unsigned int size = builder->cases[high - 1].value - lowest + 1;
+
+    Index table = EmitSwitchInst(builder, block, IR_SWITCH, builder->selector, IR_NONE);
+    IRInst *inst = &function->insts[table];
+
+    inst->value = lowest;
+    inst->falseTarget = builder->defaultBlock;
+    for(unsigned int n = 0; n < size; n++) PushIndex(&inst->caseTargets, &inst->caseCount, builder->defaultBlock);
+
+    for(unsigned int n = low; n < high; n++)
+    {
+        SwitchCase *c = &builder->cases[n];
+        inst->caseTargets[c->value - lowest] = c->target;
+        AddEdgeLike(function, block, c->target, c->test);
+    }
+
+    AddEdgeLike(function, block, builder->defaultBlock, builder->defaultTest);
+    builder->tableCount++;
+}
+
+// cases are sorted, a table where they are dense enough, otherwise halves split on 'x < middle case'
+void EmitDispatch(SwitchBuilder *builder, Index block, unsigned int low, unsigned int high)
+{
+    IRFunction *function = builder->function;
+
+    if(IsTableWorthy(builder, low, high))
+    {
+        EmitJumpTable(builder, block, low, high);
+        return;
+    }
+
+    // few enough to test one by one
+    if(high - low <= 2)
+    {
+        for(unsigned int n = low; n < high; n++)
+        {
+            SwitchCase c = builder->cases[n];
+            Index next = (n == high - 1) ? builder->defaultBlock : NewBlock(function);
+
+            Index constant = EmitSwitchConst(builder, block, c.value);
+            Index compare = EmitSwitchInst(builder, block, IR_EQ_EQ, builder->selector, constant);
+            Index branch = EmitSwitchInst(builder, block, IR_BRANCH, compare, IR_NONE);
+            function->insts[branch].trueTarget = c.target;
+            function->insts[branch].falseTarget = next;
+
+            AddEdgeLike(function, block, c.target, c.test);
+            if(next == builder->defaultBlock) AddEdgeLike(function, block, next, builder->defaultTest);
+            else AddEdge(function, block, next);
+
+            builder->compareCount++;
+            block = next;
+        }
+
+        return;
+    }
+
+    unsigned int middle = low + (high - low) / 2;
+    Index below = NewBlock(function);
+    Index above = NewBlock(function);
+
+    Index constant = EmitSwitchConst(builder, block, builder->cases[middle].value);
+    Index compare = EmitSwitchInst(builder, block, IR_LT, builder->selector, constant);
+    Index branch = EmitSwitchInst(builder, block, IR_BRANCH, compare, IR_NONE);
+    function->insts[branch].trueTarget = below;
+    function->insts[branch].falseTarget = above;
+
+    AddEdge(function, block, below);
+    AddEdge(function, block, above);
+    builder->compareCount++;
+
+    EmitDispatch(builder, below, low, middle);
+    EmitDispatch(builder, above, middle, high);
+}
+
+// the head keeps whatever it computes before its test, the tests after it become unreachable
+void RewriteChain(SwitchBuilder *builder, Index head)
+{
+    IRFunction *function = builder->function;
+    Index firstTarget = builder->cases[0].target;
+
+    for(unsigned int n = 1; n < builder->caseCount; n++)
+    {
+        SwitchCase c = builder->cases[n];
+        unsigned int m = n;
+
+        while(m > 0 && builder->cases[m - 1].value > c.value)
+        {
+            builder->cases[m] = builder->cases[m - 1];
+            m--;
+        }
+
+        builder->cases[m] = c;
+    }
+
+    Index terminator = GetTerminator(function, head);
+    Index condition = function->insts[terminator].operands[0];
+    RemoveInst(function, terminator);
+    RemoveInst(function, condition);
+
+    EmitDispatch(builder, head, 0, builder->caseCount);
+
+    // the new edges were added after the one the old test took
+    RemoveEdge(function, head, firstTarget);
+}
+
+bool LowerSwitches(IRFunction *function, const Options *options)
+{
+    unsigned int blockCount = function->blockCount;
+    bool *isConsumed = (bool*)calloc(blockCount, sizeof(bool));
+    bool changed = false;
+
+    for(unsigned int block = 0; block < blockCount; block++)
+    {
+        if(function->blocks[block].isDead || isConsumed[block] || IsChainContinuation(function, block)) continue;
+
+        SwitchBuilder builder = {0};
+        builder.function = function;
+        builder.options = &options->switches;
+
+        if(CollectChain(&builder, block))
+        {
+            for(unsigned int n = 0; n < builder.caseCount; n++) isConsumed[builder.cases[n].test] = true;
+
+            RewriteChain(&builder, block);
+            changed = true;
+
+            if(options->printReport)
+            {
+                printf("switch: '%s': %u cases on %%%d -> %u jump table%s, %u compare%s\n", function->name, builder.caseCount, builder.selector,
+                       builder.tableCount, builder.tableCount == 1 ? "" : "s", builder.compareCount, builder.compareCount == 1 ? "" : "s");
+            }
+        }
+
+        free(builder.cases);
+    }
+
+    if(changed) RemoveUnreachableBlocks(function, options);
+
+    free(isConsumed);
+    return changed;
+}
@@ -0,0 +1,8 @@
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include "ir.h"
+
+bool LowerSwitches(IRFunction *function, const Options *options);
+
+#endif //SWITCH_H
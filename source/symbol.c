@@ -1,5 +1,6 @@
 #include "symbol.h"
 #include "stdlib.h"
+#include "string.h"
 
 void PushType(TypeTable *table, Type type) 
 {
@@ -31,4 +32,77 @@ void PushSymbol(SymbolTable *table, Symbol symbol)
     }
 
     table->symbols[table->count - 1] = symbol;
+}
+
+// FNV-1a
+unsigned int HashName(const char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    while(*name)
+    {
+        hash ^= (unsigned char)(*name++);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void InsertName(NameTable *table, const char *name, int value)
+{
+    // keep the load factor under one half
+    if((table->count + 1) * 2 > table->capacity)
+    {
+        NameTable grown = {0};
+        grown.capacity = table->capacity ? table->capacity * 2 : 64;
+        grown.entries = (NameEntry*)calloc(grown.capacity, sizeof(NameEntry));
+
+        for(unsigned int n = 0; n < table->capacity; n++)
+        {
+            if(table->entries[n].name) InsertName(&grown, table->entries[n].name, table->entries[n].value);
+        }
+
+        free(table->entries);
+        *table = grown;
+    }
+
+    unsigned int slot = HashName(name) & (table->capacity - 1);
+
+    while(table->entries[slot].name)
+    {
+        if(!strcmp(table->entries[slot].name, name))
+        {
+            table->entries[slot].value = value;
+            return;
+        }
+
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    table->entries[slot].name = name;
+    table->entries[slot].value = value;
+    table->count++;
+}
+
+int LookupName(NameTable *table, const char *name, int notFound)
+{
+    if(table->capacity == 0) return notFound;
+
+    unsigned int slot = HashName(name) & (table->capacity - 1);
+
+    while(table->entries[slot].name)
+    {
+        if(!strcmp(table->entries[slot].name, name)) return table->entries[slot].value;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    return notFound;
+}
+
+void FreeNameTable(NameTable *table)
+{
+    free(table->entries);
+    table->entries = 0;
+    table->capacity = 0;
+    table->count = 0;
 }
\ No newline at end of file
@@ -21,7 +21,24 @@ typedef struct {
     unsigned int count;
 } SymbolTable;
 
+// open addressing hash map from names to indices
+typedef struct {
+    const char *name;
+    int value;
+} NameEntry;
+
+typedef struct {
+    NameEntry *entries;
+    unsigned int capacity;
+    unsigned int count;
+} NameTable;
+
 void PushType(TypeTable *table, Type type);
 void PushSymbol(SymbolTable *table, Symbol symbol);
 
+unsigned int HashName(const char *name);
+void InsertName(NameTable *table, const char *name, int value);
+int LookupName(NameTable *table, const char *name, int notFound);
+void FreeNameTable(NameTable *table);
+
 #endif
\ No newline at end of file
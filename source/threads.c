@@ -0,0 +1,226 @@
+#include <unistd.h>
+
+#include "threads.h"
+#include "context.h"
+
+// made on the first batch that can use more than one thread, lives until StopThreads.
+// the lock guards making, stopping and claiming the pool
+ThreadPool *threadPool = 0;
+pthread_mutex_t threadPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned int GetThreadCount(unsigned int requested)
+{
+    if(requested > 0) return requested;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (unsigned int)cores : 1;
+}
+
+bool TakeTask(TaskQueue *queue, bool fromBack, unsigned int *task)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    bool isTaken = queue->begin < queue->end;
+    if(isTaken) *task = fromBack ? --queue->end : queue->begin++;
+
+    pthread_mutex_unlock(&queue->lock);
+    return isTaken;
+}
+
+// own tasks first, in order, then whatever is left at the back of the others' ranges
+void ProcessTasks(ThreadPool *pool, unsigned int self)
+{
+    unsigned int task;
+
+    for(;;)
+    {
+        if(TakeTask(&pool->queues[self], false, &task))
+        {
+            pool->run(pool->data, task);
+            continue;
+        }
+
+        bool isStolen = false;
+
+        for(unsigned int k = 1; k < pool->threadCount && !isStolen; k++)
+        {
+            isStolen = TakeTask(&pool->queues[(self + k) % pool->threadCount], true, &task);
+        }
+
+        if(!isStolen) return;
+
+        __atomic_add_fetch(&pool->stealCount, 1, __ATOMIC_RELAXED);
+        pool->run(pool->data, task);
+    }
+}
+
+typedef struct {
+    ThreadPool *pool;
+    unsigned int index;
+} Worker;
+
+void *RunWorker(void *data)
+{
+    Worker worker = *(Worker*)data;
+    free(data);
+
+    ThreadPool *pool = worker.pool;
+    unsigned int seenBatch = 0;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while(pool->batch == seenBatch && !pool->isStopping) pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if(pool->isStopping)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return 0;
+        }
+
+        seenBatch = pool->batch;
+        pthread_mutex_unlock(&pool->lock);
+
+        ProcessTasks(pool, worker.index);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->busyCount == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool *CreateThreadPool(unsigned int threadCount)
+{
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    pool->threadCount = threadCount;
+    pool->threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+    pool->queues = (TaskQueue*)calloc(threadCount, sizeof(TaskQueue));
+
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->wake, 0);
+    pthread_cond_init(&pool->done, 0);
+
+    for(unsigned int n = 0; n < threadCount; n++) pthread_mutex_init(&pool->queues[n].lock, 0);
+
+    // worker 0 is whoever calls RunTasks
+    for(unsigned int n = 1; n < threadCount; n++)
+    {
+        Worker *worker = (Worker*)malloc(sizeof(Worker));
+        worker->pool = pool;
+        worker->index = n;
+
+        if(pthread_create(&pool->threads[n], 0, RunWorker, worker) != 0)
+        {
+            printf("error: cannot start worker thread %u\n", n);
+            exit(1);
+        }
+    }
+
+    return pool;
+}
+
+void StopThreadPool(ThreadPool *pool, bool printReport);
+
+// the pool runs one batch at a time, so whoever finds it busy runs their batch on their own thread.
+// that covers compilations running side by side and tasks that start batches of their own.
+// a batch asking for a different number of threads than the idle pool has gets a new pool
+ThreadPool *ClaimThreadPool(unsigned int threadCount)
+{
+    pthread_mutex_lock(&threadPoolLock);
+
+    if(threadPool && threadPool->isBusy)
+    {
+        pthread_mutex_unlock(&threadPoolLock);
+        return 0;
+    }
+
+    if(threadPool && threadPool->threadCount != threadCount)
+    {
+        StopThreadPool(threadPool, false);
+        threadPool = 0;
+    }
+
+    if(!threadPool) threadPool = CreateThreadPool(threadCount);
+
+    ThreadPool *pool = threadPool;
+    pool->isBusy = true;
+
+    pthread_mutex_unlock(&threadPoolLock);
+    return pool;
+}
+
+// returns once every task has run, tasks are spread in contiguous ranges so neighbours share a worker.
+// threadCount is the compilation's -threads, 0 for one per core
+void RunTasks(unsigned int threadCount, unsigned int taskCount, TaskProc run, void *data)
+{
+    threadCount = GetThreadCount(threadCount);
+    bool isParallel = threadCount > 1 && taskCount > 1;
+
+    // an error unwinds to the trap of the thread it was found on, so a trapped batch stays on that thread
+    if(diagnosticTrap) isParallel = false;
+
+    ThreadPool *pool = isParallel ? ClaimThreadPool(threadCount) : 0;
+
+    if(!pool)
+    {
+        for(unsigned int n = 0; n < taskCount; n++) run(data, n);
+        return;
+    }
+
+    for(unsigned int n = 0; n < pool->threadCount; n++)
+    {
+        pool->queues[n].begin = (unsigned int)((unsigned long long)taskCount * n / pool->threadCount);
+        pool->queues[n].end = (unsigned int)((unsigned long long)taskCount * (n + 1) / pool->threadCount);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->run = run;
+    pool->data = data;
+    pool->busyCount = pool->threadCount - 1;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    ProcessTasks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->busyCount > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_lock(&threadPoolLock);
+    pool->isBusy = false;
+    pthread_mutex_unlock(&threadPoolLock);
+}
+
+void StopThreadPool(ThreadPool *pool, bool printReport)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->isStopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(unsigned int n = 1; n < pool->threadCount; n++) pthread_join(pool->threads[n], 0);
+
+    if(printReport) printf("threads: %u workers, %u tasks stolen\n", pool->threadCount, pool->stealCount);
+
+    for(unsigned int n = 0; n < pool->threadCount; n++) pthread_mutex_destroy(&pool->queues[n].lock);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
+
+// only once no compilation is running
+void StopThreads(bool printReport)
+{
+    pthread_mutex_lock(&threadPoolLock);
+
+    if(threadPool) StopThreadPool(threadPool, printReport);
+    threadPool = 0;
+
+    pthread_mutex_unlock(&threadPoolLock);
+}
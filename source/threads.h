@@ -0,0 +1,40 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// task n of a batch, tasks must not depend on each other or on the order they run in
+typedef void (*TaskProc)(void *data, unsigned int task);
+
+// each worker owns a range of a batch's tasks, taken from the front by the owner and from the back by idle workers
+typedef struct {
+    unsigned int begin;
+    unsigned int end;
+    pthread_mutex_t lock;
+} TaskQueue;
+
+typedef struct {
+    pthread_t *threads;
+    TaskQueue *queues;
+    unsigned int threadCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned int batch;         // bumped for every batch, workers wait for it to change
+    unsigned int busyCount;     // workers not done with the current batch
+    bool isStopping;
+    bool isBusy;                // a batch is running, guarded by threadPoolLock
+
+    TaskProc run;
+    void *data;
+
+    unsigned int stealCount;
+} ThreadPool;
+
+unsigned int GetThreadCount(unsigned int requested);
+void RunTasks(unsigned int threadCount, unsigned int taskCount, TaskProc run, void *data);
+void StopThreads(bool printReport);
+
+#endif //THREADS_H
@@ -0,0 +1,409 @@
+#include <stdint.h>
+
+#include "vm.h"
+
+#define MINED_REPORT_COUNT 8
+
+// the limits are copied into the vm, so vms made with different limits can run side by side
+VM CreateVM(BytecodeModule *module, VMOptions options)
+{
+    VM vm = {0};
+    vm.module = module;
+    vm.options = options;
+    vm.registers = (long long*)calloc(options.registerCapacity, sizeof(long long));
+    vm.stack = (char*)calloc(options.stackBytes, 1);
+
+    if(options.mineFileName)
+    {
+        vm.pairCounts = (unsigned long long*)calloc(BC_OPCODE_COUNT * BC_OPCODE_COUNT, sizeof(unsigned long long));
+        vm.tripleCounts = (unsigned long long*)calloc(BC_OPCODE_COUNT * BC_OPCODE_COUNT * BC_OPCODE_COUNT, sizeof(unsigned long long));
+    }
+
+    return vm;
+}
+
+void FreeVM(VM *vm)
+{
+    for(unsigned int n = 0; n < vm->stringCount; n++) free(vm->strings[n]);
+
+    free(vm->strings);
+    free(vm->registers);
+    free(vm->stack);
+    free(vm->pairCounts);
+    free(vm->tripleCounts);
+}
+
+bool VMError(VM *vm, const char *message)
+{
+    vm->error = message;
+    return false;
+}
+
+char *GetPointer(long long value)
+{
+    return (char*)(intptr_t)value;
+}
+
+long long LoadValue(const char *address, unsigned int size, bool isSigned)
+{
+    switch(size)
+    {
+        case 1: { unsigned char v; memcpy(&v, address, 1); return isSigned ? (signed char)v : v; }
+        case 2: { unsigned short v; memcpy(&v, address, 2); return isSigned ? (short)v : v; }
+        case 4: { unsigned int v; memcpy(&v, address, 4); return isSigned ? (long long)(int)v : (long long)v; }
+        default: { long long v = 0; memcpy(&v, address, size); return v; }
+    }
+}
+
+void StoreValue(char *address, unsigned int size, long long value)
+{
+    switch(size)
+    {
+        case 1: { unsigned char v = value; memcpy(address, &v, 1); } break;
+        case 2: { unsigned short v = value; memcpy(address, &v, 2); } break;
+        case 4: { unsigned int v = value; memcpy(address, &v, 4); } break;
+        default: { memcpy(address, &value, size); } break;
+    }
+}
+
+// registers are wider than int, so arithmetic is done unsigned and wrapped back to 32 bits the way
+// the constant folder, the optimizer and the c backend all wrap it
+long long WrapInt(unsigned long long value)
+{
+    return (int)(unsigned int)value;
+}
+
+long long Concatenate(VM *vm, const char *left, const char *right)
+{
+    char *string = (char*)malloc(strlen(left) + strlen(right) + 1);
+    strcpy(string, left);
+    strcat(string, right);
+
+    vm->stringCount++;
+    vm->strings = (char**)realloc(vm->strings, sizeof(char*) * vm->stringCount);
+    vm->strings[vm->stringCount - 1] = string;
+
+    return (long long)(intptr_t)string;
+}
+
+bool Execute(VM *vm, unsigned int index, long long *result);
+
+bool ExecuteCall(VM *vm, BytecodeFunction *caller, BytecodeInst *inst, long long *r)
+{
+    BytecodeFunction *callee = &vm->module->functions[inst->imm];
+    if(vm->registerTop + callee->registerCount > vm->options.registerCapacity) return VMError(vm, "out of registers");
+
+    long long *arguments = vm->registers + vm->registerTop;
+    for(int n = 0; n < inst->extra; n++) arguments[n] = r[caller->pool[inst->pool + n]];
+
+    long long value;
+    if(!Execute(vm, inst->imm, &value)) return false;
+
+    if(inst->dest >= 0) r[inst->dest] = value;
+    if(inst->right >= 0) r[inst->right] = vm->secondResult;
+    return true;
+}
+
+// one dispatch per instruction, superinstructions do the work of several
+bool ExecuteBody(VM *vm, BytecodeFunction *function, long long *r, char *frame, long long *result)
+{
+    unsigned int pc = 0;
+    unsigned int previous = 0, beforePrevious = 0;
+
+    while(true)
+    {
+        BytecodeInst *inst = &function->code[pc++];
+
+        vm->dispatchCount++;
+        if(vm->options.stepLimit && vm->dispatchCount > vm->options.stepLimit) return VMError(vm, "step limit reached");
+
+        if(vm->pairCounts)
+        {
+            unsigned int opcode = inst->opcode;
+
+            if(previous) vm->pairCounts[previous * BC_OPCODE_COUNT + opcode]++;
+            if(beforePrevious) vm->tripleCounts[(beforePrevious * BC_OPCODE_COUNT + previous) * BC_OPCODE_COUNT + opcode]++;
+
+            beforePrevious = previous;
+            previous = opcode;
+        }
+
+        switch(inst->opcode)
+        {
+            case BC_NOP:            break;
+            case BC_CONST:          r[inst->dest] = inst->imm; break;
+            case BC_STRING:         r[inst->dest] = (long long)(intptr_t)vm->module->strings[inst->imm]; break;
+            case BC_MOVE:           r[inst->dest] = r[inst->left]; break;
+
+            case BC_ADD:            r[inst->dest] = WrapInt((unsigned long long)r[inst->left] + (unsigned long long)r[inst->right]); break;
+            case BC_SUB:            r[inst->dest] = WrapInt((unsigned long long)r[inst->left] - (unsigned long long)r[inst->right]); break;
+            case BC_MUL:            r[inst->dest] = WrapInt((unsigned long long)r[inst->left] * (unsigned long long)r[inst->right]); break;
+
+            case BC_DIV:
+            case BC_MOD:
+            {
+                if(r[inst->right] == 0) return VMError(vm, "division by zero");
+                r[inst->dest] = WrapInt((inst->opcode == BC_DIV) ? r[inst->left] / r[inst->right] : r[inst->left] % r[inst->right]);
+            }
+            break;
+
+            case BC_LT:             r[inst->dest] = r[inst->left] < r[inst->right]; break;
+            case BC_GT:             r[inst->dest] = r[inst->left] > r[inst->right]; break;
+            case BC_EQ:             r[inst->dest] = r[inst->left] == r[inst->right]; break;
+            case BC_NE:             r[inst->dest] = r[inst->left] != r[inst->right]; break;
+            case BC_LE:             r[inst->dest] = r[inst->left] <= r[inst->right]; break;
+            case BC_GE:             r[inst->dest] = r[inst->left] >= r[inst->right]; break;
+            case BC_NOT:            r[inst->dest] = !r[inst->left]; break;
+
+            case BC_CONCAT:         r[inst->dest] = Concatenate(vm, GetPointer(r[inst->left]), GetPointer(r[inst->right])); break;
+
+            case BC_FRAME_ADDR:     r[inst->dest] = (long long)(intptr_t)(frame + inst->imm); break;
+
+            case BC_ADDR:
+            {
+                long long address = r[inst->left] + inst->imm;
+                if(inst->right >= 0) address += r[inst->right] * inst->extra;
+                r[inst->dest] = address;
+            }
+            break;
+
+            case BC_LOAD:           r[inst->dest] = LoadValue(GetPointer(r[inst->left]), inst->size, inst->isSigned); break;
+            case BC_STORE:          StoreValue(GetPointer(r[inst->left]), inst->size, r[inst->right]); break;
+            case BC_MEMSET:         memset(GetPointer(r[inst->left]), (int)r[inst->right], inst->imm); break;
+            case BC_MEMMOVE:        memmove(GetPointer(r[inst->left]), GetPointer(r[inst->right]), inst->imm); break;
+
+            case BC_BOUNDS_CHECK:
+            {
+                if(r[inst->left] < 0 || r[inst->left] >= inst->imm) return VMError(vm, "index out of bounds");
+            }
+            break;
+
+            case BC_CALL:
+            {
+                if(!ExecuteCall(vm, function, inst, r)) return false;
+            }
+            break;
+
+            case BC_PRINT_INT:
+            case BC_PRINT_STR:
+            {
+                FILE *output = vm->options.output ? vm->options.output : stdout;
+
+                if(inst->opcode == BC_PRINT_INT) fprintf(output, "%lld\n", r[inst->left]);
+                else fprintf(output, "%s\n", GetPointer(r[inst->left]));
+
+                if(inst->dest >= 0) r[inst->dest] = 0;
+            }
+            break;
+
+            case BC_JUMP:           pc = inst->target; break;
+            case BC_JUMP_IF:        if(r[inst->left]) pc = inst->target; break;
+            case BC_JUMP_IF_NOT:    if(!r[inst->left]) pc = inst->target; break;
+
+            case BC_SWITCH:
+            {
+                long long entry = r[inst->left] - inst->imm;
+                pc = (entry >= 0 && entry < inst->extra) ? function->pool[inst->pool + entry] : inst->target;
+            }
+            break;
+
+            case BC_RET:
+            {
+                *result = (inst->left >= 0) ? r[inst->left] : 0;
+                if(inst->right >= 0) vm->secondResult = r[inst->right];
+            }
+            return true;
+
+            case BC_ADD_IMM:        r[inst->dest] = WrapInt((unsigned long long)r[inst->left] + (unsigned long long)inst->imm); break;
+            case BC_SUB_IMM:        r[inst->dest] = WrapInt((unsigned long long)r[inst->left] - (unsigned long long)inst->imm); break;
+            case BC_MUL_IMM:        r[inst->dest] = WrapInt((unsigned long long)r[inst->left] * (unsigned long long)inst->imm); break;
+
+            case BC_LT_IMM:         r[inst->dest] = r[inst->left] < inst->imm; break;
+            case BC_GT_IMM:         r[inst->dest] = r[inst->left] > inst->imm; break;
+            case BC_EQ_IMM:         r[inst->dest] = r[inst->left] == inst->imm; break;
+            case BC_NE_IMM:         r[inst->dest] = r[inst->left] != inst->imm; break;
+            case BC_LE_IMM:         r[inst->dest] = r[inst->left] <= inst->imm; break;
+            case BC_GE_IMM:         r[inst->dest] = r[inst->left] >= inst->imm; break;
+
+            case BC_JUMP_IF_LT:     if(r[inst->left] < r[inst->right]) pc = inst->target; break;
+            case BC_JUMP_IF_GT:     if(r[inst->left] > r[inst->right]) pc = inst->target; break;
+            case BC_JUMP_IF_EQ:     if(r[inst->left] == r[inst->right]) pc = inst->target; break;
+            case BC_JUMP_IF_NE:     if(r[inst->left] != r[inst->right]) pc = inst->target; break;
+            case BC_JUMP_IF_LE:     if(r[inst->left] <= r[inst->right]) pc = inst->target; break;
+            case BC_JUMP_IF_GE:     if(r[inst->left] >= r[inst->right]) pc = inst->target; break;
+
+            case BC_JUMP_IF_LT_IMM: if(r[inst->left] < inst->imm) pc = inst->target; break;
+            case BC_JUMP_IF_GT_IMM: if(r[inst->left] > inst->imm) pc = inst->target; break;
+            case BC_JUMP_IF_EQ_IMM: if(r[inst->left] == inst->imm) pc = inst->target; break;
+            case BC_JUMP_IF_NE_IMM: if(r[inst->left] != inst->imm) pc = inst->target; break;
+            case BC_JUMP_IF_LE_IMM: if(r[inst->left] <= inst->imm) pc = inst->target; break;
+            case BC_JUMP_IF_GE_IMM: if(r[inst->left] >= inst->imm) pc = inst->target; break;
+
+            case BC_LOAD_FRAME:     r[inst->dest] = LoadValue(frame + inst->imm, inst->size, inst->isSigned); break;
+            case BC_STORE_FRAME:    StoreValue(frame + inst->imm, inst->size, r[inst->right]); break;
+            case BC_LOAD_OFFSET:    r[inst->dest] = LoadValue(GetPointer(r[inst->left]) + inst->imm, inst->size, inst->isSigned); break;
+            case BC_STORE_OFFSET:   StoreValue(GetPointer(r[inst->left]) + inst->imm, inst->size, r[inst->right]); break;
+
+            default:
+            return VMError(vm, "invalid opcode");
+        }
+    }
+}
+
+// the caller has put the arguments into the first registers past its own
+bool Execute(VM *vm, unsigned int index, long long *result)
+{
+    BytecodeFunction *function = &vm->module->functions[index];
+
+    if(vm->depth >= vm->options.maxDepth) return VMError(vm, "call depth limit reached");
+    if(vm->registerTop + function->registerCount > vm->options.registerCapacity) return VMError(vm, "out of registers");
+    if(vm->stackTop + function->frameSize > vm->options.stackBytes) return VMError(vm, "out of stack memory");
+
+    unsigned int registerTop = vm->registerTop;
+    unsigned int stackTop = vm->stackTop;
+
+    long long *r = vm->registers + registerTop;
+    char *frame = vm->stack + stackTop;
+    memset(frame, 0, function->frameSize);
+
+    vm->registerTop += function->registerCount;
+    vm->stackTop += function->frameSize;
+    vm->depth++;
+
+    bool isFinished = ExecuteBody(vm, function, r, frame, result);
+
+    vm->registerTop = registerTop;
+    vm->stackTop = stackTop;
+    vm->depth--;
+
+    return isFinished;
+}
+
+bool CallBytecode(VM *vm, unsigned int function, long long *arguments, unsigned int argumentCount, long long *result)
+{
+    if(argumentCount != vm->module->functions[function].parameterCount) return VMError(vm, "argument count mismatch");
+    if(vm->registerTop + argumentCount > vm->options.registerCapacity) return VMError(vm, "out of registers");
+
+    for(unsigned int n = 0; n < argumentCount; n++) vm->registers[vm->registerTop + n] = arguments[n];
+
+    vm->error = 0;
+    return Execute(vm, function, result);
+}
+
+void ReadMinedCounts(VM *vm, const char *fileName)
+{
+    FILE *file = fopen(fileName, "r");
+    if(!file) return;
+
+    char line[256];
+
+    while(fgets(line, sizeof(line), file))
+    {
+        char kind[16], first[32], second[32], third[32];
+        unsigned long long count;
+
+        if(sscanf(line, "%15s %31s %31s %31s %llu", kind, first, second, third, &count) == 5 && !strcmp(kind, "triple"))
+        {
+            unsigned int a = BytecodeOpcodeFromString(first), b = BytecodeOpcodeFromString(second), c = BytecodeOpcodeFromString(third);
+            if(a && b && c) vm->tripleCounts[(a * BC_OPCODE_COUNT + b) * BC_OPCODE_COUNT + c] += count;
+        }
+        else if(sscanf(line, "%15s %31s %31s %llu", kind, first, second, &count) == 4 && !strcmp(kind, "pair"))
+        {
+            unsigned int a = BytecodeOpcodeFromString(first), b = BytecodeOpcodeFromString(second);
+            if(a && b) vm->pairCounts[a * BC_OPCODE_COUNT + b] += count;
+        }
+    }
+
+    fclose(file);
+}
+
+void PrintMostFrequent(unsigned long long *counts, unsigned int length, const char *kind)
+{
+    unsigned int total = 1;
+    for(unsigned int n = 0; n < length; n++) total *= BC_OPCODE_COUNT;
+
+    printf("vm: most frequent opcode %ss:\n", kind);
+
+    // repeated maximum search, ties in opcode order, the table is only read a few times
+    unsigned long long lastCount = (unsigned long long)-1;
+    unsigned int last = 0;
+
+    for(unsigned int rank = 0; rank < MINED_REPORT_COUNT; rank++)
+    {
+        unsigned int best = 0;
+
+        for(unsigned int n = 1; n < total; n++)
+        {
+            bool isAfterLast = counts[n] < lastCount || (counts[n] == lastCount && n > last);
+            if(isAfterLast && counts[n] > counts[best]) best = n;
+        }
+
+        if(counts[best] == 0) break;
+
+        lastCount = counts[best];
+        last = best;
+
+        printf("  %12llu ", counts[best]);
+        if(length == 3) printf(" %s", BytecodeOpcodeToString(best / (BC_OPCODE_COUNT * BC_OPCODE_COUNT)));
+        printf(" %s %s\n", BytecodeOpcodeToString(best / BC_OPCODE_COUNT % BC_OPCODE_COUNT), BytecodeOpcodeToString(best % BC_OPCODE_COUNT));
+    }
+}
+
+// counts from earlier runs are added in, so a corpus of programs run one after another adds up in one file
+void MineSuperinstructions(VM *vm, const char *fileName)
+{
+    ReadMinedCounts(vm, fileName);
+
+    FILE *file = fopen(fileName, "w");
+
+    if(!file)
+    {
+        printf("error: cannot write '%s'\n", fileName);
+        exit(1);
+    }
+
+    for(unsigned int a = 1; a < BC_OPCODE_COUNT; a++)
+    {
+        for(unsigned int b = 1; b < BC_OPCODE_COUNT; b++)
+        {
+            unsigned long long count = vm->pairCounts[a * BC_OPCODE_COUNT + b];
+            if(count) fprintf(file, "pair %s %s %llu\n", BytecodeOpcodeToString(a), BytecodeOpcodeToString(b), count);
+
+            for(unsigned int c = 1; c < BC_OPCODE_COUNT; c++)
+            {
+                count = vm->tripleCounts[(a * BC_OPCODE_COUNT + b) * BC_OPCODE_COUNT + c];
+                if(count) fprintf(file, "triple %s %s %s %llu\n", BytecodeOpcodeToString(a), BytecodeOpcodeToString(b), BytecodeOpcodeToString(c), count);
+            }
+        }
+    }
+
+    fclose(file);
+
+    PrintMostFrequent(vm->pairCounts, 2, "pair");
+    PrintMostFrequent(vm->tripleCounts, 3, "triple");
+}
+
+void RunProgram(BytecodeModule *module, const char *entry, VMOptions options)
+{
+    int function = FindBytecodeFunction(module, entry);
+
+    if(function == -1)
+    {
+        printf("error: entry function '%s' not found\n", entry);
+        exit(1);
+    }
+
+    VM vm = CreateVM(module, options);
+    long long result;
+
+    if(!CallBytecode(&vm, function, 0, 0, &result))
+    {
+        printf("vm error: %s\n", vm.error);
+        exit(1);
+    }
+
+    printf("vm: '%s' returned %lld after %llu dispatches\n", entry, result, vm.dispatchCount);
+    if(options.mineFileName) MineSuperinstructions(&vm, options.mineFileName);
+
+    FreeVM(&vm);
+}
@@ -0,0 +1,33 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+
+typedef struct {
+    BytecodeModule *module;
+    VMOptions options;
+
+    long long *registers;
+    unsigned int registerTop;
+    char *stack;
+    unsigned int stackTop;
+    unsigned int depth;
+
+    long long secondResult;             // second word of a struct returned in two registers
+
+    unsigned long long dispatchCount;
+    unsigned long long *pairCounts;     // executed opcode pairs and triples when mining
+    unsigned long long *tripleCounts;
+
+    char **strings;                     // made by concatenation, freed with the vm
+    unsigned int stringCount;
+
+    const char *error;
+} VM;
+
+VM CreateVM(BytecodeModule *module, VMOptions options);
+void FreeVM(VM *vm);
+bool CallBytecode(VM *vm, unsigned int function, long long *arguments, unsigned int argumentCount, long long *result);
+void RunProgram(BytecodeModule *module, const char *entry, VMOptions options);
+
+#endif //VM_H